@@ -0,0 +1,698 @@
+# bench.py
+#
+# Benchmarks of every function the dataframe extension exports, run through
+# Python on generated data. Reports time, throughput and peak memory per
+# benchmark and can write them as JSON for compare.py.
+#
+#   python3 bench.py --rows 1000000 --json python.json
+#   python3 bench.py --csv data/fixture_10m.csv --only sort --isolate
+
+import argparse
+import array
+import contextlib
+import json
+import os
+import platform
+import re
+import resource
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+import dataframe
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import gen_data  # noqa: E402
+
+DATA_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "data")
+
+# Approximate bytes per row of a column of each dtype, for GB/s figures
+DTYPE_WIDTHS = {"int64": 8, "float64": 8, "datetime64[ns]": 8, "bool": 1, "category": 4}
+
+
+class Context:
+    """The data every benchmark runs against: a CSV file and the DataFrame
+    loaded from it, which benchmarks must leave unchanged."""
+
+    def __init__(self, csv_path, scratch):
+        self.csv_path = csv_path
+        self.csv_bytes = os.path.getsize(csv_path)
+        self.scratch = scratch
+        self.df = dataframe.loadCSV(csv_path)
+        self.rows = dataframe.shape(self.df)[0]
+        self.names = list(dataframe.columns(self.df))
+        self.dtypes = dict(zip(self.names, dataframe.dtypes(self.df)))
+        self.saved = os.path.join(scratch, "frame.dfc")
+        dataframe.save(self.df, self.saved)
+
+    def copy(self):
+        """Return a copy of the DataFrame for benchmarks that change it."""
+        return dataframe.copy(self.df)
+
+    def column_bytes(self, *names):
+        """Approximate bytes of data in the given columns, or all of them."""
+        total = 0
+        for name in names or self.names:
+            # Strings: 8-byte offsets plus the text itself
+            total += DTYPE_WIDTHS.get(self.dtypes[name], 16)
+        return total * self.rows
+
+
+@contextlib.contextmanager
+def quiet():
+    """Send what C code prints to stdout to /dev/null."""
+    sys.stdout.flush()
+    saved = os.dup(1)
+    devnull = os.open(os.devnull, os.O_WRONLY)
+    os.dup2(devnull, 1)
+    try:
+        yield
+    finally:
+        # Flush C stdio before the descriptor is restored
+        try:
+            import ctypes
+            ctypes.CDLL(None).fflush(None)
+        except OSError:
+            pass
+        os.dup2(saved, 1)
+        os.close(saved)
+        os.close(devnull)
+
+
+# name -> (functions it covers, setup). setup(ctx) runs untimed before each
+# run and returns the callable to time, which returns a dict of the rows,
+# bytes and calls it processed.
+BENCHMARKS = {}
+
+
+def benchmark(name, covers=None):
+    def register(setup):
+        BENCHMARKS[name] = (covers or [name], setup)
+        return setup
+    return register
+
+
+def measure(call, **work):
+    """Time one call; work gives the rows, bytes or calls it processes."""
+    def run():
+        call()
+        return work
+    return run
+
+
+def repeat_calls(ctx, call, n=10000):
+    """Time a cheap call by making it n times."""
+    def run():
+        for _ in range(n):
+            call()
+        return {"calls": n}
+    return run
+
+
+@benchmark("createDataFrame", ["createDataFrame", "freeDataFrame"])
+def _(ctx):
+    def run():
+        dataframe.freeDataFrame(dataframe.createDataFrame(ctx.rows, 8))
+        return {"rows": ctx.rows, "bytes": ctx.rows * 8 * 8}
+    return run
+
+
+@benchmark("freeDataFrame")
+def _(ctx):
+    df = ctx.copy()
+    return measure(lambda: dataframe.freeDataFrame(df), rows=ctx.rows)
+
+
+@benchmark("addRow")
+def _(ctx):
+    n = min(ctx.rows, 200_000)
+    values = [["12345", "hello", "", "3.25"], ["-7", "world", "x", "nan"]]
+    def run():
+        df = dataframe.createDataFrame(0, 4)
+        for i in range(n):
+            dataframe.addRow(df, values[i & 1])
+        dataframe.freeDataFrame(df)
+        return {"rows": n, "calls": n}
+    return run
+
+
+# Micro-batches of 10k rows, as an ingestion service appends them
+APPEND_BATCH = 10_000
+
+
+@benchmark("append_rows")
+def _(ctx):
+    n = min(ctx.rows, 200_000)
+    rows = [[12345, "hello", None, 3.25], [-7, "world", "x", float("nan")]] * (APPEND_BATCH // 2)
+    def run():
+        df = dataframe.createDataFrame(0, 4)
+        dataframe.astype(df, 0, "int64")
+        dataframe.astype(df, 3, "float64")
+        for _ in range(n // APPEND_BATCH):
+            dataframe.append_rows(df, rows)
+        dataframe.freeDataFrame(df)
+        return {"rows": n // APPEND_BATCH * APPEND_BATCH, "calls": n // APPEND_BATCH}
+    return run
+
+
+@benchmark("append_rows[buffers]", ["append_rows", "reserve"])
+def _(ctx):
+    n = min(ctx.rows, 1_000_000)
+    columns = {"0": array.array("q", range(APPEND_BATCH)), "1": array.array("d", [0.5] * APPEND_BATCH)}
+    def run():
+        df = dataframe.createDataFrame(0, 2)
+        dataframe.astype(df, 0, "int64")
+        dataframe.astype(df, 1, "float64")
+        dataframe.reserve(df, n)
+        for _ in range(n // APPEND_BATCH):
+            dataframe.append_rows(df, columns)
+        dataframe.freeDataFrame(df)
+        return {"rows": n // APPEND_BATCH * APPEND_BATCH, "bytes": n // APPEND_BATCH * APPEND_BATCH * 16,
+                "calls": n // APPEND_BATCH}
+    return run
+
+
+@benchmark("loadCSV")
+def _(ctx):
+    def run():
+        dataframe.freeDataFrame(dataframe.loadCSV(ctx.csv_path))
+        return {"rows": ctx.rows, "bytes": ctx.csv_bytes}
+    return run
+
+
+@benchmark("loadCSV[strings]", ["loadCSV"])
+def _(ctx):
+    def run():
+        dataframe.freeDataFrame(dataframe.loadCSV(ctx.csv_path, categorical=False))
+        return {"rows": ctx.rows, "bytes": ctx.csv_bytes}
+    return run
+
+
+@benchmark("read_csv_chunked")
+def _(ctx):
+    def run():
+        rows = 0
+        for chunk in dataframe.read_csv_chunked(ctx.csv_path, 100_000):
+            rows += dataframe.shape(chunk)[0]
+        return {"rows": rows, "bytes": ctx.csv_bytes}
+    return run
+
+
+@benchmark("value_counts[chunked]", ["read_csv_chunked", "value_counts"])
+def _(ctx):
+    def run():
+        dataframe.value_counts(dataframe.read_csv_chunked(ctx.csv_path, 100_000), "key")
+        return {"rows": ctx.rows, "bytes": ctx.csv_bytes}
+    return run
+
+
+@benchmark("save")
+def _(ctx):
+    path = os.path.join(ctx.scratch, "save.dfc")
+    return measure(lambda: dataframe.save(ctx.df, path), rows=ctx.rows, bytes=ctx.column_bytes())
+
+
+@benchmark("open")
+def _(ctx):
+    def run():
+        df = dataframe.open(ctx.saved)
+        dataframe.freeDataFrame(df)
+        return {"rows": ctx.rows, "calls": 1}
+    return run
+
+
+@benchmark("schema")
+def _(ctx):
+    return repeat_calls(ctx, lambda: dataframe.schema(ctx.saved), 1000)
+
+
+@benchmark("astype")
+def _(ctx):
+    df = ctx.copy()
+    return measure(lambda: dataframe.astype(df, ctx.names.index("key"), "float64"), rows=ctx.rows, bytes=ctx.column_bytes("key"))
+
+
+def printing(name, call, rows):
+    @benchmark(name)
+    def _(ctx):
+        def run():
+            with quiet():
+                call(ctx)
+            return {"rows": rows(ctx)}
+        return run
+
+
+printing("printDataFrame", lambda ctx: dataframe.printDataFrame(ctx.df), lambda ctx: ctx.rows)
+printing("info", lambda ctx: dataframe.info(ctx.df), lambda ctx: None)
+
+
+# Row views share the parent's buffers, so these time the view itself
+for _name in ("head", "tail"):
+    benchmark(_name)(lambda ctx, f=getattr(dataframe, _name): repeat_calls(ctx, lambda: f(ctx.df, 1000), 1000))
+
+
+@benchmark("iloc")
+def _(ctx):
+    return repeat_calls(ctx, lambda: dataframe.iloc(ctx.df, slice(ctx.rows // 4, ctx.rows // 2)), 1000)
+
+
+@benchmark("iloc[step]", ["iloc"])
+def _(ctx):
+    return measure(lambda: dataframe.iloc(ctx.df, slice(None, None, 2)), rows=ctx.rows // 2)
+
+
+@benchmark("sample")
+def _(ctx):
+    return measure(lambda: dataframe.sample(ctx.df, frac=0.1, seed=1), rows=ctx.rows // 10)
+
+
+@benchmark("sample[weighted]", ["sample"])
+def _(ctx):
+    weights = array.array("d", (1.0 + i % 7 for i in range(ctx.rows)))
+    return measure(lambda: dataframe.sample(ctx.df, frac=0.1, seed=1, weights=weights, replace=True), rows=ctx.rows)
+
+
+@benchmark("sample[stratified]", ["sample"])
+def _(ctx):
+    return measure(lambda: dataframe.sample(ctx.df, frac=0.1, seed=1, stratify_by="tag"), rows=ctx.rows)
+
+
+@benchmark("sample[chunked]", ["read_csv_chunked", "sample"])
+def _(ctx):
+    def run():
+        dataframe.sample(dataframe.read_csv_chunked(ctx.csv_path, 100_000), 1000, seed=1)
+        return {"rows": ctx.rows, "bytes": ctx.csv_bytes}
+    return run
+
+
+@benchmark("copy")
+def _(ctx):
+    return measure(lambda: dataframe.copy(ctx.df), rows=ctx.rows, bytes=ctx.column_bytes())
+
+
+@benchmark("to_string")
+def _(ctx):
+    return repeat_calls(ctx, lambda: dataframe.to_string(ctx.df), 100)
+
+
+for _name in ("dtypes", "shape", "size", "ndim", "columns"):
+    benchmark(_name)(lambda ctx, f=getattr(dataframe, _name): repeat_calls(ctx, lambda: f(ctx.df)))
+
+
+@benchmark("describe")
+def _(ctx):
+    return measure(lambda: dataframe.describe(ctx.df), rows=ctx.rows, bytes=ctx.column_bytes())
+
+
+@benchmark("unique")
+def _(ctx):
+    return measure(lambda: dataframe.unique(ctx.df, "key"), rows=ctx.rows, bytes=ctx.column_bytes("key"))
+
+
+@benchmark("value_counts")
+def _(ctx):
+    return measure(lambda: dataframe.value_counts(ctx.df, "name"), rows=ctx.rows, bytes=ctx.column_bytes("name"))
+
+
+@benchmark("isnull")
+def _(ctx):
+    return measure(lambda: dataframe.isnull(ctx.df), rows=ctx.rows, bytes=ctx.column_bytes())
+
+
+@benchmark("isna")
+def _(ctx):
+    return measure(lambda: dataframe.isna(ctx.df), rows=ctx.rows, bytes=ctx.column_bytes())
+
+
+@benchmark("nlargest")
+def _(ctx):
+    return measure(lambda: dataframe.nlargest(ctx.df, "value", 100), rows=ctx.rows, bytes=ctx.column_bytes("value"))
+
+
+@benchmark("nsmallest")
+def _(ctx):
+    return measure(lambda: dataframe.nsmallest(ctx.df, ["key", "value"], 100),
+                   rows=ctx.rows, bytes=ctx.column_bytes("key", "value"))
+
+
+@benchmark("fillna")
+def _(ctx):
+    df = ctx.copy()
+    return measure(lambda: dataframe.fillna(df, "0"), rows=ctx.rows, bytes=ctx.column_bytes())
+
+
+@benchmark("fillna[ffill]")
+def _(ctx):
+    df = ctx.copy()
+    return measure(lambda: dataframe.fillna(df, method="ffill", columns=["key", "value", "when"]),
+                   rows=ctx.rows, bytes=ctx.column_bytes("key", "value", "when"))
+
+
+@benchmark("fillna[interpolate]")
+def _(ctx):
+    df = ctx.copy()
+    return measure(lambda: dataframe.fillna(df, method="interpolate", limit=8, columns=["value"]),
+                   rows=ctx.rows, bytes=ctx.column_bytes("value"))
+
+
+@benchmark("clip[columns]")
+def _(ctx):
+    df = ctx.copy()
+    return measure(lambda: dataframe.clip(df, lower=0, columns=["value"]), rows=ctx.rows, bytes=ctx.column_bytes("value"))
+
+
+@benchmark("clip")
+def _(ctx):
+    df = dataframe.lazy(ctx.df).select(["key", "value"]).collect()
+    return measure(lambda: dataframe.clip(df, "-100", "100"), rows=ctx.rows, bytes=ctx.column_bytes("key", "value"))
+
+
+@benchmark("column")
+def _(ctx):
+    return repeat_calls(ctx, lambda: dataframe.column(ctx.df, "value"))
+
+
+@benchmark("categories")
+def _(ctx):
+    return repeat_calls(ctx, lambda: dataframe.categories(ctx.df, "tag"), 1000)
+
+
+@benchmark("validity")
+def _(ctx):
+    return repeat_calls(ctx, lambda: dataframe.validity(ctx.df, "value"))
+
+
+@benchmark("sort_values")
+def _(ctx):
+    df = ctx.copy()
+    return measure(lambda: dataframe.sort_values(df, "value"), rows=ctx.rows, bytes=ctx.column_bytes())
+
+
+@benchmark("sort_values[multi]", ["sort_values"])
+def _(ctx):
+    df = ctx.copy()
+    return measure(lambda: dataframe.sort_values(df, ["tag", "key", "value"], [True, False, True]),
+                   rows=ctx.rows, bytes=ctx.column_bytes())
+
+
+@benchmark("argsort")
+def _(ctx):
+    return measure(lambda: dataframe.argsort(ctx.df, "name"), rows=ctx.rows, bytes=ctx.column_bytes("name"))
+
+
+PREDICATE = ("and", ("key", "<", 0), ("value", ">", 0.0))
+
+
+@benchmark("filter")
+def _(ctx):
+    def run():
+        dataframe.freeDataFrame(dataframe.filter(ctx.df, PREDICATE))
+        return {"rows": ctx.rows, "bytes": ctx.column_bytes("key", "value")}
+    return run
+
+
+@benchmark("argfilter")
+def _(ctx):
+    return measure(lambda: dataframe.argfilter(ctx.df, PREDICATE),
+                   rows=ctx.rows, bytes=ctx.column_bytes("key", "value"))
+
+
+@benchmark("groupby")
+def _(ctx):
+    def run():
+        dataframe.freeDataFrame(dataframe.groupby(ctx.df, "key", {"value": ["sum", "mean"], "name": "nunique"}))
+        return {"rows": ctx.rows, "bytes": ctx.column_bytes("key", "value", "name")}
+    return run
+
+
+@benchmark("join")
+def _(ctx):
+    right = dataframe.groupby(ctx.df, "key", {"value": "mean"})
+    def run():
+        dataframe.freeDataFrame(dataframe.join(ctx.df, right, "key"))
+        return {"rows": ctx.rows, "bytes": ctx.column_bytes()}
+    return run
+
+
+@benchmark("create_index")
+def _(ctx):
+    df = ctx.copy()
+    return measure(lambda: dataframe.create_index(df, "value"), rows=ctx.rows, bytes=ctx.column_bytes("value"))
+
+
+@benchmark("create_index[hash]", ["create_index"])
+def _(ctx):
+    df = ctx.copy()
+    return measure(lambda: dataframe.create_index(df, "name", "hash"), rows=ctx.rows, bytes=ctx.column_bytes("name"))
+
+
+@benchmark("drop_index")
+def _(ctx):
+    df = ctx.copy()
+    dataframe.create_index(df, "value")
+    return measure(lambda: dataframe.drop_index(df, "value"), rows=ctx.rows)
+
+
+@benchmark("indexes")
+def _(ctx):
+    df = ctx.copy()
+    dataframe.create_index(df, "id", "hash")
+    return repeat_calls(ctx, lambda: dataframe.indexes(df))
+
+
+@benchmark("lookup")
+def _(ctx):
+    df = ctx.copy()
+    dataframe.create_index(df, "id", "hash")
+    return repeat_calls(ctx, lambda: dataframe.lookup(df, "id", ctx.rows // 2))
+
+
+@benchmark("range")
+def _(ctx):
+    df = ctx.copy()
+    dataframe.create_index(df, "id")
+    return repeat_calls(ctx, lambda: dataframe.range(df, "id", ctx.rows // 2, ctx.rows // 2 + 100), 1000)
+
+
+@benchmark("filter[indexed]", ["filter", "create_index"])
+def _(ctx):
+    df = ctx.copy()
+    dataframe.create_index(df, "id")
+    predicate = ("and", ("id", ">=", ctx.rows // 2), ("id", "<", ctx.rows // 2 + 1000), ("value", ">", 0.0))
+    def run():
+        dataframe.freeDataFrame(dataframe.filter(df, predicate))
+        return {"rows": ctx.rows}
+    return run
+
+
+@benchmark("join[indexed]", ["join", "create_index"])
+def _(ctx):
+    right = dataframe.groupby(ctx.df, "key", {"value": "mean"})
+    dataframe.create_index(right, "key", "hash")
+    def run():
+        dataframe.freeDataFrame(dataframe.join(ctx.df, right, "key"))
+        return {"rows": ctx.rows, "bytes": ctx.column_bytes()}
+    return run
+
+
+@benchmark("nlargest[indexed]", ["nlargest", "create_index"])
+def _(ctx):
+    df = ctx.copy()
+    dataframe.create_index(df, "value")
+    return measure(lambda: dataframe.nlargest(df, "value", 100), rows=ctx.rows)
+
+
+@benchmark("lazy")
+def _(ctx):
+    def run():
+        query = dataframe.lazy(ctx.df).filter(PREDICATE).fillna("0").sort_values("value").head(100)
+        dataframe.freeDataFrame(query.collect())
+        return {"rows": ctx.rows, "bytes": ctx.column_bytes()}
+    return run
+
+
+@benchmark("scan_csv")
+def _(ctx):
+    def run():
+        query = dataframe.scan_csv(ctx.csv_path).select(["key", "value"]).filter(PREDICATE)
+        dataframe.freeDataFrame(query.collect())
+        return {"rows": ctx.rows, "bytes": ctx.csv_bytes}
+    return run
+
+
+@benchmark("set_num_threads", ["set_num_threads", "get_num_threads"])
+def _(ctx):
+    return repeat_calls(ctx, lambda: dataframe.set_num_threads(dataframe.get_num_threads()))
+
+
+@benchmark("memory_usage")
+def _(ctx):
+    return repeat_calls(ctx, lambda: dataframe.memory_usage(ctx.df, deep=True))
+
+
+@benchmark("stats", ["enable_stats", "stats", "reset_stats"])
+def _(ctx):
+    return repeat_calls(ctx, dataframe.stats)
+
+
+@benchmark("trace", ["start_trace", "stop_trace"])
+def _(ctx):
+    path = os.path.join(ctx.scratch, "trace.json")
+    def run():
+        dataframe.start_trace()
+        dataframe.argsort(ctx.df, "value")
+        dataframe.stop_trace(path)
+        return {"rows": ctx.rows}
+    return run
+
+
+def exported_functions():
+    return sorted(name for name in dir(dataframe)
+                  if not name.startswith("_") and callable(getattr(dataframe, name))
+                  and not isinstance(getattr(dataframe, name), type))
+
+
+def peak_rss_kb():
+    peak = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    # macOS reports bytes, Linux kilobytes
+    return peak // 1024 if sys.platform == "darwin" else peak
+
+
+def run_benchmark(ctx, name, repeat):
+    covers, setup = BENCHMARKS[name]
+    times = []
+    work = {}
+    kernels = {}
+    for i in range(repeat):
+        run = setup(ctx)
+        # The extension's own counters are on for the first run only; they
+        # cost a clock read per operation
+        dataframe.reset_stats()
+        dataframe.enable_stats(i == 0)
+        start = time.perf_counter()
+        work = run()
+        times.append(time.perf_counter() - start)
+        if i == 0:
+            kernels = dataframe.stats()
+            dataframe.enable_stats(False)
+    best = min(times)
+    result = {
+        "name": name,
+        "covers": covers,
+        "repeat": repeat,
+        "seconds": best,
+        "median_seconds": statistics.median(times),
+        "rows": work.get("rows"),
+        "bytes": work.get("bytes"),
+        "calls": work.get("calls"),
+        "peak_rss_kb": peak_rss_kb(),
+        "allocations": None,
+        # Column storage allocated by the outermost operation, which
+        # includes what the operations it calls allocate
+        "allocated_bytes": max((k["bytes_allocated"] for k in kernels.values()), default=None),
+        "kernels": kernels,
+    }
+    if best > 0:
+        if result["rows"]:
+            result["rows_per_sec"] = result["rows"] / best
+        if result["bytes"]:
+            result["gb_per_sec"] = result["bytes"] / best / 1e9
+        if result["calls"]:
+            result["calls_per_sec"] = result["calls"] / best
+    return result
+
+
+def run_isolated(args, name):
+    """Run one benchmark in a fresh interpreter, so its peak RSS is its own."""
+    with tempfile.NamedTemporaryFile(suffix=".json", delete=False) as f:
+        out = f.name
+    try:
+        command = [sys.executable, os.path.abspath(__file__), "--csv", args.csv, "--repeat", str(args.repeat),
+                   "--only", "^" + re.escape(name) + "$", "--json", out, "--quiet"]
+        if args.threads:
+            command += ["--threads", str(args.threads)]
+        subprocess.run(command, check=True)
+        with open(out) as f:
+            return json.load(f)["results"]
+    finally:
+        os.unlink(out)
+
+
+def format_rate(value, unit):
+    if value is None:
+        return ""
+    for scale, prefix in ((1e9, "G"), (1e6, "M"), (1e3, "k")):
+        if value >= scale:
+            return f"{value / scale:.2f} {prefix}{unit}"
+    return f"{value:.2f} {unit}"
+
+
+def print_result(result):
+    rate = (format_rate(result.get("rows_per_sec"), "rows/s") or format_rate(result.get("calls_per_sec"), "calls/s"))
+    gbs = f"{result['gb_per_sec']:.3f} GB/s" if "gb_per_sec" in result else ""
+    print(f"{result['name']:<24} {result['seconds'] * 1e3:>11.3f} ms {rate:>18} {gbs:>14} "
+          f"{result['peak_rss_kb'] / 1024:>9.1f} MB", flush=True)
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description="Benchmark every function of the dataframe extension.")
+    parser.add_argument("--csv", help="CSV fixture to run on (default: generate one of --rows rows)")
+    parser.add_argument("--rows", type=int, default=1_000_000)
+    parser.add_argument("--seed", type=int, default=42)
+    parser.add_argument("--repeat", type=int, default=3, help="runs per benchmark; the fastest is reported")
+    parser.add_argument("--threads", type=int, help="threads the extension may use (default: all cores)")
+    parser.add_argument("--only", help="regular expression selecting benchmarks by name")
+    parser.add_argument("--isolate", action="store_true", help="run each benchmark in its own process")
+    parser.add_argument("--json", help="write results to this file")
+    parser.add_argument("--strict", action="store_true", help="fail if an exported function has no benchmark")
+    parser.add_argument("--quiet", action="store_true", help=argparse.SUPPRESS)
+    args = parser.parse_args(argv)
+
+    if args.threads:
+        dataframe.set_num_threads(args.threads)
+    if not args.csv:
+        os.makedirs(DATA_DIR, exist_ok=True)
+        args.csv = os.path.join(DATA_DIR, f"bench_{args.rows}_{args.seed}.csv")
+        if not os.path.exists(args.csv):
+            specs = gen_data.parse_columns(gen_data.DEFAULT_COLUMNS)
+            gen_data.write_csv(args.csv + ".tmp", args.rows, specs, args.seed)
+            os.replace(args.csv + ".tmp", args.csv)
+
+    covered = {name for covers, _ in BENCHMARKS.values() for name in covers}
+    uncovered = [name for name in exported_functions() if name not in covered]
+    if uncovered and not args.quiet:
+        print("no benchmark for: " + ", ".join(uncovered), file=sys.stderr)
+    if uncovered and args.strict:
+        return 1
+
+    names = [name for name in BENCHMARKS if not args.only or re.search(args.only, name)]
+    results = []
+    with tempfile.TemporaryDirectory() as scratch:
+        ctx = None if args.isolate else Context(args.csv, scratch)
+        for name in names:
+            for result in run_isolated(args, name) if args.isolate else [run_benchmark(ctx, name, args.repeat)]:
+                results.append(result)
+                if not args.quiet:
+                    print_result(result)
+
+    if args.json:
+        report = {
+            "suite": "python",
+            "csv": os.path.abspath(args.csv),
+            "csv_bytes": os.path.getsize(args.csv),
+            "threads": dataframe.get_num_threads(),
+            "python": platform.python_version(),
+            "machine": platform.machine(),
+            "time": time.strftime("%Y-%m-%dT%H:%M:%S"),
+            "uncovered": uncovered,
+            "results": results,
+        }
+        with open(args.json, "w") as f:
+            json.dump(report, f, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
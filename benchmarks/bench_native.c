@@ -0,0 +1,405 @@
+/******************************************************************************
+bench_native.c: microbenchmarks of the core routines of dataframes.c, called
+directly rather than through Python. The extension source is compiled into
+this program so that its static functions can be reached and its allocations
+counted.
+
+    make -C benchmarks native
+    ./bench_native --rows 1000000 --repeat 5 --json native.json
+*******************************************************************************/
+#include <Python.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/resource.h>
+
+// Every allocation made by dataframes.c goes through these counters. Pool
+// threads allocate too, so they are updated atomically.
+static size_t alloc_count;
+static size_t alloc_bytes;
+
+static void countHeapCall(size_t size) {
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&alloc_bytes, size, __ATOMIC_RELAXED);
+}
+
+static void* countedMalloc(size_t size) {
+    countHeapCall(size);
+    return malloc(size);
+}
+
+static void* countedCalloc(size_t num, size_t size) {
+    countHeapCall(num * size);
+    return calloc(num, size);
+}
+
+static void* countedRealloc(void* ptr, size_t size) {
+    countHeapCall(size);
+    return realloc(ptr, size);
+}
+
+static int countedPosixMemalign(void** ptr, size_t alignment, size_t size) {
+    countHeapCall(size);
+    return posix_memalign(ptr, alignment, size);
+}
+
+#define malloc(size) countedMalloc(size)
+#define calloc(num, size) countedCalloc(num, size)
+#define realloc(ptr, size) countedRealloc(ptr, size)
+#define posix_memalign(ptr, alignment, size) countedPosixMemalign(ptr, alignment, size)
+
+#include "../dataframes.c"
+
+#undef malloc
+#undef calloc
+#undef realloc
+#undef posix_memalign
+
+// Deterministic pseudo-random numbers (splitmix64) for generated data
+static uint64_t benchRandom(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Function to write a CSV file of num_rows rows: a unique id, an int key
+// with 1000 distinct values, a float with 5% missing values and a string
+// with 10000 distinct values of 8 letters. Returns -1 if it cannot be written.
+static int writeBenchCsv(const char* path, int num_rows, uint64_t seed) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        return -1;
+    }
+    uint64_t state = seed;
+    fputs("id,key,value,name\n", f);
+    for (int i = 0; i < num_rows; i++) {
+        uint64_t r = benchRandom(&state);
+        uint64_t name = benchRandom(&state) % 10000;
+        char letters[9];
+        for (int k = 0; k < 8; k++, name /= 26) {
+            letters[k] = (char)('a' + name % 26);
+        }
+        letters[8] = '\0';
+        fprintf(f, "%d,%d,", i, (int)(r % 1000));
+        if ((r >> 10) % 20 != 0) {
+            fprintf(f, "%.17g", (double)(r >> 11) / (double)(1ULL << 53) * 2e6 - 1e6);
+        }
+        fprintf(f, ",%s\n", letters);
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+// One benchmark's measurements
+typedef struct {
+    const char* name;
+    int repeat;
+    double seconds;         // fastest run
+    double median_seconds;
+    int64_t rows;
+    int64_t bytes;          // bytes of input processed, 0 when not meaningful
+    size_t allocations;     // allocations made by the fastest run
+    size_t allocated_bytes;
+    long peak_rss_kb;
+} BenchResult;
+
+// Everything a benchmark run may use
+typedef struct {
+    const char* csv_path;
+    int64_t csv_bytes;
+    CsvOptions opts;
+    DataFrame* df;          // the CSV file, loaded once
+    int num_rows;
+    int64_t work_rows;      // set by each run: rows it processed
+    int64_t work_bytes;
+} BenchContext;
+
+typedef void (*BenchFunction)(BenchContext* ctx);
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static long peakRssKb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+// Function to run a benchmark repeat times, keeping the fastest run
+static BenchResult runBench(const char* name, BenchFunction fn, BenchContext* ctx, int repeat) {
+    BenchResult result = {name, repeat, 0, 0, 0, 0, 0, 0, 0};
+    double* times = (double*)malloc(repeat * sizeof(double));
+    for (int r = 0; r < repeat; r++) {
+        size_t count_before = alloc_count;
+        size_t bytes_before = alloc_bytes;
+        double start = now();
+        fn(ctx);
+        times[r] = now() - start;
+        if (r == 0 || times[r] < result.seconds) {
+            result.seconds = times[r];
+            result.allocations = alloc_count - count_before;
+            result.allocated_bytes = alloc_bytes - bytes_before;
+        }
+    }
+    qsort(times, repeat, sizeof(double), compareDoubles);
+    result.median_seconds = times[repeat / 2];
+    free(times);
+    result.rows = ctx->work_rows;
+    result.bytes = ctx->work_bytes;
+    result.peak_rss_kb = peakRssKb();
+    return result;
+}
+
+static void benchCreateDataFrame(BenchContext* ctx) {
+    DataFrame* df = createDataFrame(ctx->num_rows, 8);
+    if (df) {
+        freeDataFrame(df);
+    }
+    ctx->work_rows = ctx->num_rows;
+    ctx->work_bytes = (int64_t)ctx->num_rows * 8 * (int64_t)sizeof(int64_t);
+}
+
+static void benchAddRow(BenchContext* ctx) {
+    static char* rows[2][4] = {{"12345", "hello", NULL, "3.25"}, {"-7", "world", "x", "nan"}};
+    DataFrame* df = createDataFrame(0, 4);
+    int n = ctx->num_rows < 1000000 ? ctx->num_rows : 1000000;
+    for (int i = 0; df && i < n; i++) {
+        addRow(df, rows[i & 1]);
+    }
+    if (df) {
+        freeDataFrame(df);
+    }
+    ctx->work_rows = n;
+    ctx->work_bytes = 0;
+}
+
+static void benchLoadCsv(BenchContext* ctx) {
+    DataFrame* df = loadCSV(ctx->csv_path, &ctx->opts);
+    if (df) {
+        freeDataFrame(df);
+    }
+    ctx->work_rows = ctx->num_rows;
+    ctx->work_bytes = ctx->csv_bytes;
+}
+
+// Function to sort the rows of the loaded frame by one column
+static void benchSortColumn(BenchContext* ctx, int col_index) {
+    SortKey key = {&ctx->df->columns[col_index], 0, 0};
+    // A --csv fixture may hold category columns, whose ranks sorting needs
+    if (key.col->dtype == DTYPE_CATEGORY) {
+        categoryRanks(key.col->dict);
+    }
+    free(argsortRows(ctx->df, &key, 1));
+    ctx->work_rows = ctx->num_rows;
+    ctx->work_bytes = (int64_t)ctx->num_rows * (int64_t)sizeof(int64_t);
+}
+
+static void benchSortInt(BenchContext* ctx) {
+    benchSortColumn(ctx, 1);
+}
+
+static void benchSortFloat(BenchContext* ctx) {
+    benchSortColumn(ctx, 2);
+}
+
+static void benchSortString(BenchContext* ctx) {
+    benchSortColumn(ctx, 3);
+}
+
+static void benchSortMulti(BenchContext* ctx) {
+    SortKey keys[2] = {{&ctx->df->columns[1], 0, 0}, {&ctx->df->columns[2], 1, 0}};
+    free(argsortRows(ctx->df, keys, 2));
+    ctx->work_rows = ctx->num_rows;
+    ctx->work_bytes = (int64_t)ctx->num_rows * 2 * (int64_t)sizeof(int64_t);
+}
+
+static void benchTopK(BenchContext* ctx) {
+    SortKey key = {&ctx->df->columns[2], 1, 0};
+    int count;
+    free(topKRows(ctx->df, &key, 1, 100, &count));
+    ctx->work_rows = ctx->num_rows;
+    ctx->work_bytes = (int64_t)ctx->num_rows * (int64_t)sizeof(double);
+}
+
+// Function to count the distinct values of a column, most frequent first
+static void benchValueCountsColumn(BenchContext* ctx, int col_index) {
+    const Column* col = &ctx->df->columns[col_index];
+    ValueTable table;
+    if (countValues(col, ctx->num_rows, 1, &table) == 0) {
+        size_t count;
+        free(sortedValueSlots(&table, compareSlotsByCount, &count));
+        freeValueTable(&table);
+    }
+    ctx->work_rows = ctx->num_rows;
+    ctx->work_bytes = (int64_t)ctx->num_rows * (int64_t)sizeof(int64_t);
+}
+
+static void benchValueCountsInt(BenchContext* ctx) {
+    benchValueCountsColumn(ctx, 1);
+}
+
+static void benchValueCountsString(BenchContext* ctx) {
+    benchValueCountsColumn(ctx, 3);
+}
+
+static const struct {
+    const char* name;
+    BenchFunction fn;
+} benches[] = {
+    {"createDataFrame", benchCreateDataFrame},
+    {"addRow", benchAddRow},
+    {"loadCSV", benchLoadCsv},
+    {"sort[int]", benchSortInt},
+    {"sort[float]", benchSortFloat},
+    {"sort[string]", benchSortString},
+    {"sort[int,float]", benchSortMulti},
+    {"topK[100]", benchTopK},
+    {"value_counts[int]", benchValueCountsInt},
+    {"value_counts[string]", benchValueCountsString},
+};
+
+static void writeJson(FILE* f, const BenchResult* results, int num_results, const BenchContext* ctx) {
+    fprintf(f, "{\n  \"suite\": \"native\",\n  \"csv_bytes\": %lld,\n  \"threads\": %d,\n  \"results\": [",
+            (long long)ctx->csv_bytes, getNumThreads());
+    for (int i = 0; i < num_results; i++) {
+        const BenchResult* r = &results[i];
+        fprintf(f, "%s\n    {\"name\": \"%s\", \"repeat\": %d, \"seconds\": %.9g, \"median_seconds\": %.9g, "
+                   "\"rows\": %lld, \"bytes\": %lld, \"rows_per_sec\": %.6g, \"gb_per_sec\": %.6g, "
+                   "\"allocations\": %zu, \"allocated_bytes\": %zu, \"peak_rss_kb\": %ld}",
+                i ? "," : "", r->name, r->repeat, r->seconds, r->median_seconds, (long long)r->rows,
+                (long long)r->bytes, r->seconds > 0 ? r->rows / r->seconds : 0.0,
+                r->seconds > 0 ? r->bytes / r->seconds / 1e9 : 0.0, r->allocations, r->allocated_bytes,
+                r->peak_rss_kb);
+    }
+    fprintf(f, "\n  ]\n}\n");
+}
+
+static void usage(const char* program) {
+    fprintf(stderr,
+            "usage: %s [--rows N] [--repeat N] [--threads N] [--csv FILE] [--only NAME] [--json FILE]\n"
+            "  --rows     rows of generated data (default 1000000)\n"
+            "  --csv      run loadCSV on this file instead of generated data\n"
+            "  --only     run only benchmarks whose name starts with NAME\n",
+            program);
+}
+
+int main(int argc, char** argv) {
+    int num_rows = 1000000;
+    int repeat = 3;
+    int threads = 0;
+    const char* csv_path = NULL;
+    const char* only = NULL;
+    const char* json_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (value && strcmp(argv[i], "--rows") == 0) {
+            num_rows = atoi(value);
+        } else if (value && strcmp(argv[i], "--repeat") == 0) {
+            repeat = atoi(value);
+        } else if (value && strcmp(argv[i], "--threads") == 0) {
+            threads = atoi(value);
+        } else if (value && strcmp(argv[i], "--csv") == 0) {
+            csv_path = value;
+        } else if (value && strcmp(argv[i], "--only") == 0) {
+            only = value;
+        } else if (value && strcmp(argv[i], "--json") == 0) {
+            json_path = value;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+    if (num_rows < 1 || repeat < 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // The extension needs an interpreter for its error reporting and its
+    // module setup (thread pool, numeric locale)
+    Py_Initialize();
+    PyObject* module = PyInit_dataframe();
+    if (!module) {
+        PyErr_Print();
+        return 1;
+    }
+    if (threads > 0) {
+        pool.num_threads = threads;
+    }
+
+    char generated[] = "/tmp/bench_native_XXXXXX";
+    if (!csv_path) {
+        int fd = mkstemp(generated);
+        if (fd < 0 || (close(fd), writeBenchCsv(generated, num_rows, 42)) != 0) {
+            perror("bench_native: cannot write generated data");
+            return 1;
+        }
+        csv_path = generated;
+    }
+
+    BenchContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.csv_path = csv_path;
+    parseCsvOptions(',', 1, NULL, &ctx.opts);
+    // Keep strings as strings so the string kernels are what gets measured
+    ctx.opts.categorical = CATEGORY_NEVER;
+    struct stat st;
+    ctx.csv_bytes = stat(csv_path, &st) == 0 ? (int64_t)st.st_size : 0;
+    ctx.df = loadCSV(csv_path, &ctx.opts);
+    if (!ctx.df) {
+        PyErr_Print();
+        return 1;
+    }
+    ctx.num_rows = ctx.df->num_rows;
+    if (ctx.df->num_cols < 4) {
+        fprintf(stderr, "bench_native: %s needs at least 4 columns (id, int, float, string)\n", csv_path);
+        return 1;
+    }
+
+    int num_benches = (int)(sizeof(benches) / sizeof(benches[0]));
+    BenchResult results[sizeof(benches) / sizeof(benches[0])];
+    int num_results = 0;
+    fprintf(stderr, "%d rows, %d threads\n", ctx.num_rows, getNumThreads());
+    for (int b = 0; b < num_benches; b++) {
+        if (only && strncmp(benches[b].name, only, strlen(only)) != 0) {
+            continue;
+        }
+        BenchResult r = runBench(benches[b].name, benches[b].fn, &ctx, repeat);
+        results[num_results++] = r;
+        fprintf(stderr, "%-22s %11.3f ms %10.2f Mrows/s %8.3f GB/s %10zu allocs %10.1f MB alloc %9.1f MB rss\n",
+                r.name, r.seconds * 1e3, r.seconds > 0 ? r.rows / r.seconds / 1e6 : 0.0,
+                r.seconds > 0 ? r.bytes / r.seconds / 1e9 : 0.0, r.allocations, r.allocated_bytes / 1e6,
+                r.peak_rss_kb / 1024.0);
+    }
+
+    FILE* out = json_path ? fopen(json_path, "w") : stdout;
+    if (!out) {
+        perror(json_path);
+        return 1;
+    }
+    writeJson(out, results, num_results, &ctx);
+    if (json_path) {
+        fclose(out);
+    }
+    freeDataFrame(ctx.df);
+    if (csv_path == generated) {
+        unlink(generated);
+    }
+    Py_DECREF(module);
+    return 0;
+}
@@ -0,0 +1,63 @@
+# compare.py
+#
+# Compare two JSON reports of bench.py or bench_native, benchmark by
+# benchmark.
+#
+#   python3 compare.py baseline.json current.json [--threshold 0.05]
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        report = json.load(f)
+    return report, {result["name"]: result for result in report["results"]}
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description="Compare two benchmark reports.")
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=0.05,
+                        help="relative change in time reported as faster or slower (default 0.05)")
+    parser.add_argument("--fail-on-regression", action="store_true",
+                        help="exit with status 1 if any benchmark got slower")
+    args = parser.parse_args(argv)
+
+    base_report, base = load(args.baseline)
+    current_report, current = load(args.current)
+    if base_report.get("suite") != current_report.get("suite"):
+        print(f"warning: comparing a {base_report.get('suite')} report with a {current_report.get('suite')} one",
+              file=sys.stderr)
+
+    slower = 0
+    print(f"{'benchmark':<24} {'baseline ms':>12} {'current ms':>12} {'change':>8}  {'allocs':>18}")
+    for name, result in current.items():
+        old = base.get(name)
+        if not old:
+            print(f"{name:<24} {'-':>12} {result['seconds'] * 1e3:>12.3f} {'new':>8}")
+            continue
+        change = result["seconds"] / old["seconds"] - 1 if old["seconds"] > 0 else 0.0
+        verdict = ""
+        if change > args.threshold:
+            verdict = "slower"
+            slower += 1
+        elif change < -args.threshold:
+            verdict = "faster"
+        allocs = ""
+        if old.get("allocations") is not None and result.get("allocations") is not None:
+            allocs = f"{old['allocations']} -> {result['allocations']}"
+        elif old.get("allocated_bytes") is not None and result.get("allocated_bytes") is not None:
+            allocs = f"{old['allocated_bytes'] >> 10}K -> {result['allocated_bytes'] >> 10}K"
+        print(f"{name:<24} {old['seconds'] * 1e3:>12.3f} {result['seconds'] * 1e3:>12.3f} {change:>+8.1%}  "
+              f"{allocs:>18} {verdict}")
+    for name in base:
+        if name not in current:
+            print(f"{name:<24} {base[name]['seconds'] * 1e3:>12.3f} {'-':>12} {'gone':>8}")
+    return 1 if slower and args.fail_on_regression else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
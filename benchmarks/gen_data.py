@@ -0,0 +1,154 @@
+# gen_data.py
+#
+# Deterministic synthetic CSV data for the benchmarks. The same arguments
+# always produce the same bytes: every column draws from its own generator,
+# seeded from the run seed and the column name.
+#
+#   python3 gen_data.py --preset 1m --out data/
+#   python3 gen_data.py --rows 50000 --columns "k:int:card=100,v:float:nulls=0.2,s:str:len=16" -o small.csv
+
+import argparse
+import datetime
+import os
+import random
+import sys
+
+TYPES = ("int", "float", "bool", "str", "datetime")
+
+# Fixture sizes and the column layout they share
+PRESETS = {"1m": 1_000_000, "10m": 10_000_000, "100m": 100_000_000}
+DEFAULT_COLUMNS = "id:int:card=0:nulls=0,key:int:card=1000,value:float,flag:bool,name:str:card=10000,tag:str:card=16:len=6,when:datetime"
+
+EPOCH = datetime.datetime(2000, 1, 1)
+TWENTY_YEARS = 20 * 365 * 86400
+
+
+class ColumnSpec:
+    """One generated column: its type, number of distinct values (0 for as
+    many as the type allows), share of missing values and string length."""
+
+    def __init__(self, name, dtype, cardinality, null_ratio, str_len):
+        if dtype not in TYPES:
+            raise ValueError(f"column {name!r}: type must be one of {', '.join(TYPES)}")
+        if not 0.0 <= null_ratio <= 1.0:
+            raise ValueError(f"column {name!r}: nulls must be between 0 and 1")
+        self.name = name
+        self.dtype = dtype
+        self.cardinality = cardinality
+        self.null_ratio = null_ratio
+        self.str_len = str_len
+
+
+def parse_columns(text, cardinality=0, null_ratio=0.05, str_len=8):
+    """Parse "name:type[:card=N][:nulls=R][:len=L],..." into ColumnSpecs;
+    options left out take the given defaults."""
+    specs = []
+    for item in text.split(","):
+        parts = item.strip().split(":")
+        if len(parts) < 2:
+            raise ValueError(f"column spec {item!r} must be name:type[:option=value...]")
+        options = {"card": cardinality, "nulls": null_ratio, "len": str_len}
+        for option in parts[2:]:
+            key, _, value = option.partition("=")
+            if key not in options:
+                raise ValueError(f"column spec {item!r}: unknown option {key!r}")
+            options[key] = float(value) if key == "nulls" else int(value)
+        specs.append(ColumnSpec(parts[0], parts[1], options["card"], options["nulls"], options["len"]))
+    return specs
+
+
+def _value_maker(spec, rng):
+    """Return a function making one formatted value of spec from rng."""
+    if spec.dtype == "int":
+        return lambda: str(rng.randint(-(1 << 40), 1 << 40))
+    if spec.dtype == "float":
+        return lambda: repr(rng.uniform(-1e6, 1e6))
+    if spec.dtype == "bool":
+        return lambda: "true" if rng.random() < 0.5 else "false"
+    if spec.dtype == "datetime":
+        return lambda: (EPOCH + datetime.timedelta(seconds=rng.randrange(TWENTY_YEARS))).isoformat(" ")
+    letters = "abcdefghijklmnopqrstuvwxyz"
+    return lambda: "".join(rng.choice(letters) for _ in range(spec.str_len))
+
+
+class ColumnGenerator:
+    """Values of one column, row after row."""
+
+    def __init__(self, spec, seed):
+        self.spec = spec
+        self.rng = random.Random(f"{seed}:{spec.name}")
+        make = _value_maker(spec, self.rng)
+        if spec.dtype == "int" and spec.cardinality == 0 and spec.null_ratio == 0:
+            # Row numbers: a unique key for joins and lookups
+            self.next_row = 0
+            self.make = self._row_number
+        elif spec.cardinality > 0:
+            pool = [make() for _ in range(spec.cardinality)]
+            self.make = lambda: pool[self.rng.randrange(len(pool))]
+        else:
+            self.make = make
+
+    def _row_number(self):
+        value = self.next_row
+        self.next_row += 1
+        return str(value)
+
+    def values(self, n):
+        nulls = self.spec.null_ratio
+        rng = self.rng
+        make = self.make
+        if nulls == 0:
+            return [make() for _ in range(n)]
+        return ["" if rng.random() < nulls else make() for _ in range(n)]
+
+
+def write_csv(path, rows, specs, seed=42, chunk_rows=100_000):
+    """Write rows of generated data to a CSV file with a header; returns
+    the number of bytes written."""
+    generators = [ColumnGenerator(spec, seed) for spec in specs]
+    with open(path, "w", newline="") as f:
+        f.write(",".join(spec.name for spec in specs) + "\n")
+        done = 0
+        while done < rows:
+            n = min(chunk_rows, rows - done)
+            columns = [g.values(n) for g in generators]
+            f.write("\n".join(",".join(row) for row in zip(*columns)))
+            f.write("\n")
+            done += n
+    return os.path.getsize(path)
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description="Generate deterministic CSV data for the benchmarks.")
+    parser.add_argument("--preset", choices=sorted(PRESETS), action="append",
+                        help="write the fixture of this size to --out (may repeat)")
+    parser.add_argument("--out", default="data", help="directory for --preset fixtures")
+    parser.add_argument("-o", "--output", help="file to write --rows rows to")
+    parser.add_argument("--rows", type=int, default=100_000)
+    parser.add_argument("--columns", default=DEFAULT_COLUMNS,
+                        help="name:type[:card=N][:nulls=R][:len=L],... with type in " + ", ".join(TYPES))
+    parser.add_argument("--cardinality", type=int, default=0, help="default distinct values per column, 0 for unbounded")
+    parser.add_argument("--null-ratio", type=float, default=0.05, help="default share of missing values")
+    parser.add_argument("--str-len", type=int, default=8, help="default string length")
+    parser.add_argument("--seed", type=int, default=42)
+    args = parser.parse_args(argv)
+
+    try:
+        specs = parse_columns(args.columns, args.cardinality, args.null_ratio, args.str_len)
+    except ValueError as e:
+        parser.error(str(e))
+    jobs = []
+    if args.output:
+        jobs.append((args.output, args.rows))
+    for preset in args.preset or []:
+        os.makedirs(args.out, exist_ok=True)
+        jobs.append((os.path.join(args.out, f"fixture_{preset}.csv"), PRESETS[preset]))
+    if not jobs:
+        parser.error("give --output or --preset")
+    for path, rows in jobs:
+        size = write_csv(path, rows, specs, args.seed)
+        print(f"{path}: {rows} rows, {size / 1e6:.1f} MB", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
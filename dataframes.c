@@ -11,645 +11,15086 @@ Dataframes.c Copyright (C) 2023  Soumya Chakraborty
 *******************************************************************************/
 // Function prototypes
 #include <Python.h>
+#include <datetime.h>
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#include <limits.h>
+#include <locale.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+#endif
+
+// Every column buffer is aligned to a cache line so that single-column
+// scans are sequential and the compiler can vectorize them.
+#define COLUMN_ALIGNMENT 64
+
+// Row storage and string heaps grow geometrically from these sizes
+#define INITIAL_ROW_CAPACITY 16
+#define INITIAL_HEAP_CAPACITY 256
+
+// Element types a column can hold
+typedef enum {
+    DTYPE_INT64 = 0,
+    DTYPE_FLOAT64,
+    DTYPE_BOOL,
+    DTYPE_STRING,
+    DTYPE_DATETIME,
+    DTYPE_CATEGORY
+} DType;
+
+// Datetimes are int64 nanoseconds since 1970-01-01; this value is "not a time"
+#define DATETIME_NAT INT64_MIN
+
+// A column owns one contiguous buffer with room for the frame's capacity:
+//   DTYPE_INT64   -> int64_t[]
+//   DTYPE_FLOAT64 -> double[]   (missing values also hold NaN)
+//   DTYPE_BOOL    -> uint8_t[]
+//   DTYPE_STRING  -> int64_t[]  offsets into heap; row i spans
+//                                heap[offsets[i], offsets[i + 1])
+//   DTYPE_DATETIME -> int64_t[] nanoseconds since the epoch (missing values
+//                                also hold NaT)
+//   DTYPE_CATEGORY -> uint8_t[], uint16_t[] or uint32_t[] codes into the
+//                                column's dictionary of distinct strings
+// String bytes live back to back in a single heap that is not NUL-terminated.
+// Whether a row holds a value is recorded in a separate validity bitmap, one
+// bit per row (set means present), so the empty string is a value like any
+// other. Missing int64 and bool rows hold 0 and missing strings are empty.
+// Category codes start one byte wide and widen as the dictionary grows;
+// missing rows hold code 0.
+typedef struct CategoryDict CategoryDict;
 
 typedef struct {
-    char** data;
-} Row;
+    char* name;
+    DType dtype;
+    void* data;
+    char* heap;
+    size_t heap_size;
+    size_t heap_capacity;
+    uint64_t* validity;
+    int64_t null_count;     // cleared bits among the rows written so far
+    int code_width;         // category: bytes per code (1, 2 or 4)
+    CategoryDict* dict;     // category: the distinct values
+    int mapped;             // buffers borrowed rather than owned, as below
+} Column;
+
+// Values of Column.mapped for borrowed buffers. A column file's columns
+// point into its mapping; the columns of a view point into the DataFrame
+// it was sliced from, but own their validity, which cannot start mid-word.
+#define MAPPED_BUFFERS 1    // data, validity and heap are all borrowed
+#define MAPPED_VALUES 2     // data and heap are borrowed, validity is owned
+
+// The distinct values of a category column. Each code is a row of values;
+// a hash index over them finds the code of a string.
+struct CategoryDict {
+    Column values;          // string column, one row per code
+    int size;
+    int capacity;           // rows allocated in values
+    int* slots;             // hash index: a code, or -1 for an empty slot; NULL until needed
+    size_t num_slots;       // power of two, kept at least twice size
+    uint32_t* ranks;        // position of each code in sorted order; NULL until needed
+    int code_capacity;      // rows allocated in the owning column's codes
+};
 
 typedef struct {
-    Row* rows;
+    Column* columns;
     int num_rows;
     int num_cols;
-    char** headers;
+    int capacity;
+    int exports;    // live ColumnBuffer objects pointing into the column storage
+    struct MappedFile* mapping;  // file that mapped columns point into, or NULL
+    int readers;    // threads reading it with the GIL released
+    int writing;    // a thread is changing it with the GIL released
+    int views;      // live views sharing its column storage
+    PyObject* base; // view: capsule of the DataFrame whose storage it shares, or NULL
+    struct ColumnIndex* indexes;  // indexes over its columns in creation order, or NULL
 } DataFrame;
 
+#define STRING_OFFSETS(col) ((int64_t*)(col)->data)
+
 // Function declarations
+static PyObject* py_createDataFrame(PyObject* self, PyObject* args);
+static PyObject* py_freeDataFrame(PyObject* self, PyObject* args);
+static PyObject* py_addRow(PyObject* self, PyObject* args);
+static PyObject* py_append_rows(PyObject* self, PyObject* args);
+static PyObject* py_reserve(PyObject* self, PyObject* args);
+static PyObject* py_printDataFrame(PyObject* self, PyObject* args);
+static PyObject* py_loadCSV(PyObject* self, PyObject* args, PyObject* kwargs);
+static PyObject* py_read_csv_chunked(PyObject* self, PyObject* args, PyObject* kwargs);
+static PyObject* py_astype(PyObject* self, PyObject* args);
+static PyObject* py_save(PyObject* self, PyObject* args, PyObject* kwargs);
+static PyObject* py_open(PyObject* self, PyObject* args);
+static PyObject* py_schema(PyObject* self, PyObject* args);
 static PyObject* py_head(PyObject* self, PyObject* args);
 static PyObject* py_tail(PyObject* self, PyObject* args);
-static PyObject* py_sample(PyObject* self, PyObject* args);
+static PyObject* py_sample(PyObject* self, PyObject* args, PyObject* kwargs);
+static PyObject* py_iloc(PyObject* self, PyObject* args);
+static PyObject* py_copy(PyObject* self, PyObject* args);
+static PyObject* py_to_string(PyObject* self, PyObject* args, PyObject* kwargs);
 static PyObject* py_info(PyObject* self, PyObject* args);
+static PyObject* py_memory_usage(PyObject* self, PyObject* args, PyObject* kwargs);
 static PyObject* py_dtypes(PyObject* self, PyObject* args);
 static PyObject* py_shape(PyObject* self, PyObject* args);
 static PyObject* py_size(PyObject* self, PyObject* args);
 static PyObject* py_ndim(PyObject* self, PyObject* args);
-static PyObject* py_describe(PyObject* self, PyObject* args);
+static PyObject* py_describe(PyObject* self, PyObject* args, PyObject* kwargs);
 static PyObject* py_unique(PyObject* self, PyObject* args);
-static PyObject* py_nlargest(PyObject* self, PyObject* args);
-static PyObject* py_nsmallest(PyObject* self, PyObject* args);
-static PyObject* py_fillna(PyObject* self, PyObject* args);
-static PyObject* py_clip(PyObject* self, PyObject* args);
+static PyObject* py_isnull(PyObject* self, PyObject* args);
+static PyObject* py_isna(PyObject* self, PyObject* args);
+static PyObject* py_nlargest(PyObject* self, PyObject* args, PyObject* kwargs);
+static PyObject* py_nsmallest(PyObject* self, PyObject* args, PyObject* kwargs);
+static PyObject* py_fillna(PyObject* self, PyObject* args, PyObject* kwargs);
+static PyObject* py_clip(PyObject* self, PyObject* args, PyObject* kwargs);
 static PyObject* py_columns(PyObject* self, PyObject* args);
-static PyObject* py_sort_values(PyObject* self, PyObject* args);
-static PyObject* py_value_counts(PyObject* self, PyObject* args);
+static PyObject* py_column(PyObject* self, PyObject* args);
+static PyObject* py_categories(PyObject* self, PyObject* args);
+static PyObject* py_validity(PyObject* self, PyObject* args);
+static PyObject* py_sort_values(PyObject* self, PyObject* args, PyObject* kwargs);
+static PyObject* py_argsort(PyObject* self, PyObject* args, PyObject* kwargs);
+static PyObject* py_value_counts(PyObject* self, PyObject* args, PyObject* kwargs);
+static PyObject* py_filter(PyObject* self, PyObject* args);
+static PyObject* py_argfilter(PyObject* self, PyObject* args);
+static PyObject* py_create_index(PyObject* self, PyObject* args, PyObject* kwargs);
+static PyObject* py_drop_index(PyObject* self, PyObject* args, PyObject* kwargs);
+static PyObject* py_indexes(PyObject* self, PyObject* args);
+static PyObject* py_lookup(PyObject* self, PyObject* args, PyObject* kwargs);
+static PyObject* py_range(PyObject* self, PyObject* args, PyObject* kwargs);
+static PyObject* py_groupby(PyObject* self, PyObject* args, PyObject* kwargs);
+static PyObject* py_join(PyObject* self, PyObject* args, PyObject* kwargs);
+static PyObject* py_lazy(PyObject* self, PyObject* args);
+static PyObject* py_scan_csv(PyObject* self, PyObject* args, PyObject* kwargs);
+static PyObject* py_set_num_threads(PyObject* self, PyObject* args);
+static PyObject* py_get_num_threads(PyObject* self, PyObject* args);
+static PyObject* py_enable_stats(PyObject* self, PyObject* args);
+static PyObject* py_stats(PyObject* self, PyObject* args);
+static PyObject* py_reset_stats(PyObject* self, PyObject* args);
+static PyObject* py_start_trace(PyObject* self, PyObject* args);
+static PyObject* py_stop_trace(PyObject* self, PyObject* args);
 
 // Method definitions
 static PyMethodDef DataFrameMethods[] = {
-    {"head", py_head, METH_VARARGS, "Return the first n rows."},
-    {"tail", py_tail, METH_VARARGS, "Return the last n rows."},
-    {"sample", py_sample, METH_VARARGS, "Return a random sample of items."},
+    {"createDataFrame", py_createDataFrame, METH_VARARGS, "Create a DataFrame with the given number of rows and columns."},
+    {"freeDataFrame", py_freeDataFrame, METH_VARARGS,
+     "Free the memory held by a DataFrame now rather than with its last reference; it cannot be used afterwards."},
+    {"addRow", py_addRow, METH_VARARGS, "Append a row of string values to the DataFrame; None is a missing value."},
+    {"append_rows", py_append_rows, METH_VARARGS,
+     "append_rows(df, batch)\n"
+     "Append a batch of rows: a list of rows, a dict of columns by name (each a sequence or a 1-D buffer such as\n"
+     "array('q')), or a buffer of shape (rows, columns) of int64, doubles or bools; buffers may be strided. None is\n"
+     "missing and a str is parsed as addRow does; int64 columns also take ints, float64 numbers, bool bools and\n"
+     "datetime64[ns] datetimes, dates or nanoseconds. A batch that fails to convert appends nothing."},
+    {"reserve", py_reserve, METH_VARARGS,
+     "reserve(df, n)\n"
+     "Make room for n rows in all, so appending up to that many rows allocates nothing more."},
+    {"printDataFrame", py_printDataFrame, METH_VARARGS,
+     "Print the contents of the DataFrame, every row; to_string() gives a bounded rendering."},
+    {"loadCSV", (PyCFunction)(void(*)(void))py_loadCSV, METH_VARARGS | METH_KEYWORDS,
+     "loadCSV(filename, delimiter=',', header=True, quotechar='\"', categorical='auto')\n"
+     "Load a CSV file into a DataFrame, parsing it on all cores. String columns become category columns\n"
+     "always (True), never (False) or when they have at most one distinct value per 10 rows ('auto')."},
+    {"read_csv_chunked", (PyCFunction)(void(*)(void))py_read_csv_chunked, METH_VARARGS | METH_KEYWORDS,
+     "read_csv_chunked(path, chunksize, delimiter=',', header=True, quotechar='\"')\n"
+     "Return an iterator over a CSV file in DataFrames of chunksize rows, parsing the next one in the background.\n"
+     "A DataFrame's buffers are reused for a later batch once it is no longer referenced."},
+    {"save", (PyCFunction)(void(*)(void))py_save, METH_VARARGS | METH_KEYWORDS,
+     "save(df, path, stats=True)\n"
+     "Save a DataFrame as a binary columnar file, with per-column min/max statistics unless stats=False."},
+    {"open", py_open, METH_VARARGS,
+     "open(path)\n"
+     "Open a file written by save() as a DataFrame backed by a copy-on-write memory mapping of the file; the\n"
+     "file is unmapped once the DataFrame is freed."},
+    {"schema", py_schema, METH_VARARGS,
+     "schema(path)\n"
+     "Return the row count and per-column name, dtype, null count and min/max statistics of a saved file."},
+    {"astype", py_astype, METH_VARARGS,
+     "astype(df, column, dtype)\n"
+     "Cast a column (index or name) to int64, float64, bool, string, category or datetime64[ns]."},
+    {"head", py_head, METH_VARARGS,
+     "head(df, n=5)\n"
+     "Return a view of the first n rows (all but the last -n if n is negative). Views share df's storage\n"
+     "without copying it: df cannot be freed, grown or changed in place while they live, and a view is\n"
+     "copied the first time it is changed itself."},
+    {"tail", py_tail, METH_VARARGS,
+     "tail(df, n=5)\n"
+     "Return a view of the last n rows (all but the first -n if n is negative); see head()."},
+    {"sample", (PyCFunction)(void(*)(void))py_sample, METH_VARARGS | METH_KEYWORDS,
+     "sample(df, n=None, frac=None, replace=False, seed=None, weights=None, stratify_by=None)\n"
+     "Return a new DataFrame of n rows (1 if neither n nor frac is given) or frac of the rows, drawn at random\n"
+     "in random order; the same seed always draws the same sample. weights is a numeric column, a buffer of\n"
+     "doubles or a sequence with one non-negative weight per row (missing values count as 0). stratify_by is\n"
+     "a column or list of columns whose groups each get their share of the sample.\n"
+     "df may also be an iterable of DataFrames, e.g. read_csv_chunked(), sampled by n in one pass."},
+    {"iloc", py_iloc, METH_VARARGS,
+     "iloc(df, rows)\n"
+     "Select rows by position: an int or a slice with step 1 gives a view, as head() does; any other slice\n"
+     "or a sequence of ints gives a new DataFrame of those rows. Negative positions count from the end."},
+    {"copy", py_copy, METH_VARARGS,
+     "copy(df)\n"
+     "Return a new DataFrame holding a compact copy of df's rows, independent of any DataFrame df views."},
+    {"to_string", (PyCFunction)(void(*)(void))py_to_string, METH_VARARGS | METH_KEYWORDS,
+     "to_string(df, max_rows=20, max_colwidth=50)\n"
+     "Return df as an aligned table for display. Longer frames show their first and last rows around a\n"
+     "line of '...', and cells are cut to max_colwidth characters."},
     {"info", py_info, METH_VARARGS, "Print a concise summary of a DataFrame."},
+    {"memory_usage", (PyCFunction)(void(*)(void))py_memory_usage, METH_VARARGS | METH_KEYWORDS,
+     "memory_usage(df, deep=False)\n"
+     "Return a dict of the bytes each column's values, validity and string data take up. With deep=True,\n"
+     "count everything the column holds instead: spare capacity, its name and its category dictionary."},
     {"dtypes", py_dtypes, METH_VARARGS, "Return the dtypes in the DataFrame."},
     {"shape", py_shape, METH_VARARGS, "Return a tuple representing the dimensionality of the DataFrame."},
     {"size", py_size, METH_VARARGS, "Return an int representing the number of elements in the DataFrame."},
     {"ndim", py_ndim, METH_VARARGS, "Return an int representing the number of axes / array dimensions."},
-    {"describe", py_describe, METH_VARARGS, "Generate descriptive statistics."},
-    {"unique", py_unique, METH_VARARGS, "Return unique values."},
-    {"nlargest", py_nlargest, METH_VARARGS, "Return the first n rows ordered by columns in descending order."},
-    {"nsmallest", py_nsmallest, METH_VARARGS, "Return the first n rows ordered by columns in ascending order."},
-    {"fillna", py_fillna, METH_VARARGS, "Fill NA/NaN values using the specified method."},
-    {"clip", py_clip, METH_VARARGS, "Trim values at input threshold(s)."},
+    {"describe", (PyCFunction)(void(*)(void))py_describe, METH_VARARGS | METH_KEYWORDS,
+     "describe(df, exact=False)\n"
+     "Return a dict of descriptive statistics per column; quartiles are approximate unless exact=True.\n"
+     "df may also be an iterable of DataFrames, e.g. read_csv_chunked(), described in one bounded-memory pass."},
+    {"unique", py_unique, METH_VARARGS, "Return the unique values of a column in order of appearance."},
+    {"isnull", py_isnull, METH_VARARGS, "Detect missing values; returns a dict of per-column bytes masks."},
+    {"isna", py_isna, METH_VARARGS, "Detect missing values (alias of isnull)."},
+    {"nlargest", (PyCFunction)(void(*)(void))py_nlargest, METH_VARARGS | METH_KEYWORDS,
+     "nlargest(df, columns, n)\n"
+     "Return the first n rows ordered by columns in descending order, as (row_index, values...) tuples."},
+    {"nsmallest", (PyCFunction)(void(*)(void))py_nsmallest, METH_VARARGS | METH_KEYWORDS,
+     "nsmallest(df, columns, n)\n"
+     "Return the first n rows ordered by columns in ascending order, as (row_index, values...) tuples."},
+    {"fillna", (PyCFunction)(void(*)(void))py_fillna, METH_VARARGS | METH_KEYWORDS,
+     "fillna(df, value=None, method=None, limit=None, columns=None)\n"
+     "Fill missing values in place with value, or a dict of values by column, or by method: 'ffill' and 'bfill'\n"
+     "copy the last or next valid value to at most limit rows, 'interpolate' puts number and datetime values on\n"
+     "the line between the valid values around a gap. A value only fills columns it parses as the dtype of."},
+    {"clip", (PyCFunction)(void(*)(void))py_clip, METH_VARARGS | METH_KEYWORDS,
+     "clip(df, lower=None, upper=None, columns=None)\n"
+     "Trim values in place to [lower, upper]; a bound of None leaves that side open. Numbers and datetimes\n"
+     "are compared as such, strings lexicographically; missing values stay missing."},
     {"columns", py_columns, METH_VARARGS, "Return the column labels of the DataFrame."},
-    {"sort_values", py_sort_values, METH_VARARGS, "Sort by the values along either axis."},
-    {"value_counts", py_value_counts, METH_VARARGS, "Return a Series containing counts of unique values."},
+    {"column", py_column, METH_VARARGS,
+     "column(df, column)\n"
+     "Return a read-only buffer over a column's values for zero-copy use with numpy.asarray()."},
+    {"categories", py_categories, METH_VARARGS,
+     "categories(df, column)\n"
+     "Return the dictionary of a category column as a list of values indexed by code."},
+    {"validity", py_validity, METH_VARARGS,
+     "validity(df, column)\n"
+     "Return a read-only buffer over a column's validity bitmap (LSB first, set bits hold values)."},
+    {"sort_values", (PyCFunction)(void(*)(void))py_sort_values, METH_VARARGS | METH_KEYWORDS,
+     "sort_values(df, by, ascending=True, na_position='last')\n"
+     "Stable sort of the rows in place by one or more columns (index or name)."},
+    {"argsort", (PyCFunction)(void(*)(void))py_argsort, METH_VARARGS | METH_KEYWORDS,
+     "argsort(df, by, ascending=True, na_position='last')\n"
+     "Return the row permutation sort_values would apply, as an array('q')."},
+    {"value_counts", (PyCFunction)(void(*)(void))py_value_counts, METH_VARARGS | METH_KEYWORDS,
+     "value_counts(df, column, n=None, dropna=True)\n"
+     "Return a dict of the counts of unique values, most frequent first.\n"
+     "df may also be an iterable of DataFrames, e.g. read_csv_chunked(), counted together."},
+    {"filter", py_filter, METH_VARARGS,
+     "filter(df, predicate)\n"
+     "Return a new DataFrame with the rows matching predicate, e.g. ('and', ('a', '>', 3), ('b', 'in', ['x', 'y']))."},
+    {"argfilter", py_argfilter, METH_VARARGS,
+     "argfilter(df, predicate)\n"
+     "Return the row numbers filter would keep, as an array('q')."},
+    {"create_index", (PyCFunction)(void(*)(void))py_create_index, METH_VARARGS | METH_KEYWORDS,
+     "create_index(df, column, kind='sorted')\n"
+     "Index the non-missing values of a column. A 'sorted' index answers point and range lookups, a 'hash'\n"
+     "index point lookups only; filter, join and nlargest/nsmallest use them when they help. Appended rows\n"
+     "are indexed as they come, and changing the column in place drops its indexes."},
+    {"drop_index", (PyCFunction)(void(*)(void))py_drop_index, METH_VARARGS | METH_KEYWORDS,
+     "drop_index(df, column, kind=None)\n"
+     "Drop the index of a kind, or every index, over a column."},
+    {"indexes", py_indexes, METH_VARARGS,
+     "indexes(df)\n"
+     "Return a list of (column, kind) pairs, one per index of df, in creation order."},
+    {"lookup", (PyCFunction)(void(*)(void))py_lookup, METH_VARARGS | METH_KEYWORDS,
+     "lookup(df, column, value)\n"
+     "Return the rows whose column equals value, or any value of a list, as an array('q') in row order.\n"
+     "The column must have an index."},
+    {"range", (PyCFunction)(void(*)(void))py_range, METH_VARARGS | METH_KEYWORDS,
+     "range(df, column, lo=None, hi=None)\n"
+     "Return the rows whose column lies between lo and hi, both included, as an array('q') in order of value,\n"
+     "ties in row order. A bound of None is open. The column must have a sorted index."},
+    {"groupby", (PyCFunction)(void(*)(void))py_groupby, METH_VARARGS | METH_KEYWORDS,
+     "groupby(df, by, aggs, dropna=True)\n"
+     "Return a new DataFrame with one row per distinct key of the by columns, in order of first appearance,\n"
+     "and one column per aggregation, e.g. aggs={'x': ['sum', 'mean'], 'y': 'nunique'}.\n"
+     "Aggregations: count, sum, mean, min, max, first, last, nunique."},
+    {"join", (PyCFunction)(void(*)(void))py_join, METH_VARARGS | METH_KEYWORDS,
+     "join(left, right, on, how='inner', rsuffix='_right')\n"
+     "Return a new DataFrame joining right onto left where the on columns are equal; how is 'inner', 'left',\n"
+     "'semi' or 'anti'. Rows keep left order and missing keys never match."},
+    {"lazy", py_lazy, METH_VARARGS,
+     "lazy(df)\n"
+     "Return a LazyFrame recording select, filter, sort_values, head, fillna and clip over df. collect()\n"
+     "optimizes the whole query, pushing filters and heads down, turning sort+head into a top-k and fusing\n"
+     "fillna and clip into one pass; explain() shows the optimized plan."},
+    {"scan_csv", (PyCFunction)(void(*)(void))py_scan_csv, METH_VARARGS | METH_KEYWORDS,
+     "scan_csv(path, delimiter=',', header=True, quotechar='\"', categorical='auto')\n"
+     "Return a LazyFrame over a CSV file, as lazy() does for a DataFrame. Only the columns the query\n"
+     "reads are parsed."},
+    {"set_num_threads", py_set_num_threads, METH_VARARGS,
+     "set_num_threads(n)\n"
+     "Set the number of threads loading, sorting, filtering, grouping and joining may use (default: all cores).\n"
+     "These operations release the GIL, so other Python threads keep running meanwhile."},
+    {"get_num_threads", py_get_num_threads, METH_NOARGS,
+     "get_num_threads()\n"
+     "Return the number of threads parallel operations may use."},
+    {"enable_stats", py_enable_stats, METH_VARARGS,
+     "enable_stats(on=True)\n"
+     "Start or stop counting calls, rows, time, allocated bytes and threads per operation; see stats().\n"
+     "Off by default, when operations only pay one check each."},
+    {"stats", py_stats, METH_NOARGS,
+     "stats()\n"
+     "Return a dict of the operations run while stats or a trace were on, each a dict of calls, rows,\n"
+     "seconds, bytes_allocated (column storage) and max_threads."},
+    {"reset_stats", py_reset_stats, METH_NOARGS,
+     "reset_stats()\n"
+     "Zero the counters stats() returns."},
+    {"start_trace", py_start_trace, METH_NOARGS,
+     "start_trace()\n"
+     "Start recording every operation as a span for stop_trace(); counters are kept meanwhile."},
+    {"stop_trace", py_stop_trace, METH_VARARGS,
+     "stop_trace(path)\n"
+     "Stop recording and write the spans to path as Chrome trace-event JSON, to open in chrome://tracing\n"
+     "or Perfetto. Returns the number of spans written."},
     {NULL, NULL, 0, NULL}  // Sentinel
 };
 
-// Function to dynamically allocate a DataFrame structure
-static DataFrame* createDataFrame(int num_rows, int num_cols) {
-    DataFrame* df = (DataFrame*)malloc(sizeof(DataFrame));
-    df->rows = (Row*)malloc(num_rows * sizeof(Row));
-    df->headers = (char**)malloc(num_cols * sizeof(char*));
-    for (int i = 0; i < num_cols; i++) {
-        df->headers[i] = (char*)malloc(256 * sizeof(char)); // Assuming max header size
-    }
-    for (int i = 0; i < num_rows; i++) {
-        df->rows[i].data = (char**)malloc(num_cols * sizeof(char*));
-        for (int j = 0; j < num_cols; j++) {
-            df->rows[i].data[j] = (char*)malloc(256 * sizeof(char)); // Assuming max field size
-            df->rows[i].data[j][0] = '\0'; // Initialize each string to empty
-        }
+static void countAllocation(size_t bytes);
+
+// Function to allocate a buffer aligned to COLUMN_ALIGNMENT
+static void* alignedAlloc(size_t size) {
+    if (size == 0) size = 1;
+    countAllocation(size);
+#ifdef _WIN32
+    return _aligned_malloc(size, COLUMN_ALIGNMENT);
+#else
+    void* ptr = NULL;
+    if (posix_memalign(&ptr, COLUMN_ALIGNMENT, size) != 0) {
+        return NULL;
     }
-    df->num_rows = num_rows;
-    df->num_cols = num_cols;
-    return df;
+    return ptr;
+#endif
 }
 
-// Function to free memory allocated to DataFrame structure
-static void freeDataFrame(DataFrame* df) {
-    for (int i = 0; i < df->num_cols; i++) {
-        free(df->headers[i]);
+// Function to release a buffer obtained from alignedAlloc
+static void alignedFree(void* ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+// Function to resize an aligned buffer, preserving its first min(old, new) bytes
+static void* alignedRealloc(void* ptr, size_t old_size, size_t new_size) {
+    void* fresh = alignedAlloc(new_size);
+    if (!fresh) {
+        return NULL;
     }
-    free(df->headers);
-    for (int i = 0; i < df->num_rows; i++) {
-        for (int j = 0; j < df->num_cols; j++) {
-            free(df->rows[i].data[j]);
-        }
-        free(df->rows[i].data);
+    if (ptr) {
+        memcpy(fresh, ptr, old_size < new_size ? old_size : new_size);
+        alignedFree(ptr);
     }
-    free(df->rows);
-    free(df);
+    return fresh;
 }
 
-// Function to add a row of values to the DataFrame
-static void addRow(DataFrame* df, char** values) {
-    df->rows = (Row*)realloc(df->rows, (df->num_rows + 1) * sizeof(Row));
-    df->rows[df->num_rows].data = (char**)malloc(df->num_cols * sizeof(char*));
-    for (int i = 0; i < df->num_cols; i++) {
-        df->rows[df->num_rows].data[i] = (char*)malloc((strlen(values[i]) + 1) * sizeof(char));
-        strcpy(df->rows[df->num_rows].data[i], values[i]);
-    }
-    df->num_rows++;
+// Function to get the number of hardware threads available to the process
+static int getNumCPUs(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
 }
 
-// Function to print the contents of the DataFrame
-static void printDataFrame(DataFrame* df) {
-    for (int i = 0; i < df->num_cols; i++) {
-        printf("%s\t", df->headers[i]);
-    }
-    printf("\n");
-    for (int i = 0; i < df->num_rows; i++) {
-        for (int j = 0; j < df->num_cols; j++) {
-            printf("%s\t", df->rows[i].data[j]);
-        }
-        printf("\n");
-    }
+// Mutexes and condition variables of the platform's thread library
+#ifdef _WIN32
+typedef SRWLOCK Mutex;
+typedef CONDITION_VARIABLE Condition;
+#define MUTEX_INITIALIZER SRWLOCK_INIT
+#define CONDITION_INITIALIZER CONDITION_VARIABLE_INIT
+static void lockMutex(Mutex* mutex) { AcquireSRWLockExclusive(mutex); }
+static void unlockMutex(Mutex* mutex) { ReleaseSRWLockExclusive(mutex); }
+static void waitCondition(Condition* cond, Mutex* mutex) { SleepConditionVariableSRW(cond, mutex, INFINITE, 0); }
+static void wakeAll(Condition* cond) { WakeAllConditionVariable(cond); }
+#else
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Condition;
+#define MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define CONDITION_INITIALIZER PTHREAD_COND_INITIALIZER
+static void lockMutex(Mutex* mutex) { pthread_mutex_lock(mutex); }
+static void unlockMutex(Mutex* mutex) { pthread_mutex_unlock(mutex); }
+static void waitCondition(Condition* cond, Mutex* mutex) { pthread_cond_wait(cond, mutex); }
+static void wakeAll(Condition* cond) { pthread_cond_broadcast(cond); }
+#endif
+
+// Function to atomically add delta to *value, returning the old value
+static int fetchAdd(volatile int* value, int delta) {
+#ifdef _MSC_VER
+    return (int)_InterlockedExchangeAdd((volatile long*)value, delta);
+#else
+    return __atomic_fetch_add(value, delta, __ATOMIC_RELAXED);
+#endif
 }
 
-// Function to load data from a CSV file into a DataFrame
-static DataFrame* loadCSV(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        perror("Error opening file");
-        return NULL;
-    }
+// Function to atomically add delta to a 64-bit *value, returning the old value
+static int64_t fetchAdd64(volatile int64_t* value, int64_t delta) {
+#ifdef _MSC_VER
+    return (int64_t)_InterlockedExchangeAdd64((volatile __int64*)value, delta);
+#else
+    return __atomic_fetch_add(value, delta, __ATOMIC_RELAXED);
+#endif
+}
 
-    char line[4096]; // Buffer for reading each line of the file
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
 
-    // Read the header line to determine number of columns
-    if (!fgets(line, sizeof(line), file)) {
-        perror("Error reading header");
-        fclose(file);
-        return NULL;
-    }
+// Function to read a monotonic clock in nanoseconds
+static int64_t monotonicNanos(void) {
+#ifdef _WIN32
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (int64_t)((double)now.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
 
-    int num_cols = 0;
-    char* token = strtok(line, ",");
-    while (token) {
-        num_cols++;
-        token = strtok(NULL, ",");
-    }
+// Kernels whose calls are counted and timed while profiling is on
+typedef enum {
+    KERNEL_LOAD_CSV,
+    KERNEL_READ_CSV_BATCH,
+    KERNEL_ADD_ROW,
+    KERNEL_CAST,
+    KERNEL_SORT,
+    KERNEL_TOP_K,
+    KERNEL_FILTER,
+    KERNEL_TAKE,
+    KERNEL_VALUE_COUNTS,
+    KERNEL_DESCRIBE,
+    KERNEL_ELEMENTWISE,
+    KERNEL_GROUPBY,
+    KERNEL_JOIN,
+    KERNEL_SAVE,
+    KERNEL_OPEN,
+    KERNEL_SAMPLE,
+    KERNEL_CREATE_INDEX,
+    KERNEL_INDEX_LOOKUP,
+    KERNEL_APPEND_ROWS,
+    NUM_KERNELS
+} Kernel;
 
-    // Create a DataFrame with 0 rows and determined number of columns
-    DataFrame* df = createDataFrame(0, num_cols);
+static const char* const kernel_names[NUM_KERNELS] = {
+    "load_csv", "read_csv_batch", "add_row", "astype", "sort", "top_k", "filter", "take",
+    "value_counts", "describe", "fillna_clip", "groupby", "join", "save", "open",
+    "sample", "create_index", "index_lookup", "append_rows"
+};
 
-    // Rewind the file pointer to read from the beginning
-    rewind(file);
+// What profiling records, as bits of profiling.mode
+#define PROFILE_STATS 1     // per-kernel counters
+#define PROFILE_TRACE 2     // one event per kernel call, for a Chrome trace
 
-    // Read and discard the header line
-    fgets(line, sizeof(line), file);
+// Totals of one kernel since the last reset
+typedef struct {
+    int64_t calls;
+    int64_t rows;
+    int64_t nanoseconds;
+    int64_t allocated;      // bytes of column storage allocated during its calls
+    int max_threads;        // most pool threads one call used
+} KernelStats;
 
-    // Read each subsequent line as data rows
-    while (fgets(line, sizeof(line), file)) {
-        // Remove newline character if present
-        line[strcspn(line, "\n")] = 0;
+// One kernel call, as recorded for the trace
+typedef struct {
+    Kernel kernel;
+    int thread;             // small id of the calling thread
+    int threads;
+    int64_t start;          // nanoseconds since the trace started
+    int64_t duration;
+    int64_t rows;
+    int64_t allocated;
+} TraceEvent;
 
-        // Parse line into values based on comma delimiter
-        char** values = (char**)malloc(num_cols * sizeof(char*));
-        int col_idx = 0;
-        token = strtok(line, ",");
-        while (token) {
-            values[col_idx] = (char*)malloc((strlen(token) + 1) * sizeof(char));
-            strcpy(values[col_idx], token);
-            token = strtok(NULL, ",");
-            col_idx++;
-        }
+// Bounds the memory a forgotten trace can take; later calls are dropped
+#define MAX_TRACE_EVENTS (1 << 20)
 
-        // Add parsed values as a new row to the DataFrame
-        addRow(df, values);
+// Counters and trace shared by every thread. With mode 0 a kernel call only
+// tests mode once on entry, so the instrumentation costs next to nothing.
+static struct {
+    Mutex mutex;            // guards everything below except mode and allocated
+    volatile int mode;
+    volatile int64_t allocated;  // bytes of column storage allocated while profiling
+    KernelStats kernels[NUM_KERNELS];
+    TraceEvent* events;
+    size_t num_events;
+    size_t event_capacity;
+    int64_t dropped_events;
+    int64_t trace_start;
+    int num_threads_seen;
+} profiling = {MUTEX_INITIALIZER, 0, 0};
 
-        // Free memory allocated for values array
-        for (int i = 0; i < num_cols; i++) {
-            free(values[i]);
-        }
-        free(values);
-    }
+// A kernel call in progress on this thread. Spans nest: a kernel calling
+// another is timed both as itself and as part of the outer call. Only calls
+// begun while profiling is on are pushed onto current_span.
+typedef struct KernelSpan {
+    Kernel kernel;
+    int64_t start;
+    int64_t allocated;
+    int threads;
+    struct KernelSpan* outer;
+} KernelSpan;
 
-    fclose(file);
-    return df;
-}
+static THREAD_LOCAL KernelSpan* current_span;
+static THREAD_LOCAL int trace_thread_id;
 
-// Function to create a DataFrame object from Python
-static PyObject* py_createDataFrame(PyObject* self, PyObject* args) {
-    int num_rows, num_cols;
-    if (!PyArg_ParseTuple(args, "ii", &num_rows, &num_cols)) {
-        return NULL;
+// Function to count bytes of column storage as allocated by the kernels
+// running now
+static void countAllocation(size_t bytes) {
+    if (profiling.mode) {
+        fetchAdd64(&profiling.allocated, (int64_t)bytes);
     }
-    DataFrame* df = createDataFrame(num_rows, num_cols);
-    return PyCapsule_New((void*)df, "DataFrame", NULL);
 }
 
-// Function to free memory allocated to a DataFrame object
-static PyObject* py_freeDataFrame(PyObject* self, PyObject* args) {
-    PyObject* capsule;
-    if (!PyArg_ParseTuple(args, "O", &capsule)) {
-        return NULL;
+// Function to start timing a kernel call on this thread
+static void beginKernel(KernelSpan* span, Kernel kernel) {
+    span->kernel = kernel;
+    if (!profiling.mode) {
+        return;
     }
-    DataFrame* df = (DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame");
-    freeDataFrame(df);
-    Py_RETURN_NONE;
+    span->start = monotonicNanos();
+    span->allocated = fetchAdd64(&profiling.allocated, 0);
+    span->threads = 1;
+    span->outer = current_span;
+    current_span = span;
 }
 
-// Function to add a row of data to a DataFrame object from Python
-static PyObject* py_addRow(PyObject* self, PyObject* args) {
-    PyObject* capsule;
-    PyObject* values;
-    if (!PyArg_ParseTuple(args, "OO", &capsule, &values)) {
-        return NULL;
+// Function to note that the kernel running on this thread spread its work
+// over num_threads threads
+static void noteKernelThreads(int num_threads) {
+    if (current_span && num_threads > current_span->threads) {
+        current_span->threads = num_threads;
     }
+}
 
-    DataFrame* df = (DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame");
-    if (!PyList_Check(values)) {
-        PyErr_SetString(PyExc_TypeError, "Values must be a list");
-        return NULL;
+// Function to finish timing a kernel call that processed rows rows and
+// add it to the counters and the trace
+static void endKernel(KernelSpan* span, int64_t rows) {
+    if (current_span != span) {
+        return;
     }
-
-    int num_cols = (int)PyList_Size(values);
-    char** c_values = (char**)malloc(num_cols * sizeof(char*));
-    for (int i = 0; i < num_cols; i++) {
-        PyObject* item = PyList_GetItem(values, i);
-        if (!PyUnicode_Check(item)) {
-            PyErr_SetString(PyExc_TypeError, "List items must be strings");
-            free(c_values);
-            return NULL;
+    int64_t duration = monotonicNanos() - span->start;
+    int64_t allocated = fetchAdd64(&profiling.allocated, 0) - span->allocated;
+    current_span = span->outer;
+    if (current_span && span->threads > current_span->threads) {
+        current_span->threads = span->threads;
+    }
+    lockMutex(&profiling.mutex);
+    KernelStats* stats = &profiling.kernels[span->kernel];
+    stats->calls++;
+    stats->rows += rows;
+    stats->nanoseconds += duration;
+    stats->allocated += allocated;
+    if (span->threads > stats->max_threads) {
+        stats->max_threads = span->threads;
+    }
+    if (profiling.mode & PROFILE_TRACE) {
+        if (profiling.num_events == profiling.event_capacity && profiling.num_events < MAX_TRACE_EVENTS) {
+            size_t capacity = profiling.event_capacity ? profiling.event_capacity * 2 : 1024;
+            TraceEvent* events = (TraceEvent*)realloc(profiling.events, capacity * sizeof(TraceEvent));
+            if (events) {
+                profiling.events = events;
+                profiling.event_capacity = capacity;
+            }
+        }
+        if (profiling.num_events < profiling.event_capacity) {
+            if (!trace_thread_id) {
+                trace_thread_id = ++profiling.num_threads_seen;
+            }
+            TraceEvent* event = &profiling.events[profiling.num_events++];
+            event->kernel = span->kernel;
+            event->thread = trace_thread_id;
+            event->threads = span->threads;
+            event->start = span->start - profiling.trace_start;
+            event->duration = duration;
+            event->rows = rows;
+            event->allocated = allocated;
+        } else {
+            profiling.dropped_events++;
         }
-        c_values[i] = (char*)PyUnicode_AsUTF8(item);
     }
-
-    addRow(df, c_values);
-    free(c_values);
-    Py_RETURN_NONE;
+    unlockMutex(&profiling.mutex);
 }
 
-// Function to print the contents of a DataFrame object from Python
-static PyObject* py_printDataFrame(PyObject* self, PyObject* args) {
-    PyObject* capsule;
-    if (!PyArg_ParseTuple(args, "O", &capsule)) {
-        return NULL;
-    }
-    DataFrame* df = (DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame");
-    printDataFrame(df);
-    Py_RETURN_NONE;
+#ifndef _WIN32
+// Function to reinitialise the profiling mutex in a forked child, in case
+// the fork came while another thread was recording a kernel call
+static void resetProfilingAfterFork(void) {
+    pthread_mutex_init(&profiling.mutex, NULL);
 }
+#endif
 
-// Function to load data from a CSV file into a DataFrame object from Python
-static PyObject* py_loadCSV(PyObject* self, PyObject* args) {
-    const char* filename;
-    if (!PyArg_ParseTuple(args, "s", &filename)) {
-        return NULL;
-    }
-    DataFrame* df = loadCSV(filename);
-    if (!df) {
-        return NULL;
-    }
-    return PyCapsule_New((void*)df, "DataFrame", NULL);
+// Work function run by parallelFor once per task index
+typedef void (*ParallelTask)(void* ctx, int task);
+
+// A contiguous range of a job's tasks. Its owner and any thief both claim
+// tasks from the front with an atomic increment, so a task runs exactly
+// once. Ranges sit on their own cache lines.
+typedef struct {
+    volatile int next;
+    int end;
+    char padding[64 - 2 * sizeof(int)];
+} TaskRange;
+
+// One parallelFor call in flight. Each participant claims a range of its
+// own, runs it, then steals what is left of the others.
+typedef struct ParallelJob {
+    ParallelTask fn;
+    void* ctx;
+    TaskRange* ranges;
+    int num_ranges;
+    int claimed;                // ranges handed out so far
+    int active;                 // participants still running tasks
+    struct ParallelJob* next;   // next job waiting for participants
+} ParallelJob;
+
+// Persistent worker threads shared by every parallelFor call, from any
+// Python thread and from tasks that start parallel work of their own.
+// Workers sleep on a condition variable between jobs. The pool only grows;
+// parallelFor never hands a job more ranges than the configured number of
+// threads, so surplus workers stay asleep.
+static struct {
+    Mutex mutex;
+    Condition posted;           // a job is waiting for participants
+    Condition finished;         // a participant has left its job
+    ParallelJob* waiting;       // jobs with unclaimed ranges, oldest first
+    int num_workers;
+    int num_threads;            // threads a job may use, including its caller
+} pool = {MUTEX_INITIALIZER, CONDITION_INITIALIZER, CONDITION_INITIALIZER, NULL, 0, 0};
+
+// Function to get the number of threads parallel work is spread over; the
+// hardware concurrency unless set_num_threads chose otherwise
+static int getNumThreads(void) {
+    return pool.num_threads > 0 ? pool.num_threads : 1;
 }
 
-// Function to get the head (top n rows) of a DataFrame object from Python
-static PyObject* py_head(PyObject* self, PyObject* args) {
-    PyObject* capsule;
-    int n = 5; // Default to 5 rows if n is not provided
-    if (!PyArg_ParseTuple(args, "O|i", &capsule, &n)) {
-        return NULL;
+// Function to run the tasks of a job as one participant: first range
+// first, then what is left of every other range
+static void runParallelJob(ParallelJob* job, int first) {
+    for (int k = 0; k < job->num_ranges; k++) {
+        TaskRange* range = &job->ranges[(first + k) % job->num_ranges];
+        for (int task; (task = fetchAdd(&range->next, 1)) < range->end;) {
+            job->fn(job->ctx, task);
+        }
     }
-    DataFrame* df = (DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame");
+}
 
-    // Print headers
-    for (int i = 0; i < df->num_cols; i++) {
-        printf("%s\t", df->headers[i]);
+// Function to take a job off the waiting list (pool mutex held)
+static void unlistParallelJob(ParallelJob* job) {
+    for (ParallelJob** link = &pool.waiting; *link; link = &(*link)->next) {
+        if (*link == job) {
+            *link = job->next;
+            return;
+        }
     }
-    printf("\n");
+}
 
-    // Print first n rows
-    for (int i = 0; i < df->num_rows && i < n; i++) {
-        for (int j = 0; j < df->num_cols; j++) {
-            printf("%s\t", df->rows[i].data[j]);
+// Function run by each worker thread of the pool: join the oldest waiting
+// job, claim a range of it, and help until no task is left
+static void poolWorkerLoop(void) {
+    lockMutex(&pool.mutex);
+    for (;;) {
+        while (!pool.waiting) {
+            waitCondition(&pool.posted, &pool.mutex);
+        }
+        ParallelJob* job = pool.waiting;
+        int range = job->claimed++;
+        job->active++;
+        if (job->claimed == job->num_ranges) {
+            unlistParallelJob(job);
+        }
+        unlockMutex(&pool.mutex);
+        runParallelJob(job, range);
+        lockMutex(&pool.mutex);
+        if (--job->active == 0) {
+            wakeAll(&pool.finished);
         }
-        printf("\n");
     }
-    Py_RETURN_NONE;
 }
 
-// Function to get the tail (bottom n rows) of a DataFrame object from Python
-static PyObject* py_tail(PyObject* self, PyObject* args) {
-    PyObject* capsule;
-    int n = 5; // Default to 5 rows if n is not provided
-    if (!PyArg_ParseTuple(args, "O|i", &capsule, &n)) {
-        return NULL;
-    }
-    DataFrame* df = (DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame");
+#ifdef _WIN32
+static DWORD WINAPI poolThreadMain(LPVOID arg) {
+    poolWorkerLoop();
+    return 0;
+}
+#else
+static void* poolThreadMain(void* arg) {
+    poolWorkerLoop();
+    return NULL;
+}
 
-    // Print headers
-    for (int i = 0; i < df->num_cols; i++) {
-        printf("%s\t", df->headers[i]);
-    }
-    printf("\n");
+// Function to forget the pool's threads in a forked child, where they do
+// not exist, so the child starts its own
+static void resetPoolAfterFork(void) {
+    pthread_mutex_init(&pool.mutex, NULL);
+    pthread_cond_init(&pool.posted, NULL);
+    pthread_cond_init(&pool.finished, NULL);
+    pool.waiting = NULL;
+    pool.num_workers = 0;
+}
+#endif
 
-    // Print last n rows
-    int start_row = df->num_rows - n;
-    if (start_row < 0) start_row = 0;
-    for (int i = start_row; i < df->num_rows; i++) {
-        for (int j = 0; j < df->num_cols; j++) {
-            printf("%s\t", df->rows[i].data[j]);
+// Function to start workers until the pool has num_workers of them (pool
+// mutex held). A worker that fails to start is simply not there: jobs
+// finish with the threads they get.
+static void growPool(int num_workers) {
+    while (pool.num_workers < num_workers) {
+#ifdef _WIN32
+        HANDLE thread = CreateThread(NULL, 0, poolThreadMain, NULL, 0, NULL);
+        if (!thread) {
+            return;
         }
-        printf("\n");
+        CloseHandle(thread);
+#else
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, poolThreadMain, NULL) != 0) {
+            return;
+        }
+        pthread_detach(thread);
+#endif
+        pool.num_workers++;
     }
-    Py_RETURN_NONE;
 }
 
-// Function to sample a random row from a DataFrame object from Python
-static PyObject* py_sample(PyObject* self, PyObject* args) {
-    PyObject* capsule;
-    if (!PyArg_ParseTuple(args, "O", &capsule)) {
-        return NULL;
+// Function to run fn(ctx, 0) .. fn(ctx, num_tasks - 1) on up to num_threads
+// threads of the pool; the calling thread takes a share of the tasks
+// itself and returns once every task has run. Tasks are split into one
+// contiguous range per thread and threads that run out of work steal from
+// the others, so uneven tasks balance out. Tasks must not touch Python
+// objects; they may call parallelFor themselves.
+static void parallelFor(int num_tasks, int num_threads, ParallelTask fn, void* ctx) {
+    if (num_threads > getNumThreads()) num_threads = getNumThreads();
+    if (num_threads > num_tasks) num_threads = num_tasks;
+    TaskRange* ranges = num_threads > 1 ? (TaskRange*)malloc(num_threads * sizeof(TaskRange)) : NULL;
+    if (!ranges) {
+        for (int task = 0; task < num_tasks; task++) {
+            fn(ctx, task);
+        }
+        return;
     }
-    DataFrame* df = (DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame");
+    noteKernelThreads(num_threads);
+    for (int r = 0; r < num_threads; r++) {
+        ranges[r].next = (int)((int64_t)num_tasks * r / num_threads);
+        ranges[r].end = (int)((int64_t)num_tasks * (r + 1) / num_threads);
+    }
+    ParallelJob job;
+    job.fn = fn;
+    job.ctx = ctx;
+    job.ranges = ranges;
+    job.num_ranges = num_threads;
+    job.claimed = 1;
+    job.active = 1;
+    job.next = NULL;
+    lockMutex(&pool.mutex);
+    growPool(num_threads - 1);
+    ParallelJob** tail = &pool.waiting;
+    while (*tail) tail = &(*tail)->next;
+    *tail = &job;
+    wakeAll(&pool.posted);
+    unlockMutex(&pool.mutex);
 
-    // Generate a random index within the range of rows
-    int random_index = rand() % df->num_rows;
+    runParallelJob(&job, 0);
 
-    // Print headers
-    for (int i = 0; i < df->num_cols; i++) {
-        printf("%s\t", df->headers[i]);
+    // Every task has been claimed by now; wait for those still running
+    lockMutex(&pool.mutex);
+    if (job.claimed < job.num_ranges) {
+        unlistParallelJob(&job);
     }
-    printf("\n");
-
-    // Print the randomly selected row
-    for (int j = 0; j < df->num_cols; j++) {
-        printf("%s\t", df->rows[random_index].data[j]);
+    job.active--;
+    while (job.active > 0) {
+        waitCondition(&pool.finished, &pool.mutex);
     }
-    printf("\n");
-
-    Py_RETURN_NONE;
+    unlockMutex(&pool.mutex);
+    free(ranges);
 }
 
-// Function to provide information summary of a DataFrame object from Python
-static PyObject* py_info(PyObject* self, PyObject* args) {
-    PyObject* capsule;
-    if (!PyArg_ParseTuple(args, "O", &capsule)) {
-        return NULL;
-    }
-    DataFrame* df = (DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame");
+// A view of a whole file mapped into memory: read-only, or copy-on-write
+// so that writes stay private to the process
+typedef struct MappedFile {
+    const char* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} MappedFile;
 
-    // Print summary information
-    printf("Data columns (total %d columns):\n", df->num_cols);
-    for (int i = 0; i < df->num_cols; i++) {
-        printf("%s\t", df->headers[i]);
+// Function to map a file into memory, returns -1 with errno set on failure.
+// Empty files are reported as a zero-length mapping with no data.
+static int mapFile(const char* filename, int copy_on_write, MappedFile* map) {
+    map->data = NULL;
+    map->size = 0;
+#ifdef _WIN32
+    map->mapping = NULL;
+    map->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (map->file == INVALID_HANDLE_VALUE) {
+        errno = ENOENT;
+        return -1;
     }
-    printf("\n");
-    printf("Data types:\n");
-    for (int i = 0; i < df->num_cols; i++) {
-        printf("%s\t", "string"); // Assuming all columns are string type for simplicity
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(map->file, &size)) {
+        CloseHandle(map->file);
+        errno = EIO;
+        return -1;
     }
-    printf("\n");
-    printf("Memory usage: %d bytes\n", (int)(sizeof(DataFrame) + df->num_rows * sizeof(Row) + df->num_cols * sizeof(char*)));
-    printf("Total rows: %d\n", df->num_rows);
-    printf("Missing values: 0\n"); // No support for missing values in this basic implementation
-
-    Py_RETURN_NONE;
-}
-
-// Function to get data types of columns in a DataFrame object from Python
-static PyObject* py_dtypes(PyObject* self, PyObject* args) {
-    PyObject* capsule;
-    if (!PyArg_ParseTuple(args, "O", &capsule)) {
-        return NULL;
+    map->size = (size_t)size.QuadPart;
+    if (map->size == 0) {
+        return 0;
     }
-    DataFrame* df = (DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame");
-
-    // Prepare a Python list to hold data types
-    PyObject* dtype_list = PyList_New(df->num_cols);
-    if (!dtype_list) {
-        return NULL;
+    map->mapping = CreateFileMappingA(map->file, NULL, copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+    if (map->mapping) {
+        map->data = (const char*)MapViewOfFile(map->mapping, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
     }
-
-    // Add data types (assuming all columns are string for simplicity)
-    for (int i = 0; i < df->num_cols; i++) {
-        PyList_SetItem(dtype_list, i, PyUnicode_FromString("string"));
+    if (!map->data) {
+        if (map->mapping) CloseHandle(map->mapping);
+        CloseHandle(map->file);
+        errno = ENOMEM;
+        return -1;
+    }
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return -1;
     }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    map->size = (size_t)st.st_size;
+    if (map->size == 0) {
+        close(fd);
+        return 0;
+    }
+    void* data = mmap(NULL, map->size, copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+#ifdef MADV_SEQUENTIAL
+    if (!copy_on_write) {
+        madvise(data, map->size, MADV_SEQUENTIAL);
+    }
+#endif
+    map->data = (const char*)data;
+#endif
+    return 0;
+}
 
-    return dtype_list;
+// Function to release a mapping made by mapFile
+static void unmapFile(MappedFile* map) {
+#ifdef _WIN32
+    if (map->data) UnmapViewOfFile(map->data);
+    if (map->mapping) CloseHandle(map->mapping);
+    if (map->file != INVALID_HANDLE_VALUE) CloseHandle(map->file);
+#else
+    if (map->data) munmap((void*)map->data, map->size);
+#endif
+    map->data = NULL;
+    map->size = 0;
 }
 
-// Function to get shape (dimensions) of a DataFrame object from Python
-static PyObject* py_shape(PyObject* self, PyObject* args) {
-    PyObject* capsule;
-    if (!PyArg_ParseTuple(args, "O", &capsule)) {
-        return NULL;
+// Function to duplicate a NUL-terminated string
+static char* copyString(const char* text) {
+    size_t len = strlen(text);
+    char* copy = (char*)malloc(len + 1);
+    if (copy) {
+        memcpy(copy, text, len + 1);
     }
-    DataFrame* df = (DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame");
+    return copy;
+}
 
-    // Create a tuple of (num_rows, num_cols)
-    PyObject* shape_tuple = PyTuple_New(2);
-    if (!shape_tuple) {
-        return NULL;
+// Function to get the user-facing name of a dtype
+static const char* dtypeName(DType dtype) {
+    switch (dtype) {
+        case DTYPE_INT64: return "int64";
+        case DTYPE_FLOAT64: return "float64";
+        case DTYPE_BOOL: return "bool";
+        case DTYPE_STRING: return "string";
+        case DTYPE_DATETIME: return "datetime64[ns]";
+        case DTYPE_CATEGORY: return "category";
     }
-    PyTuple_SetItem(shape_tuple, 0, PyLong_FromLong(df->num_rows));
-    PyTuple_SetItem(shape_tuple, 1, PyLong_FromLong(df->num_cols));
-
-    return shape_tuple;
+    return "unknown";
 }
 
-// Function to get size (total number of elements) of a DataFrame object from Python
-static PyObject* py_size(PyObject* self, PyObject* args) {
-    PyObject* capsule;
-    if (!PyArg_ParseTuple(args, "O", &capsule)) {
-        return NULL;
+// Function to parse a dtype name, returns -1 if the name is unknown
+static int parseDType(const char* name, DType* dtype) {
+    if (strcmp(name, "int64") == 0 || strcmp(name, "int") == 0) {
+        *dtype = DTYPE_INT64;
+    } else if (strcmp(name, "float64") == 0 || strcmp(name, "float") == 0) {
+        *dtype = DTYPE_FLOAT64;
+    } else if (strcmp(name, "bool") == 0) {
+        *dtype = DTYPE_BOOL;
+    } else if (strcmp(name, "string") == 0 || strcmp(name, "str") == 0) {
+        *dtype = DTYPE_STRING;
+    } else if (strcmp(name, "datetime64[ns]") == 0 || strcmp(name, "datetime") == 0) {
+        *dtype = DTYPE_DATETIME;
+    } else if (strcmp(name, "category") == 0) {
+        *dtype = DTYPE_CATEGORY;
+    } else {
+        return -1;
     }
-    DataFrame* df = (DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame");
-
-    // Return number of rows times number of columns
-    return PyLong_FromLong(df->num_rows * df->num_cols);
+    return 0;
 }
 
-// Function to get number of dimensions of a DataFrame object from Python
-static PyObject* py_ndim(PyObject* self, PyObject* args) {
-    PyObject* capsule;
-    if (!PyArg_ParseTuple(args, "O", &capsule)) {
-        return NULL;
+// Function to get the width in bytes of one element of a dtype
+static size_t dtypeWidth(DType dtype) {
+    switch (dtype) {
+        case DTYPE_INT64: return sizeof(int64_t);
+        case DTYPE_FLOAT64: return sizeof(double);
+        case DTYPE_BOOL: return sizeof(uint8_t);
+        case DTYPE_STRING: return sizeof(int64_t);
+        case DTYPE_DATETIME: return sizeof(int64_t);
+        case DTYPE_CATEGORY: return sizeof(uint8_t);
     }
+    return 0;
+}
 
-    // DataFrame is considered 2-dimensional
-    return PyLong_FromLong(2);
+// Function to get the width in bytes of one element of a column, which for
+// category columns depends on the size of the dictionary
+static size_t columnWidth(const Column* col) {
+    return col->dtype == DTYPE_CATEGORY ? (size_t)col->code_width : dtypeWidth(col->dtype);
 }
 
-// Function to describe statistics of a DataFrame object from Python
-static PyObject* py_describe(PyObject* self, PyObject* args) {
-    PyObject* capsule;
-    if (!PyArg_ParseTuple(args, "O", &capsule)) {
-        return NULL;
-    }
+// Function to get where the strings of a column start in its heap: past 0
+// only for a view that borrows the heap of a longer column
+static int64_t heapStart(const Column* col) {
+    return col->dtype == DTYPE_STRING ? STRING_OFFSETS(col)[0] : 0;
+}
 
-    // Print basic statistics (assuming all columns are strings)
-    printf("Statistics (string columns):\n");
-    printf("Count: %d\n", 0); // No count for string data
-    printf("Unique: %d\n", 0); // No unique values for string data
-    printf("Top: %s\n", "N/A"); // No top value for string data
-    printf("Freq: %d\n", 0); // No frequency for string data
+// Function to check whether a column holds strings, plain or dictionary encoded
+static int isTextColumn(const Column* col) {
+    return col->dtype == DTYPE_STRING || col->dtype == DTYPE_CATEGORY;
+}
 
-    Py_RETURN_NONE;
+// Function to check whether text of length len equals a literal
+static int textEquals(const char* text, size_t len, const char* literal) {
+    return strlen(literal) == len && memcmp(text, literal, len) == 0;
 }
 
-// Function to get unique values of a column in a DataFrame object from Python
-static PyObject* py_unique(PyObject* self, PyObject* args) {
-    PyObject* capsule;
-    int col_index;
-    if (!PyArg_ParseTuple(args, "Oi", &capsule, &col_index)) {
-        return NULL;
-    }
-    DataFrame* df = (DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame");
+// Locale pinned to "C" so that float parsing never depends on the process locale
+#ifdef _WIN32
+static _locale_t c_numeric_locale;
+#else
+static locale_t c_numeric_locale;
+#endif
 
-    // Print unique values of the specified column (assuming all are strings)
-    printf("Unique values of column %d:\n", col_index);
-    for (int i = 0; i < df->num_rows; i++) {
-        printf("%s\n", df->rows[i].data[col_index]);
+// Function to parse a float with the C locale, used for inputs the fast path
+// cannot convert exactly. strtod needs a terminated copy: short inputs are
+// copied to the stack, longer ones such as decimals of many digits to the heap.
+static int parseFloat64Slow(const char* text, size_t len, double* out) {
+    char local[128];
+    char* buf = len < sizeof(local) ? local : (char*)malloc(len + 1);
+    if (!buf) {
+        return -1;
     }
-
-    Py_RETURN_NONE;
+    memcpy(buf, text, len);
+    buf[len] = '\0';
+    char* end;
+#ifdef _WIN32
+    double value = _strtod_l(buf, &end, c_numeric_locale);
+#else
+    double value = strtod_l(buf, &end, c_numeric_locale);
+#endif
+    int status = end == buf || *end != '\0' ? -1 : 0;
+    if (buf != local) {
+        free(buf);
+    }
+    if (status == 0) {
+        *out = value;
+    }
+    return status;
 }
 
-// Function to check for null values (simulated by empty strings in this implementation)
-static PyObject* py_isnull(PyObject* self, PyObject* args) {
-    PyObject* capsule;
-    if (!PyArg_ParseTuple(args, "O", &capsule)) {
-        return NULL;
+// Function to parse text as an int64, returns -1 if it is not a whole integer
+static int parseInt64(const char* text, size_t len, int64_t* out) {
+    size_t pos = 0;
+    int negative = 0;
+    if (pos < len && (text[pos] == '-' || text[pos] == '+')) {
+        negative = text[pos] == '-';
+        pos++;
     }
-    DataFrame* df = (DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame");
-    PyObject* result = PyList_New(df->num_rows);
-    for (int i = 0; i < df->num_rows; i++) {
-        PyObject* row_result = PyList_New(df->num_cols);
-        for (int j = 0; j < df->num_cols; j++) {
-            PyList_SetItem(row_result, j, PyBool_FromLong(df->rows[i].data[j][0] == '\0'));
+    if (pos == len) {
+        return -1;
+    }
+    // Accumulate as a negative number so that INT64_MIN is representable
+    int64_t value = 0;
+    for (; pos < len; pos++) {
+        unsigned digit = (unsigned)(text[pos] - '0');
+        if (digit > 9 || value < (INT64_MIN + (int64_t)digit) / 10) {
+            return -1;
         }
-        PyList_SetItem(result, i, row_result);
+        value = value * 10 - (int64_t)digit;
     }
-    return result;
-}
+    if (!negative) {
+        if (value == INT64_MIN) {
+            return -1;
+        }
+        value = -value;
+    }
+    *out = value;
+    return 0;
+}
+
+// Exact powers of ten representable as doubles
+static const double exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Function to parse text as a float64, an empty string parses as NaN. Decimal
+// numbers whose digits fit in 53 bits and whose exponent is within 10^22 are
+// converted exactly with one multiply or divide (Clinger's fast path); the
+// rest go through strtod pinned to the C locale.
+static int parseFloat64(const char* text, size_t len, double* out) {
+    if (len == 0) {
+        *out = NAN;
+        return 0;
+    }
+    size_t pos = 0;
+    int negative = 0;
+    if (text[pos] == '-' || text[pos] == '+') {
+        negative = text[pos] == '-';
+        pos++;
+    }
+    const char* rest = text + pos;
+    size_t rest_len = len - pos;
+    if (textEquals(rest, rest_len, "nan") || textEquals(rest, rest_len, "NaN") ||
+        textEquals(rest, rest_len, "NAN")) {
+        *out = NAN;
+        return 0;
+    }
+    if (textEquals(rest, rest_len, "inf") || textEquals(rest, rest_len, "Inf") ||
+        textEquals(rest, rest_len, "INF") || textEquals(rest, rest_len, "infinity") ||
+        textEquals(rest, rest_len, "Infinity")) {
+        *out = negative ? -INFINITY : INFINITY;
+        return 0;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0, significant = 0, exponent = 0;
+    for (; pos < len && (unsigned)(text[pos] - '0') <= 9; pos++, digits++) {
+        if (significant < 19) {
+            mantissa = mantissa * 10 + (unsigned)(text[pos] - '0');
+            significant += mantissa != 0;
+        } else {
+            exponent++;
+            significant++;
+        }
+    }
+    if (pos < len && text[pos] == '.') {
+        pos++;
+        for (; pos < len && (unsigned)(text[pos] - '0') <= 9; pos++, digits++) {
+            if (significant < 19) {
+                mantissa = mantissa * 10 + (unsigned)(text[pos] - '0');
+                significant += mantissa != 0;
+                exponent--;
+            } else {
+                significant++;
+            }
+        }
+    }
+    if (digits == 0) {
+        return -1;
+    }
+    if (pos < len && (text[pos] == 'e' || text[pos] == 'E')) {
+        pos++;
+        int exp_negative = 0, exp_value = 0, exp_digits = 0;
+        if (pos < len && (text[pos] == '-' || text[pos] == '+')) {
+            exp_negative = text[pos] == '-';
+            pos++;
+        }
+        for (; pos < len && (unsigned)(text[pos] - '0') <= 9; pos++, exp_digits++) {
+            if (exp_value < 100000) {
+                exp_value = exp_value * 10 + (text[pos] - '0');
+            }
+        }
+        if (exp_digits == 0) {
+            return -1;
+        }
+        exponent += exp_negative ? -exp_value : exp_value;
+    }
+    if (pos != len) {
+        return -1;
+    }
+    if (significant <= 19 && mantissa <= ((uint64_t)1 << 53) && exponent >= -22 && exponent <= 22) {
+        double value = (double)mantissa;
+        value = exponent < 0 ? value / exact_powers_of_ten[-exponent] : value * exact_powers_of_ten[exponent];
+        *out = negative ? -value : value;
+        return 0;
+    }
+    if (mantissa == 0) {
+        *out = negative ? -0.0 : 0.0;
+        return 0;
+    }
+    return parseFloat64Slow(text, len, out);
+}
+
+// Function to parse text as a bool
+static int parseBool(const char* text, size_t len, uint8_t* out) {
+    if (textEquals(text, len, "true") || textEquals(text, len, "True") || textEquals(text, len, "TRUE") ||
+        textEquals(text, len, "1")) {
+        *out = 1;
+    } else if (textEquals(text, len, "false") || textEquals(text, len, "False") || textEquals(text, len, "FALSE") ||
+               textEquals(text, len, "0")) {
+        *out = 0;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+// Nanoseconds per unit of time
+#define NS_PER_SECOND INT64_C(1000000000)
+#define NS_PER_DAY (INT64_C(86400) * NS_PER_SECOND)
+
+// Function to count days since 1970-01-01 for a proleptic Gregorian date
+static int64_t daysFromCivil(int64_t year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    unsigned year_of_era = (unsigned)(year - era * 400);
+    unsigned day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    unsigned day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + (int64_t)day_of_era - 719468;
+}
+
+// Function to turn days since 1970-01-01 back into a calendar date
+static void civilFromDays(int64_t days, int64_t* year, unsigned* month, unsigned* day) {
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    unsigned day_of_era = (unsigned)(days - era * 146097);
+    unsigned year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    unsigned day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    unsigned mp = (5 * day_of_year + 2) / 153;
+    *day = day_of_year - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = (int64_t)year_of_era + era * 400 + (*month <= 2);
+}
+
+// Function to count the days of a month of the proleptic Gregorian calendar
+static int daysInMonth(int year, int month) {
+    static const int month_days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    int leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+    return month_days[month - 1] + (month == 2 && leap);
+}
+
+// Function to read exactly count digits at text[*pos]
+static int readDigits(const char* text, size_t len, size_t* pos, int count, int* out) {
+    int value = 0;
+    for (int i = 0; i < count; i++, (*pos)++) {
+        if (*pos >= len || (unsigned)(text[*pos] - '0') > 9) {
+            return -1;
+        }
+        value = value * 10 + (text[*pos] - '0');
+    }
+    *out = value;
+    return 0;
+}
+
+// Function to parse an ISO 8601 timestamp into nanoseconds since the epoch.
+// Accepts YYYY-MM-DD optionally followed by 'T' or ' ', HH:MM[:SS[.fraction]]
+// and a trailing 'Z'; "" and "NaT" parse as NaT.
+static int parseDatetime(const char* text, size_t len, int64_t* out) {
+    if (len == 0 || textEquals(text, len, "NaT")) {
+        *out = DATETIME_NAT;
+        return 0;
+    }
+    size_t pos = 0;
+    int year, month, day, hour = 0, minute = 0, second = 0;
+    int64_t fraction = 0;
+    if (readDigits(text, len, &pos, 4, &year) != 0 || pos >= len || text[pos++] != '-' ||
+        readDigits(text, len, &pos, 2, &month) != 0 || pos >= len || text[pos++] != '-' ||
+        readDigits(text, len, &pos, 2, &day) != 0) {
+        return -1;
+    }
+    if (pos < len && (text[pos] == 'T' || text[pos] == ' ')) {
+        pos++;
+        if (readDigits(text, len, &pos, 2, &hour) != 0 || pos >= len || text[pos++] != ':' ||
+            readDigits(text, len, &pos, 2, &minute) != 0) {
+            return -1;
+        }
+        if (pos < len && text[pos] == ':') {
+            pos++;
+            if (readDigits(text, len, &pos, 2, &second) != 0) {
+                return -1;
+            }
+            if (pos < len && text[pos] == '.') {
+                pos++;
+                int fraction_digits = 0;
+                for (; pos < len && (unsigned)(text[pos] - '0') <= 9; pos++, fraction_digits++) {
+                    if (fraction_digits < 9) {
+                        fraction = fraction * 10 + (text[pos] - '0');
+                    }
+                }
+                if (fraction_digits == 0) {
+                    return -1;
+                }
+                for (; fraction_digits < 9; fraction_digits++) {
+                    fraction *= 10;
+                }
+            }
+        }
+    }
+    if (pos < len && text[pos] == 'Z') {
+        pos++;
+    }
+    // Dates that do not exist, such as February 30, are rejected rather
+    // than carried into the next month; so are leap seconds
+    if (pos != len || month < 1 || month > 12 || day < 1 || day > daysInMonth(year, month) || hour > 23 ||
+        minute > 59 || second > 59) {
+        return -1;
+    }
+    int64_t days = daysFromCivil(year, (unsigned)month, (unsigned)day);
+    // int64 nanoseconds cover 1677-09-22 to 2262-04-11 23:47:16.854775807
+    if (days < -106751 || days > 106751) {
+        return -1;
+    }
+    int64_t base = days * NS_PER_DAY;
+    int64_t time_of_day = ((int64_t)hour * 3600 + minute * 60 + second) * NS_PER_SECOND + fraction;
+    if (base > 0 && time_of_day > INT64_MAX - base) {
+        return -1;
+    }
+    *out = base + time_of_day;
+    return 0;
+}
+
+// Function to format a timestamp as ISO 8601, leaving out a midnight time of day
+static void formatDatetime(int64_t value, char* buf, size_t size) {
+    if (value == DATETIME_NAT) {
+        snprintf(buf, size, "NaT");
+        return;
+    }
+    int64_t days = value / NS_PER_DAY;
+    int64_t rest = value % NS_PER_DAY;
+    if (rest < 0) {
+        rest += NS_PER_DAY;
+        days--;
+    }
+    int64_t year;
+    unsigned month, day;
+    civilFromDays(days, &year, &month, &day);
+    if (rest == 0) {
+        snprintf(buf, size, "%04lld-%02u-%02u", (long long)year, month, day);
+        return;
+    }
+    int64_t seconds = rest / NS_PER_SECOND;
+    int64_t nanos = rest % NS_PER_SECOND;
+    int n = snprintf(buf, size, "%04lld-%02u-%02u %02d:%02d:%02d", (long long)year, month, day,
+                     (int)(seconds / 3600), (int)(seconds / 60 % 60), (int)(seconds % 60));
+    if (nanos && n > 0 && (size_t)n < size) {
+        // Print the fraction without trailing zeros
+        int digits = 9;
+        while (nanos % 10 == 0) {
+            nanos /= 10;
+            digits--;
+        }
+        snprintf(buf + n, size - n, ".%0*lld", digits, (long long)nanos);
+    }
+}
+
+// Function to format a double so that it parses back to the same value
+static void formatFloat64(double value, char* buf, size_t size) {
+    if (isnan(value)) {
+        snprintf(buf, size, "NaN");
+        return;
+    }
+    // Use the fewest significant digits that still round-trip
+    for (int precision = 15; precision <= 17; precision++) {
+        snprintf(buf, size, "%.*g", precision, value);
+        double parsed;
+        if (parseFloat64(buf, strlen(buf), &parsed) == 0 && parsed == value) {
+            break;
+        }
+    }
+}
+
+// Function to read the code of a category cell
+static uint32_t codeAt(const Column* col, int row) {
+    switch (col->code_width) {
+        case 1: return ((const uint8_t*)col->data)[row];
+        case 2: return ((const uint16_t*)col->data)[row];
+        default: return ((const uint32_t*)col->data)[row];
+    }
+}
+
+// Function to store the code of a category cell; it must fit the code width
+static void setCode(Column* col, int row, uint32_t code) {
+    switch (col->code_width) {
+        case 1: ((uint8_t*)col->data)[row] = (uint8_t)code; break;
+        case 2: ((uint16_t*)col->data)[row] = (uint16_t)code; break;
+        default: ((uint32_t*)col->data)[row] = code; break;
+    }
+}
+
+// Function to get the bytes of a string cell without copying; category
+// cells point into their dictionary
+static const char* stringAt(const Column* col, int row, size_t* len) {
+    if (col->dtype == DTYPE_CATEGORY) {
+        row = (int)codeAt(col, row);
+        col = &col->dict->values;
+    }
+    const int64_t* offsets = STRING_OFFSETS(col);
+    *len = (size_t)(offsets[row + 1] - offsets[row]);
+    return col->heap + offsets[row];
+}
+
+// Function to make room for extra bytes in a column's string heap
+static int reserveHeap(Column* col, size_t extra) {
+    size_t needed = col->heap_size + extra;
+    if (needed <= col->heap_capacity) {
+        return 0;
+    }
+    size_t capacity = col->heap_capacity ? col->heap_capacity : INITIAL_HEAP_CAPACITY;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    char* heap = (char*)realloc(col->heap, capacity);
+    if (!heap) {
+        return -1;
+    }
+    countAllocation(capacity - col->heap_capacity);
+    col->heap = heap;
+    col->heap_capacity = capacity;
+    return 0;
+}
+
+// Function to append a string as the value of row, which must be the next
+// row of a string column
+static int appendString(Column* col, int row, const char* text, size_t len) {
+    if (reserveHeap(col, len) != 0) {
+        return -1;
+    }
+    // An empty string may come before the heap is allocated
+    if (len > 0) {
+        memcpy(col->heap + col->heap_size, text, len);
+    }
+    col->heap_size += len;
+    STRING_OFFSETS(col)[row + 1] = (int64_t)col->heap_size;
+    return 0;
+}
+
+// Function to scramble a 64-bit value so every bit affects the low bits
+// (the splitmix64 finalizer)
+static uint64_t mixHash(uint64_t x) {
+    x ^= x >> 30;
+    x *= UINT64_C(0xbf58476d1ce4e5b9);
+    x ^= x >> 27;
+    x *= UINT64_C(0x94d049bb133111eb);
+    x ^= x >> 31;
+    return x;
+}
+
+// Function to hash a byte string eight bytes at a time
+static uint64_t hashBytes(const char* text, size_t len) {
+    uint64_t h = UINT64_C(0x9e3779b97f4a7c15) ^ (uint64_t)len;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, text + i, 8);
+        h = (h ^ word) * UINT64_C(0xff51afd7ed558ccd);
+        h = (h << 31) | (h >> 33);
+    }
+    if (i < len) {
+        uint64_t word = 0;
+        memcpy(&word, text + i, len - i);
+        h = (h ^ word) * UINT64_C(0xff51afd7ed558ccd);
+    }
+    return mixHash(h);
+}
+
+// Number of 64-bit words in a validity bitmap covering rows rows
+#define VALIDITY_WORDS(rows) (((size_t)(rows) + 63) / 64)
+
+// A validity word whose 64 rows all hold values
+#define ALL_VALID (~UINT64_C(0))
+
+// Function to count the set bits of a word
+static int popcount64(uint64_t x) {
+#ifdef _MSC_VER
+    return (int)__popcnt64(x);
+#else
+    return __builtin_popcountll(x);
+#endif
+}
+
+// Function to get the index of the lowest set bit of a non-zero word
+static int countTrailingZeros64(uint64_t x) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return (int)index;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+// Function to count the zero bits above the highest set bit of x, which
+// must not be 0
+static int countLeadingZeros64(uint64_t x) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, x);
+    return 63 - (int)index;
+#else
+    return __builtin_clzll(x);
+#endif
+}
+
+// Function to check whether a cell holds a missing value
+static int isNullCell(const Column* col, int row) {
+    return !((col->validity[row >> 6] >> (row & 63)) & 1);
+}
+
+static int initColumnStorage(Column* col, int capacity);
+static void freeColumnStorage(Column* col);
+
+// Function to free a category dictionary
+static void freeCategoryDict(CategoryDict* dict) {
+    freeColumnStorage(&dict->values);
+    free(dict->slots);
+    free(dict->ranks);
+    free(dict);
+}
+
+// Function to create an empty dictionary for a category column whose codes
+// have room for code_capacity rows
+static CategoryDict* newCategoryDict(int code_capacity) {
+    CategoryDict* dict = (CategoryDict*)calloc(1, sizeof(CategoryDict));
+    if (!dict) {
+        return NULL;
+    }
+    dict->values.dtype = DTYPE_STRING;
+    dict->capacity = INITIAL_ROW_CAPACITY;
+    dict->num_slots = 2 * INITIAL_ROW_CAPACITY;
+    dict->code_capacity = code_capacity;
+    dict->slots = (int*)malloc(dict->num_slots * sizeof(int));
+    if (!dict->slots || initColumnStorage(&dict->values, dict->capacity) != 0) {
+        freeCategoryDict(dict);
+        return NULL;
+    }
+    memset(dict->slots, 0xFF, dict->num_slots * sizeof(int));
+    return dict;
+}
+
+// Function to copy the borrowed buffers of a column into storage the column
+// owns, sized for its num_rows rows. The strings of a view need not start
+// at the beginning of the heap they borrow, so only theirs are copied.
+static int ownColumnStorage(Column* col, int num_rows) {
+    size_t data_size = ((size_t)num_rows + (col->dtype == DTYPE_STRING ? 1 : 0)) * columnWidth(col);
+    size_t validity_size = VALIDITY_WORDS(num_rows > 0 ? num_rows : 1) * sizeof(uint64_t);
+    int64_t heap_start = heapStart(col);
+    size_t heap_size = col->heap_size - (size_t)heap_start;
+    void* data = alignedAlloc(data_size);
+    uint64_t* validity = (uint64_t*)malloc(validity_size);
+    char* heap = heap_size ? (char*)malloc(heap_size) : NULL;
+    if (!data || !validity || (heap_size && !heap)) {
+        alignedFree(data);
+        free(validity);
+        free(heap);
+        return -1;
+    }
+    memcpy(data, col->data, data_size);
+    memcpy(validity, col->validity, validity_size);
+    if (heap) {
+        memcpy(heap, col->heap + heap_start, heap_size);
+    }
+    if (heap_start != 0) {
+        for (int i = 0; i <= num_rows; i++) {
+            ((int64_t*)data)[i] -= heap_start;
+        }
+    }
+    if (col->mapped == MAPPED_VALUES) {
+        free(col->validity);
+    }
+    col->data = data;
+    col->validity = validity;
+    col->heap = heap;
+    col->heap_size = heap_size;
+    col->heap_capacity = heap_size;
+    col->mapped = 0;
+    return 0;
+}
+
+// Function to find the hash slot holding a string's code, or the empty
+// slot where it belongs
+static int* findCategorySlot(const CategoryDict* dict, const char* text, size_t len, uint64_t hash) {
+    size_t mask = dict->num_slots - 1;
+    for (size_t i = (size_t)hash & mask;; i = (i + 1) & mask) {
+        int* slot = &dict->slots[i];
+        if (*slot < 0) {
+            return slot;
+        }
+        size_t value_len;
+        const char* value = stringAt(&dict->values, *slot, &value_len);
+        if (value_len == len && memcmp(value, text, len) == 0) {
+            return slot;
+        }
+    }
+}
+
+// Function to rebuild the hash index of a dictionary with num_slots slots
+static int indexCategorySlots(CategoryDict* dict, size_t num_slots) {
+    int* slots = (int*)malloc(num_slots * sizeof(int));
+    if (!slots) {
+        return -1;
+    }
+    memset(slots, 0xFF, num_slots * sizeof(int));
+    free(dict->slots);
+    dict->slots = slots;
+    dict->num_slots = num_slots;
+    for (int code = 0; code < dict->size; code++) {
+        size_t len;
+        const char* text = stringAt(&dict->values, code, &len);
+        *findCategorySlot(dict, text, len, hashBytes(text, len)) = code;
+    }
+    return 0;
+}
+
+// Function to get the code of a string in a dictionary, adding it as a new
+// code when it is not there yet. Returns -1 when out of memory.
+static int internCategory(CategoryDict* dict, const char* text, size_t len) {
+    if (!dict->slots) {
+        // Dictionaries opened from a file or sliced into a view are indexed
+        // on first use
+        size_t num_slots = 2 * INITIAL_ROW_CAPACITY;
+        while (num_slots < 2 * ((size_t)dict->size + 1)) num_slots *= 2;
+        if (indexCategorySlots(dict, num_slots) != 0) {
+            return -1;
+        }
+    }
+    uint64_t hash = hashBytes(text, len);
+    int* slot = findCategorySlot(dict, text, len, hash);
+    if (*slot >= 0) {
+        return *slot;
+    }
+    if (dict->values.mapped && ownColumnStorage(&dict->values, dict->size) != 0) {
+        return -1;
+    }
+    if (dict->size == dict->capacity) {
+        // Grow the values column like reserveRows grows a frame
+        Column* values = &dict->values;
+        int capacity = dict->capacity == 0 ? INITIAL_ROW_CAPACITY
+                       : dict->capacity > INT_MAX / 2 ? INT_MAX : dict->capacity * 2;
+        if (capacity == dict->capacity) {
+            return -1;
+        }
+        void* data = alignedRealloc(values->data, ((size_t)dict->size + 1) * sizeof(int64_t),
+                                    ((size_t)capacity + 1) * sizeof(int64_t));
+        if (!data) {
+            return -1;
+        }
+        values->data = data;
+        size_t old_words = VALIDITY_WORDS(dict->capacity);
+        size_t new_words = VALIDITY_WORDS(capacity);
+        if (new_words > old_words) {
+            uint64_t* validity = (uint64_t*)realloc(values->validity, new_words * sizeof(uint64_t));
+            if (!validity) {
+                return -1;
+            }
+            memset(validity + old_words, 0xFF, (new_words - old_words) * sizeof(uint64_t));
+            values->validity = validity;
+        }
+        dict->capacity = capacity;
+    }
+    if (appendString(&dict->values, dict->size, text, len) != 0) {
+        return -1;
+    }
+    int code = dict->size++;
+    *slot = code;
+    free(dict->ranks);
+    dict->ranks = NULL;
+    if ((size_t)dict->size * 2 > dict->num_slots && indexCategorySlots(dict, dict->num_slots * 2) != 0) {
+        dict->size--;
+        *findCategorySlot(dict, text, len, hash) = -1;
+        return -1;
+    }
+    return code;
+}
+
+// Function to copy a dictionary for a new column; codes keep their values
+static CategoryDict* copyCategoryDict(const CategoryDict* dict, int code_capacity) {
+    CategoryDict* copy = newCategoryDict(code_capacity);
+    for (int code = 0; copy && code < dict->size; code++) {
+        size_t len;
+        const char* text = stringAt(&dict->values, code, &len);
+        if (internCategory(copy, text, len) != code) {
+            freeCategoryDict(copy);
+            copy = NULL;
+        }
+    }
+    return copy;
+}
+
+// Function to widen the codes of a category column to width bytes
+static int widenCodes(Column* col, int width) {
+    size_t rows = (size_t)col->dict->code_capacity;
+    Column widened = *col;
+    widened.code_width = width;
+    widened.data = alignedAlloc((rows > 0 ? rows : 1) * (size_t)width);
+    if (!widened.data) {
+        return -1;
+    }
+    for (size_t row = 0; row < rows; row++) {
+        setCode(&widened, (int)row, codeAt(col, (int)row));
+    }
+    alignedFree(col->data);
+    col->data = widened.data;
+    col->code_width = width;
+    return 0;
+}
+
+// Function to store a string into a row of a category column, adding it to
+// the dictionary and widening the codes when needed
+static int setCategoryCell(Column* col, int row, const char* text, size_t len) {
+    int code = internCategory(col->dict, text, len);
+    if (code < 0) {
+        return -1;
+    }
+    int width = code <= UINT8_MAX ? 1 : (code <= UINT16_MAX ? 2 : 4);
+    if (width > col->code_width && widenCodes(col, width) != 0) {
+        return -1;
+    }
+    setCode(col, row, (uint32_t)code);
+    return 0;
+}
+
+// Function to allocate empty storage for capacity rows of a column; every
+// row starts out valid
+static int initColumnStorage(Column* col, int capacity) {
+    size_t slots = (size_t)capacity + (col->dtype == DTYPE_STRING ? 1 : 0);
+    size_t words = VALIDITY_WORDS(capacity > 0 ? capacity : 1);
+    col->code_width = col->dtype == DTYPE_CATEGORY ? 1 : 0;
+    col->dict = col->dtype == DTYPE_CATEGORY ? newCategoryDict(capacity) : NULL;
+    col->mapped = 0;
+    col->data = alignedAlloc(slots * columnWidth(col));
+    col->validity = (uint64_t*)malloc(words * sizeof(uint64_t));
+    col->null_count = 0;
+    col->heap = NULL;
+    col->heap_size = 0;
+    col->heap_capacity = 0;
+    if (!col->data || !col->validity || (col->dtype == DTYPE_CATEGORY && !col->dict)) {
+        alignedFree(col->data);
+        free(col->validity);
+        if (col->dict) freeCategoryDict(col->dict);
+        col->data = NULL;
+        col->validity = NULL;
+        col->dict = NULL;
+        return -1;
+    }
+    memset(col->validity, 0xFF, words * sizeof(uint64_t));
+    if (col->dtype == DTYPE_STRING) {
+        STRING_OFFSETS(col)[0] = 0;
+    }
+    return 0;
+}
+
+// Function to release the buffers of a column
+static void freeColumnStorage(Column* col) {
+    if (!col->mapped) {
+        alignedFree(col->data);
+        free(col->validity);
+        free(col->heap);
+    } else if (col->mapped == MAPPED_VALUES) {
+        free(col->validity);
+    }
+    col->mapped = 0;
+    if (col->dict) {
+        freeCategoryDict(col->dict);
+        col->dict = NULL;
+    }
+    col->data = NULL;
+    col->validity = NULL;
+    col->null_count = 0;
+    col->heap = NULL;
+    col->heap_size = 0;
+    col->heap_capacity = 0;
+}
+
+// Function to clear the validity bit of a row
+static void markNull(Column* col, int row) {
+    uint64_t bit = UINT64_C(1) << (row & 63);
+    if (col->validity[row >> 6] & bit) {
+        col->validity[row >> 6] &= ~bit;
+        col->null_count++;
+    }
+}
+
+// Function to set the validity bit of a row
+static void markValid(Column* col, int row) {
+    uint64_t bit = UINT64_C(1) << (row & 63);
+    if (!(col->validity[row >> 6] & bit)) {
+        col->validity[row >> 6] |= bit;
+        col->null_count--;
+    }
+}
+
+// Function to store a missing value into the next row of a column
+static int setNullCell(Column* col, int row) {
+    switch (col->dtype) {
+        case DTYPE_INT64:
+            ((int64_t*)col->data)[row] = 0;
+            break;
+        case DTYPE_FLOAT64:
+            ((double*)col->data)[row] = NAN;
+            break;
+        case DTYPE_BOOL:
+            ((uint8_t*)col->data)[row] = 0;
+            break;
+        case DTYPE_STRING:
+            if (appendString(col, row, "", 0) != 0) {
+                return -1;
+            }
+            break;
+        case DTYPE_DATETIME:
+            ((int64_t*)col->data)[row] = DATETIME_NAT;
+            break;
+        case DTYPE_CATEGORY:
+            setCode(col, row, 0);
+            break;
+    }
+    markNull(col, row);
+    return 0;
+}
+
+// Function to store text into the next row of a column, converting it to the
+// column's dtype. Empty text is missing for every dtype but string and
+// category; NaN and NaT are missing too.
+static int setCell(Column* col, int row, const char* text, size_t len) {
+    if (len == 0 && !isTextColumn(col)) {
+        return setNullCell(col, row);
+    }
+    switch (col->dtype) {
+        case DTYPE_INT64:
+            return parseInt64(text, len, &((int64_t*)col->data)[row]);
+        case DTYPE_FLOAT64: {
+            double* value = &((double*)col->data)[row];
+            if (parseFloat64(text, len, value) != 0) {
+                return -1;
+            }
+            if (isnan(*value)) {
+                markNull(col, row);
+            }
+            return 0;
+        }
+        case DTYPE_BOOL:
+            return parseBool(text, len, &((uint8_t*)col->data)[row]);
+        case DTYPE_STRING:
+            return appendString(col, row, text, len);
+        case DTYPE_CATEGORY:
+            return setCategoryCell(col, row, text, len);
+        case DTYPE_DATETIME: {
+            int64_t* value = &((int64_t*)col->data)[row];
+            if (parseDatetime(text, len, value) != 0) {
+                return -1;
+            }
+            if (*value == DATETIME_NAT) {
+                markNull(col, row);
+            }
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Function to render a cell as text; strings are returned without copying
+// and are not NUL-terminated, so callers print them with "%.*s"
+static const char* formatCell(const Column* col, int row, char* buf, size_t size, size_t* len) {
+    const char* text = buf;
+    if (isNullCell(col, row) && (col->dtype == DTYPE_INT64 || col->dtype == DTYPE_BOOL)) {
+        *len = strlen("<NA>");
+        return "<NA>";
+    }
+    switch (col->dtype) {
+        case DTYPE_INT64:
+            snprintf(buf, size, "%lld", (long long)((int64_t*)col->data)[row]);
+            break;
+        case DTYPE_FLOAT64:
+            formatFloat64(((double*)col->data)[row], buf, size);
+            break;
+        case DTYPE_BOOL:
+            text = ((uint8_t*)col->data)[row] ? "True" : "False";
+            break;
+        case DTYPE_STRING:
+        case DTYPE_CATEGORY:
+            return stringAt(col, row, len);
+        case DTYPE_DATETIME:
+            formatDatetime(((int64_t*)col->data)[row], buf, size);
+            break;
+    }
+    *len = strlen(text);
+    return text;
+}
+
+// Function to convert a datetime value to a Python datetime (None for NaT).
+// Python datetimes stop at microseconds.
+static PyObject* datetimeToPyObject(int64_t value) {
+    if (value == DATETIME_NAT) {
+        Py_RETURN_NONE;
+    }
+    int64_t days = value / NS_PER_DAY, rest = value % NS_PER_DAY, year;
+    if (rest < 0) {
+        rest += NS_PER_DAY;
+        days--;
+    }
+    unsigned month, day;
+    civilFromDays(days, &year, &month, &day);
+    int64_t seconds = rest / NS_PER_SECOND;
+    return PyDateTime_FromDateAndTime((int)year, (int)month, (int)day, (int)(seconds / 3600),
+                                      (int)(seconds / 60 % 60), (int)(seconds % 60),
+                                      (int)(rest % NS_PER_SECOND / 1000));
+}
+
+// Function to convert a cell to the matching Python object; missing floats
+// are NaN and every other missing value is None
+static PyObject* cellToPyObject(const Column* col, int row) {
+    if (col->dtype != DTYPE_FLOAT64 && isNullCell(col, row)) {
+        Py_RETURN_NONE;
+    }
+    switch (col->dtype) {
+        case DTYPE_INT64:
+            return PyLong_FromLongLong(((int64_t*)col->data)[row]);
+        case DTYPE_FLOAT64:
+            return PyFloat_FromDouble(((double*)col->data)[row]);
+        case DTYPE_BOOL:
+            return PyBool_FromLong(((uint8_t*)col->data)[row]);
+        case DTYPE_STRING:
+        case DTYPE_CATEGORY: {
+            size_t len;
+            const char* text = stringAt(col, row, &len);
+            return PyUnicode_FromStringAndSize(text, (Py_ssize_t)len);
+        }
+        case DTYPE_DATETIME:
+            return datetimeToPyObject(((int64_t*)col->data)[row]);
+    }
+    Py_RETURN_NONE;
+}
+
+// Function to compare two byte strings the way strcmp would
+static int compareBytes(const char* a, size_t a_len, const char* b, size_t b_len) {
+    int cmp = memcmp(a, b, a_len < b_len ? a_len : b_len);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (a_len > b_len) - (a_len < b_len);
+}
+
+// Function to compare two cells of the same column; NaN and NaT sort after every value
+static int compareCells(const Column* col, int a, int b) {
+    switch (col->dtype) {
+        case DTYPE_INT64: {
+            int64_t x = ((int64_t*)col->data)[a], y = ((int64_t*)col->data)[b];
+            return (x > y) - (x < y);
+        }
+        case DTYPE_FLOAT64: {
+            double x = ((double*)col->data)[a], y = ((double*)col->data)[b];
+            if (isnan(x) || isnan(y)) {
+                return isnan(x) - isnan(y);
+            }
+            return (x > y) - (x < y);
+        }
+        case DTYPE_BOOL: {
+            uint8_t x = ((uint8_t*)col->data)[a], y = ((uint8_t*)col->data)[b];
+            return (x > y) - (x < y);
+        }
+        case DTYPE_CATEGORY:
+            if (col->dict->ranks) {
+                uint32_t x = col->dict->ranks[codeAt(col, a)], y = col->dict->ranks[codeAt(col, b)];
+                return (x > y) - (x < y);
+            }
+            // fall through
+        case DTYPE_STRING: {
+            size_t a_len, b_len;
+            const char* x = stringAt(col, a, &a_len);
+            const char* y = stringAt(col, b, &b_len);
+            return compareBytes(x, a_len, y, b_len);
+        }
+        case DTYPE_DATETIME: {
+            int64_t x = ((int64_t*)col->data)[a], y = ((int64_t*)col->data)[b];
+            if (x == DATETIME_NAT || y == DATETIME_NAT) {
+                return (x == DATETIME_NAT) - (y == DATETIME_NAT);
+            }
+            return (x > y) - (x < y);
+        }
+    }
+    return 0;
+}
+
+// Function to get the bytes a column's values, validity bitmap and category
+// dictionary occupy
+static size_t columnMemoryUsage(const Column* col, int num_rows) {
+    size_t slots = (size_t)num_rows + (col->dtype == DTYPE_STRING ? 1 : 0);
+    size_t usage = slots * columnWidth(col) + VALIDITY_WORDS(num_rows) * sizeof(uint64_t) + col->heap_size -
+                   (size_t)heapStart(col);
+    if (col->dict) {
+        usage += columnMemoryUsage(&col->dict->values, col->dict->size) + col->dict->num_slots * sizeof(int);
+    }
+    return usage;
+}
+
+// Function to add up the bytes a column holds with room for capacity rows:
+// its buffers including spare room, its name, and its dictionary with the
+// hash index and ranks. Buffers borrowed from a file mapping or, by a view,
+// from another DataFrame are added to mapped rather than allocated.
+static void columnFootprint(const Column* col, int capacity, size_t* allocated, size_t* mapped) {
+    size_t slots = (size_t)capacity + (col->dtype == DTYPE_STRING ? 1 : 0);
+    size_t validity = col->validity ? VALIDITY_WORDS(capacity > 0 ? capacity : 1) * sizeof(uint64_t) : 0;
+    size_t buffers = col->data ? slots * columnWidth(col) + col->heap_capacity - (size_t)heapStart(col) : 0;
+    *(col->mapped == MAPPED_BUFFERS ? mapped : allocated) += validity;
+    *(col->mapped ? mapped : allocated) += buffers;
+    if (col->name) {
+        *allocated += strlen(col->name) + 1;
+    }
+    CategoryDict* dict = col->dict;
+    if (dict) {
+        *allocated += sizeof(CategoryDict);
+        if (dict->slots) {
+            *allocated += dict->num_slots * sizeof(int);
+        }
+        if (dict->ranks) {
+            *allocated += (dict->size > 0 ? (size_t)dict->size : 1) * sizeof(uint32_t);
+        }
+        columnFootprint(&dict->values, dict->capacity, allocated, mapped);
+    }
+}
+
+// Function to release a column and its buffers
+static void freeColumn(Column* col) {
+    freeColumnStorage(col);
+    free(col->name);
+    col->name = NULL;
+}
+
+// Function to grow the row storage of every column to hold at least capacity rows
+static int reserveRows(DataFrame* df, int capacity) {
+    if (capacity <= df->capacity) {
+        return 0;
+    }
+    int new_capacity = df->capacity > 0 ? df->capacity : INITIAL_ROW_CAPACITY;
+    while (new_capacity < capacity) {
+        new_capacity = new_capacity > INT_MAX / 2 ? INT_MAX : new_capacity * 2;
+    }
+    for (int j = 0; j < df->num_cols; j++) {
+        Column* col = &df->columns[j];
+        size_t extra = col->dtype == DTYPE_STRING ? 1 : 0;
+        size_t width = columnWidth(col);
+        if (col->mapped && ownColumnStorage(col, df->num_rows) != 0) {
+            return -1;
+        }
+        void* data = alignedRealloc(col->data, ((size_t)df->num_rows + extra) * width,
+                                    ((size_t)new_capacity + extra) * width);
+        if (!data) {
+            return -1;
+        }
+        col->data = data;
+        if (col->dict) {
+            col->dict->code_capacity = new_capacity;
+        }
+        // New rows start out valid
+        size_t old_words = VALIDITY_WORDS(df->capacity > 0 ? df->capacity : 1);
+        size_t new_words = VALIDITY_WORDS(new_capacity);
+        if (new_words > old_words) {
+            uint64_t* validity = (uint64_t*)realloc(col->validity, new_words * sizeof(uint64_t));
+            if (!validity) {
+                return -1;
+            }
+            memset(validity + old_words, 0xFF, (new_words - old_words) * sizeof(uint64_t));
+            col->validity = validity;
+        }
+    }
+    df->capacity = new_capacity;
+    return 0;
+}
+
+// Function to dynamically allocate a DataFrame structure
+static DataFrame* createDataFrame(int num_rows, int num_cols) {
+    DataFrame* df = (DataFrame*)malloc(sizeof(DataFrame));
+    if (!df) {
+        return NULL;
+    }
+    df->columns = (Column*)calloc(num_cols > 0 ? num_cols : 1, sizeof(Column));
+    df->num_rows = num_rows;
+    df->num_cols = num_cols;
+    df->exports = 0;
+    df->mapping = NULL;
+    df->views = 0;
+    df->base = NULL;
+    df->readers = 0;
+    df->writing = 0;
+    df->indexes = NULL;
+    df->capacity = num_rows > INITIAL_ROW_CAPACITY ? num_rows : INITIAL_ROW_CAPACITY;
+    if (!df->columns) {
+        free(df);
+        return NULL;
+    }
+    // New columns hold missing strings until they are cast or typed by the loader
+    for (int j = 0; j < num_cols; j++) {
+        Column* col = &df->columns[j];
+        char name[32];
+        snprintf(name, sizeof(name), "%d", j);
+        col->name = copyString(name);
+        col->dtype = DTYPE_STRING;
+        if (!col->name || initColumnStorage(col, df->capacity) != 0) {
+            for (int k = 0; k <= j; k++) {
+                freeColumn(&df->columns[k]);
+            }
+            free(df->columns);
+            free(df);
+            return NULL;
+        }
+        memset(col->data, 0, ((size_t)num_rows + 1) * sizeof(int64_t));
+        // Only the first num_rows rows are missing; rows added later start valid
+        memset(col->validity, 0, ((size_t)num_rows / 64) * sizeof(uint64_t));
+        if (num_rows % 64 != 0) {
+            col->validity[num_rows / 64] = ~UINT64_C(0) << (num_rows % 64);
+        }
+        col->null_count = num_rows;
+    }
+    return df;
+}
+
+// Function to let go of the DataFrame a view borrows its storage from.
+// Needs the GIL.
+static void releaseBase(DataFrame* df) {
+    DataFrame* base = (DataFrame*)PyCapsule_GetPointer(df->base, "DataFrame");
+    base->views--;
+    Py_CLEAR(df->base);
+}
+
+static int dropIndexes(DataFrame* df, int column, int kind);
+
+// Function to free memory allocated to DataFrame structure
+static void freeDataFrame(DataFrame* df) {
+    for (int j = 0; j < df->num_cols; j++) {
+        freeColumn(&df->columns[j]);
+    }
+    free(df->columns);
+    if (df->mapping) {
+        unmapFile(df->mapping);
+        free(df->mapping);
+    }
+    if (df->base) {
+        releaseBase(df);
+    }
+    dropIndexes(df, -1, -1);
+    free(df);
+}
+
+// Function to undo a partial append to rows [begin, end), which are past
+// the DataFrame's rows: their string bytes are dropped and they are left
+// valid again for the next append
+static void discardRows(DataFrame* df, int begin, int end) {
+    for (int j = 0; j < df->num_cols; j++) {
+        Column* col = &df->columns[j];
+        if (col->dtype == DTYPE_STRING) {
+            col->heap_size = (size_t)STRING_OFFSETS(col)[begin];
+        }
+        for (int row = begin; row < end; row++) {
+            markValid(col, row);
+        }
+    }
+}
+
+// Function to add a row of values to the DataFrame, returns -1 if a value
+// cannot be converted to its column's dtype. A NULL value is missing.
+static int addRow(DataFrame* df, char** values) {
+    int row = df->num_rows;
+    KernelSpan span;
+    beginKernel(&span, KERNEL_ADD_ROW);
+    if (reserveRows(df, row + 1) != 0) {
+        endKernel(&span, 0);
+        return -1;
+    }
+    for (int j = 0; j < df->num_cols; j++) {
+        Column* target = &df->columns[j];
+        int status = values[j] ? setCell(target, row, values[j], strlen(values[j])) : setNullCell(target, row);
+        if (status != 0) {
+            discardRows(df, row, row + 1);
+            endKernel(&span, 0);
+            return -1;
+        }
+    }
+    df->num_rows++;
+    endKernel(&span, 1);
+    return 0;
+}
+
+// Function to build a new column holding col's values in the order given by
+// perm; a negative entry yields a missing value
+static int gatherColumn(const Column* col, const int* perm, int n, Column* out) {
+    out->name = NULL;
+    out->dtype = col->dtype;
+    if (initColumnStorage(out, n) != 0) {
+        return -1;
+    }
+    int has_missing = col->null_count > 0;
+    switch (col->dtype) {
+        case DTYPE_INT64:
+        case DTYPE_FLOAT64:
+        case DTYPE_DATETIME: {
+            const int64_t* src = (const int64_t*)col->data;
+            int64_t* dst = (int64_t*)out->data;
+            int64_t missing = col->dtype == DTYPE_DATETIME ? DATETIME_NAT : 0;
+            if (col->dtype == DTYPE_FLOAT64) {
+                double nan = NAN;
+                memcpy(&missing, &nan, sizeof(missing));
+            }
+            for (int i = 0; i < n; i++) {
+                if (perm[i] < 0) {
+                    dst[i] = missing;
+                    has_missing = 1;
+                } else {
+                    dst[i] = src[perm[i]];
+                }
+            }
+            break;
+        }
+        case DTYPE_BOOL: {
+            const uint8_t* src = (const uint8_t*)col->data;
+            uint8_t* dst = (uint8_t*)out->data;
+            for (int i = 0; i < n; i++) {
+                if (perm[i] < 0) {
+                    dst[i] = 0;
+                    has_missing = 1;
+                } else {
+                    dst[i] = src[perm[i]];
+                }
+            }
+            break;
+        }
+        case DTYPE_STRING: {
+            // Size the heap exactly, then copy the strings in their new order
+            const int64_t* src = STRING_OFFSETS(col);
+            size_t total = 0;
+            for (int i = 0; i < n; i++) {
+                if (perm[i] >= 0) total += (size_t)(src[perm[i] + 1] - src[perm[i]]);
+            }
+            if (reserveHeap(out, total) != 0) {
+                freeColumnStorage(out);
+                return -1;
+            }
+            for (int i = 0; i < n; i++) {
+                size_t len = 0;
+                const char* text = "";
+                if (perm[i] >= 0) {
+                    text = stringAt(col, perm[i], &len);
+                } else {
+                    has_missing = 1;
+                }
+                appendString(out, i, text, len);
+            }
+            break;
+        }
+        case DTYPE_CATEGORY: {
+            // Share the codes by copying the dictionary, then move the codes
+            CategoryDict* dict = copyCategoryDict(col->dict, n);
+            void* codes = alignedAlloc((size_t)(n > 0 ? n : 1) * (size_t)col->code_width);
+            if (!dict || !codes) {
+                if (dict) freeCategoryDict(dict);
+                alignedFree(codes);
+                freeColumnStorage(out);
+                return -1;
+            }
+            freeCategoryDict(out->dict);
+            alignedFree(out->data);
+            out->dict = dict;
+            out->data = codes;
+            out->code_width = col->code_width;
+            for (int i = 0; i < n; i++) {
+                if (perm[i] < 0) {
+                    setCode(out, i, 0);
+                    has_missing = 1;
+                } else {
+                    setCode(out, i, codeAt(col, perm[i]));
+                }
+            }
+            break;
+        }
+    }
+    if (has_missing) {
+        for (int i = 0; i < n; i++) {
+            if (perm[i] < 0 || isNullCell(col, perm[i])) markNull(out, i);
+        }
+    }
+    return 0;
+}
+
+// Shared state for gathering every column through one list of rows in parallel
+typedef struct {
+    const DataFrame* df;
+    const int* rows;
+    int num_rows;
+    Column* gathered;
+    int* status;
+} PermuteJob;
+
+// Function to gather one column of a PermuteJob (runs on a worker thread)
+static void permuteColumn(void* ctx, int col_index) {
+    PermuteJob* job = (PermuteJob*)ctx;
+    job->status[col_index] = gatherColumn(&job->df->columns[col_index], job->rows, job->num_rows,
+                                          &job->gathered[col_index]);
+}
+
+// Function to gather the given rows of every column into new storage in
+// gathered, one column per task. Returns -1 with nothing allocated when
+// any column fails.
+static int gatherColumns(const DataFrame* df, const int* rows, int num_rows, Column* gathered) {
+    PermuteJob job;
+    job.df = df;
+    job.rows = rows;
+    job.num_rows = num_rows;
+    job.gathered = gathered;
+    job.status = (int*)malloc((df->num_cols > 0 ? df->num_cols : 1) * sizeof(int));
+    if (!job.status) {
+        return -1;
+    }
+    parallelFor(df->num_cols, getNumThreads(), permuteColumn, &job);
+    int failed = 0;
+    for (int j = 0; j < df->num_cols; j++) {
+        failed |= job.status[j] != 0;
+    }
+    for (int j = 0; failed && j < df->num_cols; j++) {
+        if (job.status[j] == 0) {
+            freeColumnStorage(&gathered[j]);
+        }
+    }
+    free(job.status);
+    return failed ? -1 : 0;
+}
+
+// Function to reorder every column of the DataFrame by a row permutation.
+// Columns are gathered in parallel; on failure the DataFrame is unchanged.
+static int applyPermutation(DataFrame* df, const int* perm) {
+    if (df->num_cols == 0) {
+        return 0;
+    }
+    Column* gathered = (Column*)malloc(df->num_cols * sizeof(Column));
+    if (!gathered || gatherColumns(df, perm, df->num_rows, gathered) != 0) {
+        free(gathered);
+        return -1;
+    }
+    for (int j = 0; j < df->num_cols; j++) {
+        freeColumnStorage(&df->columns[j]);
+        df->columns[j].data = gathered[j].data;
+        df->columns[j].heap = gathered[j].heap;
+        df->columns[j].heap_size = gathered[j].heap_size;
+        df->columns[j].heap_capacity = gathered[j].heap_capacity;
+        df->columns[j].code_width = gathered[j].code_width;
+        df->columns[j].dict = gathered[j].dict;
+        df->columns[j].mapped = 0;
+        df->columns[j].validity = gathered[j].validity;
+        df->columns[j].null_count = gathered[j].null_count;
+    }
+    free(gathered);
+    df->capacity = df->num_rows;
+    return 0;
+}
+
+// Function to build a new DataFrame holding the given rows of df, in order
+static DataFrame* takeRows(const DataFrame* df, const int* rows, int num_rows) {
+    KernelSpan span;
+    beginKernel(&span, KERNEL_TAKE);
+    DataFrame* out = (DataFrame*)malloc(sizeof(DataFrame));
+    if (!out) {
+        endKernel(&span, 0);
+        return NULL;
+    }
+    out->columns = (Column*)calloc(df->num_cols > 0 ? df->num_cols : 1, sizeof(Column));
+    out->num_rows = num_rows;
+    out->num_cols = df->num_cols;
+    out->capacity = num_rows;
+    out->exports = 0;
+    out->mapping = NULL;
+    out->views = 0;
+    out->base = NULL;
+    out->readers = 0;
+    out->writing = 0;
+    out->indexes = NULL;
+    if (!out->columns || gatherColumns(df, rows, num_rows, out->columns) != 0) {
+        free(out->columns);
+        free(out);
+        endKernel(&span, 0);
+        return NULL;
+    }
+    int failed = 0;
+    for (int j = 0; j < df->num_cols; j++) {
+        out->columns[j].name = copyString(df->columns[j].name);
+        failed |= !out->columns[j].name;
+    }
+    if (failed) {
+        freeDataFrame(out);
+        endKernel(&span, 0);
+        return NULL;
+    }
+    endKernel(&span, num_rows);
+    return out;
+}
+
+// Function to copy rows [start, start + length) of a validity bitmap into a
+// new one, counting the cleared bits. Bits past the last row are set, as
+// they are in any bitmap.
+static uint64_t* sliceValidity(const uint64_t* validity, int start, int length, int64_t* null_count) {
+    size_t words = VALIDITY_WORDS(length > 0 ? length : 1);
+    uint64_t* out = (uint64_t*)malloc(words * sizeof(uint64_t));
+    if (!out) {
+        return NULL;
+    }
+    int shift = start & 63;
+    const uint64_t* src = validity + (start >> 6);
+    size_t src_words = VALIDITY_WORDS(shift + length);
+    int64_t nulls = 0;
+    for (size_t w = 0; w < words; w++) {
+        uint64_t word = w < src_words ? src[w] >> shift : 0;
+        if (shift && w + 1 < src_words) {
+            word |= src[w + 1] << (64 - shift);
+        }
+        int bits = length - (int)(w * 64);
+        if (bits < 64) {
+            word |= bits > 0 ? ~UINT64_C(0) << bits : ~UINT64_C(0);
+        }
+        nulls += 64 - popcount64(word);
+        out[w] = word;
+    }
+    *null_count = nulls;
+    return out;
+}
+
+// Function to make a DataFrame of rows [start, start + length) of df that
+// points into df's buffers instead of copying them; only the validity
+// bitmaps are copied. Category columns get a dictionary of their own over
+// df's values, indexed the first time a value is added. The caller ties
+// the view to the DataFrame that owns the buffers. Returns NULL when out
+// of memory.
+static DataFrame* sliceRows(const DataFrame* df, int start, int length) {
+    DataFrame* view = (DataFrame*)malloc(sizeof(DataFrame));
+    if (!view) {
+        return NULL;
+    }
+    view->columns = (Column*)calloc(df->num_cols > 0 ? df->num_cols : 1, sizeof(Column));
+    view->num_rows = length;
+    view->num_cols = df->num_cols;
+    view->capacity = length;
+    view->exports = 0;
+    view->mapping = NULL;
+    view->readers = 0;
+    view->writing = 0;
+    view->indexes = NULL;
+    view->views = 0;
+    view->base = NULL;
+    if (!view->columns) {
+        free(view);
+        return NULL;
+    }
+    int failed = 0;
+    for (int j = 0; !failed && j < df->num_cols; j++) {
+        const Column* src = &df->columns[j];
+        Column* col = &view->columns[j];
+        col->dtype = src->dtype;
+        col->code_width = src->code_width;
+        col->mapped = MAPPED_VALUES;
+        col->data = (char*)src->data + (size_t)start * columnWidth(src);
+        if (src->dtype == DTYPE_STRING) {
+            col->heap = src->heap;
+            col->heap_size = (size_t)STRING_OFFSETS(src)[start + length];
+            col->heap_capacity = col->heap_size;
+        }
+        col->name = copyString(src->name);
+        col->validity = sliceValidity(src->validity, start, length, &col->null_count);
+        failed = !col->name || !col->validity;
+        if (!failed && src->dict) {
+            CategoryDict* dict = (CategoryDict*)calloc(1, sizeof(CategoryDict));
+            if (dict) {
+                dict->values = src->dict->values;
+                dict->values.mapped = MAPPED_BUFFERS;
+                dict->values.heap_capacity = dict->values.heap_size;
+                dict->size = src->dict->size;
+                dict->capacity = dict->size;
+                dict->code_capacity = length;
+            }
+            col->dict = dict;
+            failed = !dict;
+        }
+    }
+    if (failed) {
+        freeDataFrame(view);
+        return NULL;
+    }
+    return view;
+}
+
+// Function to give a view storage of its own before it is changed, which
+// leaves the DataFrame it was sliced from alone and no longer pinned
+static int detachView(DataFrame* df) {
+    if (!df->base) {
+        return 0;
+    }
+    for (int j = 0; j < df->num_cols; j++) {
+        Column* col = &df->columns[j];
+        if (col->mapped && ownColumnStorage(col, df->num_rows) != 0) {
+            return -1;
+        }
+        if (col->dict && col->dict->values.mapped && ownColumnStorage(&col->dict->values, col->dict->size) != 0) {
+            return -1;
+        }
+    }
+    releaseBase(df);
+    return 0;
+}
+
+// Function to keep only the given columns of a DataFrame, in the given
+// order, freeing the others. Each column may be given once.
+static int selectColumns(DataFrame* df, const int* columns, int num_columns) {
+    Column* kept = (Column*)malloc((num_columns > 0 ? num_columns : 1) * sizeof(Column));
+    uint8_t* keep = (uint8_t*)calloc(df->num_cols > 0 ? df->num_cols : 1, 1);
+    if (!kept || !keep) {
+        free(kept);
+        free(keep);
+        return -1;
+    }
+    for (int j = 0; j < num_columns; j++) {
+        kept[j] = df->columns[columns[j]];
+        keep[columns[j]] = 1;
+    }
+    for (int j = 0; j < df->num_cols; j++) {
+        if (!keep[j]) {
+            freeColumn(&df->columns[j]);
+        }
+    }
+    free(keep);
+    free(df->columns);
+    df->columns = kept;
+    df->num_cols = num_columns;
+    return 0;
+}
+
+// Function to dictionary-encode a string column in place, giving up and
+// leaving the column unchanged once the dictionary would hold more than
+// max_size values. Returns 0 when encoded, 1 when given up and -1 when out
+// of memory.
+static int encodeCategoryColumn(Column* col, int num_rows, int capacity, int max_size) {
+    Column encoded = *col;
+    encoded.dtype = DTYPE_CATEGORY;
+    if (initColumnStorage(&encoded, capacity) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < num_rows; i++) {
+        if (isNullCell(col, i)) {
+            setCode(&encoded, i, 0);
+            markNull(&encoded, i);
+            continue;
+        }
+        size_t len;
+        const char* text = stringAt(col, i, &len);
+        int status = setCategoryCell(&encoded, i, text, len);
+        if (status != 0 || encoded.dict->size > max_size) {
+            freeColumnStorage(&encoded);
+            return status != 0 ? -1 : 1;
+        }
+    }
+    freeColumnStorage(col);
+    *col = encoded;
+    return 0;
+}
+
+// Function to convert a column to another dtype in place
+static int convertColumn(DataFrame* df, int col_index, DType dtype) {
+    Column* col = &df->columns[col_index];
+    if (col->dtype == dtype) {
+        return 0;
+    }
+    if (col->dtype == DTYPE_STRING && dtype == DTYPE_CATEGORY) {
+        if (encodeCategoryColumn(col, df->num_rows, df->capacity, INT_MAX) != 0) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        return 0;
+    }
+    Column converted = *col;
+    converted.dtype = dtype;
+    if (initColumnStorage(&converted, df->capacity) != 0) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    char buf[64];
+    for (int i = 0; i < df->num_rows; i++) {
+        if (isNullCell(col, i)) {
+            if (setNullCell(&converted, i) != 0) {
+                freeColumnStorage(&converted);
+                PyErr_NoMemory();
+                return -1;
+            }
+            continue;
+        }
+        size_t len;
+        const char* text = formatCell(col, i, buf, sizeof(buf), &len);
+        if (setCell(&converted, i, text, len) != 0) {
+            char shown[64];
+            snprintf(shown, sizeof(shown), "%.*s", (int)len, text);
+            freeColumnStorage(&converted);
+            PyErr_Format(PyExc_ValueError, "cannot convert value '%s' in row %d of column '%s' to %s",
+                         shown, i, col->name, dtypeName(dtype));
+            return -1;
+        }
+    }
+    freeColumnStorage(col);
+    *col = converted;
+    return 0;
+}
+
+// Function to cast a column of df in place, timed as one kernel
+static int castColumn(DataFrame* df, int col_index, DType dtype) {
+    KernelSpan span;
+    beginKernel(&span, KERNEL_CAST);
+    int status = convertColumn(df, col_index, dtype);
+    endKernel(&span, status == 0 ? df->num_rows : 0);
+    return status;
+}
+
+// Rows per chunk below which a sort is not split across threads
+#define SORT_MIN_CHUNK_ROWS (1 << 16)
+
+// Runs at most this long are insertion sorted rather than merged
+#define SORT_INSERTION_ROWS 16
+
+// One sort key: the column, its direction and where its missing values go
+typedef struct {
+    const Column* col;
+    int descending;
+    int nulls_first;
+} SortKey;
+
+// Function to compare two rows on each sort key in turn. Missing values are
+// placed by nulls_first whatever the direction of the key.
+static int compareSortRows(const SortKey* keys, int num_keys, int a, int b) {
+    for (int k = 0; k < num_keys; k++) {
+        const Column* col = keys[k].col;
+        int a_null = isNullCell(col, a), b_null = isNullCell(col, b);
+        if (a_null || b_null) {
+            if (a_null != b_null) {
+                return (a_null ? -1 : 1) * (keys[k].nulls_first ? 1 : -1);
+            }
+            continue;
+        }
+        int cmp = compareCells(col, a, b);
+        if (cmp != 0) {
+            return keys[k].descending ? -cmp : cmp;
+        }
+    }
+    return 0;
+}
+
+// Function to merge the sorted runs rows[0, mid) and rows[mid, n) into out.
+// Ties take the left run first, which keeps the merge stable.
+static void mergeSortedRuns(const int* rows, int mid, int n, int* out, const SortKey* keys, int num_keys) {
+    int i = 0, j = mid, o = 0;
+    while (i < mid && j < n) {
+        if (compareSortRows(keys, num_keys, rows[j], rows[i]) < 0) {
+            out[o++] = rows[j++];
+        } else {
+            out[o++] = rows[i++];
+        }
+    }
+    memcpy(out + o, rows + i, (size_t)(mid - i) * sizeof(int));
+    o += mid - i;
+    memcpy(out + o, rows + j, (size_t)(n - j) * sizeof(int));
+}
+
+// Function to stable-sort rows[0, n) by the sort keys, using tmp as scratch
+static void mergeSortRows(int* rows, int* tmp, int n, const SortKey* keys, int num_keys) {
+    if (n <= SORT_INSERTION_ROWS) {
+        for (int i = 1; i < n; i++) {
+            int row = rows[i];
+            int j = i;
+            while (j > 0 && compareSortRows(keys, num_keys, row, rows[j - 1]) < 0) {
+                rows[j] = rows[j - 1];
+                j--;
+            }
+            rows[j] = row;
+        }
+        return;
+    }
+    int mid = n / 2;
+    mergeSortRows(rows, tmp, mid, keys, num_keys);
+    mergeSortRows(rows + mid, tmp + mid, n - mid, keys, num_keys);
+    if (compareSortRows(keys, num_keys, rows[mid - 1], rows[mid]) <= 0) {
+        return;
+    }
+    mergeSortedRuns(rows, mid, n, tmp, keys, num_keys);
+    memcpy(rows, tmp, (size_t)n * sizeof(int));
+}
+
+// Function to map an int64 to an unsigned key with the same order
+static uint64_t int64OrderKey(int64_t value) {
+    return (uint64_t)value ^ (UINT64_C(1) << 63);
+}
+
+// Function to map a non-NaN float64 to an unsigned key with the same order;
+// -0.0 and 0.0 compare equal, so they share a key
+static uint64_t float64OrderKey(double value) {
+    if (value == 0.0) {
+        value = 0.0;
+    }
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits >> 63) ? ~bits : bits ^ (UINT64_C(1) << 63);
+}
+
+// Function to invert int64OrderKey
+static int64_t int64FromOrderKey(uint64_t key) {
+    return (int64_t)(key ^ (UINT64_C(1) << 63));
+}
+
+// Function to invert float64OrderKey
+static double float64FromOrderKey(uint64_t key) {
+    uint64_t bits = (key >> 63) ? key ^ (UINT64_C(1) << 63) : ~key;
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Function to rank the values of a category dictionary in sorted string
+// order, so category cells compare and sort by their codes' ranks. Ranks are
+// kept until a new value is added. Returns -1 when out of memory.
+static int categoryRanks(CategoryDict* dict) {
+    if (dict->ranks) {
+        return 0;
+    }
+    size_t slots = dict->size > 0 ? (size_t)dict->size : 1;
+    int* order = (int*)malloc(slots * sizeof(int));
+    int* tmp = (int*)malloc(slots * sizeof(int));
+    uint32_t* ranks = (uint32_t*)malloc(slots * sizeof(uint32_t));
+    if (!order || !tmp || !ranks) {
+        free(order);
+        free(tmp);
+        free(ranks);
+        return -1;
+    }
+    SortKey key = {&dict->values, 0, 0};
+    for (int code = 0; code < dict->size; code++) {
+        order[code] = code;
+    }
+    mergeSortRows(order, tmp, dict->size, &key, 1);
+    for (int i = 0; i < dict->size; i++) {
+        ranks[order[i]] = (uint32_t)i;
+    }
+    free(order);
+    free(tmp);
+    dict->ranks = ranks;
+    return 0;
+}
+
+// Function to map a non-missing cell to an unsigned key whose integer order
+// is the order of the cells (reversed for descending keys). Strings map to
+// their first 8 bytes, big-endian and zero padded; category cells map to the
+// rank of their code, which categoryRanks must have computed.
+static uint64_t radixKey(const SortKey* key, int row) {
+    const Column* col = key->col;
+    uint64_t bits = 0;
+    switch (col->dtype) {
+        case DTYPE_INT64:
+        case DTYPE_DATETIME:
+            bits = int64OrderKey(((int64_t*)col->data)[row]);
+            break;
+        case DTYPE_FLOAT64:
+            bits = float64OrderKey(((double*)col->data)[row]);
+            break;
+        case DTYPE_BOOL:
+            bits = ((uint8_t*)col->data)[row];
+            break;
+        case DTYPE_STRING: {
+            size_t len;
+            const unsigned char* text = (const unsigned char*)stringAt(col, row, &len);
+            for (size_t i = 0; i < 8; i++) {
+                bits = (bits << 8) | (i < len ? text[i] : 0);
+            }
+            break;
+        }
+        case DTYPE_CATEGORY:
+            bits = col->dict->ranks[codeAt(col, row)];
+            break;
+    }
+    return key->descending ? ~bits : bits;
+}
+
+// Function to stable-sort (keys[i], rows[i]) pairs by key with an LSD radix
+// sort over bytes. Passes where every key has the same byte are skipped, so
+// narrow value ranges cost fewer passes.
+static void radixSortPairs(uint64_t* keys, int* rows, uint64_t* key_tmp, int* row_tmp, int n) {
+    if (n < 2) {
+        return;
+    }
+    size_t counts[8][256];
+    memset(counts, 0, sizeof(counts));
+    for (int i = 0; i < n; i++) {
+        uint64_t key = keys[i];
+        for (int b = 0; b < 8; b++) {
+            counts[b][(key >> (8 * b)) & 0xFF]++;
+        }
+    }
+    uint64_t* src_keys = keys;
+    int* src_rows = rows;
+    for (int b = 0; b < 8; b++) {
+        size_t* count = counts[b];
+        int shift = 8 * b;
+        if (count[(src_keys[0] >> shift) & 0xFF] == (size_t)n) {
+            continue;
+        }
+        size_t offset = 0;
+        for (int d = 0; d < 256; d++) {
+            size_t c = count[d];
+            count[d] = offset;
+            offset += c;
+        }
+        for (int i = 0; i < n; i++) {
+            size_t pos = count[(src_keys[i] >> shift) & 0xFF]++;
+            key_tmp[pos] = src_keys[i];
+            row_tmp[pos] = src_rows[i];
+        }
+        uint64_t* swap_keys = src_keys;
+        int* swap_rows = src_rows;
+        src_keys = key_tmp;
+        src_rows = row_tmp;
+        key_tmp = swap_keys;
+        row_tmp = swap_rows;
+    }
+    if (src_keys != keys) {
+        memcpy(keys, src_keys, (size_t)n * sizeof(uint64_t));
+        memcpy(rows, src_rows, (size_t)n * sizeof(int));
+    }
+}
+
+// Scratch buffers for sorting a run of rows, each as long as the run
+typedef struct {
+    uint64_t* keys;
+    uint64_t* key_tmp;
+    int* row_tmp;
+    int* nulls;
+} SortScratch;
+
+// Function to stable-sort rows[0, n) by a single key: missing values are set
+// aside in order, the rest are radix sorted, and strings sharing an 8-byte
+// prefix are then ordered by a full comparison
+static void sortRowsByKey(int* rows, int n, const SortKey* key, SortScratch* scratch) {
+    int count = 0, num_nulls = 0;
+    for (int i = 0; i < n; i++) {
+        if (isNullCell(key->col, rows[i])) {
+            scratch->nulls[num_nulls++] = rows[i];
+        } else {
+            scratch->keys[count] = radixKey(key, rows[i]);
+            rows[count++] = rows[i];
+        }
+    }
+    radixSortPairs(scratch->keys, rows, scratch->key_tmp, scratch->row_tmp, count);
+    if (key->col->dtype == DTYPE_STRING) {
+        int start = 0;
+        while (start < count) {
+            size_t first_len, len;
+            stringAt(key->col, rows[start], &first_len);
+            int ambiguous = first_len > 8;
+            int end = start + 1;
+            while (end < count && scratch->keys[end] == scratch->keys[start]) {
+                stringAt(key->col, rows[end], &len);
+                ambiguous |= len > 8 || len != first_len;
+                end++;
+            }
+            if (ambiguous) {
+                mergeSortRows(rows + start, scratch->row_tmp, end - start, key, 1);
+            }
+            start = end;
+        }
+    }
+    if (num_nulls == 0) {
+        return;
+    }
+    if (key->nulls_first) {
+        memmove(rows + num_nulls, rows, (size_t)count * sizeof(int));
+        memcpy(rows, scratch->nulls, (size_t)num_nulls * sizeof(int));
+    } else {
+        memcpy(rows + count, scratch->nulls, (size_t)num_nulls * sizeof(int));
+    }
+}
+
+// Shared state for a parallel argsort: chunk sorts, then pairwise merges
+typedef struct {
+    const SortKey* keys;
+    int num_keys;
+    int* rows;
+    int* tmp;
+    uint64_t* radix_keys;
+    uint64_t* radix_tmp;
+    int* nulls;
+    int* bounds;      // chunk c covers rows [bounds[c], bounds[c + 1])
+    int num_chunks;
+    int span;         // chunks per sorted run in the current merge round
+} SortJob;
+
+// Function to sort one chunk of rows by every key, least significant key
+// first (runs on a worker thread)
+static void sortChunk(void* ctx, int chunk) {
+    SortJob* job = (SortJob*)ctx;
+    int begin = job->bounds[chunk];
+    int n = job->bounds[chunk + 1] - begin;
+    int* rows = job->rows + begin;
+    for (int i = 0; i < n; i++) {
+        rows[i] = begin + i;
+    }
+    SortScratch scratch;
+    scratch.keys = job->radix_keys + begin;
+    scratch.key_tmp = job->radix_tmp + begin;
+    scratch.row_tmp = job->tmp + begin;
+    scratch.nulls = job->nulls + begin;
+    for (int k = job->num_keys - 1; k >= 0; k--) {
+        sortRowsByKey(rows, n, &job->keys[k], &scratch);
+    }
+}
+
+// Function to merge one pair of neighbouring sorted runs from rows into tmp
+// (runs on a worker thread)
+static void mergeSortRunPair(void* ctx, int pair) {
+    SortJob* job = (SortJob*)ctx;
+    int first = pair * 2 * job->span;
+    int middle = first + job->span < job->num_chunks ? first + job->span : job->num_chunks;
+    int last = middle + job->span < job->num_chunks ? middle + job->span : job->num_chunks;
+    int begin = job->bounds[first];
+    mergeSortedRuns(job->rows + begin, job->bounds[middle] - begin, job->bounds[last] - begin, job->tmp + begin,
+                    job->keys, job->num_keys);
+}
+
+// Function to compute the stable permutation that orders the DataFrame's
+// rows by the sort keys. Chunks of rows are sorted on separate threads and
+// then merged pairwise. Returns a malloc'd array of num_rows row indices, or
+// NULL when out of memory.
+static int* argsortRows(const DataFrame* df, const SortKey* keys, int num_keys) {
+    int n = df->num_rows;
+    size_t slots = n > 0 ? (size_t)n : 1;
+    int num_chunks = n / SORT_MIN_CHUNK_ROWS;
+    if (num_chunks > getNumThreads()) num_chunks = getNumThreads();
+    if (num_chunks < 1) num_chunks = 1;
+
+    KernelSpan span;
+    beginKernel(&span, KERNEL_SORT);
+    SortJob job;
+    job.keys = keys;
+    job.num_keys = num_keys;
+    job.rows = (int*)malloc(slots * sizeof(int));
+    job.tmp = (int*)malloc(slots * sizeof(int));
+    job.radix_keys = (uint64_t*)malloc(slots * sizeof(uint64_t));
+    job.radix_tmp = (uint64_t*)malloc(slots * sizeof(uint64_t));
+    job.nulls = (int*)malloc(slots * sizeof(int));
+    job.bounds = (int*)malloc((num_chunks + 1) * sizeof(int));
+    job.num_chunks = num_chunks;
+    int ok = job.rows && job.tmp && job.radix_keys && job.radix_tmp && job.nulls && job.bounds;
+    if (ok) {
+        for (int c = 0; c <= num_chunks; c++) {
+            job.bounds[c] = (int)((int64_t)n * c / num_chunks);
+        }
+        parallelFor(num_chunks, num_chunks, sortChunk, &job);
+    }
+    free(job.radix_keys);
+    free(job.radix_tmp);
+    free(job.nulls);
+    if (!ok) {
+        free(job.rows);
+        free(job.tmp);
+        free(job.bounds);
+        endKernel(&span, 0);
+        return NULL;
+    }
+
+    for (job.span = 1; job.span < num_chunks; job.span *= 2) {
+        int num_pairs = (num_chunks + 2 * job.span - 1) / (2 * job.span);
+        parallelFor(num_pairs, num_pairs, mergeSortRunPair, &job);
+        int* swap = job.rows;
+        job.rows = job.tmp;
+        job.tmp = swap;
+    }
+    free(job.tmp);
+    free(job.bounds);
+    endKernel(&span, n);
+    return job.rows;
+}
+
+// Function to decide whether row a comes before row b in sort-key order,
+// with ties going to the earlier row
+static int sortRowBefore(const SortKey* keys, int num_keys, int a, int b) {
+    int cmp = compareSortRows(keys, num_keys, a, b);
+    return cmp < 0 || (cmp == 0 && a < b);
+}
+
+// Function to move heap[i] up a top-k heap, whose root is the kept row
+// that sorts last
+static void topKSiftUp(int* heap, int i, const SortKey* keys, int num_keys) {
+    int row = heap[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!sortRowBefore(keys, num_keys, heap[parent], row)) {
+            break;
+        }
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = row;
+}
+
+// Function to move heap[i] down a top-k heap of the given size
+static void topKSiftDown(int* heap, int size, int i, const SortKey* keys, int num_keys) {
+    int row = heap[i];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= size) {
+            break;
+        }
+        if (child + 1 < size && sortRowBefore(keys, num_keys, heap[child], heap[child + 1])) {
+            child++;
+        }
+        if (!sortRowBefore(keys, num_keys, row, heap[child])) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = row;
+}
+
+// Shared state for a parallel top-k: one bounded heap per chunk of rows
+typedef struct {
+    const SortKey* keys;
+    int num_keys;
+    int num_rows;
+    int k;
+    int num_chunks;
+    int* heaps;       // chunk c keeps its rows in heaps[c * k, c * k + k)
+    int* sizes;
+} TopKJob;
+
+// Function to find the first k rows of one chunk in sort-key order with a
+// bounded heap (runs on a worker thread). Rows missing the primary key are
+// skipped. For non-string primary keys most rows are rejected by comparing
+// radix keys against the heap root, without a full row comparison.
+static void topKChunk(void* ctx, int chunk) {
+    TopKJob* job = (TopKJob*)ctx;
+    const SortKey* primary = &job->keys[0];
+    int begin = (int)((int64_t)job->num_rows * chunk / job->num_chunks);
+    int end = (int)((int64_t)job->num_rows * (chunk + 1) / job->num_chunks);
+    int* heap = job->heaps + (size_t)chunk * job->k;
+    int size = 0;
+    int fast = primary->col->dtype != DTYPE_STRING;
+    uint64_t root_key = 0;
+    for (int row = begin; row < end; row++) {
+        if (isNullCell(primary->col, row)) {
+            continue;
+        }
+        if (size < job->k) {
+            heap[size] = row;
+            topKSiftUp(heap, size++, job->keys, job->num_keys);
+            if (fast && size == job->k) {
+                root_key = radixKey(primary, heap[0]);
+            }
+            continue;
+        }
+        if (fast && radixKey(primary, row) > root_key) {
+            continue;
+        }
+        if (!sortRowBefore(job->keys, job->num_keys, row, heap[0])) {
+            continue;
+        }
+        heap[0] = row;
+        topKSiftDown(heap, size, 0, job->keys, job->num_keys);
+        if (fast) {
+            root_key = radixKey(primary, heap[0]);
+        }
+    }
+    job->sizes[chunk] = size;
+}
+
+// Function to compare two row indices, for qsort
+static int compareRowIndices(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// Function to find the first k rows of the DataFrame in sort-key order in
+// O(n log k). Each chunk of rows keeps its own heap on its own thread; the
+// candidates are then merged. Stores the row count found (at most k) and
+// returns a malloc'd array of rows in order, or NULL when out of memory.
+static int* topKRows(const DataFrame* df, const SortKey* keys, int num_keys, int k, int* count) {
+    if (k > df->num_rows) k = df->num_rows;
+    if (k < 0) k = 0;
+    int num_chunks = df->num_rows / SORT_MIN_CHUNK_ROWS;
+    if (num_chunks > getNumThreads()) num_chunks = getNumThreads();
+    if (num_chunks < 1) num_chunks = 1;
+
+    KernelSpan span;
+    beginKernel(&span, KERNEL_TOP_K);
+    TopKJob job;
+    job.keys = keys;
+    job.num_keys = num_keys;
+    job.num_rows = df->num_rows;
+    job.k = k;
+    job.num_chunks = num_chunks;
+    job.heaps = (int*)malloc(((size_t)num_chunks * k + 1) * sizeof(int));
+    job.sizes = (int*)calloc(num_chunks, sizeof(int));
+    int* tmp = (int*)malloc(((size_t)num_chunks * k + 1) * sizeof(int));
+    if (!job.heaps || !job.sizes || !tmp) {
+        free(job.heaps);
+        free(job.sizes);
+        free(tmp);
+        endKernel(&span, 0);
+        return NULL;
+    }
+    if (k > 0) {
+        parallelFor(num_chunks, num_chunks, topKChunk, &job);
+    }
+
+    // Pack the candidates, put them in row order, then stable-sort by key
+    int candidates = 0;
+    for (int c = 0; c < num_chunks; c++) {
+        memmove(job.heaps + candidates, job.heaps + (size_t)c * k, (size_t)job.sizes[c] * sizeof(int));
+        candidates += job.sizes[c];
+    }
+    qsort(job.heaps, candidates, sizeof(int), compareRowIndices);
+    mergeSortRows(job.heaps, tmp, candidates, keys, num_keys);
+    free(job.sizes);
+    free(tmp);
+    *count = candidates < k ? candidates : k;
+    endKernel(&span, df->num_rows);
+    return job.heaps;
+}
+
+// Rows per chunk below which hashing is not split across threads
+#define HASH_MIN_CHUNK_ROWS (1 << 16)
+
+// Initial slot count of a ValueTable; always a power of two
+#define VALUE_TABLE_INITIAL_CAPACITY 64
+
+// Function to get the bits of a double with -0.0 and NaN made canonical,
+// so equal values have equal bits
+static uint64_t float64ValueKey(double value) {
+    if (value == 0.0) value = 0.0;
+    if (isnan(value)) value = NAN;
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// Function to compute the hash-table key of a cell: the bits of the value
+// for fixed-width columns (with -0.0 and NaN made canonical), or a hash of
+// the bytes for strings
+static uint64_t valueKey(const Column* col, int row) {
+    switch (col->dtype) {
+        case DTYPE_INT64:
+        case DTYPE_DATETIME:
+            return (uint64_t)((int64_t*)col->data)[row];
+        case DTYPE_FLOAT64:
+            return float64ValueKey(((double*)col->data)[row]);
+        case DTYPE_BOOL:
+            return ((uint8_t*)col->data)[row];
+        case DTYPE_STRING: {
+            size_t len;
+            const char* text = stringAt(col, row, &len);
+            return hashBytes(text, len);
+        }
+        case DTYPE_CATEGORY:
+            return codeAt(col, row);
+    }
+    return 0;
+}
+
+// Function to check whether row a of column x and row b of column y, of
+// the same dtype or both string and category, hold the same value
+static int sameValueAcross(const Column* x, int a, const Column* y, int b) {
+    if (isTextColumn(x)) {
+        size_t a_len, b_len;
+        const char* s = stringAt(x, a, &a_len);
+        const char* t = stringAt(y, b, &b_len);
+        return a_len == b_len && memcmp(s, t, a_len) == 0;
+    }
+    return valueKey(x, a) == valueKey(y, b);
+}
+
+// One distinct value in a ValueTable: its key, the first row holding it
+// and how often it occurs
+typedef struct {
+    uint64_t key;
+    int row;          // -1 marks an empty slot
+    int64_t count;
+} ValueSlot;
+
+// Open-addressing (linear probing) hash table from the values of one column
+// to their counts. Slots refer back to rows rather than copying values, so
+// strings are compared in place in the column's heap. Missing values are
+// counted beside the slots so they never collide with a stored value.
+typedef struct {
+    const Column* col;
+    ValueSlot* slots;
+    size_t capacity;  // power of two, kept at least twice size
+    size_t size;
+    int null_row;     // first missing row, -1 if none was counted
+    int64_t null_count;
+} ValueTable;
+
+// Function to set up an empty ValueTable with the given power-of-two capacity
+static int initValueTable(ValueTable* table, const Column* col, size_t capacity) {
+    table->col = col;
+    table->capacity = capacity;
+    table->size = 0;
+    table->null_row = -1;
+    table->null_count = 0;
+    table->slots = (ValueSlot*)malloc(capacity * sizeof(ValueSlot));
+    if (!table->slots) {
+        return -1;
+    }
+    for (size_t i = 0; i < capacity; i++) {
+        table->slots[i].row = -1;
+    }
+    return 0;
+}
+
+// Function to free the slots of a ValueTable
+static void freeValueTable(ValueTable* table) {
+    free(table->slots);
+    table->slots = NULL;
+    table->capacity = 0;
+    table->size = 0;
+}
+
+// Function to find the slot holding the value with this key and row, or the
+// empty slot where it belongs
+static ValueSlot* findValueSlot(const ValueTable* table, uint64_t key, int row) {
+    const Column* col = table->col;
+    int is_string = col->dtype == DTYPE_STRING;
+    size_t mask = table->capacity - 1;
+    size_t i = (size_t)(is_string ? key : mixHash(key)) & mask;
+    for (;; i = (i + 1) & mask) {
+        ValueSlot* slot = &table->slots[i];
+        if (slot->row < 0) {
+            return slot;
+        }
+        if (slot->key != key) {
+            continue;
+        }
+        if (!is_string) {
+            return slot;
+        }
+        size_t a_len, b_len;
+        const char* a = stringAt(col, slot->row, &a_len);
+        const char* b = stringAt(col, row, &b_len);
+        if (a_len == b_len && memcmp(a, b, a_len) == 0) {
+            return slot;
+        }
+    }
+}
+
+// Function to double the capacity of a ValueTable and rehash its slots
+static int growValueTable(ValueTable* table) {
+    ValueTable grown;
+    if (initValueTable(&grown, table->col, table->capacity * 2) != 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < table->capacity; i++) {
+        ValueSlot* slot = &table->slots[i];
+        if (slot->row >= 0) {
+            *findValueSlot(&grown, slot->key, slot->row) = *slot;
+        }
+    }
+    grown.size = table->size;
+    grown.null_row = table->null_row;
+    grown.null_count = table->null_count;
+    free(table->slots);
+    *table = grown;
+    return 0;
+}
+
+// Function to add count occurrences of the value in row to a ValueTable,
+// keeping the earliest row seen for each value
+static int addValue(ValueTable* table, uint64_t key, int row, int64_t count) {
+    if ((table->size + 1) * 2 > table->capacity && growValueTable(table) != 0) {
+        return -1;
+    }
+    ValueSlot* slot = findValueSlot(table, key, row);
+    if (slot->row < 0) {
+        slot->key = key;
+        slot->row = row;
+        slot->count = count;
+        table->size++;
+        return 0;
+    }
+    slot->count += count;
+    if (row < slot->row) {
+        slot->row = row;
+    }
+    return 0;
+}
+
+// Shared state for counting a column's values: one ValueTable per chunk
+typedef struct {
+    const Column* col;
+    int num_rows;
+    int num_chunks;
+    int skip_nulls;
+    ValueTable* tables;
+    int* status;
+} ValueCountJob;
+
+// Function to count the codes of one chunk of a category column into a
+// histogram indexed by code, then move the used codes into the chunk's table
+static int countChunkCodes(const ValueCountJob* job, ValueTable* table, int begin, int end) {
+    const Column* col = job->col;
+    int size = col->dict->size > 0 ? col->dict->size : 1;
+    int64_t* counts = (int64_t*)calloc(size, sizeof(int64_t));
+    int* first = (int*)malloc(size * sizeof(int));
+    if (!counts || !first) {
+        free(counts);
+        free(first);
+        return -1;
+    }
+    for (int row = begin; row < end; row++) {
+        if (isNullCell(col, row)) {
+            if (!job->skip_nulls) {
+                if (table->null_row < 0) table->null_row = row;
+                table->null_count++;
+            }
+            continue;
+        }
+        uint32_t code = codeAt(col, row);
+        if (counts[code]++ == 0) {
+            first[code] = row;
+        }
+    }
+    int status = 0;
+    for (int code = 0; code < col->dict->size && status == 0; code++) {
+        if (counts[code] > 0) {
+            status = addValue(table, (uint64_t)code, first[code], counts[code]);
+        }
+    }
+    free(counts);
+    free(first);
+    return status;
+}
+
+// Function to count the values in one chunk of rows into that chunk's own
+// table (runs on a worker thread). int64 columns without missing values
+// take a loop that reads the keys straight from the column, and category
+// columns are counted as a histogram of their codes.
+static void countChunkValues(void* ctx, int chunk) {
+    ValueCountJob* job = (ValueCountJob*)ctx;
+    const Column* col = job->col;
+    int begin = (int)((int64_t)job->num_rows * chunk / job->num_chunks);
+    int end = (int)((int64_t)job->num_rows * (chunk + 1) / job->num_chunks);
+    ValueTable* table = &job->tables[chunk];
+    int status = initValueTable(table, col, VALUE_TABLE_INITIAL_CAPACITY);
+    if (status == 0 && col->dtype == DTYPE_CATEGORY) {
+        status = countChunkCodes(job, table, begin, end);
+    } else if (status == 0 && col->dtype == DTYPE_INT64 && col->null_count == 0) {
+        const int64_t* values = (const int64_t*)col->data;
+        for (int row = begin; row < end && status == 0; row++) {
+            status = addValue(table, (uint64_t)values[row], row, 1);
+        }
+    } else if (status == 0) {
+        for (int row = begin; row < end && status == 0; row++) {
+            if (isNullCell(col, row)) {
+                if (!job->skip_nulls) {
+                    if (table->null_row < 0) table->null_row = row;
+                    table->null_count++;
+                }
+                continue;
+            }
+            status = addValue(table, valueKey(col, row), row, 1);
+        }
+    }
+    job->status[chunk] = status;
+}
+
+// Function to count the distinct values of a column into a ValueTable.
+// Chunks of rows are counted on separate threads and the partial tables
+// merged afterwards. Missing values are left out when skip_nulls is set.
+static int countValues(const Column* col, int num_rows, int skip_nulls, ValueTable* out) {
+    int num_chunks = num_rows / HASH_MIN_CHUNK_ROWS;
+    if (num_chunks > getNumThreads()) num_chunks = getNumThreads();
+    if (num_chunks < 1) num_chunks = 1;
+    ValueCountJob job;
+    job.col = col;
+    job.num_rows = num_rows;
+    job.num_chunks = num_chunks;
+    job.skip_nulls = skip_nulls;
+    job.tables = (ValueTable*)calloc(num_chunks, sizeof(ValueTable));
+    job.status = (int*)malloc(num_chunks * sizeof(int));
+    if (!job.tables || !job.status) {
+        free(job.tables);
+        free(job.status);
+        return -1;
+    }
+    KernelSpan span;
+    beginKernel(&span, KERNEL_VALUE_COUNTS);
+    parallelFor(num_chunks, num_chunks, countChunkValues, &job);
+    int status = 0;
+    for (int c = 0; c < num_chunks; c++) {
+        status |= job.status[c];
+    }
+
+    // Fold the later chunks into the first; its rows come first, so each
+    // value keeps its earliest row
+    for (int c = 1; c < num_chunks; c++) {
+        ValueTable* partial = &job.tables[c];
+        for (size_t i = 0; status == 0 && i < partial->capacity; i++) {
+            ValueSlot* slot = &partial->slots[i];
+            if (slot->row >= 0) {
+                status = addValue(&job.tables[0], slot->key, slot->row, slot->count);
+            }
+        }
+        if (partial->null_count > 0) {
+            if (job.tables[0].null_row < 0) job.tables[0].null_row = partial->null_row;
+            job.tables[0].null_count += partial->null_count;
+        }
+        freeValueTable(partial);
+    }
+    if (status != 0) {
+        freeValueTable(&job.tables[0]);
+    } else {
+        *out = job.tables[0];
+    }
+    free(job.tables);
+    free(job.status);
+    endKernel(&span, num_rows);
+    return status;
+}
+
+// Function to order value slots by descending count, then by first row, for qsort
+static int compareSlotsByCount(const void* a, const void* b) {
+    const ValueSlot* x = (const ValueSlot*)a;
+    const ValueSlot* y = (const ValueSlot*)b;
+    if (x->count != y->count) {
+        return x->count > y->count ? -1 : 1;
+    }
+    return (x->row > y->row) - (x->row < y->row);
+}
+
+// Function to order value slots by first row, for qsort
+static int compareSlotsByRow(const void* a, const void* b) {
+    const ValueSlot* x = (const ValueSlot*)a;
+    const ValueSlot* y = (const ValueSlot*)b;
+    return (x->row > y->row) - (x->row < y->row);
+}
+
+// Function to copy the occupied slots of a ValueTable, plus one slot for its
+// missing values if any were counted, into a malloc'd array sorted with
+// compare. Returns NULL when out of memory.
+static ValueSlot* sortedValueSlots(const ValueTable* table, int (*compare)(const void*, const void*), size_t* count) {
+    ValueSlot* sorted = (ValueSlot*)malloc((table->size + 1) * sizeof(ValueSlot));
+    if (!sorted) {
+        return NULL;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->slots[i].row >= 0) {
+            sorted[n++] = table->slots[i];
+        }
+    }
+    if (table->null_count > 0) {
+        sorted[n].key = 0;
+        sorted[n].row = table->null_row;
+        sorted[n].count = table->null_count;
+        n++;
+    }
+    qsort(sorted, n, sizeof(ValueSlot), compare);
+    *count = n;
+    return sorted;
+}
+
+// Capacity of the top level of a QuantileSketch; each level below gets 2/3
+// of the room of the one above
+#define SKETCH_K 1024
+
+// Levels a QuantileSketch keeps; lower weights are handled by sampling
+#define SKETCH_LIVE_LEVELS 6
+
+// Enough QuantileSketch levels for 2^62 values
+#define SKETCH_MAX_LEVELS 64
+
+// KLL-style streaming quantile sketch over doubles. Level h holds values
+// that each stand for 2^h inputs. When a level outgrows its capacity every
+// other value of it in sorted order (from a random offset) is promoted to
+// the next level, so the total weight always equals the number of values
+// added. Only SKETCH_LIVE_LEVELS levels are kept: once the sketch grows
+// taller, inputs are sampled one per block of 2^min_level before they
+// reach the lowest level, which makes an update O(1) amortized. The lowest
+// level is sorted at compaction; the levels above are kept sorted by
+// merging promoted values in. Until the first compaction the sketch holds
+// every value and its quantiles are exact.
+typedef struct {
+    double* levels[SKETCH_MAX_LEVELS];
+    int sizes[SKETCH_MAX_LEVELS];
+    int min_level;           // lowest live level; inputs are sampled above 0
+    int num_levels;          // live levels are [min_level, num_levels)
+    int bottom_capacity;
+    int64_t block_seen;      // inputs seen in the current sampling block
+    int64_t block_pick;      // which of them becomes the sample
+    double block_value;
+    double* scratch;
+    uint64_t rng;
+    int failed;
+} QuantileSketch;
+
+// Function to step the sketch's xorshift random number generator
+static uint64_t sketchRandom(QuantileSketch* sketch) {
+    sketch->rng ^= sketch->rng << 13;
+    sketch->rng ^= sketch->rng >> 7;
+    sketch->rng ^= sketch->rng << 17;
+    return sketch->rng;
+}
+
+// Function to get the capacity of a sketch level
+static int sketchCapacity(const QuantileSketch* sketch, int level) {
+    return (int)(SKETCH_K * pow(2.0 / 3.0, sketch->num_levels - 1 - level));
+}
+
+// Function to add an empty level on top of a sketch
+static int addSketchLevel(QuantileSketch* sketch) {
+    if (sketch->num_levels == SKETCH_MAX_LEVELS) {
+        return -1;
+    }
+    double* items = (double*)malloc((2 * SKETCH_K + 2) * sizeof(double));
+    if (!items) {
+        return -1;
+    }
+    sketch->levels[sketch->num_levels] = items;
+    sketch->sizes[sketch->num_levels] = 0;
+    sketch->num_levels++;
+    sketch->bottom_capacity = sketchCapacity(sketch, sketch->min_level);
+    return 0;
+}
+
+// Function to set up an empty sketch with a fixed seed, so results repeat
+static void initSketch(QuantileSketch* sketch) {
+    sketch->min_level = 0;
+    sketch->num_levels = 0;
+    sketch->block_seen = 0;
+    sketch->block_pick = 0;
+    sketch->block_value = 0.0;
+    sketch->rng = UINT64_C(0x853c49e6748fea9b);
+    sketch->scratch = (double*)malloc((2 * SKETCH_K + 2) * sizeof(double));
+    sketch->failed = !sketch->scratch || addSketchLevel(sketch) != 0;
+}
+
+// Function to free the levels of a sketch
+static void freeSketch(QuantileSketch* sketch) {
+    for (int h = sketch->min_level; h < sketch->num_levels; h++) {
+        free(sketch->levels[h]);
+    }
+    free(sketch->scratch);
+    sketch->num_levels = 0;
+}
+
+// Function to sort an array of non-NaN doubles in place (quicksort with a
+// median-of-three pivot, finishing short ranges by insertion)
+static void sortDoubles(double* values, int n) {
+    while (n > 16) {
+        double a = values[0], b = values[n / 2], c = values[n - 1];
+        double pivot = a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+        int i = 0, j = n - 1;
+        while (i <= j) {
+            while (values[i] < pivot) i++;
+            while (values[j] > pivot) j--;
+            if (i <= j) {
+                double swap = values[i];
+                values[i++] = values[j];
+                values[j--] = swap;
+            }
+        }
+        // Recurse into the smaller side and loop on the larger one
+        if (j + 1 < n - i) {
+            sortDoubles(values, j + 1);
+            values += i;
+            n -= i;
+        } else {
+            sortDoubles(values + i, n - i);
+            n = j + 1;
+        }
+    }
+    for (int i = 1; i < n; i++) {
+        double value = values[i];
+        int j = i;
+        while (j > 0 && values[j - 1] > value) {
+            values[j] = values[j - 1];
+            j--;
+        }
+        values[j] = value;
+    }
+}
+
+// Function to promote every other value of sketch level h into level h + 1.
+// With an odd count the largest value is left behind, at this weight.
+static void promoteSketchLevel(QuantileSketch* sketch, int h) {
+    double* items = sketch->levels[h];
+    int size = sketch->sizes[h];
+    if (h == sketch->min_level) {
+        sortDoubles(items, size);
+    }
+    int offset = (int)(sketchRandom(sketch) & 1);
+    int pairs = size / 2;
+    double largest = items[size - 1];
+    for (int i = 0; i < pairs; i++) {
+        items[i] = items[2 * i + offset];
+    }
+    double* above = sketch->levels[h + 1];
+    int above_size = sketch->sizes[h + 1];
+    int i = 0, j = 0, o = 0;
+    while (i < pairs && j < above_size) {
+        sketch->scratch[o++] = above[j] < items[i] ? above[j++] : items[i++];
+    }
+    while (i < pairs) sketch->scratch[o++] = items[i++];
+    while (j < above_size) sketch->scratch[o++] = above[j++];
+    memcpy(above, sketch->scratch, (size_t)o * sizeof(double));
+    sketch->sizes[h + 1] = o;
+    sketch->sizes[h] = size & 1;
+    if (size & 1) {
+        items[0] = largest;
+    }
+}
+
+// Function to start a new sampling block of 2^min_level inputs, of which
+// the first seen have already been accounted for
+static void startSketchBlock(QuantileSketch* sketch, int64_t seen) {
+    sketch->block_seen = seen;
+    sketch->block_pick = (int64_t)(sketchRandom(sketch) & ((UINT64_C(1) << sketch->min_level) - 1));
+}
+
+// Function to compact every level of a sketch that is over capacity, adding
+// a level on top when the highest one fills and retiring the lowest into
+// the sampler when there are too many
+static void compactSketch(QuantileSketch* sketch) {
+    for (int h = sketch->min_level; h < sketch->num_levels; h++) {
+        if (sketch->sizes[h] < sketchCapacity(sketch, h)) {
+            continue;
+        }
+        if (h == sketch->num_levels - 1 && addSketchLevel(sketch) != 0) {
+            sketch->failed = 1;
+            return;
+        }
+        promoteSketchLevel(sketch, h);
+    }
+    if (sketch->num_levels - sketch->min_level <= SKETCH_LIVE_LEVELS) {
+        return;
+    }
+    // Empty the lowest level into the next one. A value left over stands for
+    // half of the next sampling block, and is the sample if the pick lands
+    // in that half.
+    int h = sketch->min_level;
+    if (sketch->sizes[h] > 1) {
+        promoteSketchLevel(sketch, h);
+    }
+    int leftover = sketch->sizes[h];
+    double value = sketch->levels[h][0];
+    free(sketch->levels[h]);
+    sketch->min_level++;
+    sketch->bottom_capacity = sketchCapacity(sketch, sketch->min_level);
+    startSketchBlock(sketch, leftover ? (int64_t)1 << h : 0);
+    if (leftover && sketch->block_pick < sketch->block_seen) {
+        sketch->block_value = value;
+    }
+}
+
+// Function to add a value to a sketch
+static void sketchAdd(QuantileSketch* sketch, double value) {
+    if (sketch->failed) {
+        return;
+    }
+    if (sketch->min_level > 0) {
+        if (sketch->block_seen++ == sketch->block_pick) {
+            sketch->block_value = value;
+        }
+        if (sketch->block_seen < ((int64_t)1 << sketch->min_level)) {
+            return;
+        }
+        value = sketch->block_value;
+        startSketchBlock(sketch, 0);
+    }
+    int h = sketch->min_level;
+    sketch->levels[h][sketch->sizes[h]++] = value;
+    if (sketch->sizes[h] >= sketch->bottom_capacity) {
+        compactSketch(sketch);
+    }
+}
+
+// One value retained by a sketch with the number of inputs it stands for
+typedef struct {
+    double value;
+    int64_t weight;
+} WeightedValue;
+
+// Function to order weighted values by value, for qsort
+static int compareWeightedValues(const void* a, const void* b) {
+    double x = ((const WeightedValue*)a)->value, y = ((const WeightedValue*)b)->value;
+    return (x > y) - (x < y);
+}
+
+// Function to estimate quantiles from a sketch, linearly interpolating
+// between neighbouring ranks like the exact method does. An unfinished
+// sampling block counts with the weight of the inputs it has seen.
+static int sketchQuantiles(QuantileSketch* sketch, const double* qs, int num_qs, double* out) {
+    size_t retained = 1;
+    for (int h = sketch->min_level; h < sketch->num_levels; h++) {
+        retained += (size_t)sketch->sizes[h];
+    }
+    WeightedValue* items = (WeightedValue*)malloc(retained * sizeof(WeightedValue));
+    if (!items) {
+        return -1;
+    }
+    size_t n = 0;
+    int64_t total = 0;
+    for (int h = sketch->min_level; h < sketch->num_levels; h++) {
+        for (int i = 0; i < sketch->sizes[h]; i++) {
+            items[n].value = sketch->levels[h][i];
+            items[n++].weight = (int64_t)1 << h;
+        }
+        total += (int64_t)sketch->sizes[h] << h;
+    }
+    if (sketch->min_level > 0 && sketch->block_seen > sketch->block_pick) {
+        items[n].value = sketch->block_value;
+        items[n++].weight = sketch->block_seen;
+        total += sketch->block_seen;
+    }
+    if (n == 0) {
+        for (int q = 0; q < num_qs; q++) out[q] = NAN;
+        free(items);
+        return 0;
+    }
+    qsort(items, n, sizeof(WeightedValue), compareWeightedValues);
+    for (int q = 0; q < num_qs; q++) {
+        double position = qs[q] * (double)(total - 1);
+        int64_t below = (int64_t)position;
+        double fraction = position - (double)below;
+
+        // Find the values holding ranks below and below + 1
+        double lo = items[n - 1].value, hi = items[n - 1].value;
+        int64_t seen = 0;
+        for (size_t i = 0; i < n; i++) {
+            seen += items[i].weight;
+            if (seen > below) {
+                lo = items[i].value;
+                hi = seen > below + 1 || i + 1 == n ? lo : items[i + 1].value;
+                break;
+            }
+        }
+        out[q] = lo + (hi - lo) * fraction;
+    }
+    free(items);
+    return 0;
+}
+
+// Values per block of the fused describe pass; one block stays in L1 cache
+#define DESCRIBE_BLOCK_ROWS 1024
+
+// Quantiles reported by describe
+static const double describe_quantiles[] = {0.25, 0.5, 0.75};
+#define NUM_DESCRIBE_QUANTILES 3
+
+// Count, mean and sum of squared deviations of a set of values, in a form
+// that two sets can be combined without losing precision
+typedef struct {
+    int64_t count;
+    double mean;
+    double m2;
+} Moments;
+
+// Function to fold the moments of one set of values into another (Chan et
+// al.'s pairwise update)
+static void mergeMoments(Moments* into, const Moments* part) {
+    if (part->count == 0) {
+        return;
+    }
+    if (into->count == 0) {
+        *into = *part;
+        return;
+    }
+    int64_t count = into->count + part->count;
+    double delta = part->mean - into->mean;
+    into->mean += delta * (double)part->count / (double)count;
+    into->m2 += part->m2 + delta * delta * (double)into->count * (double)part->count / (double)count;
+    into->count = count;
+}
+
+// Function to move the k-th smallest of keys[0, n) into keys[k], with every
+// key before it no larger and every key after it no smaller (quickselect)
+static void selectKth(uint64_t* keys, size_t n, size_t k) {
+    int64_t lo = 0, hi = (int64_t)n - 1, target = (int64_t)k;
+    while (lo < hi) {
+        // Median of three as the pivot
+        int64_t mid = lo + (hi - lo) / 2;
+        uint64_t a = keys[lo], b = keys[mid], c = keys[hi];
+        uint64_t pivot = a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+        int64_t i = lo, j = hi;
+        while (i <= j) {
+            while (keys[i] < pivot) i++;
+            while (keys[j] > pivot) j--;
+            if (i <= j) {
+                uint64_t swap = keys[i];
+                keys[i++] = keys[j];
+                keys[j--] = swap;
+            }
+        }
+        if (target <= j) {
+            hi = j;
+        } else if (target >= i) {
+            lo = i;
+        } else {
+            return;
+        }
+    }
+}
+
+// Function to find exact quantiles of n order keys (int64OrderKey or
+// float64OrderKey) by selection, in expected O(n) per quantile. The keys
+// are reordered. Stores the two neighbouring values each quantile falls
+// between and its fraction of the way from one to the other.
+static void exactQuantileKeys(uint64_t* keys, size_t n, const double* qs, int num_qs,
+                              uint64_t* lo, uint64_t* hi, double* fraction) {
+    for (int q = 0; q < num_qs; q++) {
+        double position = qs[q] * (double)(n - 1);
+        size_t below = (size_t)position;
+        fraction[q] = position - (double)below;
+        selectKth(keys, n, below);
+        lo[q] = keys[below];
+        hi[q] = lo[q];
+        if (below + 1 < n) {
+            hi[q] = keys[below + 1];
+            for (size_t i = below + 2; i < n; i++) {
+                if (keys[i] < hi[q]) hi[q] = keys[i];
+            }
+        }
+    }
+}
+
+// Summary statistics of one column, as reported by describe
+typedef struct {
+    int64_t count;
+    // int64 and float64 columns
+    double mean;
+    double std;
+    double min;
+    double max;
+    double quantiles[NUM_DESCRIBE_QUANTILES];
+    // datetime columns
+    int64_t datetime_mean;
+    int64_t datetime_min;
+    int64_t datetime_max;
+    int64_t datetime_quantiles[NUM_DESCRIBE_QUANTILES];
+    // string and bool columns
+    int64_t unique;
+    int top_row;
+    int64_t freq;
+    int status;
+} ColumnSummary;
+
+// Shared state for summarizing every column of a DataFrame in parallel
+typedef struct {
+    const DataFrame* df;
+    int exact;
+    ColumnSummary* summaries;
+} DescribeJob;
+
+// Running totals of an int64 or float64 column's summary. A summary can be
+// fed several columns in turn, e.g. the same column of successive chunks.
+typedef struct {
+    Moments total;
+    double min;
+    double max;
+    int sketched;           // feeds the quantile sketch
+    QuantileSketch sketch;
+} NumericSummary;
+
+// Function to start an empty numeric summary
+static void initNumericSummary(NumericSummary* summary, int sketched) {
+    summary->total.count = 0;
+    summary->total.mean = 0.0;
+    summary->total.m2 = 0.0;
+    summary->min = INFINITY;
+    summary->max = -INFINITY;
+    summary->sketched = sketched;
+    if (sketched) {
+        initSketch(&summary->sketch);
+    }
+}
+
+// Function to fold the values of an int64 or float64 column into a summary
+// in one pass over blocks of values. Each block's count, sum, min and max
+// are taken in four independent lanes the compiler can vectorize; its
+// squared deviations are then summed while the block is still in cache, and
+// the block's moments are merged into the running totals. The block also
+// feeds the quantile sketch.
+static void addNumericValues(NumericSummary* summary, const Column* col, int num_rows) {
+    double min = summary->min, max = summary->max;
+    double block[DESCRIBE_BLOCK_ROWS];
+    for (int begin = 0; begin < num_rows; begin += DESCRIBE_BLOCK_ROWS) {
+        int n = num_rows - begin < DESCRIBE_BLOCK_ROWS ? num_rows - begin : DESCRIBE_BLOCK_ROWS;
+        if (col->dtype == DTYPE_INT64) {
+            const int64_t* values = (const int64_t*)col->data + begin;
+            for (int i = 0; i < n; i++) block[i] = (double)values[i];
+            // Missing ints become NaN; blocks start on a word, and words
+            // without a missing row are skipped whole
+            for (int w = 0; col->null_count > 0 && w * 64 < n; w++) {
+                uint64_t missing = ~col->validity[begin / 64 + w];
+                while (missing) {
+                    int k = w * 64 + countTrailingZeros64(missing);
+                    if (k < n) block[k] = NAN;
+                    missing &= missing - 1;
+                }
+            }
+        } else {
+            memcpy(block, (const double*)col->data + begin, (size_t)n * sizeof(double));
+        }
+        double sums[4] = {0, 0, 0, 0}, mins[4] = {min, min, min, min}, maxs[4] = {max, max, max, max};
+        int64_t counts[4] = {0, 0, 0, 0};
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            for (int l = 0; l < 4; l++) {
+                double x = block[i + l];
+                int present = x == x;
+                counts[l] += present;
+                sums[l] += present ? x : 0.0;
+                mins[l] = x < mins[l] ? x : mins[l];
+                maxs[l] = x > maxs[l] ? x : maxs[l];
+            }
+        }
+        for (; i < n; i++) {
+            double x = block[i];
+            int present = x == x;
+            counts[0] += present;
+            sums[0] += present ? x : 0.0;
+            mins[0] = x < mins[0] ? x : mins[0];
+            maxs[0] = x > maxs[0] ? x : maxs[0];
+        }
+        Moments part;
+        part.count = counts[0] + counts[1] + counts[2] + counts[3];
+        if (part.count == 0) {
+            continue;
+        }
+        part.mean = (sums[0] + sums[1] + sums[2] + sums[3]) / (double)part.count;
+        part.m2 = 0.0;
+        for (i = 0; i < n; i++) {
+            double delta = block[i] == block[i] ? block[i] - part.mean : 0.0;
+            part.m2 += delta * delta;
+        }
+        mergeMoments(&summary->total, &part);
+        for (int l = 0; l < 4; l++) {
+            min = mins[l] < min ? mins[l] : min;
+            max = maxs[l] > max ? maxs[l] : max;
+        }
+        if (summary->sketched) {
+            for (i = 0; i < n; i++) {
+                if (block[i] == block[i]) sketchAdd(&summary->sketch, block[i]);
+            }
+        }
+    }
+    summary->min = min;
+    summary->max = max;
+}
+
+// Function to report a numeric summary, with sketched quantiles when it has
+// a sketch (NaN otherwise), and release it
+static int finishNumericSummary(NumericSummary* summary, ColumnSummary* out) {
+    const Moments* total = &summary->total;
+    out->count = total->count;
+    out->mean = total->count > 0 ? total->mean : NAN;
+    out->std = total->count > 1 ? sqrt(total->m2 / (double)(total->count - 1)) : NAN;
+    out->min = total->count > 0 ? summary->min : NAN;
+    out->max = total->count > 0 ? summary->max : NAN;
+    for (int q = 0; q < NUM_DESCRIBE_QUANTILES; q++) {
+        out->quantiles[q] = NAN;
+    }
+    if (!summary->sketched) {
+        return 0;
+    }
+    int status = 0;
+    if (summary->sketch.failed) {
+        status = -1;
+    } else if (total->count > 0) {
+        status = sketchQuantiles(&summary->sketch, describe_quantiles, NUM_DESCRIBE_QUANTILES, out->quantiles);
+    }
+    freeSketch(&summary->sketch);
+    summary->sketched = 0;
+    return status;
+}
+
+// Function to summarize an int64 or float64 column. Quantiles come from the
+// sketch or, when exact, from selection on the column's order keys.
+static int describeNumeric(const Column* col, int num_rows, int exact, ColumnSummary* out) {
+    NumericSummary summary;
+    initNumericSummary(&summary, !exact);
+    addNumericValues(&summary, col, num_rows);
+    int status = finishNumericSummary(&summary, out);
+    if (status != 0 || !exact || out->count == 0) {
+        return status;
+    }
+    uint64_t* keys = (uint64_t*)malloc((size_t)out->count * sizeof(uint64_t));
+    if (!keys) {
+        return -1;
+    }
+    size_t n = 0;
+    for (int row = 0; row < num_rows; row++) {
+        if (col->dtype == DTYPE_INT64) {
+            if (!isNullCell(col, row)) keys[n++] = int64OrderKey(((int64_t*)col->data)[row]);
+        } else if (!isnan(((double*)col->data)[row])) {
+            keys[n++] = float64OrderKey(((double*)col->data)[row]);
+        }
+    }
+    uint64_t lo[NUM_DESCRIBE_QUANTILES], hi[NUM_DESCRIBE_QUANTILES];
+    double fraction[NUM_DESCRIBE_QUANTILES];
+    exactQuantileKeys(keys, n, describe_quantiles, NUM_DESCRIBE_QUANTILES, lo, hi, fraction);
+    for (int q = 0; q < NUM_DESCRIBE_QUANTILES; q++) {
+        double a, b;
+        if (col->dtype == DTYPE_INT64) {
+            a = (double)int64FromOrderKey(lo[q]);
+            b = (double)int64FromOrderKey(hi[q]);
+        } else {
+            a = float64FromOrderKey(lo[q]);
+            b = float64FromOrderKey(hi[q]);
+        }
+        out->quantiles[q] = a + (b - a) * fraction[q];
+    }
+    free(keys);
+    return 0;
+}
+
+// Running totals of a datetime column's summary. Timestamps are summed
+// into 128 bits (two words, two's complement) so the mean is exact and
+// needs no second pass.
+typedef struct {
+    int64_t count;
+    int64_t min;
+    int64_t max;
+    uint64_t sum_hi;
+    uint64_t sum_lo;
+    int sketched;
+    QuantileSketch sketch;
+} DatetimeSummary;
+
+// Function to start an empty datetime summary
+static void initDatetimeSummary(DatetimeSummary* summary, int sketched) {
+    summary->count = 0;
+    summary->min = INT64_MAX;
+    summary->max = INT64_MIN;
+    summary->sum_hi = 0;
+    summary->sum_lo = 0;
+    summary->sketched = sketched;
+    if (sketched) {
+        initSketch(&summary->sketch);
+    }
+}
+
+// Function to fold the timestamps of a datetime column into a summary
+static void addDatetimeValues(DatetimeSummary* summary, const Column* col, int num_rows) {
+    const int64_t* values = (const int64_t*)col->data;
+    int64_t count = summary->count, min = summary->min, max = summary->max;
+    uint64_t sum_hi = summary->sum_hi, sum_lo = summary->sum_lo;
+    for (int row = 0; row < num_rows; row++) {
+        int64_t value = values[row];
+        if (value == DATETIME_NAT) continue;
+        count++;
+        min = value < min ? value : min;
+        max = value > max ? value : max;
+        sum_lo += (uint64_t)value;
+        sum_hi += (sum_lo < (uint64_t)value) + (value < 0 ? UINT64_MAX : 0);
+        if (summary->sketched) sketchAdd(&summary->sketch, (double)value);
+    }
+    summary->count = count;
+    summary->min = min;
+    summary->max = max;
+    summary->sum_hi = sum_hi;
+    summary->sum_lo = sum_lo;
+}
+
+// Function to divide a 128-bit two's complement sum by a positive count,
+// rounding toward zero; the quotient must fit in 64 bits
+static int64_t divideSum128(uint64_t hi, uint64_t lo, int64_t count) {
+    int negative = (int)(hi >> 63);
+    if (negative) {
+        lo = ~lo + 1;
+        hi = ~hi + (lo == 0);
+    }
+    uint64_t divisor = (uint64_t)count, remainder = hi % divisor, quotient = 0;
+    for (int bit = 63; bit >= 0; bit--) {
+        uint64_t carry = remainder >> 63;
+        remainder = (remainder << 1) | ((lo >> bit) & 1);
+        quotient <<= 1;
+        if (carry || remainder >= divisor) {
+            remainder -= divisor;
+            quotient |= 1;
+        }
+    }
+    return negative ? -(int64_t)quotient : (int64_t)quotient;
+}
+
+// Function to report a datetime summary, with sketched quantiles when it
+// has a sketch (NaT otherwise), and release it
+static int finishDatetimeSummary(DatetimeSummary* summary, ColumnSummary* out) {
+    out->count = summary->count;
+    out->datetime_mean = out->datetime_min = out->datetime_max = DATETIME_NAT;
+    for (int q = 0; q < NUM_DESCRIBE_QUANTILES; q++) {
+        out->datetime_quantiles[q] = DATETIME_NAT;
+    }
+    int status = 0;
+    if (summary->count > 0) {
+        out->datetime_mean = divideSum128(summary->sum_hi, summary->sum_lo, summary->count);
+        out->datetime_min = summary->min;
+        out->datetime_max = summary->max;
+    }
+    if (!summary->sketched) {
+        return 0;
+    }
+    if (summary->sketch.failed) {
+        status = -1;
+    } else if (summary->count > 0) {
+        double quantiles[NUM_DESCRIBE_QUANTILES];
+        status = sketchQuantiles(&summary->sketch, describe_quantiles, NUM_DESCRIBE_QUANTILES, quantiles);
+        for (int q = 0; status == 0 && q < NUM_DESCRIBE_QUANTILES; q++) {
+            double value = quantiles[q];
+            out->datetime_quantiles[q] = value <= (double)summary->min   ? summary->min
+                                         : value >= (double)summary->max ? summary->max
+                                                                         : (int64_t)value;
+        }
+    }
+    freeSketch(&summary->sketch);
+    summary->sketched = 0;
+    return status;
+}
+
+// Function to summarize a datetime column: count, exact mean, min, max and
+// quantiles. Quantiles come from the sketch or, when exact, from selection
+// on the int64 values.
+static int describeDatetime(const Column* col, int num_rows, int exact, ColumnSummary* out) {
+    DatetimeSummary summary;
+    initDatetimeSummary(&summary, !exact);
+    addDatetimeValues(&summary, col, num_rows);
+    int status = finishDatetimeSummary(&summary, out);
+    if (status != 0 || !exact || out->count == 0) {
+        return status;
+    }
+    const int64_t* values = (const int64_t*)col->data;
+    uint64_t* keys = (uint64_t*)malloc((size_t)out->count * sizeof(uint64_t));
+    if (!keys) {
+        return -1;
+    }
+    size_t n = 0;
+    for (int row = 0; row < num_rows; row++) {
+        if (values[row] != DATETIME_NAT) keys[n++] = int64OrderKey(values[row]);
+    }
+    uint64_t lo[NUM_DESCRIBE_QUANTILES], hi[NUM_DESCRIBE_QUANTILES];
+    double fraction[NUM_DESCRIBE_QUANTILES];
+    exactQuantileKeys(keys, n, describe_quantiles, NUM_DESCRIBE_QUANTILES, lo, hi, fraction);
+    for (int q = 0; q < NUM_DESCRIBE_QUANTILES; q++) {
+        int64_t a = int64FromOrderKey(lo[q]), b = int64FromOrderKey(hi[q]);
+        out->datetime_quantiles[q] = a + (int64_t)llround((double)(b - a) * fraction[q]);
+    }
+    free(keys);
+    return 0;
+}
+
+// Function to summarize a string or bool column: count, number of distinct
+// values, the most frequent value (the earliest on ties) and its frequency
+static int describeCategorical(const Column* col, int num_rows, ColumnSummary* out) {
+    ValueTable table;
+    if (countValues(col, num_rows, 1, &table) != 0) {
+        return -1;
+    }
+    out->count = 0;
+    out->unique = (int64_t)table.size;
+    out->top_row = -1;
+    out->freq = 0;
+    for (size_t i = 0; i < table.capacity; i++) {
+        const ValueSlot* slot = &table.slots[i];
+        if (slot->row < 0) {
+            continue;
+        }
+        out->count += slot->count;
+        if (slot->count > out->freq || (slot->count == out->freq && slot->row < out->top_row)) {
+            out->freq = slot->count;
+            out->top_row = slot->row;
+        }
+    }
+    freeValueTable(&table);
+    return 0;
+}
+
+// Function to summarize one column of a DescribeJob (runs on a worker thread)
+static void describeColumn(void* ctx, int col_index) {
+    DescribeJob* job = (DescribeJob*)ctx;
+    const Column* col = &job->df->columns[col_index];
+    ColumnSummary* out = &job->summaries[col_index];
+    switch (col->dtype) {
+        case DTYPE_INT64:
+        case DTYPE_FLOAT64:
+            out->status = describeNumeric(col, job->df->num_rows, job->exact, out);
+            break;
+        case DTYPE_DATETIME:
+            out->status = describeDatetime(col, job->df->num_rows, job->exact, out);
+            break;
+        case DTYPE_BOOL:
+        case DTYPE_STRING:
+        case DTYPE_CATEGORY:
+            out->status = describeCategorical(col, job->df->num_rows, out);
+            break;
+    }
+}
+
+// Rows a filter evaluates at a time; the masks of a block stay in cache
+// while every predicate of the tree runs over it
+#define FILTER_BLOCK_ROWS (1 << 14)
+#define FILTER_BLOCK_WORDS (FILTER_BLOCK_ROWS / 64)
+
+// IN-lists up to this long are matched by comparing against every value;
+// longer ones are binary searched
+#define FILTER_LINEAR_IN 16
+
+// Kinds of filter predicates
+typedef enum {
+    PREDICATE_AND,
+    PREDICATE_OR,
+    PREDICATE_NOT,
+    PREDICATE_IS_NULL,
+    PREDICATE_NOT_NULL,
+    PREDICATE_INT_RANGE,      // int64, datetime and bool: int_lo <= x <= int_hi
+    PREDICATE_FLOAT_RANGE,    // float64: float_lo <= x <= float_hi
+    PREDICATE_INT_IN,
+    PREDICATE_FLOAT_IN,
+    PREDICATE_STRING_EQUAL,
+    PREDICATE_STRING_COMPARE, // compareBytes(x, text) has the sign in string_sign
+    PREDICATE_STRING_IN,
+    PREDICATE_STARTS_WITH,
+    PREDICATE_CONTAINS,
+    PREDICATE_CODE_IN         // category: code_matches[code] is set
+} PredicateKind;
+
+// A string borrowed from the predicate's Python objects
+typedef struct {
+    const char* text;
+    size_t len;
+} FilterString;
+
+// Node of a predicate tree. Leaves test one column and never match a
+// missing value, even when negated; AND/OR/NOT combine their children.
+typedef struct Predicate {
+    PredicateKind kind;
+    const Column* col;
+    int negate;               // leaves: match the non-missing rows that fail the test
+    int empty;                // ranges: no value can match
+    int64_t int_lo, int_hi;
+    double float_lo, float_hi;
+    FilterString text;
+    int string_sign;          // -1 for <, 0 for <= or >=, 1 for >; see string_inclusive
+    int string_inclusive;
+    int64_t* ints;            // sorted IN-lists
+    double* floats;
+    FilterString* strings;
+    size_t list_len;
+    uint8_t* code_matches;    // category: one 0/1 byte per dictionary code
+    struct Predicate* children;
+    int num_children;
+} Predicate;
+
+// Function to release what a predicate tree allocated
+static void freePredicate(Predicate* pred) {
+    for (int c = 0; c < pred->num_children; c++) {
+        freePredicate(&pred->children[c]);
+    }
+    free(pred->children);
+    free(pred->ints);
+    free(pred->floats);
+    free(pred->strings);
+    free(pred->code_matches);
+    memset(pred, 0, sizeof(Predicate));
+}
+
+// Function to pack 64 bytes of 0/1 matches into a word, eight at a time:
+// the multiply gathers the low bit of each byte into the top byte
+static uint64_t packMatches(const uint8_t* match) {
+    uint64_t word = 0;
+    for (int i = 0; i < 8; i++) {
+        uint64_t bytes;
+        memcpy(&bytes, match + 8 * i, 8);
+        word |= ((bytes * UINT64_C(0x0102040810204080)) >> 56) << (8 * i);
+    }
+    return word;
+}
+
+// Function to compare two strings for qsort and bsearch
+static int compareFilterStrings(const void* a, const void* b) {
+    const FilterString* x = (const FilterString*)a;
+    const FilterString* y = (const FilterString*)b;
+    return compareBytes(x->text, x->len, y->text, y->len);
+}
+
+// Function to find needle in a string
+static int containsBytes(const char* text, size_t len, const char* needle, size_t needle_len) {
+    if (needle_len == 0) {
+        return 1;
+    }
+    const char* end = text + len;
+    while ((size_t)(end - text) >= needle_len) {
+        const char* hit = (const char*)memchr(text, needle[0], (size_t)(end - text) - needle_len + 1);
+        if (!hit) {
+            return 0;
+        }
+        if (memcmp(hit + 1, needle + 1, needle_len - 1) == 0) {
+            return 1;
+        }
+        text = hit + 1;
+    }
+    return 0;
+}
+
+// Function to test 64-row groups of a leaf's column into packed words.
+// match[] is filled by a branch-free loop per value type so the compiler
+// can vectorize the comparisons, then packed.
+static void evaluateLeaf(const Predicate* pred, int begin, int end, const uint64_t* active, uint64_t* out) {
+    const Column* col = pred->col;
+    int num_words = (end - begin + 63) / 64;
+    uint8_t match[64];
+    for (int w = 0; w < num_words; w++) {
+        if (active && !active[w]) {
+            out[w] = 0;
+            continue;
+        }
+        int base = begin + w * 64;
+        int n = end - base < 64 ? end - base : 64;
+        if (n < 64) {
+            memset(match, 0, sizeof(match));
+        }
+        switch (pred->kind) {
+            case PREDICATE_INT_RANGE: {
+                uint64_t lo = (uint64_t)pred->int_lo, span = (uint64_t)pred->int_hi - lo;
+                if (col->dtype == DTYPE_BOOL) {
+                    const uint8_t* values = (const uint8_t*)col->data + base;
+                    for (int i = 0; i < n; i++) match[i] = (uint64_t)values[i] - lo <= span;
+                } else {
+                    const int64_t* values = (const int64_t*)col->data + base;
+                    for (int i = 0; i < n; i++) match[i] = (uint64_t)values[i] - lo <= span;
+                }
+                break;
+            }
+            case PREDICATE_FLOAT_RANGE: {
+                const double* values = (const double*)col->data + base;
+                double lo = pred->float_lo, hi = pred->float_hi;
+                for (int i = 0; i < n; i++) match[i] = (values[i] >= lo) & (values[i] <= hi);
+                break;
+            }
+            case PREDICATE_INT_IN: {
+                const int64_t* values = (const int64_t*)col->data + base;
+                if (pred->list_len <= FILTER_LINEAR_IN) {
+                    memset(match, 0, sizeof(match));
+                    for (size_t k = 0; k < pred->list_len; k++) {
+                        int64_t v = pred->ints[k];
+                        for (int i = 0; i < n; i++) match[i] |= values[i] == v;
+                    }
+                } else {
+                    for (int i = 0; i < n; i++) {
+                        size_t lo = 0, hi = pred->list_len;
+                        while (lo < hi) {
+                            size_t mid = (lo + hi) / 2;
+                            if (pred->ints[mid] < values[i]) lo = mid + 1; else hi = mid;
+                        }
+                        match[i] = lo < pred->list_len && pred->ints[lo] == values[i];
+                    }
+                }
+                break;
+            }
+            case PREDICATE_FLOAT_IN: {
+                const double* values = (const double*)col->data + base;
+                if (pred->list_len <= FILTER_LINEAR_IN) {
+                    memset(match, 0, sizeof(match));
+                    for (size_t k = 0; k < pred->list_len; k++) {
+                        double v = pred->floats[k];
+                        for (int i = 0; i < n; i++) match[i] |= values[i] == v;
+                    }
+                } else {
+                    for (int i = 0; i < n; i++) {
+                        size_t lo = 0, hi = pred->list_len;
+                        while (lo < hi) {
+                            size_t mid = (lo + hi) / 2;
+                            if (pred->floats[mid] < values[i]) lo = mid + 1; else hi = mid;
+                        }
+                        match[i] = lo < pred->list_len && pred->floats[lo] == values[i];
+                    }
+                }
+                break;
+            }
+            case PREDICATE_STRING_EQUAL: {
+                const int64_t* offsets = STRING_OFFSETS(col) + base;
+                for (int i = 0; i < n; i++) {
+                    size_t len = (size_t)(offsets[i + 1] - offsets[i]);
+                    match[i] = len == pred->text.len && memcmp(col->heap + offsets[i], pred->text.text, len) == 0;
+                }
+                break;
+            }
+            case PREDICATE_STRING_COMPARE: {
+                const int64_t* offsets = STRING_OFFSETS(col) + base;
+                for (int i = 0; i < n; i++) {
+                    int cmp = compareBytes(col->heap + offsets[i], (size_t)(offsets[i + 1] - offsets[i]),
+                                           pred->text.text, pred->text.len);
+                    cmp = (cmp > 0) - (cmp < 0);
+                    match[i] = cmp == pred->string_sign || (pred->string_inclusive && cmp == 0);
+                }
+                break;
+            }
+            case PREDICATE_STRING_IN: {
+                const int64_t* offsets = STRING_OFFSETS(col) + base;
+                for (int i = 0; i < n; i++) {
+                    FilterString key = {col->heap + offsets[i], (size_t)(offsets[i + 1] - offsets[i])};
+                    match[i] = bsearch(&key, pred->strings, pred->list_len, sizeof(FilterString),
+                                       compareFilterStrings) != NULL;
+                }
+                break;
+            }
+            case PREDICATE_STARTS_WITH: {
+                const int64_t* offsets = STRING_OFFSETS(col) + base;
+                for (int i = 0; i < n; i++) {
+                    size_t len = (size_t)(offsets[i + 1] - offsets[i]);
+                    match[i] = len >= pred->text.len && memcmp(col->heap + offsets[i], pred->text.text,
+                                                               pred->text.len) == 0;
+                }
+                break;
+            }
+            case PREDICATE_CONTAINS: {
+                const int64_t* offsets = STRING_OFFSETS(col) + base;
+                for (int i = 0; i < n; i++) {
+                    match[i] = containsBytes(col->heap + offsets[i], (size_t)(offsets[i + 1] - offsets[i]),
+                                             pred->text.text, pred->text.len);
+                }
+                break;
+            }
+            case PREDICATE_CODE_IN: {
+                const uint8_t* matches = pred->code_matches;
+                if (col->code_width == 1) {
+                    const uint8_t* codes = (const uint8_t*)col->data + base;
+                    for (int i = 0; i < n; i++) match[i] = matches[codes[i]];
+                } else if (col->code_width == 2) {
+                    const uint16_t* codes = (const uint16_t*)col->data + base;
+                    for (int i = 0; i < n; i++) match[i] = matches[codes[i]];
+                } else {
+                    const uint32_t* codes = (const uint32_t*)col->data + base;
+                    for (int i = 0; i < n; i++) match[i] = matches[codes[i]];
+                }
+                break;
+            }
+            default:
+                memset(match, 0, sizeof(match));
+                break;
+        }
+        out[w] = packMatches(match);
+    }
+}
+
+// Function to evaluate a predicate tree over rows [begin, end) of a block
+// into packed match words. Where the active word is zero the output word
+// is left unspecified (the caller discards it), which lets AND skip the
+// words its earlier children rejected.
+static void evaluatePredicate(const Predicate* pred, int begin, int end, const uint64_t* active, uint64_t* out) {
+    int num_words = (end - begin + 63) / 64;
+    uint64_t tail = (end - begin) % 64 ? (UINT64_C(1) << ((end - begin) % 64)) - 1 : ALL_VALID;
+    const uint64_t* validity = pred->col ? pred->col->validity + begin / 64 : NULL;
+    switch (pred->kind) {
+        case PREDICATE_AND:
+        case PREDICATE_OR: {
+            uint64_t scratch[FILTER_BLOCK_WORDS];
+            int is_and = pred->kind == PREDICATE_AND;
+            evaluatePredicate(&pred->children[0], begin, end, active, out);
+            for (int c = 1; c < pred->num_children; c++) {
+                uint64_t any = 0;
+                for (int w = 0; w < num_words; w++) any |= out[w];
+                if (is_and && !any) {
+                    break;
+                }
+                evaluatePredicate(&pred->children[c], begin, end, is_and ? out : active, scratch);
+                for (int w = 0; w < num_words; w++) {
+                    out[w] = is_and ? out[w] & scratch[w] : out[w] | scratch[w];
+                }
+            }
+            return;
+        }
+        case PREDICATE_NOT:
+            evaluatePredicate(&pred->children[0], begin, end, active, out);
+            for (int w = 0; w < num_words; w++) out[w] = ~out[w];
+            break;
+        case PREDICATE_IS_NULL:
+            for (int w = 0; w < num_words; w++) out[w] = ~validity[w];
+            break;
+        case PREDICATE_NOT_NULL:
+            for (int w = 0; w < num_words; w++) out[w] = validity[w];
+            break;
+        default:
+            if (pred->empty) {
+                memset(out, 0, (size_t)num_words * sizeof(uint64_t));
+            } else {
+                evaluateLeaf(pred, begin, end, active, out);
+            }
+            for (int w = 0; w < num_words; w++) {
+                out[w] = (pred->negate ? ~out[w] : out[w]) & validity[w];
+            }
+            break;
+    }
+    out[num_words - 1] &= tail;
+}
+
+// Entries per block of a sorted index
+#define INDEX_BLOCK_ROWS 256
+
+// Initial slot count of a hash index; always a power of two
+#define INDEX_INITIAL_SLOTS 64
+
+// A filter answers from an index only when the index finds at most one row
+// in this many; past that the vectorized scan is faster
+#define INDEX_FILTER_SHARE 32
+
+// Kinds of column index
+typedef enum {
+    INDEX_SORTED,
+    INDEX_HASH,
+    NUM_INDEX_KINDS
+} IndexKind;
+
+static const char* const index_kind_names[NUM_INDEX_KINDS] = {"sorted", "hash"};
+
+// Up to INDEX_BLOCK_ROWS entries of a sorted index, in index order
+typedef struct {
+    int size;
+    uint64_t keys[INDEX_BLOCK_ROWS];
+    int rows[INDEX_BLOCK_ROWS];
+} IndexBlock;
+
+// One distinct value of a hash index: its hash and the first and last rows
+// of its chain, which runs in ascending row order
+typedef struct {
+    uint64_t hash;
+    int first;        // -1 marks an empty slot
+    int last;
+} IndexSlot;
+
+// An index over the non-missing values of one column. Rows appended to the
+// DataFrame are entered as they come; changing the column in place drops it.
+//   INDEX_SORTED  (key, row) entries in value order, ties in row order, kept
+//                 in blocks that split when full like the leaves of a
+//                 B+-tree. Keys order like the values (see indexKey), so
+//                 only strings sharing their first 8 bytes read the column.
+//   INDEX_HASH    open-addressing table of the distinct values, each
+//                 chaining its rows through chain
+typedef struct ColumnIndex {
+    IndexKind kind;
+    int column;               // position of the column in the DataFrame
+    int num_rows;             // rows [0, num_rows) have been entered
+    int64_t size;             // entries: the non-missing rows among them
+    IndexBlock** blocks;      // sorted
+    int num_blocks;
+    int block_capacity;
+    IndexSlot* slots;         // hash: at most half full
+    size_t slot_mask;
+    size_t num_values;
+    int* chain;               // hash: next row with the same value, -1 at the end
+    int chain_capacity;
+    struct ColumnIndex* next;
+} ColumnIndex;
+
+// A value looked up in an index. Text carries its bytes; other values the
+// key a hash index compares (see valueKey).
+typedef struct {
+    uint64_t key;             // sorted-index key
+    uint64_t value;
+    int is_text;
+    const char* text;
+    size_t len;
+} IndexProbe;
+
+// A place in a sorted index: an entry of a block, or {num_blocks, 0} for
+// the end. Blocks are never empty and offsets always fall inside them.
+typedef struct {
+    int block;
+    int offset;
+} IndexPosition;
+
+// Values between two probes; an end is open without has_lo or has_hi and
+// holds the values equal to its probe when inclusive
+typedef struct {
+    IndexProbe lo, hi;
+    int has_lo, has_hi;
+    int lo_inclusive, hi_inclusive;
+} IndexRange;
+
+// Function to map a string to the big-endian, zero-padded number of its
+// first 8 bytes, whose order agrees with compareBytes
+static uint64_t textIndexKey(const char* text, size_t len) {
+    uint64_t bits = 0;
+    for (size_t i = 0; i < 8; i++) {
+        bits = (bits << 8) | (i < len ? (unsigned char)text[i] : 0);
+    }
+    return bits;
+}
+
+// Function to map a double to its sorted-index key, with NaN after every
+// number as compareCells has it
+static uint64_t floatIndexKey(double value) {
+    return isnan(value) ? UINT64_MAX : float64OrderKey(value);
+}
+
+// Function to map an integer value of an int64, datetime or bool column to
+// its sorted-index key
+static uint64_t intIndexKey(const Column* col, int64_t value) {
+    return col->dtype == DTYPE_BOOL ? (uint64_t)value : int64OrderKey(value);
+}
+
+// Function to make the probe of a non-missing cell
+static IndexProbe probeOfCell(const Column* col, int row) {
+    IndexProbe probe;
+    memset(&probe, 0, sizeof(probe));
+    switch (col->dtype) {
+        case DTYPE_INT64:
+        case DTYPE_DATETIME:
+            probe.value = (uint64_t)((int64_t*)col->data)[row];
+            probe.key = int64OrderKey((int64_t)probe.value);
+            break;
+        case DTYPE_FLOAT64:
+            probe.value = valueKey(col, row);
+            probe.key = floatIndexKey(((double*)col->data)[row]);
+            break;
+        case DTYPE_BOOL:
+            probe.value = probe.key = ((uint8_t*)col->data)[row];
+            break;
+        case DTYPE_STRING:
+        case DTYPE_CATEGORY:
+            probe.is_text = 1;
+            probe.text = stringAt(col, row, &probe.len);
+            probe.key = textIndexKey(probe.text, probe.len);
+            break;
+    }
+    return probe;
+}
+
+// Function to make the probe of a string
+static IndexProbe probeOfText(const char* text, size_t len) {
+    IndexProbe probe;
+    memset(&probe, 0, sizeof(probe));
+    probe.is_text = 1;
+    probe.text = text;
+    probe.len = len;
+    probe.key = textIndexKey(text, len);
+    return probe;
+}
+
+// Function to make the probe of a value of an int64, datetime or bool column
+static IndexProbe probeOfInt(const Column* col, int64_t value) {
+    IndexProbe probe;
+    memset(&probe, 0, sizeof(probe));
+    probe.value = (uint64_t)value;
+    probe.key = intIndexKey(col, value);
+    return probe;
+}
+
+// Function to make the probe of a value of a float64 column
+static IndexProbe probeOfFloat(double value) {
+    IndexProbe probe;
+    memset(&probe, 0, sizeof(probe));
+    probe.value = float64ValueKey(value);
+    probe.key = floatIndexKey(value);
+    return probe;
+}
+
+// Function to hash a probe for a hash index. Text hashes its bytes, so
+// string and category columns agree whatever their dictionaries.
+static uint64_t probeHash(const IndexProbe* probe) {
+    return probe->is_text ? hashBytes(probe->text, probe->len) : mixHash(probe->value);
+}
+
+// Function to check whether a cell holds the value of a probe
+static int probeMatchesCell(const Column* col, int row, const IndexProbe* probe) {
+    if (probe->is_text) {
+        size_t len;
+        const char* text = stringAt(col, row, &len);
+        return len == probe->len && memcmp(text, probe->text, len) == 0;
+    }
+    return valueKey(col, row) == probe->value;
+}
+
+// Function to compare the value of a sorted-index entry with a probe
+static int compareIndexEntry(const Column* col, uint64_t key, int row, const IndexProbe* probe) {
+    if (key != probe->key) {
+        return key < probe->key ? -1 : 1;
+    }
+    if (!probe->is_text) {
+        return 0;
+    }
+    size_t len;
+    const char* text = stringAt(col, row, &len);
+    return compareBytes(text, len, probe->text, probe->len);
+}
+
+// Function to find the first entry of a sorted index not below a probe, or
+// with past_equal the first one above it, in O(log n)
+static IndexPosition seekIndex(const ColumnIndex* index, const Column* col, const IndexProbe* probe, int past_equal) {
+    // The first block whose last entry is far enough holds the entry
+    int lo = 0, hi = index->num_blocks;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        const IndexBlock* block = index->blocks[mid];
+        int cmp = compareIndexEntry(col, block->keys[block->size - 1], block->rows[block->size - 1], probe);
+        if (cmp < 0 || (past_equal && cmp == 0)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    IndexPosition pos = {lo, 0};
+    if (lo == index->num_blocks) {
+        return pos;
+    }
+    const IndexBlock* block = index->blocks[lo];
+    int a = 0, b = block->size - 1;
+    while (a < b) {
+        int mid = (a + b) / 2;
+        int cmp = compareIndexEntry(col, block->keys[mid], block->rows[mid], probe);
+        if (cmp < 0 || (past_equal && cmp == 0)) {
+            a = mid + 1;
+        } else {
+            b = mid;
+        }
+    }
+    pos.offset = a;
+    return pos;
+}
+
+// Function to copy the rows of up to limit entries in [from, to) of a
+// sorted index to out, in index order, or only count them when out is
+// NULL. Returns how many it took.
+static int64_t indexRowsBetween(const ColumnIndex* index, IndexPosition from, IndexPosition to, int* out,
+                                int64_t limit) {
+    int64_t count = 0;
+    for (int b = from.block; b <= to.block && b < index->num_blocks && count < limit; b++) {
+        const IndexBlock* block = index->blocks[b];
+        int begin = b == from.block ? from.offset : 0;
+        int end = b == to.block ? to.offset : block->size;
+        if (end <= begin) {
+            continue;
+        }
+        int64_t take = end - begin < limit - count ? end - begin : limit - count;
+        if (out) {
+            memcpy(out + count, block->rows + begin, (size_t)take * sizeof(int));
+        }
+        count += take;
+    }
+    return count;
+}
+
+// Function to copy up to limit rows of a sorted index whose values are in
+// a range, in value order, or only count them when out is NULL
+static int64_t sortedRangeRows(const ColumnIndex* index, const Column* col, const IndexRange* range, int* out,
+                               int64_t limit) {
+    IndexPosition from = {0, 0};
+    IndexPosition to = {index->num_blocks, 0};
+    if (range->has_lo) {
+        from = seekIndex(index, col, &range->lo, !range->lo_inclusive);
+    }
+    if (range->has_hi) {
+        to = seekIndex(index, col, &range->hi, range->hi_inclusive);
+    }
+    return indexRowsBetween(index, from, to, out, limit);
+}
+
+// Function to find the first row of the chain holding a probe's value in a
+// hash index, or -1
+static int findIndexChain(const ColumnIndex* index, const Column* col, const IndexProbe* probe) {
+    uint64_t hash = probeHash(probe);
+    for (size_t i = (size_t)hash & index->slot_mask;; i = (i + 1) & index->slot_mask) {
+        const IndexSlot* slot = &index->slots[i];
+        if (slot->first < 0) {
+            return -1;
+        }
+        if (slot->hash == hash && probeMatchesCell(col, slot->first, probe)) {
+            return slot->first;
+        }
+    }
+}
+
+// Function to copy up to limit rows of a hash index holding the single
+// value of a range, in row order, or only count them when out is NULL.
+// Returns -1 for a range that is not a single value.
+static int64_t hashRangeRows(const ColumnIndex* index, const Column* col, const IndexRange* range, int* out,
+                             int64_t limit) {
+    const IndexProbe* lo = &range->lo;
+    const IndexProbe* hi = &range->hi;
+    if (!range->has_lo || !range->has_hi || !range->lo_inclusive || !range->hi_inclusive || lo->key != hi->key ||
+        lo->value != hi->value || lo->len != hi->len || (lo->is_text && memcmp(lo->text, hi->text, lo->len) != 0)) {
+        return -1;
+    }
+    int64_t count = 0;
+    for (int row = findIndexChain(index, col, lo); row >= 0 && count < limit; row = index->chain[row]) {
+        if (out) {
+            out[count] = row;
+        }
+        count++;
+    }
+    return count;
+}
+
+// Function to count the ranges of values an index looks up for a predicate
+// leaf, or -1 when no index can answer it
+static int64_t leafRangeCount(const Predicate* leaf) {
+    if (leaf->negate) {
+        return -1;
+    }
+    switch (leaf->kind) {
+        case PREDICATE_INT_RANGE:
+        case PREDICATE_FLOAT_RANGE:
+        case PREDICATE_STRING_EQUAL:
+        case PREDICATE_STRING_COMPARE:
+            return leaf->empty ? 0 : 1;
+        case PREDICATE_INT_IN:
+        case PREDICATE_FLOAT_IN:
+        case PREDICATE_STRING_IN:
+            return leaf->empty ? 0 : (int64_t)leaf->list_len;
+        case PREDICATE_CODE_IN:
+            return leaf->empty ? 0 : leaf->col->dict->size;
+        default:
+            return -1;
+    }
+}
+
+// Function to get the t-th range of values a predicate leaf matches.
+// Returns 0 for a term that adds nothing: a code outside the set, or a
+// value an IN list repeats.
+static int leafRange(const Predicate* leaf, int64_t t, IndexRange* range) {
+    const Column* col = leaf->col;
+    memset(range, 0, sizeof(*range));
+    range->has_lo = range->has_hi = 1;
+    range->lo_inclusive = range->hi_inclusive = 1;
+    switch (leaf->kind) {
+        case PREDICATE_INT_RANGE:
+            range->lo = probeOfInt(col, leaf->int_lo);
+            range->hi = probeOfInt(col, leaf->int_hi);
+            break;
+        case PREDICATE_FLOAT_RANGE:
+            range->lo = probeOfFloat(leaf->float_lo);
+            range->hi = probeOfFloat(leaf->float_hi);
+            break;
+        case PREDICATE_STRING_EQUAL:
+            range->lo = range->hi = probeOfText(leaf->text.text, leaf->text.len);
+            break;
+        case PREDICATE_STRING_COMPARE:
+            if (leaf->string_sign < 0) {
+                range->has_lo = 0;
+                range->hi = probeOfText(leaf->text.text, leaf->text.len);
+                range->hi_inclusive = leaf->string_inclusive;
+            } else {
+                range->has_hi = 0;
+                range->lo = probeOfText(leaf->text.text, leaf->text.len);
+                range->lo_inclusive = leaf->string_inclusive;
+            }
+            break;
+        case PREDICATE_INT_IN:
+            if (t > 0 && leaf->ints[t] == leaf->ints[t - 1]) {
+                return 0;
+            }
+            range->lo = range->hi = probeOfInt(col, leaf->ints[t]);
+            break;
+        case PREDICATE_FLOAT_IN:
+            // -0.0 and 0.0 are the same value
+            if (t > 0 && float64ValueKey(leaf->floats[t]) == float64ValueKey(leaf->floats[t - 1])) {
+                return 0;
+            }
+            range->lo = range->hi = probeOfFloat(leaf->floats[t]);
+            break;
+        case PREDICATE_STRING_IN:
+            if (t > 0 && compareFilterStrings(&leaf->strings[t], &leaf->strings[t - 1]) == 0) {
+                return 0;
+            }
+            range->lo = range->hi = probeOfText(leaf->strings[t].text, leaf->strings[t].len);
+            break;
+        case PREDICATE_CODE_IN: {
+            if (!leaf->code_matches[t]) {
+                return 0;
+            }
+            size_t len;
+            const char* text = stringAt(&col->dict->values, (int)t, &len);
+            range->lo = range->hi = probeOfText(text, len);
+            break;
+        }
+        default:
+            return 0;
+    }
+    return 1;
+}
+
+// Function to look up the rows matching a predicate leaf in an index over
+// its column: per range of values, in value order for a sorted index and
+// in row order for a hash index. Returns 1 with a malloc'd array of rows,
+// 0 when the index cannot answer the leaf or would find more than limit
+// rows, and -1 when out of memory.
+static int indexLeafRows(const ColumnIndex* index, const Predicate* leaf, int64_t limit, int** rows, int* count) {
+    int64_t terms = leafRangeCount(leaf);
+    if (terms < 0) {
+        return 0;
+    }
+    // Count the rows first, so an unselective lookup gives up early
+    int64_t total = 0;
+    for (int64_t t = 0; t < terms; t++) {
+        IndexRange range;
+        if (!leafRange(leaf, t, &range)) {
+            continue;
+        }
+        int64_t found = index->kind == INDEX_SORTED ? sortedRangeRows(index, leaf->col, &range, NULL, limit - total + 1)
+                                                    : hashRangeRows(index, leaf->col, &range, NULL, limit - total + 1);
+        if (found < 0 || found > limit - total) {
+            return 0;
+        }
+        total += found;
+    }
+    int* out = (int*)malloc((size_t)(total > 0 ? total : 1) * sizeof(int));
+    if (!out) {
+        return -1;
+    }
+    int64_t filled = 0;
+    for (int64_t t = 0; t < terms; t++) {
+        IndexRange range;
+        if (!leafRange(leaf, t, &range)) {
+            continue;
+        }
+        filled += index->kind == INDEX_SORTED ? sortedRangeRows(index, leaf->col, &range, out + filled, total - filled)
+                                              : hashRangeRows(index, leaf->col, &range, out + filled, total - filled);
+    }
+    *rows = out;
+    *count = (int)filled;
+    return 1;
+}
+
+// Function to find an index of a kind over a column of a DataFrame
+static ColumnIndex* findIndex(const DataFrame* df, int column, IndexKind kind) {
+    for (ColumnIndex* index = df->indexes; index; index = index->next) {
+        if (index->column == column && index->kind == kind) {
+            return index;
+        }
+    }
+    return NULL;
+}
+
+// Function to find an index of a kind over a column given by its storage,
+// or NULL when the column is not one of the DataFrame's own
+static ColumnIndex* findColumnIndex(const DataFrame* df, const Column* col, IndexKind kind) {
+    for (ColumnIndex* index = df->indexes; index; index = index->next) {
+        if (&df->columns[index->column] == col && index->kind == kind) {
+            return index;
+        }
+    }
+    return NULL;
+}
+
+// Function to get the bytes an index takes up
+static size_t indexMemory(const ColumnIndex* index) {
+    size_t slots = index->slots ? (index->slot_mask + 1) * sizeof(IndexSlot) : 0;
+    return sizeof(ColumnIndex) + (size_t)index->num_blocks * sizeof(IndexBlock) +
+           (size_t)index->block_capacity * sizeof(IndexBlock*) + slots + (size_t)index->chain_capacity * sizeof(int);
+}
+
+// Function to free an index
+static void freeIndex(ColumnIndex* index) {
+    for (int b = 0; b < index->num_blocks; b++) {
+        free(index->blocks[b]);
+    }
+    free(index->blocks);
+    free(index->slots);
+    free(index->chain);
+    free(index);
+}
+
+// Function to drop the indexes of a DataFrame over a column, or over every
+// column when column is -1, of a kind, or of any kind when kind is -1.
+// Returns how many were dropped.
+static int dropIndexes(DataFrame* df, int column, int kind) {
+    int dropped = 0;
+    ColumnIndex** link = &df->indexes;
+    while (*link) {
+        ColumnIndex* index = *link;
+        if ((column < 0 || index->column == column) && (kind < 0 || (int)index->kind == kind)) {
+            *link = index->next;
+            freeIndex(index);
+            dropped++;
+        } else {
+            link = &index->next;
+        }
+    }
+    return dropped;
+}
+
+// Function to add an empty block to a sorted index before block b
+static IndexBlock* insertIndexBlock(ColumnIndex* index, int b) {
+    if (index->num_blocks == index->block_capacity) {
+        int capacity = index->block_capacity ? index->block_capacity * 2 : 16;
+        IndexBlock** blocks = (IndexBlock**)realloc(index->blocks, (size_t)capacity * sizeof(IndexBlock*));
+        if (!blocks) {
+            return NULL;
+        }
+        index->blocks = blocks;
+        index->block_capacity = capacity;
+    }
+    IndexBlock* block = (IndexBlock*)malloc(sizeof(IndexBlock));
+    if (!block) {
+        return NULL;
+    }
+    block->size = 0;
+    memmove(index->blocks + b + 1, index->blocks + b, (size_t)(index->num_blocks - b) * sizeof(IndexBlock*));
+    index->blocks[b] = block;
+    index->num_blocks++;
+    return block;
+}
+
+// Function to enter a row into a sorted index after the entries with the
+// same value, which all have lower rows. A full block is split in half,
+// except that an entry past the end of the last one starts a new block, so
+// rows appended in value order leave their blocks full.
+static int insertSortedRow(ColumnIndex* index, const Column* col, int row) {
+    IndexProbe probe = probeOfCell(col, row);
+    IndexPosition pos = seekIndex(index, col, &probe, 1);
+    if (index->num_blocks == 0) {
+        if (!insertIndexBlock(index, 0)) {
+            return -1;
+        }
+    } else if (pos.block == index->num_blocks ||
+               (pos.offset == 0 && pos.block > 0 && index->blocks[pos.block - 1]->size < INDEX_BLOCK_ROWS)) {
+        // Between two blocks, the end of the earlier one is as good a place
+        pos.block--;
+        pos.offset = index->blocks[pos.block]->size;
+    }
+    IndexBlock* block = index->blocks[pos.block];
+    if (block->size == INDEX_BLOCK_ROWS) {
+        int appending = pos.block == index->num_blocks - 1 && pos.offset == block->size;
+        IndexBlock* next = insertIndexBlock(index, pos.block + 1);
+        if (!next) {
+            return -1;
+        }
+        if (appending) {
+            block = next;
+            pos.offset = 0;
+        } else {
+            int half = INDEX_BLOCK_ROWS / 2;
+            next->size = INDEX_BLOCK_ROWS - half;
+            memcpy(next->keys, block->keys + half, (size_t)next->size * sizeof(uint64_t));
+            memcpy(next->rows, block->rows + half, (size_t)next->size * sizeof(int));
+            block->size = half;
+            if (pos.offset > half) {
+                block = next;
+                pos.offset -= half;
+            }
+        }
+    }
+    int after = block->size - pos.offset;
+    memmove(block->keys + pos.offset + 1, block->keys + pos.offset, (size_t)after * sizeof(uint64_t));
+    memmove(block->rows + pos.offset + 1, block->rows + pos.offset, (size_t)after * sizeof(int));
+    block->keys[pos.offset] = probe.key;
+    block->rows[pos.offset] = row;
+    block->size++;
+    index->size++;
+    return 0;
+}
+
+// Function to double the slots of a hash index, placing the values again
+// by their stored hashes
+static int growIndexSlots(ColumnIndex* index) {
+    size_t capacity = (index->slot_mask + 1) * 2;
+    IndexSlot* slots = (IndexSlot*)malloc(capacity * sizeof(IndexSlot));
+    if (!slots) {
+        return -1;
+    }
+    for (size_t i = 0; i < capacity; i++) {
+        slots[i].first = -1;
+    }
+    for (size_t i = 0; i <= index->slot_mask; i++) {
+        const IndexSlot* slot = &index->slots[i];
+        if (slot->first < 0) {
+            continue;
+        }
+        size_t j = (size_t)slot->hash & (capacity - 1);
+        while (slots[j].first >= 0) {
+            j = (j + 1) & (capacity - 1);
+        }
+        slots[j] = *slot;
+    }
+    free(index->slots);
+    index->slots = slots;
+    index->slot_mask = capacity - 1;
+    return 0;
+}
+
+// Function to enter a row into a hash index at the end of its value's
+// chain; the index's chain must have room for the row
+static int insertHashedRow(ColumnIndex* index, const Column* col, int row) {
+    if ((index->num_values + 1) * 2 > index->slot_mask + 1 && growIndexSlots(index) != 0) {
+        return -1;
+    }
+    IndexProbe probe = probeOfCell(col, row);
+    uint64_t hash = probeHash(&probe);
+    index->chain[row] = -1;
+    for (size_t i = (size_t)hash & index->slot_mask;; i = (i + 1) & index->slot_mask) {
+        IndexSlot* slot = &index->slots[i];
+        if (slot->first < 0) {
+            slot->hash = hash;
+            slot->first = row;
+            slot->last = row;
+            index->num_values++;
+            break;
+        }
+        if (slot->hash == hash && probeMatchesCell(col, slot->first, &probe)) {
+            index->chain[slot->last] = row;
+            slot->last = row;
+            break;
+        }
+    }
+    index->size++;
+    return 0;
+}
+
+// Function to enter rows [index->num_rows, num_rows) of col into an index
+static int enterIndexRows(ColumnIndex* index, const Column* col, int num_rows) {
+    if (index->kind == INDEX_HASH && num_rows > index->chain_capacity) {
+        int capacity = index->chain_capacity > 0 ? index->chain_capacity : INITIAL_ROW_CAPACITY;
+        while (capacity < num_rows) {
+            capacity = capacity > INT_MAX / 2 ? INT_MAX : capacity * 2;
+        }
+        int* chain = (int*)realloc(index->chain, (size_t)capacity * sizeof(int));
+        if (!chain) {
+            return -1;
+        }
+        index->chain = chain;
+        index->chain_capacity = capacity;
+    }
+    for (int row = index->num_rows; row < num_rows; row++) {
+        if (isNullCell(col, row)) {
+            continue;
+        }
+        int status = index->kind == INDEX_SORTED ? insertSortedRow(index, col, row) : insertHashedRow(index, col, row);
+        if (status != 0) {
+            return -1;
+        }
+    }
+    index->num_rows = num_rows;
+    return 0;
+}
+
+// Function to build a sorted index over every row at once: the keys of the
+// non-missing rows are radix sorted, runs of strings sharing their first 8
+// bytes are then put in full order, and the entries are packed into full
+// blocks. Returns -1 when out of memory.
+static int fillSortedIndex(ColumnIndex* index, const Column* col, int num_rows) {
+    size_t slots = num_rows > 0 ? (size_t)num_rows : 1;
+    uint64_t* keys = (uint64_t*)malloc(slots * sizeof(uint64_t));
+    uint64_t* key_tmp = (uint64_t*)malloc(slots * sizeof(uint64_t));
+    int* rows = (int*)malloc(slots * sizeof(int));
+    int* row_tmp = (int*)malloc(slots * sizeof(int));
+    int status = keys && key_tmp && rows && row_tmp ? 0 : -1;
+    int count = 0;
+    for (int row = 0; status == 0 && row < num_rows; row++) {
+        if (!isNullCell(col, row)) {
+            keys[count] = probeOfCell(col, row).key;
+            rows[count++] = row;
+        }
+    }
+    if (status == 0) {
+        radixSortPairs(keys, rows, key_tmp, row_tmp, count);
+    }
+    if (status == 0 && isTextColumn(col)) {
+        SortKey order = {col, 0, 0};
+        int start = 0;
+        while (start < count) {
+            size_t first_len, len;
+            stringAt(col, rows[start], &first_len);
+            int ambiguous = first_len > 8;
+            int end = start + 1;
+            while (end < count && keys[end] == keys[start]) {
+                stringAt(col, rows[end], &len);
+                ambiguous |= len > 8 || len != first_len;
+                end++;
+            }
+            if (ambiguous) {
+                mergeSortRows(rows + start, row_tmp, end - start, &order, 1);
+            }
+            start = end;
+        }
+    }
+    for (int begin = 0; status == 0 && begin < count; begin += INDEX_BLOCK_ROWS) {
+        IndexBlock* block = insertIndexBlock(index, index->num_blocks);
+        if (!block) {
+            status = -1;
+            break;
+        }
+        block->size = count - begin < INDEX_BLOCK_ROWS ? count - begin : INDEX_BLOCK_ROWS;
+        memcpy(block->keys, keys + begin, (size_t)block->size * sizeof(uint64_t));
+        memcpy(block->rows, rows + begin, (size_t)block->size * sizeof(int));
+    }
+    free(keys);
+    free(key_tmp);
+    free(rows);
+    free(row_tmp);
+    if (status == 0) {
+        index->size = count;
+        index->num_rows = num_rows;
+    }
+    return status;
+}
+
+// Function to build an index of a kind over a column of a DataFrame, timed
+// as one kernel. Returns NULL when out of memory.
+static ColumnIndex* buildIndex(const DataFrame* df, int column, IndexKind kind) {
+    KernelSpan span;
+    beginKernel(&span, KERNEL_CREATE_INDEX);
+    const Column* col = &df->columns[column];
+    ColumnIndex* index = (ColumnIndex*)calloc(1, sizeof(ColumnIndex));
+    int status = index ? 0 : -1;
+    if (status == 0) {
+        index->kind = kind;
+        index->column = column;
+    }
+    if (status == 0 && kind == INDEX_HASH) {
+        index->slots = (IndexSlot*)malloc(INDEX_INITIAL_SLOTS * sizeof(IndexSlot));
+        status = index->slots ? 0 : -1;
+        for (int i = 0; status == 0 && i < INDEX_INITIAL_SLOTS; i++) {
+            index->slots[i].first = -1;
+        }
+        index->slot_mask = INDEX_INITIAL_SLOTS - 1;
+        if (status == 0) {
+            status = enterIndexRows(index, col, df->num_rows);
+        }
+    } else if (status == 0) {
+        status = fillSortedIndex(index, col, df->num_rows);
+    }
+    if (status != 0 && index) {
+        freeIndex(index);
+        index = NULL;
+    }
+    endKernel(&span, index ? df->num_rows : 0);
+    return index;
+}
+
+// Function to enter the rows appended to a DataFrame into its indexes. An
+// index that cannot grow for want of memory is dropped, not left stale.
+static void extendIndexes(DataFrame* df) {
+    ColumnIndex** link = &df->indexes;
+    while (*link) {
+        ColumnIndex* index = *link;
+        if (index->num_rows != df->num_rows &&
+            enterIndexRows(index, &df->columns[index->column], df->num_rows) != 0) {
+            *link = index->next;
+            freeIndex(index);
+        } else {
+            link = &index->next;
+        }
+    }
+}
+
+// Function to look a predicate leaf up in an index over its column: a
+// hash index for single values, a sorted one for anything else it can
+// answer. Returns as indexLeafRows, and 0 when the column has no index.
+static int leafIndexRows(const DataFrame* df, const Predicate* leaf, int64_t limit, int** rows, int* count) {
+    if (!leaf->col || leaf->kind <= PREDICATE_NOT_NULL) {
+        return 0;
+    }
+    const ColumnIndex* hash = findColumnIndex(df, leaf->col, INDEX_HASH);
+    const ColumnIndex* sorted = findColumnIndex(df, leaf->col, INDEX_SORTED);
+    int status = hash ? indexLeafRows(hash, leaf, limit, rows, count) : 0;
+    if (status == 0 && sorted) {
+        status = indexLeafRows(sorted, leaf, limit, rows, count);
+    }
+    return status;
+}
+
+// Function to answer a filter from an index when the predicate, or one of
+// the predicates ANDed at its top, is a selective leaf on an indexed
+// column. The rows found are put in row order and, under an AND, the whole
+// predicate is checked on just the 64-row words holding them. Returns 1
+// with a malloc'd selection vector, 0 to scan instead, -1 when out of memory.
+static int filterByIndex(const DataFrame* df, const Predicate* pred, int** rows, int* count) {
+    if (!df->indexes) {
+        return 0;
+    }
+    int64_t limit = df->num_rows / INDEX_FILTER_SHARE;
+    const Predicate* leaves = pred->kind == PREDICATE_AND ? pred->children : pred;
+    int num_leaves = pred->kind == PREDICATE_AND ? pred->num_children : 1;
+    int status = 0;
+    int* found = NULL;
+    int n = 0;
+    for (int c = 0; status == 0 && c < num_leaves; c++) {
+        status = leafIndexRows(df, &leaves[c], limit, &found, &n);
+    }
+    if (status <= 0) {
+        return status;
+    }
+    qsort(found, n, sizeof(int), compareRowIndices);
+    if (pred->kind == PREDICATE_AND && num_leaves > 1) {
+        int kept = 0;
+        for (int i = 0; i < n;) {
+            int begin = found[i] & ~63;
+            int end = df->num_rows - begin < 64 ? df->num_rows : begin + 64;
+            uint64_t match;
+            evaluatePredicate(pred, begin, end, NULL, &match);
+            for (; i < n && found[i] < end; i++) {
+                if ((match >> (found[i] - begin)) & 1) {
+                    found[kept++] = found[i];
+                }
+            }
+        }
+        n = kept;
+    }
+    *rows = found;
+    *count = n;
+    return 1;
+}
+
+// Function to find the first k rows in sort-key order from a sorted index
+// over the first key, walking it from the end the key starts at one run of
+// equal values at a time. With one key the runs give the rows in order;
+// with more, every row tying with the k-th on the first key is collected
+// and the candidates are sorted. Returns 1 with a malloc'd array of rows,
+// 0 when there is no such index or too many rows tie, -1 when out of memory.
+static int topKByIndex(const DataFrame* df, const SortKey* keys, int num_keys, int k, int** rows, int* count) {
+    if (!df->indexes) {
+        return 0;
+    }
+    const Column* col = keys[0].col;
+    const ColumnIndex* index = findColumnIndex(df, col, INDEX_SORTED);
+    if (!index) {
+        return 0;
+    }
+    if (k > df->num_rows) k = df->num_rows;
+    if (k < 0) k = 0;
+    if (k > index->size) {
+        // Missing values would have to follow
+        return 0;
+    }
+    int descending = keys[0].descending;
+    int64_t limit = num_keys == 1 ? k : (int64_t)k * 4 > (1 << 16) ? (int64_t)k * 4 : (1 << 16);
+    IndexPosition first = {0, 0};
+    IndexPosition last = {index->num_blocks, 0};
+
+    KernelSpan span;
+    beginKernel(&span, KERNEL_TOP_K);
+    int* out = NULL;
+    int64_t total = 0;
+    int status = 0;
+    // Size the candidates, then copy them
+    for (int pass = 0; status == 0 && pass < 2; pass++) {
+        IndexPosition pos = descending ? last : first;
+        total = 0;
+        while (total < k) {
+            IndexPosition begin, end;
+            if (descending) {
+                if (pos.block == 0 && pos.offset == 0) break;
+                IndexPosition prev = pos;
+                if (prev.offset == 0) {
+                    prev.block--;
+                    prev.offset = index->blocks[prev.block]->size;
+                }
+                IndexProbe probe = probeOfCell(col, index->blocks[prev.block]->rows[prev.offset - 1]);
+                begin = seekIndex(index, col, &probe, 0);
+                end = pos;
+                pos = begin;
+            } else {
+                if (pos.block == index->num_blocks) break;
+                IndexProbe probe = probeOfCell(col, index->blocks[pos.block]->rows[pos.offset]);
+                begin = pos;
+                end = seekIndex(index, col, &probe, 1);
+                pos = end;
+            }
+            int64_t want = num_keys == 1 ? k - total : limit - total + 1;
+            int64_t taken = indexRowsBetween(index, begin, end, out ? out + total : NULL, want);
+            if (num_keys > 1 && taken > limit - total) {
+                status = 1;
+                break;
+            }
+            total += taken;
+        }
+        if (status == 0 && pass == 0) {
+            out = (int*)malloc((size_t)(total > 0 ? total : 1) * sizeof(int));
+            status = out ? 0 : -1;
+        }
+    }
+    if (status == 0 && num_keys > 1) {
+        int* tmp = (int*)malloc((size_t)(total > 0 ? total : 1) * sizeof(int));
+        if (tmp) {
+            qsort(out, (size_t)total, sizeof(int), compareRowIndices);
+            mergeSortRows(out, tmp, (int)total, keys, num_keys);
+            free(tmp);
+        } else {
+            status = -1;
+        }
+    }
+    endKernel(&span, status == 0 ? total : 0);
+    if (status != 0) {
+        free(out);
+        return status > 0 ? 0 : -1;
+    }
+    *rows = out;
+    *count = total < k ? (int)total : k;
+    return 1;
+}
+
+// Shared state for evaluating a predicate over a DataFrame in blocks
+typedef struct {
+    const Predicate* pred;
+    int num_rows;
+    uint64_t* mask;           // one bit per row
+    int64_t* counts;          // matches per block, then the block's first output index
+    int* rows;
+} FilterJob;
+
+// Function to evaluate the predicate over one block (runs on a worker thread)
+static void filterBlock(void* ctx, int block) {
+    FilterJob* job = (FilterJob*)ctx;
+    int begin = block * FILTER_BLOCK_ROWS;
+    int end = job->num_rows - begin < FILTER_BLOCK_ROWS ? job->num_rows : begin + FILTER_BLOCK_ROWS;
+    uint64_t* out = job->mask + begin / 64;
+    evaluatePredicate(job->pred, begin, end, NULL, out);
+    int64_t count = 0;
+    for (int w = 0; w < (end - begin + 63) / 64; w++) {
+        count += popcount64(out[w]);
+    }
+    job->counts[block] = count;
+}
+
+// Function to write the row numbers of one block's matches (runs on a worker thread)
+static void selectBlock(void* ctx, int block) {
+    FilterJob* job = (FilterJob*)ctx;
+    int begin = block * FILTER_BLOCK_ROWS;
+    int end = job->num_rows - begin < FILTER_BLOCK_ROWS ? job->num_rows : begin + FILTER_BLOCK_ROWS;
+    int* rows = job->rows + job->counts[block];
+    for (int w = 0; w < (end - begin + 63) / 64; w++) {
+        uint64_t word = job->mask[begin / 64 + w];
+        while (word) {
+            *rows++ = begin + w * 64 + countTrailingZeros64(word);
+            word &= word - 1;
+        }
+    }
+}
+
+// Function to evaluate a predicate over every row of df and return the
+// ascending row numbers that match as a selection vector (malloc'd, NULL
+// when out of memory). Blocks are evaluated in parallel into a bitmask,
+// which is then expanded into row numbers in parallel.
+static int* filterRows(const DataFrame* df, const Predicate* pred, int* count) {
+    int num_blocks = (df->num_rows + FILTER_BLOCK_ROWS - 1) / FILTER_BLOCK_ROWS;
+    FilterJob job;
+    job.pred = pred;
+    job.num_rows = df->num_rows;
+    job.mask = (uint64_t*)malloc(VALIDITY_WORDS(df->num_rows > 0 ? df->num_rows : 1) * sizeof(uint64_t));
+    job.counts = (int64_t*)malloc((num_blocks > 0 ? num_blocks : 1) * sizeof(int64_t));
+    job.rows = NULL;
+    KernelSpan span;
+    beginKernel(&span, KERNEL_FILTER);
+    int indexed = filterByIndex(df, pred, &job.rows, count);
+    if (indexed != 0) {
+        free(job.mask);
+        free(job.counts);
+        endKernel(&span, job.rows ? *count : 0);
+        return indexed > 0 ? job.rows : NULL;
+    }
+    if (job.mask && job.counts) {
+        parallelFor(num_blocks, getNumThreads(), filterBlock, &job);
+        int64_t total = 0;
+        for (int b = 0; b < num_blocks; b++) {
+            int64_t matches = job.counts[b];
+            job.counts[b] = total;
+            total += matches;
+        }
+        job.rows = (int*)malloc((size_t)(total > 0 ? total : 1) * sizeof(int));
+        if (job.rows) {
+            parallelFor(num_blocks, getNumThreads(), selectBlock, &job);
+            *count = (int)total;
+        }
+    }
+    free(job.mask);
+    free(job.counts);
+    endKernel(&span, job.rows ? df->num_rows : 0);
+    return job.rows;
+}
+
+// Packed keys with up to this many codes (or up to a quarter of the rows
+// across all chunks) are grouped through direct arrays rather than hash tables
+#define GROUPBY_DENSE_CODES (1 << 16)
+
+// Initial slot count of a GroupTable; always a power of two
+#define GROUP_TABLE_INITIAL_CAPACITY 64
+
+// Aggregations computed per group by groupRows
+typedef enum {
+    AGG_COUNT,
+    AGG_SUM,
+    AGG_MEAN,
+    AGG_MIN,
+    AGG_MAX,
+    AGG_FIRST,
+    AGG_LAST,
+    AGG_NUNIQUE
+} AggKind;
+
+// Names of the AggKind values, also used as suffixes of the result columns
+static const char* const agg_names[] = {"count", "sum", "mean", "min", "max", "first", "last", "nunique"};
+#define NUM_AGG_KINDS 8
+
+// One aggregation requested from groupRows
+typedef struct {
+    const Column* col;
+    AggKind kind;
+} Aggregation;
+
+// The key columns of a group-by. When every key is int64, datetime or bool
+// and the product of their value ranges fits in 64 bits, a row's key is
+// packed into one exact integer code (code 0 of a column stands for a
+// missing value); otherwise the key is a hash of the values and rows are
+// compared whenever two hashes meet.
+typedef struct {
+    const Column** cols;
+    int num_cols;
+    int dropna;          // rows with a missing key belong to no group
+    int packed;
+    int64_t* mins;       // packed: smallest value of each column
+    uint64_t* strides;   // packed: weight of each column's code
+    uint64_t num_codes;  // packed: number of distinct codes
+} GroupKeys;
+
+// Function to check whether two rows of a column hold the same value
+static int sameCellValue(const Column* col, int a, int b) {
+    if (col->dtype == DTYPE_STRING) {
+        size_t a_len, b_len;
+        const char* x = stringAt(col, a, &a_len);
+        const char* y = stringAt(col, b, &b_len);
+        return a_len == b_len && memcmp(x, y, a_len) == 0;
+    }
+    return valueKey(col, a) == valueKey(col, b);
+}
+
+// Function to read an int64, datetime or bool cell, or a category code, as
+// an integer
+static int64_t integerAt(const Column* col, int row) {
+    if (col->dtype == DTYPE_BOOL) {
+        return ((const uint8_t*)col->data)[row];
+    }
+    if (col->dtype == DTYPE_CATEGORY) {
+        return codeAt(col, row);
+    }
+    return ((const int64_t*)col->data)[row];
+}
+
+// Function to decide whether the keys can be packed into integer codes,
+// filling in the minimum and stride of every key column if so
+static void packGroupKeys(GroupKeys* keys, int num_rows) {
+    keys->packed = 0;
+    uint64_t product = 1;
+    for (int j = 0; j < keys->num_cols; j++) {
+        const Column* col = keys->cols[j];
+        if (col->dtype != DTYPE_INT64 && col->dtype != DTYPE_DATETIME && col->dtype != DTYPE_BOOL &&
+            col->dtype != DTYPE_CATEGORY) {
+            return;
+        }
+        int64_t lo = INT64_MAX;
+        int64_t hi = INT64_MIN;
+        if (col->dtype == DTYPE_CATEGORY && col->dict->size > 0) {
+            // Codes already are dense integers
+            lo = 0;
+            hi = col->dict->size - 1;
+        }
+        for (int row = 0; col->dtype != DTYPE_CATEGORY && row < num_rows; row++) {
+            if (col->null_count > 0 && isNullCell(col, row)) continue;
+            int64_t value = integerAt(col, row);
+            if (value < lo) lo = value;
+            if (value > hi) hi = value;
+        }
+        // One code per value in [lo, hi] plus code 0 for missing values
+        uint64_t range = 1;
+        if (lo <= hi) {
+            uint64_t span = (uint64_t)hi - (uint64_t)lo;
+            if (span >= UINT64_MAX - 1) {
+                return;
+            }
+            range = span + 2;
+        } else {
+            lo = 0;
+        }
+        if (product > UINT64_MAX / range) {
+            return;
+        }
+        keys->mins[j] = lo;
+        keys->strides[j] = product;
+        product *= range;
+    }
+    keys->num_codes = product;
+    keys->packed = 1;
+}
+
+// Function to compute the key of a row: its packed code or its hash.
+// Returns 0 when the row is dropped because one of its keys is missing.
+static int groupKeyOf(const GroupKeys* keys, int row, uint64_t* out) {
+    uint64_t key = keys->packed ? 0 : UINT64_C(0x9e3779b97f4a7c15);
+    for (int j = 0; j < keys->num_cols; j++) {
+        const Column* col = keys->cols[j];
+        int missing = col->null_count > 0 && isNullCell(col, row);
+        if (missing && keys->dropna) {
+            return 0;
+        }
+        if (keys->packed) {
+            if (!missing) {
+                key += ((uint64_t)integerAt(col, row) - (uint64_t)keys->mins[j] + 1) * keys->strides[j];
+            }
+        } else {
+            key = mixHash(key ^ (missing ? UINT64_C(0xc2b2ae3d27d4eb4f) : valueKey(col, row)));
+        }
+    }
+    *out = key;
+    return 1;
+}
+
+// Function to check whether two rows have equal keys; missing keys are
+// equal to each other
+static int sameGroupKey(const GroupKeys* keys, int a, int b) {
+    for (int j = 0; j < keys->num_cols; j++) {
+        const Column* col = keys->cols[j];
+        int a_missing = col->null_count > 0 && isNullCell(col, a);
+        int b_missing = col->null_count > 0 && isNullCell(col, b);
+        if (a_missing || b_missing) {
+            if (a_missing != b_missing) return 0;
+            continue;
+        }
+        if (!sameCellValue(col, a, b)) return 0;
+    }
+    return 1;
+}
+
+// One group in a GroupTable's slots
+typedef struct {
+    uint64_t key;
+    int id;           // -1 marks an empty slot
+} GroupSlot;
+
+// Open-addressing (linear probing) hash table from group keys to group ids,
+// which are handed out in order of first appearance. The key and first row
+// of every group are kept by id.
+typedef struct {
+    const GroupKeys* keys;
+    GroupSlot* slots;
+    size_t capacity;  // power of two, kept at least twice size
+    int size;
+    uint64_t* group_keys;
+    int* group_rows;
+    size_t group_capacity;
+} GroupTable;
+
+// Function to set up an empty GroupTable
+static int initGroupTable(GroupTable* table, const GroupKeys* keys) {
+    table->keys = keys;
+    table->capacity = GROUP_TABLE_INITIAL_CAPACITY;
+    table->size = 0;
+    table->group_capacity = GROUP_TABLE_INITIAL_CAPACITY / 2;
+    table->slots = (GroupSlot*)malloc(table->capacity * sizeof(GroupSlot));
+    table->group_keys = (uint64_t*)malloc(table->group_capacity * sizeof(uint64_t));
+    table->group_rows = (int*)malloc(table->group_capacity * sizeof(int));
+    if (!table->slots || !table->group_keys || !table->group_rows) {
+        free(table->slots);
+        free(table->group_keys);
+        free(table->group_rows);
+        table->slots = NULL;
+        table->group_keys = NULL;
+        table->group_rows = NULL;
+        return -1;
+    }
+    for (size_t i = 0; i < table->capacity; i++) {
+        table->slots[i].id = -1;
+    }
+    return 0;
+}
+
+// Function to free a GroupTable
+static void freeGroupTable(GroupTable* table) {
+    free(table->slots);
+    free(table->group_keys);
+    free(table->group_rows);
+    table->slots = NULL;
+    table->group_keys = NULL;
+    table->group_rows = NULL;
+    table->size = 0;
+}
+
+// Function to find the slot of the group with this key and row, or the
+// empty slot where it belongs
+static GroupSlot* findGroupSlot(const GroupTable* table, uint64_t key, int row) {
+    size_t mask = table->capacity - 1;
+    size_t i = (size_t)(table->keys->packed ? mixHash(key) : key) & mask;
+    for (;; i = (i + 1) & mask) {
+        GroupSlot* slot = &table->slots[i];
+        if (slot->id < 0) {
+            return slot;
+        }
+        if (slot->key == key &&
+            (table->keys->packed || sameGroupKey(table->keys, table->group_rows[slot->id], row))) {
+            return slot;
+        }
+    }
+}
+
+// Function to double the slots of a GroupTable and rehash them
+static int growGroupTable(GroupTable* table) {
+    size_t capacity = table->capacity * 2;
+    GroupSlot* slots = (GroupSlot*)malloc(capacity * sizeof(GroupSlot));
+    if (!slots) {
+        return -1;
+    }
+    for (size_t i = 0; i < capacity; i++) {
+        slots[i].id = -1;
+    }
+    // Ids are distinct, so each one goes to the first empty slot on its probe
+    size_t mask = capacity - 1;
+    for (int id = 0; id < table->size; id++) {
+        uint64_t key = table->group_keys[id];
+        size_t i = (size_t)(table->keys->packed ? mixHash(key) : key) & mask;
+        while (slots[i].id >= 0) {
+            i = (i + 1) & mask;
+        }
+        slots[i].key = key;
+        slots[i].id = id;
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->capacity = capacity;
+    return 0;
+}
+
+// Function to look up the group of a row by its key, adding a new group
+// whose first row is row when there is none. Returns the group id, or -1
+// when out of memory.
+static int findOrAddGroup(GroupTable* table, uint64_t key, int row) {
+    if ((size_t)(table->size + 1) * 2 > table->capacity && growGroupTable(table) != 0) {
+        return -1;
+    }
+    GroupSlot* slot = findGroupSlot(table, key, row);
+    if (slot->id >= 0) {
+        return slot->id;
+    }
+    if ((size_t)table->size == table->group_capacity) {
+        size_t capacity = table->group_capacity * 2;
+        uint64_t* group_keys = (uint64_t*)realloc(table->group_keys, capacity * sizeof(uint64_t));
+        if (group_keys) table->group_keys = group_keys;
+        int* group_rows = (int*)realloc(table->group_rows, capacity * sizeof(int));
+        if (group_rows) table->group_rows = group_rows;
+        if (!group_keys || !group_rows) {
+            return -1;
+        }
+        table->group_capacity = capacity;
+    }
+    slot->key = key;
+    slot->id = table->size;
+    table->group_keys[table->size] = key;
+    table->group_rows[table->size] = row;
+    return table->size++;
+}
+
+// Shared state for assigning every row to a group. Each chunk of rows is
+// grouped on its own thread, into its own GroupTable or, for dense packed
+// keys, straight into codes with an array of first rows per code.
+typedef struct {
+    const GroupKeys* keys;
+    int num_rows;
+    int num_chunks;
+    int dense;
+    int* group_of_row;    // chunk-local ids or codes, then final group ids; -1 when dropped
+    GroupTable* tables;   // sparse: one per chunk
+    int* first_rows;      // dense: num_codes per chunk, -1 when the code is absent
+    int** remaps;         // local id or code to final group id; per chunk when sparse
+    int* status;
+} GroupJob;
+
+// Function to assign the rows of one chunk to chunk-local groups (runs on a
+// worker thread)
+static void groupChunk(void* ctx, int chunk) {
+    GroupJob* job = (GroupJob*)ctx;
+    int begin = (int)((int64_t)job->num_rows * chunk / job->num_chunks);
+    int end = (int)((int64_t)job->num_rows * (chunk + 1) / job->num_chunks);
+    int* group_of_row = job->group_of_row;
+    if (job->dense) {
+        int* first_rows = job->first_rows + (size_t)chunk * job->keys->num_codes;
+        for (int row = begin; row < end; row++) {
+            uint64_t code;
+            if (!groupKeyOf(job->keys, row, &code)) {
+                group_of_row[row] = -1;
+                continue;
+            }
+            if (first_rows[code] < 0) first_rows[code] = row;
+            group_of_row[row] = (int)code;
+        }
+        job->status[chunk] = 0;
+        return;
+    }
+    GroupTable* table = &job->tables[chunk];
+    int status = initGroupTable(table, job->keys);
+    for (int row = begin; row < end && status == 0; row++) {
+        uint64_t key;
+        if (!groupKeyOf(job->keys, row, &key)) {
+            group_of_row[row] = -1;
+            continue;
+        }
+        int id = findOrAddGroup(table, key, row);
+        group_of_row[row] = id;
+        status = id < 0 ? -1 : 0;
+    }
+    job->status[chunk] = status;
+}
+
+// Function to turn the chunk-local ids or codes of one chunk's rows into
+// final group ids (runs on a worker thread)
+static void remapChunk(void* ctx, int chunk) {
+    GroupJob* job = (GroupJob*)ctx;
+    int begin = (int)((int64_t)job->num_rows * chunk / job->num_chunks);
+    int end = (int)((int64_t)job->num_rows * (chunk + 1) / job->num_chunks);
+    const int* remap = job->remaps[job->dense ? 0 : chunk];
+    if (!remap) {
+        return;
+    }
+    for (int row = begin; row < end; row++) {
+        int local = job->group_of_row[row];
+        if (local >= 0) job->group_of_row[row] = remap[local];
+    }
+}
+
+// Function to order (first row, code) pairs packed into 64 bits, for qsort
+static int compareUint64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Function to number the groups of the dense chunks: codes keep their
+// earliest first row and get ids in order of it
+static int mergeDenseGroups(GroupJob* job, int** group_rows, int* num_groups) {
+    size_t num_codes = (size_t)job->keys->num_codes;
+    uint64_t* present = (uint64_t*)malloc(num_codes * sizeof(uint64_t));
+    int* remap = (int*)malloc(num_codes * sizeof(int));
+    if (!present || !remap) {
+        free(present);
+        free(remap);
+        return -1;
+    }
+    size_t n = 0;
+    for (size_t code = 0; code < num_codes; code++) {
+        for (int c = 0; c < job->num_chunks; c++) {
+            int row = job->first_rows[(size_t)c * num_codes + code];
+            if (row >= 0) {
+                present[n++] = ((uint64_t)row << 32) | code;
+                break;
+            }
+        }
+    }
+    qsort(present, n, sizeof(uint64_t), compareUint64);
+    int* rows = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+    if (!rows) {
+        free(present);
+        free(remap);
+        return -1;
+    }
+    for (size_t g = 0; g < n; g++) {
+        rows[g] = (int)(present[g] >> 32);
+        remap[present[g] & 0xFFFFFFFFu] = (int)g;
+    }
+    free(present);
+    job->remaps[0] = remap;
+    *group_rows = rows;
+    *num_groups = (int)n;
+    return 0;
+}
+
+// Function to fold the chunk tables into the first one. Chunks are folded
+// in row order, so final ids stay in order of first appearance.
+static int mergeSparseGroups(GroupJob* job, int** group_rows, int* num_groups) {
+    GroupTable* merged = &job->tables[0];
+    for (int c = 1; c < job->num_chunks; c++) {
+        GroupTable* partial = &job->tables[c];
+        int* remap = (int*)malloc((partial->size > 0 ? partial->size : 1) * sizeof(int));
+        if (!remap) {
+            return -1;
+        }
+        job->remaps[c] = remap;
+        for (int id = 0; id < partial->size; id++) {
+            remap[id] = findOrAddGroup(merged, partial->group_keys[id], partial->group_rows[id]);
+            if (remap[id] < 0) {
+                return -1;
+            }
+        }
+        freeGroupTable(partial);
+    }
+    *group_rows = merged->group_rows;
+    *num_groups = merged->size;
+    merged->group_rows = NULL;
+    return 0;
+}
+
+// Function to assign every row of a DataFrame to a group. group_of_row
+// receives each row's group id (-1 for dropped rows) and *group_rows a
+// malloc'd array with the first row of every group; ids follow the order
+// in which groups first appear.
+static int assignGroups(GroupKeys* keys, int num_rows, int* group_of_row, int** group_rows, int* num_groups) {
+    packGroupKeys(keys, num_rows);
+    int num_chunks = num_rows / HASH_MIN_CHUNK_ROWS;
+    if (num_chunks > getNumThreads()) num_chunks = getNumThreads();
+    if (num_chunks < 1) num_chunks = 1;
+    GroupJob job;
+    job.keys = keys;
+    job.num_rows = num_rows;
+    job.num_chunks = num_chunks;
+    job.dense = keys->packed && (keys->num_codes <= GROUPBY_DENSE_CODES ||
+                                 keys->num_codes * (uint64_t)num_chunks <= (uint64_t)num_rows / 4);
+    job.group_of_row = group_of_row;
+    job.tables = NULL;
+    job.first_rows = NULL;
+    job.remaps = (int**)calloc(num_chunks, sizeof(int*));
+    job.status = (int*)malloc(num_chunks * sizeof(int));
+    if (job.dense) {
+        size_t cells = (size_t)num_chunks * keys->num_codes;
+        job.first_rows = (int*)malloc(cells * sizeof(int));
+        if (job.first_rows) {
+            memset(job.first_rows, 0xFF, cells * sizeof(int));
+        }
+    } else {
+        job.tables = (GroupTable*)calloc(num_chunks, sizeof(GroupTable));
+    }
+    int status = -1;
+    if (job.remaps && job.status && (job.dense ? job.first_rows != NULL : job.tables != NULL)) {
+        parallelFor(num_chunks, num_chunks, groupChunk, &job);
+        status = 0;
+        for (int c = 0; c < num_chunks; c++) {
+            status |= job.status[c];
+        }
+        if (status == 0) {
+            status = job.dense ? mergeDenseGroups(&job, group_rows, num_groups)
+                               : mergeSparseGroups(&job, group_rows, num_groups);
+        }
+        if (status == 0) {
+            parallelFor(num_chunks, num_chunks, remapChunk, &job);
+        }
+    }
+    for (int c = 0; job.tables && c < num_chunks; c++) {
+        freeGroupTable(&job.tables[c]);
+    }
+    for (int c = 0; job.remaps && c < num_chunks; c++) {
+        free(job.remaps[c]);
+    }
+    free(job.tables);
+    free(job.first_rows);
+    free(job.remaps);
+    free(job.status);
+    return status;
+}
+
+// Running state of one aggregation over one chunk of rows, indexed by
+// group. Which arrays are used depends on the aggregation and dtype.
+typedef struct {
+    int64_t* counts;  // values seen (count, sum, mean, min, max, nunique)
+    int64_t* ints;    // sums and extremes of int64, datetime and bool columns
+    double* floats;   // sums and extremes of float64 columns, sums for mean
+    int* rows;        // chosen rows (first, last, min and max of strings); -1 for none
+} AggState;
+
+// Shared state for computing every aggregation. Tasks cover one
+// aggregation over one chunk of rows; the chunk states of an aggregation
+// are then reduced and turned into a result column.
+typedef struct {
+    const Aggregation* aggs;
+    int num_aggs;
+    const int* group_of_row;
+    int num_rows;
+    int num_groups;
+    int num_chunks;
+    AggState* states;     // num_chunks per aggregation
+    Column* results;
+    int* status;
+} AggregateJob;
+
+// Function to check whether a row's value beats the current extreme for
+// a min (sign 1) or max (sign -1) aggregation of a string column
+static int stringBeats(const Column* col, int row, int best, int sign) {
+    size_t a_len, b_len;
+    const char* a = stringAt(col, row, &a_len);
+    const char* b = stringAt(col, best, &b_len);
+    return sign * compareBytes(a, a_len, b, b_len) < 0;
+}
+
+// Function to free the arrays of an AggState
+static void freeAggState(AggState* state) {
+    free(state->counts);
+    free(state->ints);
+    free(state->floats);
+    free(state->rows);
+    memset(state, 0, sizeof(*state));
+}
+
+// Function to allocate the arrays an aggregation needs
+static int initAggState(const Aggregation* agg, int num_groups, AggState* state) {
+    size_t n = num_groups > 0 ? (size_t)num_groups : 1;
+    const Column* col = agg->col;
+    int is_float = col->dtype == DTYPE_FLOAT64;
+    int by_row = agg->kind == AGG_FIRST || agg->kind == AGG_LAST ||
+                 ((agg->kind == AGG_MIN || agg->kind == AGG_MAX) && isTextColumn(col));
+    memset(state, 0, sizeof(*state));
+    if (by_row) {
+        state->rows = (int*)malloc(n * sizeof(int));
+        if (!state->rows) {
+            return -1;
+        }
+        memset(state->rows, 0xFF, n * sizeof(int));
+        return 0;
+    }
+    state->counts = (int64_t*)calloc(n, sizeof(int64_t));
+    if ((agg->kind == AGG_SUM || agg->kind == AGG_MIN || agg->kind == AGG_MAX) && !is_float) {
+        state->ints = (int64_t*)calloc(n, sizeof(int64_t));
+    } else if (agg->kind != AGG_COUNT && agg->kind != AGG_NUNIQUE) {
+        state->floats = (double*)calloc(n, sizeof(double));
+    }
+    if (!state->counts || (agg->kind != AGG_COUNT && agg->kind != AGG_NUNIQUE && !state->ints && !state->floats)) {
+        freeAggState(state);
+        return -1;
+    }
+    return 0;
+}
+
+// Function to count the distinct values per group of a column with a hash
+// set of (group, value) pairs
+static int countDistinctPerGroup(const Column* col, const int* group_of_row, int num_rows, int64_t* counts) {
+    size_t capacity = VALUE_TABLE_INITIAL_CAPACITY;
+    size_t size = 0;
+    ValueSlot* slots = (ValueSlot*)malloc(capacity * sizeof(ValueSlot));
+    if (!slots) {
+        return -1;
+    }
+    for (size_t i = 0; i < capacity; i++) {
+        slots[i].row = -1;
+    }
+    for (int row = 0; row < num_rows; row++) {
+        int group = group_of_row[row];
+        if (group < 0 || (col->null_count > 0 && isNullCell(col, row))) {
+            continue;
+        }
+        if ((size + 1) * 2 > capacity) {
+            // Double the table; the stored keys already tell each pair's slot
+            size_t grown_capacity = capacity * 2;
+            ValueSlot* grown = (ValueSlot*)malloc(grown_capacity * sizeof(ValueSlot));
+            if (!grown) {
+                free(slots);
+                return -1;
+            }
+            for (size_t i = 0; i < grown_capacity; i++) {
+                grown[i].row = -1;
+            }
+            for (size_t i = 0; i < capacity; i++) {
+                if (slots[i].row < 0) continue;
+                size_t j = (size_t)slots[i].key & (grown_capacity - 1);
+                while (grown[j].row >= 0) j = (j + 1) & (grown_capacity - 1);
+                grown[j] = slots[i];
+            }
+            free(slots);
+            slots = grown;
+            capacity = grown_capacity;
+        }
+        uint64_t key = mixHash(valueKey(col, row) ^ mixHash((uint64_t)group + 1));
+        size_t i = (size_t)key & (capacity - 1);
+        for (;; i = (i + 1) & (capacity - 1)) {
+            ValueSlot* slot = &slots[i];
+            if (slot->row < 0) {
+                slot->key = key;
+                slot->row = row;
+                size++;
+                counts[group]++;
+                break;
+            }
+            if (slot->key == key && group_of_row[slot->row] == group && sameCellValue(col, slot->row, row)) {
+                break;
+            }
+        }
+    }
+    free(slots);
+    return 0;
+}
+
+// Function to run one aggregation over one chunk of rows (runs on a worker thread)
+static void aggregateChunk(void* ctx, int task) {
+    AggregateJob* job = (AggregateJob*)ctx;
+    int a = task / job->num_chunks;
+    int chunk = task % job->num_chunks;
+    const Aggregation* agg = &job->aggs[a];
+    AggState* state = &job->states[task];
+    // Distinct counts cannot be added up across chunks, so one task does all rows
+    if (agg->kind == AGG_NUNIQUE && chunk > 0) {
+        job->status[task] = 0;
+        return;
+    }
+    if (initAggState(agg, job->num_groups, state) != 0) {
+        job->status[task] = -1;
+        return;
+    }
+    const Column* col = agg->col;
+    const int* group_of_row = job->group_of_row;
+    int begin = (int)((int64_t)job->num_rows * chunk / job->num_chunks);
+    int end = (int)((int64_t)job->num_rows * (chunk + 1) / job->num_chunks);
+    int check = col->null_count > 0;
+    int is_float = col->dtype == DTYPE_FLOAT64;
+    const double* floats = (const double*)col->data;
+    int sign = agg->kind == AGG_MIN ? 1 : -1;
+    int status = 0;
+    switch (agg->kind) {
+        case AGG_COUNT:
+            for (int row = begin; row < end; row++) {
+                int g = group_of_row[row];
+                if (g < 0 || (check && isNullCell(col, row))) continue;
+                state->counts[g]++;
+            }
+            break;
+        case AGG_SUM:
+        case AGG_MEAN:
+            for (int row = begin; row < end; row++) {
+                int g = group_of_row[row];
+                if (g < 0 || (check && isNullCell(col, row))) continue;
+                state->counts[g]++;
+                if (state->ints) {
+                    state->ints[g] = (int64_t)((uint64_t)state->ints[g] + (uint64_t)integerAt(col, row));
+                } else {
+                    state->floats[g] += is_float ? floats[row] : (double)integerAt(col, row);
+                }
+            }
+            break;
+        case AGG_MIN:
+        case AGG_MAX:
+            for (int row = begin; row < end; row++) {
+                int g = group_of_row[row];
+                if (g < 0 || (check && isNullCell(col, row))) continue;
+                if (state->rows) {
+                    if (state->rows[g] < 0 || stringBeats(col, row, state->rows[g], sign)) state->rows[g] = row;
+                } else if (is_float) {
+                    double value = floats[row];
+                    if (state->counts[g]++ == 0 || (sign > 0 ? value < state->floats[g] : value > state->floats[g])) {
+                        state->floats[g] = value;
+                    }
+                } else {
+                    int64_t value = integerAt(col, row);
+                    if (state->counts[g]++ == 0 || (sign > 0 ? value < state->ints[g] : value > state->ints[g])) {
+                        state->ints[g] = value;
+                    }
+                }
+            }
+            break;
+        case AGG_FIRST:
+        case AGG_LAST:
+            for (int row = begin; row < end; row++) {
+                int g = group_of_row[row];
+                if (g < 0 || (check && isNullCell(col, row))) continue;
+                if (agg->kind == AGG_LAST || state->rows[g] < 0) state->rows[g] = row;
+            }
+            break;
+        case AGG_NUNIQUE:
+            status = countDistinctPerGroup(col, group_of_row, job->num_rows, state->counts);
+            break;
+    }
+    job->status[task] = status;
+}
+
+// Function to fold the later chunk states of an aggregation into the first
+static void reduceAggStates(const Aggregation* agg, AggState* states, int num_chunks, int num_groups) {
+    AggState* into = &states[0];
+    int sign = agg->kind == AGG_MIN ? 1 : -1;
+    for (int c = 1; c < num_chunks && agg->kind != AGG_NUNIQUE; c++) {
+        const AggState* part = &states[c];
+        for (int g = 0; g < num_groups; g++) {
+            if (into->rows) {
+                int row = part->rows[g];
+                if (row < 0) continue;
+                if (into->rows[g] < 0 || agg->kind == AGG_LAST ||
+                    ((agg->kind == AGG_MIN || agg->kind == AGG_MAX) && stringBeats(agg->col, row, into->rows[g], sign))) {
+                    into->rows[g] = row;
+                }
+                continue;
+            }
+            if (part->counts[g] == 0) continue;
+            if (agg->kind == AGG_MIN || agg->kind == AGG_MAX) {
+                if (into->floats) {
+                    if (into->counts[g] == 0 ||
+                        (sign > 0 ? part->floats[g] < into->floats[g] : part->floats[g] > into->floats[g])) {
+                        into->floats[g] = part->floats[g];
+                    }
+                } else if (into->counts[g] == 0 ||
+                           (sign > 0 ? part->ints[g] < into->ints[g] : part->ints[g] > into->ints[g])) {
+                    into->ints[g] = part->ints[g];
+                }
+            } else if (into->ints) {
+                into->ints[g] = (int64_t)((uint64_t)into->ints[g] + (uint64_t)part->ints[g]);
+            } else if (into->floats) {
+                into->floats[g] += part->floats[g];
+            }
+            into->counts[g] += part->counts[g];
+        }
+    }
+}
+
+// Function to turn the reduced state of an aggregation into its result column
+static int buildAggColumn(const Aggregation* agg, const AggState* state, int num_groups, Column* out) {
+    const Column* col = agg->col;
+    if (state->rows) {
+        return gatherColumn(col, state->rows, num_groups, out);
+    }
+    out->name = NULL;
+    switch (agg->kind) {
+        case AGG_COUNT:
+        case AGG_NUNIQUE:
+            out->dtype = DTYPE_INT64;
+            break;
+        case AGG_SUM:
+            out->dtype = col->dtype == DTYPE_FLOAT64 ? DTYPE_FLOAT64 : DTYPE_INT64;
+            break;
+        case AGG_MEAN:
+            out->dtype = DTYPE_FLOAT64;
+            break;
+        default:
+            out->dtype = col->dtype;
+            break;
+    }
+    if (initColumnStorage(out, num_groups) != 0) {
+        return -1;
+    }
+    for (int g = 0; g < num_groups; g++) {
+        int empty = state->counts[g] == 0;
+        switch (agg->kind) {
+            case AGG_COUNT:
+            case AGG_NUNIQUE:
+                ((int64_t*)out->data)[g] = state->counts[g];
+                break;
+            case AGG_SUM:
+                if (state->ints) {
+                    ((int64_t*)out->data)[g] = state->ints[g];
+                } else {
+                    ((double*)out->data)[g] = state->floats[g];
+                }
+                break;
+            case AGG_MEAN:
+                if (empty) {
+                    setNullCell(out, g);
+                } else {
+                    ((double*)out->data)[g] = state->floats[g] / (double)state->counts[g];
+                }
+                break;
+            default:
+                if (empty) {
+                    setNullCell(out, g);
+                } else if (out->dtype == DTYPE_FLOAT64) {
+                    ((double*)out->data)[g] = state->floats[g];
+                } else if (out->dtype == DTYPE_BOOL) {
+                    ((uint8_t*)out->data)[g] = (uint8_t)state->ints[g];
+                } else {
+                    ((int64_t*)out->data)[g] = state->ints[g];
+                }
+                break;
+        }
+    }
+    return 0;
+}
+
+// Function to reduce one aggregation's chunk states and build its result
+// column (runs on a worker thread)
+static void finishAggregation(void* ctx, int a) {
+    AggregateJob* job = (AggregateJob*)ctx;
+    AggState* states = &job->states[(size_t)a * job->num_chunks];
+    reduceAggStates(&job->aggs[a], states, job->num_chunks, job->num_groups);
+    job->status[a] = buildAggColumn(&job->aggs[a], &states[0], job->num_groups, &job->results[a]);
+}
+
+// Function to compute the aggregations for groups already assigned to the
+// rows, one result column each. Rows are split into chunks only while the
+// per-chunk group arrays stay small next to the chunk itself.
+static int computeAggregations(const Aggregation* aggs, int num_aggs, const int* group_of_row, int num_rows,
+                               int num_groups, Column* results) {
+    int num_chunks = (int)(num_rows / (HASH_MIN_CHUNK_ROWS + 4 * (int64_t)num_groups));
+    if (num_chunks > getNumThreads()) num_chunks = getNumThreads();
+    if (num_chunks < 1) num_chunks = 1;
+    int num_tasks = num_aggs * num_chunks;
+    AggregateJob job;
+    job.aggs = aggs;
+    job.num_aggs = num_aggs;
+    job.group_of_row = group_of_row;
+    job.num_rows = num_rows;
+    job.num_groups = num_groups;
+    job.num_chunks = num_chunks;
+    job.results = results;
+    job.states = (AggState*)calloc(num_tasks > 0 ? num_tasks : 1, sizeof(AggState));
+    job.status = (int*)malloc((num_tasks > 0 ? num_tasks : 1) * sizeof(int));
+    int status = -1;
+    if (job.states && job.status) {
+        parallelFor(num_tasks, getNumThreads(), aggregateChunk, &job);
+        status = 0;
+        for (int t = 0; t < num_tasks; t++) {
+            status |= job.status[t];
+        }
+        if (status == 0) {
+            parallelFor(num_aggs, getNumThreads(), finishAggregation, &job);
+            for (int a = 0; a < num_aggs; a++) {
+                status |= job.status[a];
+            }
+            for (int a = 0; status != 0 && a < num_aggs; a++) {
+                if (job.status[a] == 0) freeColumnStorage(&results[a]);
+            }
+        }
+    }
+    for (int t = 0; job.states && t < num_tasks; t++) {
+        freeAggState(&job.states[t]);
+    }
+    free(job.states);
+    free(job.status);
+    return status;
+}
+
+// Function to group the rows of df by the key columns and aggregate each
+// group into a new DataFrame: the key columns come first, then one column
+// per aggregation named <column>_<aggregation>. Groups are listed in order
+// of first appearance. Returns NULL when out of memory.
+static DataFrame* groupRows(const DataFrame* df, const Column** key_cols, int num_keys, int dropna,
+                            const Aggregation* aggs, int num_aggs) {
+    KernelSpan span;
+    beginKernel(&span, KERNEL_GROUPBY);
+    GroupKeys keys;
+    keys.cols = key_cols;
+    keys.num_cols = num_keys;
+    keys.dropna = dropna;
+    keys.mins = (int64_t*)malloc(num_keys * sizeof(int64_t));
+    keys.strides = (uint64_t*)malloc(num_keys * sizeof(uint64_t));
+    int* group_of_row = (int*)malloc((df->num_rows > 0 ? df->num_rows : 1) * sizeof(int));
+    int* group_rows = NULL;
+    int num_groups = 0;
+    DataFrame* out = NULL;
+    int num_cols = num_keys + num_aggs;
+    if (!keys.mins || !keys.strides || !group_of_row ||
+        assignGroups(&keys, df->num_rows, group_of_row, &group_rows, &num_groups) != 0) {
+        goto done;
+    }
+    out = (DataFrame*)malloc(sizeof(DataFrame));
+    if (!out) {
+        goto done;
+    }
+    out->columns = (Column*)calloc(num_cols, sizeof(Column));
+    out->num_rows = num_groups;
+    out->num_cols = num_cols;
+    out->capacity = num_groups;
+    out->exports = 0;
+    out->mapping = NULL;
+    out->views = 0;
+    out->base = NULL;
+    out->readers = 0;
+    out->writing = 0;
+    out->indexes = NULL;
+    if (!out->columns) {
+        free(out);
+        out = NULL;
+        goto done;
+    }
+    // Columns that were never filled are all zero, so freeDataFrame can
+    // clean up after a failure at any point
+    int failed = computeAggregations(aggs, num_aggs, group_of_row, df->num_rows, num_groups,
+                                     out->columns + num_keys) != 0;
+    // The keys of each group are those of its first row
+    for (int k = 0; !failed && k < num_keys; k++) {
+        failed = gatherColumn(key_cols[k], group_rows, num_groups, &out->columns[k]) != 0;
+    }
+    for (int j = 0; !failed && j < num_cols; j++) {
+        const char* name = j < num_keys ? key_cols[j]->name : aggs[j - num_keys].col->name;
+        const char* suffix = j < num_keys ? NULL : agg_names[aggs[j - num_keys].kind];
+        size_t len = strlen(name) + (suffix ? strlen(suffix) + 1 : 0);
+        out->columns[j].name = (char*)malloc(len + 1);
+        if (!out->columns[j].name) {
+            failed = 1;
+        } else if (suffix) {
+            snprintf(out->columns[j].name, len + 1, "%s_%s", name, suffix);
+        } else {
+            memcpy(out->columns[j].name, name, len + 1);
+        }
+    }
+    if (failed) {
+        freeDataFrame(out);
+        out = NULL;
+    }
+
+done:
+    free(keys.mins);
+    free(keys.strides);
+    free(group_of_row);
+    free(group_rows);
+    endKernel(&span, df->num_rows);
+    return out;
+}
+
+// Rows hashed together in one pass over the key columns by the join
+#define JOIN_BLOCK_ROWS 1024
+
+// Bits of the hash choosing the partition of a build row when the hash
+// table is built on several threads
+#define JOIN_PARTITION_BITS 6
+
+// Kinds of join
+typedef enum {
+    JOIN_INNER,
+    JOIN_LEFT,
+    JOIN_SEMI,
+    JOIN_ANTI
+} JoinKind;
+
+// Growable pair of row-number vectors, one entry per output row of a join;
+// a right row of -1 means no match
+typedef struct {
+    int* left;
+    int* right;
+    size_t size;
+    size_t capacity;
+} RowPairs;
+
+// Function to append a (left, right) row pair; fails when out of memory or
+// when the result would outgrow an int row count
+static int appendRowPair(RowPairs* pairs, int left, int right) {
+    if (pairs->size == pairs->capacity) {
+        size_t capacity = pairs->capacity ? pairs->capacity * 2 : 256;
+        if (pairs->size >= INT_MAX) {
+            return -1;
+        }
+        int* grown_left = (int*)realloc(pairs->left, capacity * sizeof(int));
+        if (grown_left) pairs->left = grown_left;
+        int* grown_right = (int*)realloc(pairs->right, capacity * sizeof(int));
+        if (grown_right) pairs->right = grown_right;
+        if (!grown_left || !grown_right) {
+            return -1;
+        }
+        pairs->capacity = capacity;
+    }
+    pairs->left[pairs->size] = left;
+    pairs->right[pairs->size] = right;
+    pairs->size++;
+    return 0;
+}
+
+// Function to free the vectors of a RowPairs
+static void freeRowPairs(RowPairs* pairs) {
+    free(pairs->left);
+    free(pairs->right);
+    memset(pairs, 0, sizeof(*pairs));
+}
+
+// Function to hash the join keys of rows [begin, end) one column at a
+// time. valid[i] is cleared for rows with a missing key, which never match.
+// Category keys hash their text, since each side has its own dictionary.
+static void hashJoinKeys(const Column** cols, int num_keys, int begin, int end, uint64_t* hashes, uint8_t* valid) {
+    int n = end - begin;
+    for (int i = 0; i < n; i++) {
+        hashes[i] = UINT64_C(0x9e3779b97f4a7c15);
+        valid[i] = 1;
+    }
+    for (int k = 0; k < num_keys; k++) {
+        const Column* col = cols[k];
+        if (col->null_count > 0) {
+            for (int i = 0; i < n; i++) {
+                if (isNullCell(col, begin + i)) valid[i] = 0;
+            }
+        }
+        if (col->dtype == DTYPE_INT64 || col->dtype == DTYPE_DATETIME) {
+            const int64_t* values = (const int64_t*)col->data + begin;
+            for (int i = 0; i < n; i++) {
+                hashes[i] = mixHash(hashes[i] ^ (uint64_t)values[i]);
+            }
+        } else if (col->dtype == DTYPE_CATEGORY) {
+            for (int i = 0; i < n; i++) {
+                size_t len;
+                const char* text = stringAt(col, begin + i, &len);
+                hashes[i] = mixHash(hashes[i] ^ hashBytes(text, len));
+            }
+        } else {
+            for (int i = 0; i < n; i++) {
+                hashes[i] = mixHash(hashes[i] ^ valueKey(col, begin + i));
+            }
+        }
+    }
+}
+
+// One distinct key of a build partition: its hash and the first and last
+// build rows of its chain, which runs in ascending row order through next
+typedef struct {
+    uint64_t hash;
+    int first;        // -1 marks an empty slot
+    int last;
+} JoinSlot;
+
+// Shared state of a hash join. The build side is hashed and scattered into
+// partitions by the top bits of the hash, each partition gets its own
+// open-addressing table built on its own thread, and chunks of the probe
+// side are then looked up in parallel, each into its own RowPairs.
+typedef struct {
+    JoinKind kind;
+    int num_keys;
+    int build_is_left;
+    int exact;                // one fixed-width key: equal hashes mean equal keys
+    const Column** build_cols;
+    const Column** probe_cols;
+    int num_build;
+    int num_probe;
+    int build_chunks;
+    int probe_chunks;
+    int partition_bits;       // 0 when there is a single partition
+    int num_partitions;
+    uint64_t* hashes;         // per build row
+    uint8_t* valid;           // per build row
+    int* partition_counts;    // per build chunk and partition, then scatter offsets
+    int* partition_begin;     // num_partitions + 1 offsets into order
+    int* order;               // valid build rows grouped by partition
+    int* next;                // next build row with the same key, -1 at the end
+    JoinSlot** tables;        // per partition, sized to stay at most half full
+    size_t* table_masks;
+    RowPairs* pairs;          // per probe chunk
+    int* status;
+} JoinJob;
+
+// Function to pick the partition of a hash
+static int joinPartition(const JoinJob* job, uint64_t hash) {
+    return job->partition_bits ? (int)(hash >> (64 - job->partition_bits)) : 0;
+}
+
+// Function to hash one chunk of build rows and count them per partition
+// (runs on a worker thread)
+static void hashBuildChunk(void* ctx, int chunk) {
+    JoinJob* job = (JoinJob*)ctx;
+    int begin = (int)((int64_t)job->num_build * chunk / job->build_chunks);
+    int end = (int)((int64_t)job->num_build * (chunk + 1) / job->build_chunks);
+    int* counts = job->partition_counts + (size_t)chunk * job->num_partitions;
+    for (int block = begin; block < end; block += JOIN_BLOCK_ROWS) {
+        int block_end = end - block < JOIN_BLOCK_ROWS ? end : block + JOIN_BLOCK_ROWS;
+        hashJoinKeys(job->build_cols, job->num_keys, block, block_end, job->hashes + block, job->valid + block);
+    }
+    for (int row = begin; row < end; row++) {
+        if (job->valid[row]) counts[joinPartition(job, job->hashes[row])]++;
+    }
+}
+
+// Function to scatter one chunk of build rows into their partitions,
+// keeping row order within each partition (runs on a worker thread)
+static void scatterBuildChunk(void* ctx, int chunk) {
+    JoinJob* job = (JoinJob*)ctx;
+    int begin = (int)((int64_t)job->num_build * chunk / job->build_chunks);
+    int end = (int)((int64_t)job->num_build * (chunk + 1) / job->build_chunks);
+    int* offsets = job->partition_counts + (size_t)chunk * job->num_partitions;
+    for (int row = begin; row < end; row++) {
+        if (job->valid[row]) job->order[offsets[joinPartition(job, job->hashes[row])]++] = row;
+    }
+}
+
+// Function to build the hash table of one partition (runs on a worker thread)
+static void buildPartition(void* ctx, int p) {
+    JoinJob* job = (JoinJob*)ctx;
+    int begin = job->partition_begin[p];
+    int end = job->partition_begin[p + 1];
+    size_t capacity = 1;
+    while (capacity < (size_t)(end - begin) * 2 + 1) {
+        capacity *= 2;
+    }
+    JoinSlot* slots = (JoinSlot*)malloc(capacity * sizeof(JoinSlot));
+    job->tables[p] = slots;
+    job->table_masks[p] = capacity - 1;
+    if (!slots) {
+        job->status[p] = -1;
+        return;
+    }
+    for (size_t i = 0; i < capacity; i++) {
+        slots[i].first = -1;
+    }
+    for (int idx = begin; idx < end; idx++) {
+        int row = job->order[idx];
+        uint64_t hash = job->hashes[row];
+        job->next[row] = -1;
+        for (size_t i = (size_t)hash & (capacity - 1);; i = (i + 1) & (capacity - 1)) {
+            JoinSlot* slot = &slots[i];
+            if (slot->first < 0) {
+                slot->hash = hash;
+                slot->first = row;
+                slot->last = row;
+                break;
+            }
+            if (slot->hash != hash) {
+                continue;
+            }
+            int same = 1;
+            for (int k = 0; !job->exact && same && k < job->num_keys; k++) {
+                same = sameValueAcross(job->build_cols[k], slot->first, job->build_cols[k], row);
+            }
+            if (same) {
+                job->next[slot->last] = row;
+                slot->last = row;
+                break;
+            }
+        }
+    }
+    job->status[p] = 0;
+}
+
+// Function to find the first build row whose key equals that of a probe
+// row, or -1
+static int findJoinChain(const JoinJob* job, uint64_t hash, int row) {
+    int p = joinPartition(job, hash);
+    const JoinSlot* slots = job->tables[p];
+    size_t mask = job->table_masks[p];
+    for (size_t i = (size_t)hash & mask;; i = (i + 1) & mask) {
+        const JoinSlot* slot = &slots[i];
+        if (slot->first < 0) {
+            return -1;
+        }
+        if (slot->hash != hash) {
+            continue;
+        }
+        int same = 1;
+        for (int k = 0; !job->exact && same && k < job->num_keys; k++) {
+            same = sameValueAcross(job->probe_cols[k], row, job->build_cols[k], slot->first);
+        }
+        if (same) {
+            return slot->first;
+        }
+    }
+}
+
+// Function to record what a probe row adds to a join, given the first build
+// row with its key (or -1) and the links of the build rows' chains. When
+// the build side is the right one, the pairs already have the join's final
+// shape; otherwise every matching (left, right) pair is recorded for
+// assembleLeftBuild.
+static int appendJoinMatches(JoinKind kind, int build_is_left, RowPairs* pairs, int row, int match, const int* next) {
+    int status = 0;
+    if (build_is_left) {
+        for (; status == 0 && match >= 0; match = next[match]) {
+            status = appendRowPair(pairs, match, row);
+        }
+        return status;
+    }
+    switch (kind) {
+        case JOIN_INNER:
+        case JOIN_LEFT:
+            if (match < 0 && kind == JOIN_LEFT) {
+                status = appendRowPair(pairs, row, -1);
+            }
+            for (; status == 0 && match >= 0; match = next[match]) {
+                status = appendRowPair(pairs, row, match);
+            }
+            break;
+        case JOIN_SEMI:
+        case JOIN_ANTI:
+            if ((match >= 0) == (kind == JOIN_SEMI)) {
+                status = appendRowPair(pairs, row, -1);
+            }
+            break;
+    }
+    return status;
+}
+
+// Function to probe one chunk of rows against the built tables, a block of
+// hashes at a time (runs on a worker thread)
+static void probeChunk(void* ctx, int chunk) {
+    JoinJob* job = (JoinJob*)ctx;
+    int begin = (int)((int64_t)job->num_probe * chunk / job->probe_chunks);
+    int end = (int)((int64_t)job->num_probe * (chunk + 1) / job->probe_chunks);
+    RowPairs* pairs = &job->pairs[chunk];
+    uint64_t hashes[JOIN_BLOCK_ROWS];
+    uint8_t valid[JOIN_BLOCK_ROWS];
+    int status = 0;
+    for (int block = begin; status == 0 && block < end; block += JOIN_BLOCK_ROWS) {
+        int block_end = end - block < JOIN_BLOCK_ROWS ? end : block + JOIN_BLOCK_ROWS;
+        hashJoinKeys(job->probe_cols, job->num_keys, block, block_end, hashes, valid);
+        for (int row = block; status == 0 && row < block_end; row++) {
+            int match = valid[row - block] ? findJoinChain(job, hashes[row - block], row) : -1;
+            status = appendJoinMatches(job->kind, job->build_is_left, pairs, row, match, job->next);
+        }
+    }
+    job->status[chunk] = status;
+}
+
+// Shared state of a join on one key that probes a hash index over one
+// side's key instead of building a table; chunks of the other side are
+// looked up in parallel, each into its own RowPairs
+typedef struct {
+    JoinKind kind;
+    int build_is_left;
+    const ColumnIndex* index;
+    const Column* build_col;
+    const Column* probe_col;
+    int num_probe;
+    int probe_chunks;
+    RowPairs* pairs;          // per probe chunk
+    int* status;
+} IndexJoinJob;
+
+// Function to probe one chunk of rows against a hash index, giving pairs
+// of the same shape as probeChunk (runs on a worker thread)
+static void probeIndexChunk(void* ctx, int chunk) {
+    IndexJoinJob* job = (IndexJoinJob*)ctx;
+    int begin = (int)((int64_t)job->num_probe * chunk / job->probe_chunks);
+    int end = (int)((int64_t)job->num_probe * (chunk + 1) / job->probe_chunks);
+    int status = 0;
+    for (int row = begin; status == 0 && row < end; row++) {
+        int match = -1;
+        if (!isNullCell(job->probe_col, row)) {
+            IndexProbe probe = probeOfCell(job->probe_col, row);
+            match = findIndexChain(job->index, job->build_col, &probe);
+        }
+        status = appendJoinMatches(job->kind, job->build_is_left, &job->pairs[chunk], row, match, job->index->chain);
+    }
+    job->status[chunk] = status;
+}
+
+// Function to concatenate the pairs of every probe chunk into out
+static int concatRowPairs(RowPairs* parts, int num_parts, RowPairs* out) {
+    size_t total = 0;
+    for (int c = 0; c < num_parts; c++) {
+        total += parts[c].size;
+    }
+    if (total > INT_MAX) {
+        return -1;
+    }
+    memset(out, 0, sizeof(*out));
+    out->capacity = total > 0 ? total : 1;
+    out->left = (int*)malloc(out->capacity * sizeof(int));
+    out->right = (int*)malloc(out->capacity * sizeof(int));
+    if (!out->left || !out->right) {
+        freeRowPairs(out);
+        return -1;
+    }
+    for (int c = 0; c < num_parts; c++) {
+        memcpy(out->left + out->size, parts[c].left, parts[c].size * sizeof(int));
+        memcpy(out->right + out->size, parts[c].right, parts[c].size * sizeof(int));
+        out->size += parts[c].size;
+    }
+    return 0;
+}
+
+// Function to put the matches found by probing with the right side into
+// left row order: a counting sort on the left row, stable so each left
+// row's matches stay in right row order. Unmatched left rows are added
+// for left and anti joins.
+static int assembleLeftBuild(JoinKind kind, RowPairs* parts, int num_parts, int num_left, RowPairs* out) {
+    int64_t* offsets = (int64_t*)calloc((size_t)num_left + 1, sizeof(int64_t));
+    if (!offsets) {
+        return -1;
+    }
+    for (int c = 0; c < num_parts; c++) {
+        for (size_t i = 0; i < parts[c].size; i++) {
+            offsets[parts[c].left[i] + 1]++;
+        }
+    }
+    // Turn the match counts into output slots per left row
+    int64_t total = 0;
+    for (int l = 0; l < num_left; l++) {
+        int64_t matches = offsets[l + 1];
+        int64_t slots = matches;
+        if (kind == JOIN_LEFT && matches == 0) slots = 1;
+        if (kind == JOIN_SEMI) slots = matches > 0;
+        if (kind == JOIN_ANTI) slots = matches == 0;
+        offsets[l + 1] = slots;
+        offsets[l] = total;
+        total += slots;
+    }
+    offsets[num_left] = total;
+    if (total > INT_MAX) {
+        free(offsets);
+        return -1;
+    }
+    memset(out, 0, sizeof(*out));
+    out->capacity = total > 0 ? (size_t)total : 1;
+    out->size = (size_t)total;
+    out->left = (int*)malloc(out->capacity * sizeof(int));
+    out->right = (int*)malloc(out->capacity * sizeof(int));
+    if (!out->left || !out->right) {
+        freeRowPairs(out);
+        free(offsets);
+        return -1;
+    }
+    for (int l = 0; l < num_left; l++) {
+        for (int64_t i = offsets[l]; i < offsets[l + 1]; i++) {
+            out->left[i] = l;
+            out->right[i] = -1;
+        }
+    }
+    if (kind == JOIN_INNER || kind == JOIN_LEFT) {
+        for (int c = 0; c < num_parts; c++) {
+            for (size_t i = 0; i < parts[c].size; i++) {
+                out->right[offsets[parts[c].left[i]]++] = parts[c].right[i];
+            }
+        }
+    }
+    free(offsets);
+    return 0;
+}
+
+// Function to check whether an int64 or datetime column without missing
+// values is sorted in ascending order
+static int isSortedAscending(const Column* col, int num_rows) {
+    const int64_t* values = (const int64_t*)col->data;
+    for (int row = 1; row < num_rows; row++) {
+        if (values[row] < values[row - 1]) return 0;
+    }
+    return 1;
+}
+
+// Function to join two columns that are both sorted ascending by merging
+// them, producing pairs in left row order
+static int mergeJoinSorted(JoinKind kind, const Column* left, int num_left, const Column* right, int num_right,
+                           RowPairs* out) {
+    const int64_t* a = (const int64_t*)left->data;
+    const int64_t* b = (const int64_t*)right->data;
+    memset(out, 0, sizeof(*out));
+    int j = 0;
+    int status = 0;
+    for (int i = 0; status == 0 && i < num_left; i++) {
+        while (j < num_right && b[j] < a[i]) {
+            j++;
+        }
+        int run_end = j;
+        while (run_end < num_right && b[run_end] == a[i]) {
+            run_end++;
+        }
+        int matched = run_end > j;
+        switch (kind) {
+            case JOIN_INNER:
+            case JOIN_LEFT:
+                for (int r = j; status == 0 && r < run_end; r++) {
+                    status = appendRowPair(out, i, r);
+                }
+                if (!matched && kind == JOIN_LEFT) {
+                    status = appendRowPair(out, i, -1);
+                }
+                break;
+            case JOIN_SEMI:
+            case JOIN_ANTI:
+                if (matched == (kind == JOIN_SEMI)) {
+                    status = appendRowPair(out, i, -1);
+                }
+                break;
+        }
+    }
+    if (status != 0) {
+        freeRowPairs(out);
+    }
+    return status;
+}
+
+// Function to free everything a JoinJob allocated
+static void freeJoinJob(JoinJob* job) {
+    for (int p = 0; job->tables && p < job->num_partitions; p++) {
+        free(job->tables[p]);
+    }
+    for (int c = 0; job->pairs && c < job->probe_chunks; c++) {
+        freeRowPairs(&job->pairs[c]);
+    }
+    free(job->hashes);
+    free(job->valid);
+    free(job->partition_counts);
+    free(job->partition_begin);
+    free(job->order);
+    free(job->next);
+    free(job->tables);
+    free(job->table_masks);
+    free(job->pairs);
+    free(job->status);
+}
+
+// Function to join on one key through a hash index over the right key, or
+// else the left one, so no table is built. Returns 1 when it did the join,
+// 0 when neither key has a hash index and -1 when out of memory.
+static int joinByIndex(JoinKind kind, const DataFrame* left, const Column* left_key, const DataFrame* right,
+                       const Column* right_key, RowPairs* out) {
+    IndexJoinJob job;
+    memset(&job, 0, sizeof(job));
+    job.kind = kind;
+    job.index = findColumnIndex(right, right_key, INDEX_HASH);
+    if (!job.index) {
+        job.index = findColumnIndex(left, left_key, INDEX_HASH);
+        job.build_is_left = job.index != NULL;
+    }
+    if (!job.index) {
+        return 0;
+    }
+    job.build_col = job.build_is_left ? left_key : right_key;
+    job.probe_col = job.build_is_left ? right_key : left_key;
+    job.num_probe = job.build_is_left ? right->num_rows : left->num_rows;
+    job.probe_chunks = job.num_probe / HASH_MIN_CHUNK_ROWS;
+    if (job.probe_chunks > getNumThreads()) job.probe_chunks = getNumThreads();
+    if (job.probe_chunks < 1) job.probe_chunks = 1;
+    job.pairs = (RowPairs*)calloc(job.probe_chunks, sizeof(RowPairs));
+    job.status = (int*)calloc(job.probe_chunks, sizeof(int));
+    int status = -1;
+    if (job.pairs && job.status) {
+        parallelFor(job.probe_chunks, job.probe_chunks, probeIndexChunk, &job);
+        status = 0;
+        for (int c = 0; c < job.probe_chunks; c++) {
+            status |= job.status[c];
+        }
+    }
+    if (status == 0) {
+        status = job.build_is_left ? assembleLeftBuild(kind, job.pairs, job.probe_chunks, left->num_rows, out)
+                                   : concatRowPairs(job.pairs, job.probe_chunks, out);
+    }
+    for (int c = 0; job.pairs && c < job.probe_chunks; c++) {
+        freeRowPairs(&job.pairs[c]);
+    }
+    free(job.pairs);
+    free(job.status);
+    return status == 0 ? 1 : -1;
+}
+
+// Function to match the rows of two DataFrames on equal keys, producing
+// the (left, right) row pairs of the join in left row order with matches
+// in right row order. Missing keys never match. Inputs sorted on a single
+// int64 or datetime key are merged, a single key with a hash index probes
+// it; otherwise the hash table is built on the smaller side.
+static int joinRows(JoinKind kind, const DataFrame* left, const Column** left_keys, const DataFrame* right,
+                    const Column** right_keys, int num_keys, RowPairs* out) {
+    const Column* key = left_keys[0];
+    if (num_keys == 1 && (key->dtype == DTYPE_INT64 || key->dtype == DTYPE_DATETIME) &&
+        key->null_count == 0 && right_keys[0]->null_count == 0 && isSortedAscending(key, left->num_rows) &&
+        isSortedAscending(right_keys[0], right->num_rows)) {
+        return mergeJoinSorted(kind, key, left->num_rows, right_keys[0], right->num_rows, out);
+    }
+    int indexed = num_keys == 1 ? joinByIndex(kind, left, key, right, right_keys[0], out) : 0;
+    if (indexed != 0) {
+        return indexed > 0 ? 0 : -1;
+    }
+
+    JoinJob job;
+    memset(&job, 0, sizeof(job));
+    job.kind = kind;
+    job.num_keys = num_keys;
+    job.build_is_left = left->num_rows < right->num_rows;
+    job.exact = num_keys == 1 && !isTextColumn(key);
+    job.build_cols = job.build_is_left ? left_keys : right_keys;
+    job.probe_cols = job.build_is_left ? right_keys : left_keys;
+    job.num_build = job.build_is_left ? left->num_rows : right->num_rows;
+    job.num_probe = job.build_is_left ? right->num_rows : left->num_rows;
+    job.build_chunks = job.num_build / HASH_MIN_CHUNK_ROWS;
+    if (job.build_chunks > getNumThreads()) job.build_chunks = getNumThreads();
+    if (job.build_chunks < 1) job.build_chunks = 1;
+    job.probe_chunks = job.num_probe / HASH_MIN_CHUNK_ROWS;
+    if (job.probe_chunks > getNumThreads()) job.probe_chunks = getNumThreads();
+    if (job.probe_chunks < 1) job.probe_chunks = 1;
+    job.partition_bits = job.build_chunks > 1 ? JOIN_PARTITION_BITS : 0;
+    job.num_partitions = 1 << job.partition_bits;
+    size_t build_rows = job.num_build > 0 ? (size_t)job.num_build : 1;
+    int max_tasks = job.num_partitions > job.probe_chunks ? job.num_partitions : job.probe_chunks;
+    job.hashes = (uint64_t*)malloc(build_rows * sizeof(uint64_t));
+    job.valid = (uint8_t*)malloc(build_rows);
+    job.partition_counts = (int*)calloc((size_t)job.build_chunks * job.num_partitions, sizeof(int));
+    job.partition_begin = (int*)malloc((job.num_partitions + 1) * sizeof(int));
+    job.order = (int*)malloc(build_rows * sizeof(int));
+    job.next = (int*)malloc(build_rows * sizeof(int));
+    job.tables = (JoinSlot**)calloc(job.num_partitions, sizeof(JoinSlot*));
+    job.table_masks = (size_t*)calloc(job.num_partitions, sizeof(size_t));
+    job.pairs = (RowPairs*)calloc(job.probe_chunks, sizeof(RowPairs));
+    job.status = (int*)calloc(max_tasks, sizeof(int));
+    int status = -1;
+    if (!job.hashes || !job.valid || !job.partition_counts || !job.partition_begin || !job.order || !job.next ||
+        !job.tables || !job.table_masks || !job.pairs || !job.status) {
+        goto done;
+    }
+
+    // Hash and partition the build side, then build every partition's table
+    parallelFor(job.build_chunks, job.build_chunks, hashBuildChunk, &job);
+    int offset = 0;
+    for (int p = 0; p < job.num_partitions; p++) {
+        job.partition_begin[p] = offset;
+        for (int c = 0; c < job.build_chunks; c++) {
+            int* count = &job.partition_counts[(size_t)c * job.num_partitions + p];
+            int rows = *count;
+            *count = offset;
+            offset += rows;
+        }
+    }
+    job.partition_begin[job.num_partitions] = offset;
+    parallelFor(job.build_chunks, job.build_chunks, scatterBuildChunk, &job);
+    parallelFor(job.num_partitions, getNumThreads(), buildPartition, &job);
+    status = 0;
+    for (int p = 0; p < job.num_partitions; p++) {
+        status |= job.status[p];
+    }
+    if (status != 0) {
+        goto done;
+    }
+
+    parallelFor(job.probe_chunks, job.probe_chunks, probeChunk, &job);
+    for (int c = 0; c < job.probe_chunks; c++) {
+        status |= job.status[c];
+    }
+    if (status == 0) {
+        status = job.build_is_left ? assembleLeftBuild(kind, job.pairs, job.probe_chunks, left->num_rows, out)
+                                   : concatRowPairs(job.pairs, job.probe_chunks, out);
+    }
+
+done:
+    freeJoinJob(&job);
+    return status;
+}
+
+// Shared state for gathering the output columns of a join, each from its
+// source column through the left or right row vector
+typedef struct {
+    const Column** sources;
+    const int** rows;
+    int num_rows;
+    Column* out;
+    int* status;
+} JoinGatherJob;
+
+// Function to gather one output column of a join (runs on a worker thread)
+static void gatherJoinColumn(void* ctx, int j) {
+    JoinGatherJob* job = (JoinGatherJob*)ctx;
+    job->status[j] = gatherColumn(job->sources[j], job->rows[j], job->num_rows, &job->out[j]);
+}
+
+// Function to join right onto left and build the result as a new
+// DataFrame. Semi and anti joins keep the matching (or unmatched) left
+// rows; inner and left joins hold every left column followed by the
+// right columns other than the keys, whose names get rsuffix when they
+// clash with a left column. Returns NULL when out of memory.
+static DataFrame* buildJoin(JoinKind kind, const DataFrame* left, const Column** left_keys, const DataFrame* right,
+                            const Column** right_keys, int num_keys, const char* rsuffix) {
+    RowPairs pairs;
+    if (joinRows(kind, left, left_keys, right, right_keys, num_keys, &pairs) != 0) {
+        return NULL;
+    }
+    if (kind == JOIN_SEMI || kind == JOIN_ANTI) {
+        DataFrame* out = takeRows(left, pairs.left, (int)pairs.size);
+        freeRowPairs(&pairs);
+        return out;
+    }
+    int num_cols = left->num_cols;
+    for (int j = 0; j < right->num_cols; j++) {
+        int is_key = 0;
+        for (int k = 0; k < num_keys; k++) {
+            is_key |= right_keys[k] == &right->columns[j];
+        }
+        num_cols += !is_key;
+    }
+    DataFrame* out = (DataFrame*)malloc(sizeof(DataFrame));
+    JoinGatherJob job;
+    size_t slots = num_cols > 0 ? (size_t)num_cols : 1;
+    job.sources = (const Column**)malloc(slots * sizeof(Column*));
+    job.rows = (const int**)malloc(slots * sizeof(int*));
+    job.status = (int*)malloc(slots * sizeof(int));
+    job.num_rows = (int)pairs.size;
+    job.out = (Column*)calloc(slots, sizeof(Column));
+    if (!out || !job.sources || !job.rows || !job.status || !job.out) {
+        free(out);
+        free(job.out);
+        out = NULL;
+        goto done;
+    }
+    int n = 0;
+    for (int j = 0; j < left->num_cols; j++, n++) {
+        job.sources[n] = &left->columns[j];
+        job.rows[n] = pairs.left;
+    }
+    for (int j = 0; j < right->num_cols; j++) {
+        int is_key = 0;
+        for (int k = 0; k < num_keys; k++) {
+            is_key |= right_keys[k] == &right->columns[j];
+        }
+        if (!is_key) {
+            job.sources[n] = &right->columns[j];
+            job.rows[n++] = pairs.right;
+        }
+    }
+    parallelFor(num_cols, getNumThreads(), gatherJoinColumn, &job);
+
+    // Columns that failed to gather are all zero, so freeDataFrame cleans up
+    out->columns = job.out;
+    out->num_rows = job.num_rows;
+    out->num_cols = num_cols;
+    out->capacity = job.num_rows;
+    out->exports = 0;
+    out->mapping = NULL;
+    out->views = 0;
+    out->base = NULL;
+    out->readers = 0;
+    out->writing = 0;
+    out->indexes = NULL;
+    int failed = 0;
+    for (int j = 0; j < num_cols; j++) {
+        failed |= job.status[j] != 0;
+    }
+    for (int j = 0; !failed && j < num_cols; j++) {
+        const char* name = job.sources[j]->name;
+        int clashes = 0;
+        for (int l = 0; j >= left->num_cols && l < left->num_cols; l++) {
+            clashes |= strcmp(left->columns[l].name, name) == 0;
+        }
+        size_t len = strlen(name) + (clashes ? strlen(rsuffix) : 0);
+        out->columns[j].name = (char*)malloc(len + 1);
+        if (!out->columns[j].name) {
+            failed = 1;
+        } else {
+            snprintf(out->columns[j].name, len + 1, "%s%s", name, clashes ? rsuffix : "");
+        }
+    }
+    if (failed) {
+        freeDataFrame(out);
+        out = NULL;
+    }
+
+done:
+    free(job.sources);
+    free(job.rows);
+    free(job.status);
+    freeRowPairs(&pairs);
+    return out;
+}
+
+// Function to join right onto left, timed as one kernel
+static DataFrame* joinFrames(JoinKind kind, const DataFrame* left, const Column** left_keys, const DataFrame* right,
+                             const Column** right_keys, int num_keys, const char* rsuffix) {
+    KernelSpan span;
+    beginKernel(&span, KERNEL_JOIN);
+    DataFrame* out = buildJoin(kind, left, left_keys, right, right_keys, num_keys, rsuffix);
+    endKernel(&span, out ? (int64_t)left->num_rows + right->num_rows : 0);
+    return out;
+}
+
+// Growable buffer that text for display is built in
+typedef struct {
+    char* data;
+    size_t size;
+    size_t capacity;
+} TextBuffer;
+
+// Function to append len bytes of text to a buffer. Returns -1 when out of memory.
+static int appendText(TextBuffer* buf, const char* text, size_t len) {
+    if (len > buf->capacity - buf->size) {
+        size_t capacity = buf->capacity > 0 ? buf->capacity : 256;
+        while (capacity - buf->size < len) capacity *= 2;
+        char* data = (char*)realloc(buf->data, capacity);
+        if (!data) {
+            return -1;
+        }
+        buf->data = data;
+        buf->capacity = capacity;
+    }
+    // Empty cells may come from a column with no heap yet
+    if (len > 0) {
+        memcpy(buf->data + buf->size, text, len);
+    }
+    buf->size += len;
+    return 0;
+}
+
+// Function to append count spaces to a buffer
+static int appendSpaces(TextBuffer* buf, size_t count) {
+    static const char spaces[] = "                                ";
+    int status = 0;
+    while (status == 0 && count > 0) {
+        size_t n = count < sizeof(spaces) - 1 ? count : sizeof(spaces) - 1;
+        status = appendText(buf, spaces, n);
+        count -= n;
+    }
+    return status;
+}
+
+// Function to count the characters of UTF-8 text
+static size_t textWidth(const char* text, size_t len) {
+    size_t width = 0;
+    for (size_t i = 0; i < len; i++) {
+        width += ((unsigned char)text[i] & 0xC0) != 0x80;
+    }
+    return width;
+}
+
+// Bytes of output printDataFrame gathers before writing them out
+#define PRINT_BUFFER_BYTES (1 << 16)
+
+// Function to print the contents of the DataFrame, one tab-separated line
+// per row under a line of column names. Lines are gathered in a buffer and
+// written in large blocks. Returns -1 when out of memory.
+static int printDataFrame(const DataFrame* df) {
+    TextBuffer buf = {NULL, 0, 0};
+    int status = 0;
+    for (int j = 0; status == 0 && j < df->num_cols; j++) {
+        status = appendText(&buf, df->columns[j].name, strlen(df->columns[j].name)) | appendText(&buf, "\t", 1);
+    }
+    status |= appendText(&buf, "\n", 1);
+    char cell[64];
+    for (int i = 0; status == 0 && i < df->num_rows; i++) {
+        for (int j = 0; status == 0 && j < df->num_cols; j++) {
+            size_t len;
+            const char* text = formatCell(&df->columns[j], i, cell, sizeof(cell), &len);
+            status = appendText(&buf, text, len) | appendText(&buf, "\t", 1);
+        }
+        status |= appendText(&buf, "\n", 1);
+        if (buf.size >= PRINT_BUFFER_BYTES) {
+            fwrite(buf.data, 1, buf.size, stdout);
+            buf.size = 0;
+        }
+    }
+    if (status == 0) {
+        fwrite(buf.data, 1, buf.size, stdout);
+        fflush(stdout);
+    }
+    free(buf.data);
+    return status;
+}
+
+// Function to cut text longer than max_width characters (at least 4) to
+// fit, ending it with "..." in buf; *width gets its length in characters
+static const char* fitText(const char* text, size_t* len, size_t max_width, char* buf, size_t size,
+                           size_t* width) {
+    *width = textWidth(text, *len);
+    if (*width <= max_width) {
+        return text;
+    }
+    // Keep max_width - 3 characters, without splitting one, then the dots
+    size_t keep = 0;
+    for (size_t chars = 0; keep < *len; keep++) {
+        if (((unsigned char)text[keep] & 0xC0) != 0x80 && chars++ == max_width - 3) break;
+    }
+    if (keep > size - 4) {
+        keep = size - 4;
+        while (keep > 0 && ((unsigned char)text[keep] & 0xC0) == 0x80) keep--;
+    }
+    memmove(buf, text, keep);
+    memcpy(buf + keep, "...", 3);
+    *len = keep + 3;
+    *width = textWidth(buf, *len);
+    return buf;
+}
+
+// Function to get the text a cell is displayed as, missing strings as
+// <NA>, cut to max_width characters
+static const char* displayCell(const Column* col, int row, char* buf, size_t size, size_t max_width, size_t* len,
+                               size_t* width) {
+    const char* text;
+    if (isNullCell(col, row) && isTextColumn(col)) {
+        text = "<NA>";
+        *len = strlen(text);
+    } else {
+        text = formatCell(col, row, buf, size, len);
+    }
+    return fitText(text, len, max_width, buf, size, width);
+}
+
+// Function to render a DataFrame as a table for display: row labels, then
+// the columns right-aligned under their names. At most max_rows rows are
+// shown, the first and last halves of longer frames around a line of
+// "...", and cells are cut to max_colwidth characters, so the cost does
+// not grow with the frame. Returns -1 when out of memory.
+static int formatTable(const DataFrame* df, int max_rows, int max_colwidth, TextBuffer* out) {
+    int shown = df->num_rows <= max_rows ? df->num_rows : max_rows;
+    int head = df->num_rows <= max_rows ? shown : (shown + 1) / 2;
+    int skipped = df->num_rows - shown;
+    size_t* widths = (size_t*)calloc(df->num_cols > 0 ? df->num_cols : 1, sizeof(size_t));
+    if (!widths) {
+        return -1;
+    }
+    char label[32];
+    size_t label_width = (size_t)snprintf(label, sizeof(label), "%d", df->num_rows > 0 ? df->num_rows - 1 : 0);
+    char cell[256];
+    size_t len, width;
+    for (int j = 0; j < df->num_cols; j++) {
+        const Column* col = &df->columns[j];
+        len = strlen(col->name);
+        fitText(col->name, &len, (size_t)max_colwidth, cell, sizeof(cell), &widths[j]);
+        if (skipped > 0 && widths[j] < 3) widths[j] = 3;
+        for (int k = 0; k < shown; k++) {
+            int row = k < head ? k : k + skipped;
+            displayCell(col, row, cell, sizeof(cell), (size_t)max_colwidth, &len, &width);
+            if (width > widths[j]) widths[j] = width;
+        }
+    }
+
+    int status = appendSpaces(out, label_width);
+    for (int j = 0; status == 0 && j < df->num_cols; j++) {
+        len = strlen(df->columns[j].name);
+        const char* name = fitText(df->columns[j].name, &len, (size_t)max_colwidth, cell, sizeof(cell), &width);
+        status = appendSpaces(out, 2 + widths[j] - width) | appendText(out, name, len);
+    }
+    status |= appendText(out, "\n", 1);
+    for (int k = 0; status == 0 && k < shown; k++) {
+        int row = k < head ? k : k + skipped;
+        if (k == head && skipped > 0) {
+            status = appendText(out, "...", 3) | appendSpaces(out, label_width > 3 ? label_width - 3 : 0);
+            for (int j = 0; status == 0 && j < df->num_cols; j++) {
+                status = appendSpaces(out, 2 + widths[j] - 3) | appendText(out, "...", 3);
+            }
+            status |= appendText(out, "\n", 1);
+        }
+        len = (size_t)snprintf(label, sizeof(label), "%d", row);
+        status |= appendText(out, label, len) | appendSpaces(out, label_width - len);
+        for (int j = 0; status == 0 && j < df->num_cols; j++) {
+            const char* text = displayCell(&df->columns[j], row, cell, sizeof(cell), (size_t)max_colwidth, &len,
+                                           &width);
+            status = appendSpaces(out, 2 + widths[j] - width) | appendText(out, text, len);
+        }
+        status |= appendText(out, "\n", 1);
+    }
+    len = (size_t)snprintf(cell, sizeof(cell), "\n[%d rows x %d columns]", df->num_rows, df->num_cols);
+    status |= appendText(out, cell, len);
+    free(widths);
+    return status;
+}
+
+// Chunks smaller than this are not worth a thread of their own
+#define CSV_MIN_CHUNK_BYTES (1 << 20)
+
+// Number of leading records sampled to pick each column's dtype
+#define CSV_INFER_ROWS 1000
+
+// A string column is only encoded as a category by the auto mode when its
+// dictionary holds at most one value per this many rows
+#define CATEGORY_AUTO_RATIO 10
+
+// When the CSV reader dictionary-encodes string columns
+typedef enum {
+    CATEGORY_NEVER,
+    CATEGORY_AUTO,      // when the column has few distinct values
+    CATEGORY_ALWAYS
+} CategoryMode;
+
+// Options accepted by the CSV reader
+typedef struct {
+    char delimiter;
+    char quote;         // '\0' disables quoting
+    int has_header;
+    CategoryMode categorical;
+    const int* columns; // fields to load, in increasing order; NULL loads every field
+    int num_columns;
+    int num_fields;     // fields per record, filled in by loadCSV when columns is set
+} CsvOptions;
+
+// One field of a record as it appears in the file
+typedef struct {
+    const char* text;   // contents without the surrounding quotes
+    size_t len;
+    int quoted;         // was enclosed in quotes, so an empty field is an empty string
+    int escaped;        // contains doubled quotes that still need unescaping
+    int unterminated;   // opening quote without a closing one
+} CsvField;
+
+// Function to read the field starting at pos. Returns the position just past
+// the field's delimiter or record terminator and sets *end_of_record when the
+// field was the last one of its record. Follows RFC 4180: quoted fields may
+// contain delimiters, newlines and doubled quotes.
+static size_t readCsvField(const char* data, size_t pos, size_t end, const CsvOptions* opts,
+                           CsvField* field, int* end_of_record) {
+    const char delimiter = opts->delimiter;
+    field->escaped = 0;
+    field->unterminated = 0;
+    field->quoted = 0;
+    if (opts->quote && pos < end && data[pos] == opts->quote) {
+        size_t start = ++pos;
+        field->quoted = 1;
+        for (;;) {
+            if (pos >= end) {
+                field->text = data + start;
+                field->len = end - start;
+                field->unterminated = 1;
+                *end_of_record = 1;
+                return end;
+            }
+            if (data[pos] == opts->quote) {
+                if (pos + 1 < end && data[pos + 1] == opts->quote) {
+                    field->escaped = 1;
+                    pos += 2;
+                    continue;
+                }
+                break;
+            }
+            pos++;
+        }
+        field->text = data + start;
+        field->len = pos - start;
+        pos++;
+        // Anything between the closing quote and the delimiter is dropped
+        while (pos < end && data[pos] != delimiter && data[pos] != '\n' && data[pos] != '\r') {
+            pos++;
+        }
+    } else {
+        size_t start = pos;
+        while (pos < end && data[pos] != delimiter && data[pos] != '\n' && data[pos] != '\r') {
+            pos++;
+        }
+        field->text = data + start;
+        field->len = pos - start;
+    }
+    if (pos >= end) {
+        *end_of_record = 1;
+        return end;
+    }
+    if (data[pos] == delimiter) {
+        *end_of_record = 0;
+        return pos + 1;
+    }
+    *end_of_record = 1;
+    if (data[pos] == '\r' && pos + 1 < end && data[pos + 1] == '\n') {
+        return pos + 2;
+    }
+    return pos + 1;
+}
+
+// Function to collapse doubled quotes of an escaped field into scratch;
+// returns the unescaped text or NULL if scratch cannot grow
+static const char* unescapeCsvField(const CsvField* field, char quote, char** scratch, size_t* scratch_size,
+                                    size_t* len) {
+    if (*scratch_size < field->len) {
+        char* grown = (char*)realloc(*scratch, field->len);
+        if (!grown) {
+            return NULL;
+        }
+        *scratch = grown;
+        *scratch_size = field->len;
+    }
+    size_t out = 0;
+    for (size_t i = 0; i < field->len; i++) {
+        (*scratch)[out++] = field->text[i];
+        if (field->text[i] == quote) {
+            i++;
+        }
+    }
+    *len = out;
+    return *scratch;
+}
+
+// Function to skip blank lines starting at pos
+static size_t skipBlankLines(const char* data, size_t pos, size_t end) {
+    while (pos < end && (data[pos] == '\n' || data[pos] == '\r')) {
+        pos++;
+    }
+    return pos;
+}
+
+// Errors a CSV chunk can report
+enum {
+    CSV_OK = 0,
+    CSV_NO_MEMORY,
+    CSV_TOO_MANY_FIELDS,
+    CSV_UNTERMINATED_QUOTE
+};
+
+// A slice of the file parsed by one task into its own column buffers
+typedef struct {
+    size_t begin;       // first byte of the first record
+    size_t end;         // one past the last byte of the last record
+    size_t quotes;      // quote characters in the raw slice, used for splitting
+    DataFrame* part;    // rows parsed from this chunk
+    DType* widened;     // per column, the dtype every value seen so far fits
+    int error;
+    size_t error_offset;
+} CsvChunk;
+
+// State shared by the tasks of one CSV load
+typedef struct {
+    const char* data;
+    size_t data_begin;  // first byte after the header
+    size_t size;
+    const CsvOptions* opts;
+    int num_cols;
+    int num_chunks;
+    CsvChunk* chunks;
+    DataFrame* result;
+    size_t* heap_bases; // num_chunks x num_cols byte offsets into the result's heaps
+    int* row_bases;
+} CsvLoad;
+
+// Function to get the raw byte range assigned to a chunk before alignment
+static void csvRawRange(const CsvLoad* load, int chunk, size_t* begin, size_t* end) {
+    size_t span = load->size - load->data_begin;
+    *begin = load->data_begin + (size_t)((double)span * chunk / load->num_chunks);
+    *end = chunk + 1 == load->num_chunks ? load->size
+                                         : load->data_begin + (size_t)((double)span * (chunk + 1) / load->num_chunks);
+}
+
+// Task counting the quote characters of a chunk's raw range
+static void csvCountQuotes(void* ctx, int chunk) {
+    CsvLoad* load = (CsvLoad*)ctx;
+    size_t begin, end, quotes = 0;
+    csvRawRange(load, chunk, &begin, &end);
+    if (load->opts->quote) {
+        for (size_t pos = begin; pos < end; pos++) {
+            quotes += load->data[pos] == load->opts->quote;
+        }
+    }
+    load->chunks[chunk].quotes = quotes;
+}
+
+// Task moving a chunk's start to the first record boundary in its raw range.
+// A newline starts a record only if an even number of quotes precede it, so
+// the parity inherited from earlier chunks tells us where records begin even
+// when quoted fields contain newlines.
+static void csvAlignChunk(void* ctx, int chunk) {
+    CsvLoad* load = (CsvLoad*)ctx;
+    size_t begin, end;
+    csvRawRange(load, chunk, &begin, &end);
+    if (chunk == 0) {
+        load->chunks[chunk].begin = begin;
+        return;
+    }
+    size_t quotes = 0;
+    for (int k = 0; k < chunk; k++) {
+        quotes += load->chunks[k].quotes;
+    }
+    int in_quotes = (int)(quotes & 1);
+    size_t pos = begin;
+    // The raw start is itself a boundary if it directly follows a newline
+    if (!in_quotes && load->data[pos - 1] == '\n') {
+        load->chunks[chunk].begin = pos;
+        return;
+    }
+    for (; pos < load->size; pos++) {
+        char c = load->data[pos];
+        if (load->opts->quote && c == load->opts->quote) {
+            in_quotes = !in_quotes;
+        } else if (c == '\n' && !in_quotes) {
+            break;
+        }
+    }
+    load->chunks[chunk].begin = pos < load->size ? pos + 1 : load->size;
+}
+
+// Function to parse records from pos up to end into part, stopping after
+// max_rows rows. Values that do not fit a column's dtype are noted in
+// widened. Returns the position of the first record not parsed; on failure
+// *error is set and *error_offset is where the bad record starts. Fields
+// left out of opts->columns are skipped without being converted.
+static size_t csvParseRecords(const char* data, size_t pos, size_t end, const CsvOptions* opts, DataFrame* part,
+                              int max_rows, DType* widened, int* error, size_t* error_offset) {
+    char* scratch = NULL;
+    size_t scratch_size = 0;
+    int num_fields = opts->columns ? opts->num_fields : part->num_cols;
+    pos = skipBlankLines(data, pos, end);
+    while (pos < end && part->num_rows < max_rows) {
+        size_t record_start = pos;
+        int row = part->num_rows;
+        if (reserveRows(part, row + 1) != 0) {
+            *error = CSV_NO_MEMORY;
+            break;
+        }
+        int field_index = 0, col_index = 0;
+        int end_of_record = 0;
+        while (!end_of_record) {
+            CsvField field;
+            pos = readCsvField(data, pos, end, opts, &field, &end_of_record);
+            if (field.unterminated) {
+                *error = CSV_UNTERMINATED_QUOTE;
+                break;
+            }
+            if (field_index >= num_fields) {
+                *error = CSV_TOO_MANY_FIELDS;
+                break;
+            }
+            if (opts->columns && (col_index >= part->num_cols || opts->columns[col_index] != field_index)) {
+                field_index++;
+                continue;
+            }
+            const char* text = field.text;
+            size_t len = field.len;
+            if (field.escaped) {
+                text = unescapeCsvField(&field, opts->quote, &scratch, &scratch_size, &len);
+            }
+            if (!text) {
+                *error = CSV_NO_MEMORY;
+                break;
+            }
+            // An unquoted empty field is missing; a quoted one is the empty string
+            Column* col = &part->columns[col_index];
+            if (len == 0 && !field.quoted) {
+                if (setNullCell(col, row) != 0) {
+                    *error = CSV_NO_MEMORY;
+                    break;
+                }
+            } else if (setCell(col, row, text, len) != 0) {
+                if (col->dtype == DTYPE_STRING) {
+                    *error = CSV_NO_MEMORY;
+                    break;
+                }
+                // The value does not fit the inferred dtype; remember how far
+                // the column has to widen and keep going. An int64 column
+                // that has only met floats so far can still become float64.
+                DType* column_widened = &widened[col_index];
+                double unused;
+                if (col->dtype == DTYPE_INT64 && *column_widened != DTYPE_STRING &&
+                    parseFloat64(text, len, &unused) == 0) {
+                    *column_widened = DTYPE_FLOAT64;
+                } else {
+                    *column_widened = DTYPE_STRING;
+                }
+            }
+            field_index++;
+            col_index++;
+        }
+        if (*error) {
+            *error_offset = record_start;
+            break;
+        }
+        // Short records are padded with missing values
+        for (; col_index < part->num_cols; col_index++) {
+            if (setNullCell(&part->columns[col_index], row) != 0) {
+                *error = CSV_NO_MEMORY;
+                break;
+            }
+        }
+        if (*error) {
+            break;
+        }
+        part->num_rows++;
+        pos = skipBlankLines(data, pos, end);
+    }
+    free(scratch);
+    return pos;
+}
+
+// Task parsing every record of a chunk into the chunk's own DataFrame
+static void csvParseChunk(void* ctx, int chunk_index) {
+    CsvLoad* load = (CsvLoad*)ctx;
+    CsvChunk* chunk = &load->chunks[chunk_index];
+    csvParseRecords(load->data, chunk->begin, chunk->end, load->opts, chunk->part, INT_MAX, chunk->widened,
+                    &chunk->error, &chunk->error_offset);
+}
+
+// Function to append num_rows rows of src to dst starting at dst_row; dst
+// must already have room for the rows and heap_base bytes of dst's heap are
+// reserved for src's strings
+static void copyColumnRows(Column* dst, int dst_row, const Column* src, int num_rows, size_t heap_base) {
+    if (src->dtype == DTYPE_STRING) {
+        const int64_t* src_offsets = STRING_OFFSETS(src);
+        int64_t* dst_offsets = STRING_OFFSETS(dst);
+        for (int i = 0; i < num_rows; i++) {
+            dst_offsets[dst_row + i + 1] = src_offsets[i + 1] + (int64_t)heap_base;
+        }
+        if (src->heap_size) {
+            memcpy(dst->heap + heap_base, src->heap, src->heap_size);
+        }
+    } else {
+        size_t width = dtypeWidth(src->dtype);
+        memcpy((char*)dst->data + (size_t)dst_row * width, src->data, (size_t)num_rows * width);
+    }
+}
+
+// Function to clear in dst the validity bits of src's missing rows, shifted
+// down by dst_row. Only words of src that contain a missing row are visited.
+static void copyNullRows(Column* dst, int dst_row, const Column* src, int num_rows) {
+    if (src->null_count == 0) {
+        return;
+    }
+    size_t words = VALIDITY_WORDS(num_rows);
+    for (size_t w = 0; w < words; w++) {
+        uint64_t missing = ~src->validity[w];
+        if (w + 1 == words && (num_rows & 63)) {
+            missing &= (UINT64_C(1) << (num_rows & 63)) - 1;
+        }
+        while (missing) {
+            markNull(dst, dst_row + (int)(w * 64) + countTrailingZeros64(missing));
+            missing &= missing - 1;
+        }
+    }
+}
+
+// Task copying one chunk's rows into the combined DataFrame
+static void csvMergeChunk(void* ctx, int chunk_index) {
+    CsvLoad* load = (CsvLoad*)ctx;
+    DataFrame* part = load->chunks[chunk_index].part;
+    for (int j = 0; j < load->num_cols; j++) {
+        copyColumnRows(&load->result->columns[j], load->row_bases[chunk_index], &part->columns[j], part->num_rows,
+                       load->heap_bases[chunk_index * load->num_cols + j]);
+    }
+}
+
+// Function to count the line number of a byte offset, for error messages
+static size_t lineNumberAt(const char* data, size_t offset) {
+    size_t line = 1;
+    for (size_t pos = 0; pos < offset; pos++) {
+        line += data[pos] == '\n';
+    }
+    return line;
+}
+
+// Candidate dtypes while sampling a column
+enum {
+    CANDIDATE_INT64 = 1,
+    CANDIDATE_FLOAT64 = 2,
+    CANDIDATE_BOOL = 4,
+    CANDIDATE_DATETIME = 8
+};
+
+// Function to get the dtypes a non-empty value could belong to. Only the
+// words true/false count as bools so that 0/1 columns stay integers.
+static int csvCandidates(const char* text, size_t len) {
+    int candidates = 0;
+    int64_t int_value;
+    double float_value;
+    uint8_t bool_value;
+    if (parseInt64(text, len, &int_value) == 0) {
+        candidates |= CANDIDATE_INT64;
+    }
+    if (parseFloat64(text, len, &float_value) == 0) {
+        candidates |= CANDIDATE_FLOAT64;
+    }
+    if (len > 1 && parseBool(text, len, &bool_value) == 0) {
+        candidates |= CANDIDATE_BOOL;
+    }
+    if (len >= 10 && parseDatetime(text, len, &int_value) == 0) {
+        candidates |= CANDIDATE_DATETIME;
+    }
+    return candidates;
+}
+
+// Function to pick each column's dtype from the first CSV_INFER_ROWS records.
+// A column takes the narrowest dtype every sampled value parses as, in the
+// order bool, int64, float64, datetime. Empty cells do not constrain the
+// dtype: they are missing values, or empty strings when quoted in a string
+// column. Columns with no values are strings.
+static void inferCsvTypes(const char* data, size_t pos, size_t size, const CsvOptions* opts, int num_cols,
+                          DType* dtypes) {
+    int* candidates = (int*)malloc((num_cols > 0 ? num_cols : 1) * sizeof(int));
+    uint8_t* has_value = (uint8_t*)calloc(num_cols > 0 ? num_cols : 1, 1);
+    for (int j = 0; j < num_cols; j++) {
+        dtypes[j] = DTYPE_STRING;
+    }
+    if (!candidates || !has_value) {
+        free(candidates);
+        free(has_value);
+        return;
+    }
+    for (int j = 0; j < num_cols; j++) {
+        candidates[j] = CANDIDATE_INT64 | CANDIDATE_FLOAT64 | CANDIDATE_BOOL | CANDIDATE_DATETIME;
+    }
+    pos = skipBlankLines(data, pos, size);
+    for (int row = 0; row < CSV_INFER_ROWS && pos < size; row++) {
+        int field_index = 0, end_of_record = 0;
+        while (!end_of_record) {
+            CsvField field;
+            pos = readCsvField(data, pos, size, opts, &field, &end_of_record);
+            if (field_index < num_cols) {
+                if (field.len != 0) {
+                    has_value[field_index] = 1;
+                    candidates[field_index] &= field.escaped ? 0 : csvCandidates(field.text, field.len);
+                }
+            }
+            field_index++;
+        }
+        pos = skipBlankLines(data, pos, size);
+    }
+    for (int j = 0; j < num_cols; j++) {
+        if (!has_value[j]) {
+            dtypes[j] = DTYPE_STRING;
+        } else if (candidates[j] & CANDIDATE_BOOL) {
+            dtypes[j] = DTYPE_BOOL;
+        } else if (candidates[j] & CANDIDATE_INT64) {
+            dtypes[j] = DTYPE_INT64;
+        } else if (candidates[j] & CANDIDATE_FLOAT64) {
+            dtypes[j] = DTYPE_FLOAT64;
+        } else if (candidates[j] & CANDIDATE_DATETIME) {
+            dtypes[j] = DTYPE_DATETIME;
+        }
+    }
+    free(candidates);
+    free(has_value);
+}
+
+// Function to change the dtype of a column that holds no rows yet
+static int retypeEmptyColumn(DataFrame* df, int col_index, DType dtype) {
+    Column* col = &df->columns[col_index];
+    if (col->dtype == dtype) {
+        return 0;
+    }
+    freeColumnStorage(col);
+    col->dtype = dtype;
+    return initColumnStorage(col, df->capacity);
+}
+
+// Function to read the header record, or the first record when there is no
+// header, to learn the column count and names. Returns the position of the
+// first data record.
+static size_t readCsvHeader(const char* data, size_t pos, size_t size, const CsvOptions* opts, DataFrame** out) {
+    char* scratch = NULL;
+    size_t scratch_size = 0;
+    int num_cols = 0, capacity = 16;
+    char** names = (char**)malloc(capacity * sizeof(char*));
+    int end_of_record = pos >= size;
+    size_t next = pos;
+    *out = NULL;
+    while (names && !end_of_record) {
+        CsvField field;
+        next = readCsvField(data, next, size, opts, &field, &end_of_record);
+        if (field.unterminated) {
+            PyErr_Format(PyExc_ValueError, "unterminated quoted field on line %zu", lineNumberAt(data, pos));
+            goto fail;
+        }
+        if (num_cols == capacity) {
+            char** grown = (char**)realloc(names, 2 * capacity * sizeof(char*));
+            if (!grown) {
+                PyErr_NoMemory();
+                goto fail;
+            }
+            names = grown;
+            capacity *= 2;
+        }
+        const char* text = field.text;
+        size_t len = field.len;
+        if (field.escaped) {
+            text = unescapeCsvField(&field, opts->quote, &scratch, &scratch_size, &len);
+        }
+        char* name = text ? (char*)malloc(len + 1) : NULL;
+        if (!name) {
+            PyErr_NoMemory();
+            goto fail;
+        }
+        memcpy(name, text, len);
+        name[len] = '\0';
+        names[num_cols++] = name;
+    }
+    if (!names) {
+        PyErr_NoMemory();
+        return 0;
+    }
+    DataFrame* df = createDataFrame(0, num_cols);
+    if (!df) {
+        PyErr_NoMemory();
+        goto fail;
+    }
+    if (opts->has_header) {
+        for (int j = 0; j < num_cols; j++) {
+            free(df->columns[j].name);
+            df->columns[j].name = names[j];
+        }
+        pos = next;
+    } else {
+        for (int j = 0; j < num_cols; j++) {
+            free(names[j]);
+        }
+    }
+    free(names);
+    free(scratch);
+    *out = df;
+    return pos;
+
+fail:
+    for (int j = 0; j < num_cols; j++) {
+        free(names[j]);
+    }
+    free(names);
+    free(scratch);
+    return 0;
+}
+
+// Shared state for dictionary-encoding the string columns of a new DataFrame
+typedef struct {
+    DataFrame* df;
+    int max_size;
+    int* status;
+} CategoryEncodeJob;
+
+// Function to encode one string column of a CategoryEncodeJob (runs on a
+// worker thread)
+static void encodeCategoryTask(void* ctx, int col_index) {
+    CategoryEncodeJob* job = (CategoryEncodeJob*)ctx;
+    Column* col = &job->df->columns[col_index];
+    job->status[col_index] = 0;
+    if (col->dtype == DTYPE_STRING) {
+        job->status[col_index] = encodeCategoryColumn(col, job->df->num_rows, job->df->capacity, job->max_size);
+    }
+}
+
+// Function to dictionary-encode the string columns of a loaded DataFrame,
+// one column per thread. In auto mode a column stays a string column once
+// its dictionary outgrows a tenth of the rows.
+static int encodeCategoryColumns(DataFrame* df, CategoryMode mode) {
+    if (mode == CATEGORY_NEVER || df->num_cols == 0) {
+        return 0;
+    }
+    CategoryEncodeJob job;
+    job.df = df;
+    job.max_size = mode == CATEGORY_ALWAYS ? INT_MAX : df->num_rows / CATEGORY_AUTO_RATIO;
+    job.status = (int*)malloc(df->num_cols * sizeof(int));
+    if (!job.status) {
+        return -1;
+    }
+    int num_threads = getNumThreads() < df->num_cols ? getNumThreads() : df->num_cols;
+    parallelFor(df->num_cols, num_threads, encodeCategoryTask, &job);
+    int status = 0;
+    for (int j = 0; j < df->num_cols; j++) {
+        status |= job.status[j] < 0 ? -1 : 0;
+    }
+    free(job.status);
+    return status;
+}
+
+// Function to map a CSV file and read its header into a DataFrame with no
+// rows. Sets *pos to the first data record; returns -1 with an exception
+// set on failure.
+static int openCsvFile(const char* filename, const CsvOptions* opts, MappedFile* map, DataFrame** df, size_t* pos) {
+    if (mapFile(filename, 0, map) != 0) {
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, filename);
+        return -1;
+    }
+    *pos = 0;
+    // Skip a UTF-8 byte order mark
+    if (map->size >= 3 && memcmp(map->data, "\xEF\xBB\xBF", 3) == 0) {
+        *pos = 3;
+    }
+    *pos = skipBlankLines(map->data, *pos, map->size);
+    if (*pos >= map->size && opts->has_header) {
+        unmapFile(map);
+        PyErr_Format(PyExc_ValueError, "%s: missing header line", filename);
+        return -1;
+    }
+    *pos = readCsvHeader(map->data, *pos, map->size, opts, df);
+    if (!*df) {
+        unmapFile(map);
+        return -1;
+    }
+    return 0;
+}
+
+// Function to load data from a CSV file into a DataFrame. The file is mapped
+// into memory, cut into chunks at record boundaries and the chunks are
+// parsed in parallel straight into column buffers, then concatenated.
+// String columns are then dictionary-encoded as opts->categorical asks.
+// When opts->columns is set only those fields become columns; the others
+// are stepped over by the parser.
+static DataFrame* readCsvFile(const char* filename, const CsvOptions* opts) {
+    MappedFile map;
+    DataFrame* df;
+    size_t pos;
+    if (openCsvFile(filename, opts, &map, &df, &pos) != 0) {
+        return NULL;
+    }
+    const char* data = map.data;
+    // Types are sampled for every field, then narrowed to the loaded ones
+    int num_fields = df->num_cols;
+    DType* dtypes = (DType*)malloc((num_fields > 0 ? num_fields : 1) * sizeof(DType));
+    CsvOptions parse_opts = *opts;
+    parse_opts.num_fields = num_fields;
+    if (dtypes) {
+        inferCsvTypes(data, pos, map.size, opts, num_fields, dtypes);
+    }
+    if (dtypes && opts->columns) {
+        for (int j = 0; j < opts->num_columns; j++) {
+            if (opts->columns[j] < 0 || opts->columns[j] >= num_fields ||
+                (j > 0 && opts->columns[j] <= opts->columns[j - 1])) {
+                PyErr_Format(PyExc_ValueError, "%s does not have the columns asked for", filename);
+                free(dtypes);
+                freeDataFrame(df);
+                unmapFile(&map);
+                return NULL;
+            }
+            dtypes[j] = dtypes[opts->columns[j]];
+        }
+        if (selectColumns(df, opts->columns, opts->num_columns) != 0) {
+            free(dtypes);
+            dtypes = NULL;
+        }
+    }
+
+    CsvLoad load;
+    load.data = data;
+    load.data_begin = pos;
+    load.size = map.size;
+    load.opts = &parse_opts;
+    load.num_cols = df->num_cols;
+    load.result = df;
+    size_t span = map.size - pos;
+    int num_threads = getNumThreads();
+    load.num_chunks = (int)(span / CSV_MIN_CHUNK_BYTES) + 1;
+    if (load.num_chunks > num_threads) load.num_chunks = num_threads;
+    load.chunks = (CsvChunk*)calloc(load.num_chunks, sizeof(CsvChunk));
+    load.heap_bases = (size_t*)calloc((size_t)load.num_chunks * (df->num_cols > 0 ? df->num_cols : 1), sizeof(size_t));
+    load.row_bases = (int*)calloc(load.num_chunks, sizeof(int));
+    int failed = !load.chunks || !load.heap_bases || !load.row_bases || !dtypes;
+    for (int k = 0; !failed && k < load.num_chunks; k++) {
+        load.chunks[k].widened = (DType*)malloc((df->num_cols > 0 ? df->num_cols : 1) * sizeof(DType));
+        failed = !load.chunks[k].widened;
+    }
+    if (failed) {
+        PyErr_NoMemory();
+        goto done;
+    }
+
+    // Split at record boundaries. The file and the DataFrame are private
+    // to this call, so the GIL is let go while the chunks are worked on.
+    Py_BEGIN_ALLOW_THREADS
+    parallelFor(load.num_chunks, num_threads, csvCountQuotes, &load);
+    parallelFor(load.num_chunks, num_threads, csvAlignChunk, &load);
+    Py_END_ALLOW_THREADS
+    for (int k = 0; k < load.num_chunks; k++) {
+        if (k > 0 && load.chunks[k].begin < load.chunks[k - 1].begin) {
+            load.chunks[k].begin = load.chunks[k - 1].begin;
+        }
+    }
+    for (int k = 0; k < load.num_chunks; k++) {
+        load.chunks[k].end = k + 1 < load.num_chunks ? load.chunks[k + 1].begin : map.size;
+    }
+
+    // Parse every chunk with the sampled dtypes. A value the sample did not
+    // anticipate widens its column (int64 to float64, anything to string) and
+    // the chunks are parsed again; dtypes only widen, so this settles quickly.
+    for (;;) {
+        for (int j = 0; j < df->num_cols; j++) {
+            if (retypeEmptyColumn(df, j, dtypes[j]) != 0) {
+                failed = 1;
+            }
+        }
+        for (int k = 0; !failed && k < load.num_chunks; k++) {
+            CsvChunk* chunk = &load.chunks[k];
+            if (chunk->part) {
+                freeDataFrame(chunk->part);
+            }
+            chunk->part = createDataFrame(0, df->num_cols);
+            failed = !chunk->part;
+            for (int j = 0; !failed && j < df->num_cols; j++) {
+                chunk->widened[j] = dtypes[j];
+                failed = retypeEmptyColumn(chunk->part, j, dtypes[j]) != 0;
+            }
+        }
+        if (failed) {
+            PyErr_NoMemory();
+            goto done;
+        }
+        Py_BEGIN_ALLOW_THREADS
+        parallelFor(load.num_chunks, num_threads, csvParseChunk, &load);
+        Py_END_ALLOW_THREADS
+
+        // Report the first error in file order
+        for (int k = 0; k < load.num_chunks; k++) {
+            CsvChunk* chunk = &load.chunks[k];
+            if (chunk->error == CSV_NO_MEMORY) {
+                PyErr_NoMemory();
+                failed = 1;
+            } else if (chunk->error) {
+                PyErr_Format(PyExc_ValueError, "%s, line %zu: %s", filename, lineNumberAt(data, chunk->error_offset),
+                             chunk->error == CSV_TOO_MANY_FIELDS ? "too many fields" : "unterminated quoted field");
+                failed = 1;
+            }
+            if (failed) {
+                goto done;
+            }
+        }
+
+        int widened = 0;
+        for (int k = 0; k < load.num_chunks; k++) {
+            for (int j = 0; j < df->num_cols; j++) {
+                DType dtype = load.chunks[k].widened[j];
+                if (dtype != dtypes[j] && dtypes[j] != DTYPE_STRING) {
+                    dtypes[j] = dtype == DTYPE_FLOAT64 && dtypes[j] == DTYPE_INT64 ? DTYPE_FLOAT64 : DTYPE_STRING;
+                    widened = 1;
+                }
+            }
+        }
+        if (!widened) {
+            break;
+        }
+    }
+
+    // Lay the parts out back to back and copy them in parallel
+    int total_rows = 0;
+    for (int k = 0; k < load.num_chunks; k++) {
+        load.row_bases[k] = total_rows;
+        if (load.chunks[k].part->num_rows > INT_MAX - total_rows) {
+            PyErr_Format(PyExc_OverflowError, "%s has more than %d rows", filename, INT_MAX);
+            failed = 1;
+            goto done;
+        }
+        total_rows += load.chunks[k].part->num_rows;
+    }
+    if (reserveRows(df, total_rows) != 0) {
+        PyErr_NoMemory();
+        failed = 1;
+        goto done;
+    }
+    for (int j = 0; j < df->num_cols; j++) {
+        Column* col = &df->columns[j];
+        size_t heap_size = 0;
+        for (int k = 0; k < load.num_chunks; k++) {
+            load.heap_bases[k * df->num_cols + j] = heap_size;
+            heap_size += load.chunks[k].part->columns[j].heap_size;
+        }
+        if (col->dtype == DTYPE_STRING && reserveHeap(col, heap_size) != 0) {
+            PyErr_NoMemory();
+            failed = 1;
+            goto done;
+        }
+        col->heap_size = heap_size;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    parallelFor(load.num_chunks, num_threads, csvMergeChunk, &load);
+    Py_END_ALLOW_THREADS
+    // Validity words straddle chunk boundaries, so missing rows are marked
+    // after the parallel copy
+    for (int k = 0; k < load.num_chunks; k++) {
+        for (int j = 0; j < df->num_cols; j++) {
+            copyNullRows(&df->columns[j], load.row_bases[k], &load.chunks[k].part->columns[j],
+                         load.chunks[k].part->num_rows);
+        }
+    }
+    df->num_rows = total_rows;
+    if (encodeCategoryColumns(df, opts->categorical) != 0) {
+        PyErr_NoMemory();
+        failed = 1;
+    }
+
+done:
+    if (load.chunks) {
+        for (int k = 0; k < load.num_chunks; k++) {
+            if (load.chunks[k].part) {
+                freeDataFrame(load.chunks[k].part);
+            }
+        }
+    }
+    if (load.chunks) {
+        for (int k = 0; k < load.num_chunks; k++) {
+            free(load.chunks[k].widened);
+        }
+    }
+    free(load.chunks);
+    free(load.heap_bases);
+    free(load.row_bases);
+    free(dtypes);
+    unmapFile(&map);
+    if (failed) {
+        freeDataFrame(df);
+        return NULL;
+    }
+    return df;
+}
+
+// Function to load a CSV file, timed as one kernel
+static DataFrame* loadCSV(const char* filename, const CsvOptions* opts) {
+    KernelSpan span;
+    beginKernel(&span, KERNEL_LOAD_CSV);
+    DataFrame* df = readCsvFile(filename, opts);
+    endKernel(&span, df ? df->num_rows : 0);
+    return df;
+}
+
+// A CSV file read a batch of rows at a time. The file stays mapped and each
+// batch is parsed into a DataFrame handed in by the caller, so a stream of
+// batches of the same size settles into reusing the same buffers. Column
+// dtypes are sampled once from the start of the file; when a batch holds a
+// value that does not fit, that batch is parsed again with the column
+// widened and later batches keep the wider dtype.
+typedef struct {
+    MappedFile map;
+    CsvOptions opts;
+    size_t pos;         // first byte of the next batch
+    size_t released;    // leading bytes of the mapping handed back to the OS
+    int chunksize;      // rows per batch
+    DataFrame* header;  // column names, in a DataFrame with no rows
+    DType* dtypes;      // per column, the dtype of the next batch
+    DType* widened;
+    // Result of the last readCsvBatch
+    DataFrame* batch;
+    size_t batch_end;
+    int error;
+    size_t error_offset;
+} CsvStream;
+
+// Function to open a CSV file for reading in batches of chunksize rows;
+// returns -1 with an exception set on failure
+static int openCsvStream(const char* filename, const CsvOptions* opts, int chunksize, CsvStream* stream) {
+    memset(stream, 0, sizeof(CsvStream));
+    stream->opts = *opts;
+    stream->chunksize = chunksize;
+    if (openCsvFile(filename, opts, &stream->map, &stream->header, &stream->pos) != 0) {
+        return -1;
+    }
+    int num_cols = stream->header->num_cols > 0 ? stream->header->num_cols : 1;
+    stream->dtypes = (DType*)malloc(num_cols * sizeof(DType));
+    stream->widened = (DType*)malloc(num_cols * sizeof(DType));
+    if (!stream->dtypes || !stream->widened) {
+        free(stream->dtypes);
+        free(stream->widened);
+        freeDataFrame(stream->header);
+        unmapFile(&stream->map);
+        PyErr_NoMemory();
+        return -1;
+    }
+    inferCsvTypes(stream->map.data, stream->pos, stream->map.size, opts, stream->header->num_cols, stream->dtypes);
+    return 0;
+}
+
+// Function to close a CSV stream; a batch it still holds is freed
+static void closeCsvStream(CsvStream* stream) {
+    if (stream->batch) {
+        freeDataFrame(stream->batch);
+    }
+    freeDataFrame(stream->header);
+    free(stream->dtypes);
+    free(stream->widened);
+    unmapFile(&stream->map);
+}
+
+// Function to create an empty DataFrame with the columns of a CSV stream,
+// for readCsvBatch to fill
+static DataFrame* newCsvBatch(const CsvStream* stream) {
+    DataFrame* df = createDataFrame(0, stream->header->num_cols);
+    for (int j = 0; df && j < df->num_cols; j++) {
+        char* name = copyString(stream->header->columns[j].name);
+        if (!name) {
+            freeDataFrame(df);
+            return NULL;
+        }
+        free(df->columns[j].name);
+        df->columns[j].name = name;
+    }
+    return df;
+}
+
+// Function to empty a batch DataFrame for reuse, keeping the storage of
+// every column that already has the wanted dtype
+static int resetCsvBatch(DataFrame* df, const DType* dtypes) {
+    for (int j = 0; j < df->num_cols; j++) {
+        Column* col = &df->columns[j];
+        if (col->dtype != dtypes[j] || col->mapped) {
+            freeColumnStorage(col);
+            col->dtype = dtypes[j];
+            if (initColumnStorage(col, df->capacity) != 0) {
+                return -1;
+            }
+            continue;
+        }
+        memset(col->validity, 0xFF, VALIDITY_WORDS(df->capacity) * sizeof(uint64_t));
+        col->null_count = 0;
+        col->heap_size = 0;
+        if (col->dtype == DTYPE_STRING) {
+            STRING_OFFSETS(col)[0] = 0;
+        }
+    }
+    df->num_rows = 0;
+    return 0;
+}
+
+// Function to parse the next batch of a CSV stream into stream->batch,
+// which must be set. Does not touch Python objects, so it can run on a
+// thread of its own while the previous batch is in use.
+static void readCsvBatch(CsvStream* stream) {
+    DataFrame* batch = stream->batch;
+    int num_cols = batch->num_cols;
+    KernelSpan span;
+    beginKernel(&span, KERNEL_READ_CSV_BATCH);
+    for (;;) {
+        stream->error = CSV_OK;
+        if (resetCsvBatch(batch, stream->dtypes) != 0 || reserveRows(batch, stream->chunksize) != 0) {
+            stream->error = CSV_NO_MEMORY;
+            break;
+        }
+        memcpy(stream->widened, stream->dtypes, num_cols * sizeof(DType));
+        stream->batch_end = csvParseRecords(stream->map.data, stream->pos, stream->map.size, &stream->opts, batch,
+                                            stream->chunksize, stream->widened, &stream->error, &stream->error_offset);
+        if (stream->error || memcmp(stream->widened, stream->dtypes, num_cols * sizeof(DType)) == 0) {
+            break;
+        }
+        memcpy(stream->dtypes, stream->widened, num_cols * sizeof(DType));
+    }
+    endKernel(&span, stream->error ? 0 : batch->num_rows);
+}
+
+// Function to move a CSV stream past its last batch. Pages that lie wholly
+// before the new position are handed back to the OS; the mapping is of a
+// file, so they would be read again if ever touched.
+static void advanceCsvStream(CsvStream* stream) {
+    stream->pos = stream->batch_end;
+#if !defined(_WIN32) && defined(MADV_DONTNEED)
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t end = stream->pos / page_size * page_size;
+    if (end > stream->released) {
+        madvise((void*)(stream->map.data + stream->released), end - stream->released, MADV_DONTNEED);
+        stream->released = end;
+    }
+#endif
+}
+
+// Column files begin with this magic and version; byte_order tells apart a
+// file written on a machine of the other endianness
+#define COLUMN_FILE_MAGIC "DFCOLS\r\n"
+#define COLUMN_FILE_VERSION 1
+#define COLUMN_FILE_BYTE_ORDER UINT64_C(0x0102030405060708)
+
+// Header at the start of a column file, followed by one ColumnFileEntry
+// per column
+typedef struct {
+    char magic[8];
+    uint64_t byte_order;
+    uint64_t version;
+    uint64_t num_rows;
+    uint64_t num_cols;
+    uint64_t file_size;
+    uint64_t reserved[2];
+} ColumnFileHeader;
+
+// Where one column lives in a column file. Buffers are stored exactly as
+// they are in memory, at offsets from the start of the file aligned to
+// COLUMN_ALIGNMENT, so a mapped file is used in place.
+typedef struct {
+    uint64_t name_offset;
+    uint64_t name_len;
+    uint64_t dtype;
+    uint64_t code_width;            // category: bytes per code
+    uint64_t null_count;
+    uint64_t data_offset;           // num_rows values (num_rows + 1 string offsets)
+    uint64_t validity_offset;       // VALIDITY_WORDS(num_rows) words, at least one
+    uint64_t heap_offset;           // string: the bytes the offsets point into
+    uint64_t heap_size;
+    uint64_t dict_size;             // category: the dictionary page, a string
+    uint64_t dict_data_offset;      // column of dict_size rows laid out the same way
+    uint64_t dict_validity_offset;
+    uint64_t dict_heap_offset;
+    uint64_t dict_heap_size;
+    uint64_t has_stats;             // min and max hold int64 or double bits
+    uint64_t min;
+    uint64_t max;
+} ColumnFileEntry;
+
+// Function to find the smallest and largest value of an int64, datetime,
+// bool or float64 column as int64 or double bits. Returns 0 when there is
+// no value to summarize.
+static int columnMinMax(const Column* col, int num_rows, uint64_t* min, uint64_t* max) {
+    int found = 0;
+    if (col->dtype == DTYPE_FLOAT64) {
+        const double* values = (const double*)col->data;
+        double lo = INFINITY, hi = -INFINITY;
+        for (int row = 0; row < num_rows; row++) {
+            if (isnan(values[row])) continue;
+            lo = values[row] < lo ? values[row] : lo;
+            hi = values[row] > hi ? values[row] : hi;
+            found = 1;
+        }
+        memcpy(min, &lo, sizeof(lo));
+        memcpy(max, &hi, sizeof(hi));
+    } else if (col->dtype == DTYPE_INT64 || col->dtype == DTYPE_DATETIME || col->dtype == DTYPE_BOOL) {
+        int64_t lo = INT64_MAX, hi = INT64_MIN;
+        for (int row = 0; row < num_rows; row++) {
+            if (col->null_count > 0 && isNullCell(col, row)) continue;
+            int64_t value = integerAt(col, row);
+            lo = value < lo ? value : lo;
+            hi = value > hi ? value : hi;
+            found = 1;
+        }
+        *min = (uint64_t)lo;
+        *max = (uint64_t)hi;
+    }
+    return found;
+}
+
+// Function to append len bytes to a column file at the next aligned offset.
+// Returns the offset, or 0 on a write error.
+static uint64_t writeAligned(FILE* file, uint64_t* pos, const void* data, size_t len) {
+    static const char zeros[COLUMN_ALIGNMENT];
+    size_t pad = (size_t)((COLUMN_ALIGNMENT - *pos % COLUMN_ALIGNMENT) % COLUMN_ALIGNMENT);
+    if (fwrite(zeros, 1, pad, file) != pad || (len > 0 && fwrite(data, 1, len, file) != len)) {
+        return 0;
+    }
+    uint64_t offset = *pos + pad;
+    *pos = offset + len;
+    return offset;
+}
+
+// Function to append count string offsets less heap_start to a column file
+// at the next aligned offset. Returns the offset, or 0 on a write error.
+static uint64_t writeRebasedOffsets(FILE* file, uint64_t* pos, const int64_t* offsets, size_t count,
+                                    int64_t heap_start) {
+    int64_t chunk[1024];
+    uint64_t offset = writeAligned(file, pos, NULL, 0);
+    for (size_t i = 0; offset && i < count; i += 1024) {
+        size_t n = count - i < 1024 ? count - i : 1024;
+        for (size_t k = 0; k < n; k++) {
+            chunk[k] = offsets[i + k] - heap_start;
+        }
+        if (fwrite(chunk, sizeof(int64_t), n, file) != n) {
+            return 0;
+        }
+        *pos += n * sizeof(int64_t);
+    }
+    return offset;
+}
+
+// Function to append the values, validity bitmap and heap of num_rows rows
+// of a column to a column file, storing their offsets. Strings are stored
+// from the start of the heap, whatever part of it the column uses.
+static int writeColumnBuffers(FILE* file, uint64_t* pos, const Column* col, int num_rows, uint64_t* data_offset,
+                              uint64_t* validity_offset, uint64_t* heap_offset) {
+    size_t data_size = ((size_t)num_rows + (col->dtype == DTYPE_STRING ? 1 : 0)) * columnWidth(col);
+    size_t validity_size = VALIDITY_WORDS(num_rows > 0 ? num_rows : 1) * sizeof(uint64_t);
+    int64_t heap_start = heapStart(col);
+    if (heap_start == 0) {
+        *data_offset = writeAligned(file, pos, col->data, data_size);
+    } else {
+        *data_offset = writeRebasedOffsets(file, pos, STRING_OFFSETS(col), (size_t)num_rows + 1, heap_start);
+    }
+    *validity_offset = writeAligned(file, pos, col->validity, validity_size);
+    const char* heap = col->heap ? col->heap + heap_start : NULL;
+    *heap_offset = writeAligned(file, pos, heap, col->heap_size - (size_t)heap_start);
+    return *data_offset && *validity_offset && *heap_offset ? 0 : -1;
+}
+
+// Function to save a DataFrame as a column file. The file is written next
+// to path and renamed over it, so processes that have the old file mapped
+// keep their pages. Returns -1 with errno set on failure.
+static int writeColumnFile(const DataFrame* df, const char* path, int with_stats) {
+    KernelSpan span;
+    beginKernel(&span, KERNEL_SAVE);
+    size_t path_len = strlen(path);
+    char* tmp_path = (char*)malloc(path_len + 5);
+    ColumnFileEntry* entries = (ColumnFileEntry*)calloc(df->num_cols > 0 ? df->num_cols : 1, sizeof(ColumnFileEntry));
+    FILE* file = NULL;
+    if (tmp_path && entries) {
+        memcpy(tmp_path, path, path_len);
+        memcpy(tmp_path + path_len, ".tmp", 5);
+        file = fopen(tmp_path, "wb");
+    } else {
+        errno = ENOMEM;
+    }
+    if (!file) {
+        free(tmp_path);
+        free(entries);
+        endKernel(&span, 0);
+        return -1;
+    }
+    ColumnFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, COLUMN_FILE_MAGIC, sizeof(header.magic));
+    header.byte_order = COLUMN_FILE_BYTE_ORDER;
+    header.version = COLUMN_FILE_VERSION;
+    header.num_rows = (uint64_t)df->num_rows;
+    header.num_cols = (uint64_t)df->num_cols;
+
+    // The header and column table are written again once the offsets are known
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(entries, sizeof(ColumnFileEntry), df->num_cols, file) == (size_t)df->num_cols;
+    uint64_t pos = sizeof(header) + (uint64_t)df->num_cols * sizeof(ColumnFileEntry);
+    for (int j = 0; ok && j < df->num_cols; j++) {
+        const Column* col = &df->columns[j];
+        ColumnFileEntry* entry = &entries[j];
+        entry->name_len = strlen(col->name);
+        entry->name_offset = writeAligned(file, &pos, col->name, entry->name_len);
+        entry->dtype = (uint64_t)col->dtype;
+        entry->code_width = (uint64_t)col->code_width;
+        entry->null_count = (uint64_t)col->null_count;
+        entry->heap_size = col->heap_size - (size_t)heapStart(col);
+        ok = entry->name_offset != 0 && writeColumnBuffers(file, &pos, col, df->num_rows, &entry->data_offset,
+                                                           &entry->validity_offset, &entry->heap_offset) == 0;
+        if (ok && col->dtype == DTYPE_CATEGORY) {
+            entry->dict_size = (uint64_t)col->dict->size;
+            entry->dict_heap_size = col->dict->values.heap_size;
+            ok = writeColumnBuffers(file, &pos, &col->dict->values, col->dict->size, &entry->dict_data_offset,
+                                    &entry->dict_validity_offset, &entry->dict_heap_offset) == 0;
+        }
+        if (with_stats) {
+            entry->has_stats = (uint64_t)columnMinMax(col, df->num_rows, &entry->min, &entry->max);
+        }
+    }
+    header.file_size = pos;
+    ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1 &&
+         fwrite(entries, sizeof(ColumnFileEntry), df->num_cols, file) == (size_t)df->num_cols;
+    ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+    ok = ok && MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING);
+    if (!ok) errno = EIO;
+#else
+    ok = ok && rename(tmp_path, path) == 0;
+#endif
+    if (!ok) {
+        int saved = errno;
+        remove(tmp_path);
+        errno = saved;
+    }
+    free(tmp_path);
+    free(entries);
+    endKernel(&span, ok ? df->num_rows : 0);
+    return ok ? 0 : -1;
+}
+
+// Function to check that [offset, offset + size) lies inside a mapped file
+static int fileRangeValid(const MappedFile* map, uint64_t offset, uint64_t size) {
+    return offset <= map->size && size <= map->size - offset;
+}
+
+// Function to check the header and column table of a mapped column file
+// and return the table, or NULL with a ValueError set
+static const ColumnFileEntry* readColumnFileHeader(const MappedFile* map, const char* path) {
+    const ColumnFileHeader* header = (const ColumnFileHeader*)map->data;
+    if (map->size < sizeof(ColumnFileHeader) || memcmp(header->magic, COLUMN_FILE_MAGIC, sizeof(header->magic)) != 0) {
+        PyErr_Format(PyExc_ValueError, "%s is not a DataFrame file", path);
+        return NULL;
+    }
+    if (header->byte_order != COLUMN_FILE_BYTE_ORDER || header->version != COLUMN_FILE_VERSION) {
+        PyErr_Format(PyExc_ValueError, "%s was written by an incompatible version or machine", path);
+        return NULL;
+    }
+    if (header->file_size != map->size || header->num_rows > INT_MAX || header->num_cols > INT_MAX ||
+        !fileRangeValid(map, sizeof(ColumnFileHeader), header->num_cols * sizeof(ColumnFileEntry))) {
+        PyErr_Format(PyExc_ValueError, "%s is truncated or corrupt", path);
+        return NULL;
+    }
+    return (const ColumnFileEntry*)(map->data + sizeof(ColumnFileHeader));
+}
+
+// Function to point a column of num_rows rows, whose dtype and code width
+// are set, at its buffers in a mapped file. Returns -1 when the buffers do
+// not fit the file.
+static int mapColumnBuffers(const MappedFile* map, Column* col, int num_rows, uint64_t data_offset,
+                            uint64_t validity_offset, uint64_t heap_offset, uint64_t heap_size) {
+    size_t data_size = ((size_t)num_rows + (col->dtype == DTYPE_STRING ? 1 : 0)) * columnWidth(col);
+    size_t validity_size = VALIDITY_WORDS(num_rows > 0 ? num_rows : 1) * sizeof(uint64_t);
+    if (!fileRangeValid(map, data_offset, data_size) || !fileRangeValid(map, validity_offset, validity_size) ||
+        !fileRangeValid(map, heap_offset, heap_size) || data_offset % COLUMN_ALIGNMENT != 0 ||
+        validity_offset % COLUMN_ALIGNMENT != 0) {
+        return -1;
+    }
+    col->data = (void*)(map->data + data_offset);
+    col->validity = (uint64_t*)(map->data + validity_offset);
+    col->heap = heap_size > 0 ? (char*)(map->data + heap_offset) : NULL;
+    col->heap_size = heap_size;
+    col->heap_capacity = heap_size;
+    col->mapped = MAPPED_BUFFERS;
+    if (col->dtype == DTYPE_STRING &&
+        (STRING_OFFSETS(col)[0] != 0 || STRING_OFFSETS(col)[num_rows] != (int64_t)heap_size)) {
+        return -1;
+    }
+    return 0;
+}
+
+// Function to open a column file as a DataFrame whose columns point straight
+// into a copy-on-write mapping of the file. Nothing is read up front beyond
+// the header, so pages are only loaded for the columns that are used, and
+// processes opening the same file share them through the page cache.
+// Returns NULL with a Python error set on failure.
+static DataFrame* mapColumnFile(const char* path) {
+    MappedFile* map = (MappedFile*)malloc(sizeof(MappedFile));
+    if (!map) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    if (mapFile(path, 1, map) != 0) {
+        free(map);
+        PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+        return NULL;
+    }
+    const ColumnFileEntry* entries = readColumnFileHeader(map, path);
+    DataFrame* df = entries ? (DataFrame*)malloc(sizeof(DataFrame)) : NULL;
+    if (!df) {
+        if (entries) PyErr_NoMemory();
+        unmapFile(map);
+        free(map);
+        return NULL;
+    }
+    const ColumnFileHeader* header = (const ColumnFileHeader*)map->data;
+    df->num_rows = (int)header->num_rows;
+    df->num_cols = (int)header->num_cols;
+    df->capacity = df->num_rows;
+    df->exports = 0;
+    df->mapping = map;
+    df->readers = 0;
+    df->writing = 0;
+    df->indexes = NULL;
+    df->views = 0;
+    df->base = NULL;
+    df->columns = (Column*)calloc(df->num_cols > 0 ? df->num_cols : 1, sizeof(Column));
+    if (!df->columns) {
+        df->num_cols = 0;
+        freeDataFrame(df);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    int status = 0;
+    for (int j = 0; status == 0 && j < df->num_cols; j++) {
+        const ColumnFileEntry* entry = &entries[j];
+        Column* col = &df->columns[j];
+        if (entry->dtype > DTYPE_CATEGORY || !fileRangeValid(map, entry->name_offset, entry->name_len) ||
+            entry->null_count > header->num_rows) {
+            status = -1;
+            break;
+        }
+        col->name = (char*)malloc(entry->name_len + 1);
+        if (!col->name) {
+            status = -2;
+            break;
+        }
+        memcpy(col->name, map->data + entry->name_offset, entry->name_len);
+        col->name[entry->name_len] = '\0';
+        col->dtype = (DType)entry->dtype;
+        col->null_count = (int64_t)entry->null_count;
+        if (col->dtype == DTYPE_CATEGORY) {
+            if ((entry->code_width != 1 && entry->code_width != 2 && entry->code_width != 4) ||
+                entry->dict_size > INT32_MAX) {
+                status = -1;
+                break;
+            }
+            col->code_width = (int)entry->code_width;
+            col->dict = (CategoryDict*)calloc(1, sizeof(CategoryDict));
+            if (!col->dict) {
+                status = -2;
+                break;
+            }
+            // The dictionary is used in place too; its hash index is built
+            // the first time a value is added
+            CategoryDict* dict = col->dict;
+            dict->values.dtype = DTYPE_STRING;
+            dict->size = (int)entry->dict_size;
+            dict->capacity = dict->size;
+            dict->code_capacity = df->num_rows;
+            if (mapColumnBuffers(map, &dict->values, dict->size, entry->dict_data_offset,
+                                 entry->dict_validity_offset, entry->dict_heap_offset, entry->dict_heap_size) != 0) {
+                status = -1;
+                break;
+            }
+        }
+        if (mapColumnBuffers(map, col, df->num_rows, entry->data_offset, entry->validity_offset, entry->heap_offset,
+                             entry->heap_size) != 0) {
+            status = -1;
+        }
+    }
+    if (status != 0) {
+        freeDataFrame(df);
+        if (status == -2) {
+            PyErr_NoMemory();
+        } else {
+            PyErr_Format(PyExc_ValueError, "%s is truncated or corrupt", path);
+        }
+        return NULL;
+    }
+    return df;
+}
+
+// Function to open a column file, timed as one kernel
+static DataFrame* openColumnFile(const char* path) {
+    KernelSpan span;
+    beginKernel(&span, KERNEL_OPEN);
+    DataFrame* df = mapColumnFile(path);
+    endKernel(&span, df ? df->num_rows : 0);
+    return df;
+}
+
+// State of a xoshiro256** pseudo-random generator. Every sampling call owns
+// one seeded from its seed, so samples are reproducible and calls on
+// different threads never share state.
+typedef struct {
+    uint64_t s[4];
+} Random;
+
+// Function to seed a generator, filling its state with splitmix64 outputs
+static void seedRandom(Random* rng, uint64_t seed) {
+    for (int i = 0; i < 4; i++) {
+        seed += UINT64_C(0x9e3779b97f4a7c15);
+        rng->s[i] = mixHash(seed);
+    }
+}
+
+// Function to draw the next 64 random bits
+static uint64_t nextRandom(Random* rng) {
+    uint64_t* s = rng->s;
+    uint64_t x = s[1] * 5;
+    uint64_t result = ((x << 7) | (x >> 57)) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+    return result;
+}
+
+// Function to draw an integer uniformly from [0, bound) without modulo
+// bias, by Lemire's multiply-and-reject method
+static uint32_t randomBelow(Random* rng, uint32_t bound) {
+    uint64_t m = (nextRandom(rng) >> 32) * bound;
+    if ((uint32_t)m < bound) {
+        uint32_t threshold = (0u - bound) % bound;
+        while ((uint32_t)m < threshold) {
+            m = (nextRandom(rng) >> 32) * bound;
+        }
+    }
+    return (uint32_t)(m >> 32);
+}
+
+// Function to draw a double uniformly from (0, 1], safe to take the log of
+static double randomUnit(Random* rng) {
+    return (double)((nextRandom(rng) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+// Function to put n rows in uniformly random order (Fisher-Yates)
+static void shuffleRows(int* rows, int n, Random* rng) {
+    for (int i = n - 1; i > 0; i--) {
+        int j = (int)randomBelow(rng, (uint32_t)i + 1);
+        int row = rows[i];
+        rows[i] = rows[j];
+        rows[j] = row;
+    }
+}
+
+// Returned by the sampling functions when too few rows have a positive
+// weight to draw the sample from
+#define SAMPLE_TOO_FEW 1
+
+// How to draw a sample: with or without replacement, with an optional
+// weight per row of the DataFrame, and within the groups of the strata
+// columns in proportion to their sizes
+typedef struct {
+    int replace;
+    const double* weights;  // NULL for uniform
+    const Column** strata;
+    int num_strata;         // 0 for no stratification
+    uint64_t seed;
+} SampleSpec;
+
+// Function to draw count distinct rows of the population (rows 0..size-1
+// when population is NULL) in random order. Small samples use Floyd's
+// algorithm with a hash set of the picks; samples of more than a quarter of
+// the rows shuffle the front of a copy of the population instead.
+static int sampleDistinct(const int* population, int size, int count, Random* rng, int* out) {
+    if ((int64_t)count * 4 > size) {
+        int* order = (int*)malloc((size > 0 ? size : 1) * sizeof(int));
+        if (!order) {
+            return -1;
+        }
+        for (int i = 0; i < size; i++) {
+            order[i] = population ? population[i] : i;
+        }
+        for (int i = 0; i < count; i++) {
+            int j = i + (int)randomBelow(rng, (uint32_t)(size - i));
+            int row = order[j];
+            order[j] = order[i];
+            order[i] = row;
+        }
+        memcpy(out, order, (size_t)count * sizeof(int));
+        free(order);
+        return 0;
+    }
+    size_t num_slots = 16;
+    while (num_slots < (size_t)count * 2) {
+        num_slots *= 2;
+    }
+    int* slots = (int*)malloc(num_slots * sizeof(int));
+    if (!slots) {
+        return -1;
+    }
+    memset(slots, 0xFF, num_slots * sizeof(int));
+    size_t mask = num_slots - 1;
+    int k = 0;
+    for (int j = size - count; j < size; j++) {
+        // Pick t from [0, j]; if it was taken already, j itself is new
+        int pick = (int)randomBelow(rng, (uint32_t)j + 1);
+        for (int attempt = 0; attempt < 2; attempt++) {
+            size_t slot = (size_t)mixHash((uint64_t)pick) & mask;
+            while (slots[slot] >= 0 && slots[slot] != pick) {
+                slot = (slot + 1) & mask;
+            }
+            if (slots[slot] < 0) {
+                slots[slot] = pick;
+                break;
+            }
+            pick = j;
+        }
+        out[k++] = pick;
+    }
+    free(slots);
+    // Floyd's picks form a uniform subset but not a uniform order
+    shuffleRows(out, count, rng);
+    if (population) {
+        for (int i = 0; i < count; i++) {
+            out[i] = population[out[i]];
+        }
+    }
+    return 0;
+}
+
+// Function to draw count rows of the population with replacement, each in
+// proportion to its weight, from an alias table (Vose's method): every draw
+// takes one uniform bucket and one coin flip
+static int sampleWeightedWithReplacement(const int* population, int size, const double* weights, int count,
+                                         Random* rng, int* out) {
+    double total = 0.0;
+    for (int i = 0; i < size; i++) {
+        total += weights[population ? population[i] : i];
+    }
+    if (count > 0 && !(total > 0.0)) {
+        return SAMPLE_TOO_FEW;
+    }
+    double* prob = (double*)malloc((size > 0 ? size : 1) * sizeof(double));
+    int* alias = (int*)malloc((size > 0 ? size : 1) * sizeof(int));
+    int* work = (int*)malloc((size > 0 ? size : 1) * sizeof(int));
+    if (!prob || !alias || !work) {
+        free(prob);
+        free(alias);
+        free(work);
+        return -1;
+    }
+    // Buckets below their fair share fill the worklist from the front and
+    // the rest from the back; each small bucket is topped up by a large one
+    int num_small = 0, large_start = size;
+    for (int i = 0; i < size; i++) {
+        prob[i] = weights[population ? population[i] : i] * size / total;
+        alias[i] = i;
+        if (prob[i] < 1.0) {
+            work[num_small++] = i;
+        } else {
+            work[--large_start] = i;
+        }
+    }
+    int small_top = num_small, large_top = large_start;
+    while (small_top > 0 && large_top < size) {
+        int small = work[--small_top];
+        int large = work[large_top];
+        alias[small] = large;
+        prob[large] -= 1.0 - prob[small];
+        if (prob[large] < 1.0) {
+            large_top++;
+            work[small_top++] = large;
+        }
+    }
+    // What is left over is a full bucket up to rounding
+    while (small_top > 0) {
+        prob[work[--small_top]] = 1.0;
+    }
+    for (int i = large_top; i < size; i++) {
+        prob[work[i]] = 1.0;
+    }
+    for (int i = 0; i < count; i++) {
+        int bucket = (int)randomBelow(rng, (uint32_t)size);
+        int pick = randomUnit(rng) <= prob[bucket] ? bucket : alias[bucket];
+        out[i] = population ? population[pick] : pick;
+    }
+    free(prob);
+    free(alias);
+    free(work);
+    return 0;
+}
+
+// A row of a weighted sample without replacement and its random key
+typedef struct {
+    double key;
+    int row;
+} SampleKey;
+
+// Function to order SampleKeys by ascending key
+static int compareSampleKeys(const void* a, const void* b) {
+    double x = ((const SampleKey*)a)->key;
+    double y = ((const SampleKey*)b)->key;
+    return (x > y) - (x < y);
+}
+
+// Function to move the entry at i of a max-heap of SampleKeys down into place
+static void siftSampleKey(SampleKey* heap, int n, int i) {
+    for (;;) {
+        int largest = i, left = 2 * i + 1, right = left + 1;
+        if (left < n && heap[left].key > heap[largest].key) largest = left;
+        if (right < n && heap[right].key > heap[largest].key) largest = right;
+        if (largest == i) {
+            return;
+        }
+        SampleKey entry = heap[i];
+        heap[i] = heap[largest];
+        heap[largest] = entry;
+        i = largest;
+    }
+}
+
+// Function to draw count distinct rows of the population, each row in
+// proportion to its weight among the rows not drawn yet (Efraimidis-
+// Spirakis): every row gets an exponential key scaled by 1/weight and the
+// count smallest keys win, in key order. One pass with a bounded heap.
+static int sampleWeightedDistinct(const int* population, int size, const double* weights, int count, Random* rng,
+                                  int* out) {
+    if (count == 0) {
+        return 0;
+    }
+    SampleKey* heap = (SampleKey*)malloc((size_t)count * sizeof(SampleKey));
+    if (!heap) {
+        return -1;
+    }
+    int n = 0;
+    for (int i = 0; i < size; i++) {
+        int row = population ? population[i] : i;
+        if (!(weights[row] > 0.0)) {
+            continue;
+        }
+        double key = -log(randomUnit(rng)) / weights[row];
+        if (n < count) {
+            heap[n].key = key;
+            heap[n].row = row;
+            n++;
+            if (n == count) {
+                for (int k = count / 2 - 1; k >= 0; k--) {
+                    siftSampleKey(heap, count, k);
+                }
+            }
+        } else if (key < heap[0].key) {
+            heap[0].key = key;
+            heap[0].row = row;
+            siftSampleKey(heap, count, 0);
+        }
+    }
+    if (n < count) {
+        free(heap);
+        return SAMPLE_TOO_FEW;
+    }
+    qsort(heap, (size_t)count, sizeof(SampleKey), compareSampleKeys);
+    for (int i = 0; i < count; i++) {
+        out[i] = heap[i].row;
+    }
+    free(heap);
+    return 0;
+}
+
+// Function to draw count rows of the population as spec says, ignoring
+// its strata
+static int drawSample(const SampleSpec* spec, const int* population, int size, int count, Random* rng, int* out) {
+    if (spec->weights) {
+        return spec->replace ? sampleWeightedWithReplacement(population, size, spec->weights, count, rng, out)
+                             : sampleWeightedDistinct(population, size, spec->weights, count, rng, out);
+    }
+    if (!spec->replace) {
+        return sampleDistinct(population, size, count, rng, out);
+    }
+    for (int i = 0; i < count; i++) {
+        int pick = (int)randomBelow(rng, (uint32_t)size);
+        out[i] = population ? population[pick] : pick;
+    }
+    return 0;
+}
+
+// A group of a stratified sample and the share of the sample it is owed
+typedef struct {
+    int group;
+    int64_t remainder;  // fractional part of its share, scaled by the row count
+} StratumShare;
+
+// Function to order StratumShares by descending remainder, then by group
+static int compareStratumShares(const void* a, const void* b) {
+    const StratumShare* x = (const StratumShare*)a;
+    const StratumShare* y = (const StratumShare*)b;
+    if (x->remainder != y->remainder) {
+        return x->remainder > y->remainder ? -1 : 1;
+    }
+    return (x->group > y->group) - (x->group < y->group);
+}
+
+// Function to draw a stratified sample: rows are split into the groups of
+// spec's strata columns (missing values form a group of their own) and every
+// group gets a share of the count in proportion to its size, the rounding
+// going to the largest remainders so the shares add up to count. Each group
+// is sampled on its own and the sample is shuffled.
+static int drawStratifiedSample(const DataFrame* df, const SampleSpec* spec, int count, Random* rng, int* out) {
+    int num_rows = df->num_rows;
+    GroupKeys keys;
+    keys.cols = spec->strata;
+    keys.num_cols = spec->num_strata;
+    keys.dropna = 0;
+    keys.mins = (int64_t*)malloc(spec->num_strata * sizeof(int64_t));
+    keys.strides = (uint64_t*)malloc(spec->num_strata * sizeof(uint64_t));
+    int* group_of_row = (int*)malloc((num_rows > 0 ? num_rows : 1) * sizeof(int));
+    int* members = (int*)malloc((num_rows > 0 ? num_rows : 1) * sizeof(int));
+    int* group_rows = NULL;
+    int* starts = NULL;
+    int* quotas = NULL;
+    StratumShare* shares = NULL;
+    int num_groups = 0;
+    int status = -1;
+    if (!keys.mins || !keys.strides || !group_of_row || !members ||
+        assignGroups(&keys, num_rows, group_of_row, &group_rows, &num_groups) != 0) {
+        goto done;
+    }
+    starts = (int*)calloc((size_t)num_groups + 1, sizeof(int));
+    quotas = (int*)malloc((num_groups > 0 ? num_groups : 1) * sizeof(int));
+    shares = (StratumShare*)malloc((num_groups > 0 ? num_groups : 1) * sizeof(StratumShare));
+    if (!starts || !quotas || !shares) {
+        goto done;
+    }
+    // Lay out the rows of every group together, in row order
+    for (int i = 0; i < num_rows; i++) {
+        starts[group_of_row[i] + 1]++;
+    }
+    for (int g = 0; g < num_groups; g++) {
+        starts[g + 1] += starts[g];
+    }
+    for (int i = 0; i < num_rows; i++) {
+        members[starts[group_of_row[i]]++] = i;
+    }
+    for (int g = num_groups; g > 0; g--) {
+        starts[g] = starts[g - 1];
+    }
+    starts[0] = 0;
+    int assigned = 0;
+    for (int g = 0; g < num_groups; g++) {
+        int64_t share = (int64_t)count * (starts[g + 1] - starts[g]);
+        quotas[g] = (int)(share / num_rows);
+        shares[g].group = g;
+        shares[g].remainder = share % num_rows;
+        assigned += quotas[g];
+    }
+    qsort(shares, (size_t)num_groups, sizeof(StratumShare), compareStratumShares);
+    for (int i = 0; assigned < count; i++, assigned++) {
+        quotas[shares[i].group]++;
+    }
+    int pos = 0;
+    status = 0;
+    for (int g = 0; status == 0 && g < num_groups; g++) {
+        status = drawSample(spec, members + starts[g], starts[g + 1] - starts[g], quotas[g], rng, out + pos);
+        pos += quotas[g];
+    }
+    if (status == 0) {
+        shuffleRows(out, count, rng);
+    }
+done:
+    free(keys.mins);
+    free(keys.strides);
+    free(group_of_row);
+    free(members);
+    free(group_rows);
+    free(starts);
+    free(quotas);
+    free(shares);
+    return status;
+}
+
+// Function to draw count rows of df as spec says into out. Returns 0, -1
+// when out of memory or SAMPLE_TOO_FEW when too few rows have a positive
+// weight.
+static int sampleRows(const DataFrame* df, const SampleSpec* spec, int count, int* out) {
+    KernelSpan span;
+    beginKernel(&span, KERNEL_SAMPLE);
+    Random rng;
+    seedRandom(&rng, spec->seed);
+    int status = spec->num_strata > 0 ? drawStratifiedSample(df, spec, count, &rng, out)
+                                      : drawSample(spec, NULL, df->num_rows, count, &rng, out);
+    endKernel(&span, status == 0 ? count : 0);
+    return status;
+}
+
+// Function to append every row of src to dst; the columns must have the
+// same dtypes and none may be a category column
+static int appendFrameRows(DataFrame* dst, const DataFrame* src) {
+    int dst_row = dst->num_rows;
+    if (reserveRows(dst, dst_row + src->num_rows) != 0) {
+        return -1;
+    }
+    for (int j = 0; j < dst->num_cols; j++) {
+        Column* col = &dst->columns[j];
+        const Column* part = &src->columns[j];
+        size_t heap_base = col->heap_size;
+        size_t heap_bytes = part->dtype == DTYPE_STRING ? part->heap_size - heapStart(part) : 0;
+        if (heap_bytes && reserveHeap(col, heap_bytes) != 0) {
+            return -1;
+        }
+        if (part->dtype == DTYPE_STRING && heapStart(part)) {
+            // Offsets of a view start past the beginning of its heap
+            const int64_t* offsets = STRING_OFFSETS(part);
+            for (int i = 0; i < src->num_rows; i++) {
+                STRING_OFFSETS(col)[dst_row + i + 1] = offsets[i + 1] - offsets[0] + (int64_t)heap_base;
+            }
+            memcpy(col->heap + heap_base, part->heap + offsets[0], heap_bytes);
+        } else {
+            copyColumnRows(col, dst_row, part, src->num_rows, heap_base);
+        }
+        col->heap_size += heap_bytes;
+        copyNullRows(col, dst_row, part, src->num_rows);
+    }
+    dst->num_rows += src->num_rows;
+    return 0;
+}
+
+// Function to give the columns of two DataFrames the same dtypes so the
+// rows of one can be appended to the other: int64 and float64 meet at
+// float64, any other pair (and any category column) at string
+static int matchColumnTypes(DataFrame* a, DataFrame* b) {
+    for (int j = 0; j < a->num_cols; j++) {
+        DType x = a->columns[j].dtype;
+        DType y = b->columns[j].dtype;
+        if (x == y && x != DTYPE_CATEGORY) {
+            continue;
+        }
+        DType target = DTYPE_STRING;
+        if ((x == DTYPE_INT64 || x == DTYPE_FLOAT64) && (y == DTYPE_INT64 || y == DTYPE_FLOAT64)) {
+            target = DTYPE_FLOAT64;
+        }
+        if (castColumn(a, j, target) != 0 || castColumn(b, j, target) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Function to resolve a column given from Python by position or by name
+static int resolveColumn(DataFrame* df, PyObject* key) {
+    if (PyLong_Check(key)) {
+        long index = PyLong_AsLong(key);
+        if (index == -1 && PyErr_Occurred()) {
+            return -1;
+        }
+        if (index < 0 || index >= df->num_cols) {
+            PyErr_SetString(PyExc_IndexError, "column index out of range");
+            return -1;
+        }
+        return (int)index;
+    }
+    if (PyUnicode_Check(key)) {
+        const char* name = PyUnicode_AsUTF8(key);
+        if (!name) {
+            return -1;
+        }
+        for (int j = 0; j < df->num_cols; j++) {
+            if (strcmp(df->columns[j].name, name) == 0) {
+                return j;
+            }
+        }
+        PyErr_Format(PyExc_KeyError, "no column named '%s'", name);
+        return -1;
+    }
+    PyErr_SetString(PyExc_TypeError, "columns must be given by index or name");
+    return -1;
+}
+
+// Kernels release the GIL while they run, holding a read or write lock on
+// each DataFrame they use instead. Code that keeps the GIL takes no lock:
+// it waits until no lock held conflicts with what it is about to do, and
+// no new one can be taken until it lets the GIL go, since taking a lock
+// needs the GIL.
+static Mutex frame_locks = MUTEX_INITIALIZER;
+static Condition frame_unlocked = CONDITION_INITIALIZER;
+
+// How a Python function uses a DataFrame
+enum {
+    FRAME_READ,
+    FRAME_WRITE
+};
+
+// Function to tell whether the locks held on a DataFrame conflict with an
+// access (frame_locks held)
+static int frameBusy(const DataFrame* df, int access) {
+    return df->writing || (access == FRAME_WRITE && df->readers > 0);
+}
+
+// Function to wait, with the GIL released, until the locks held on a
+// DataFrame allow an access. Called and returns with the GIL held.
+static void waitForFrame(DataFrame* df, int access) {
+    lockMutex(&frame_locks);
+    int busy = frameBusy(df, access);
+    unlockMutex(&frame_locks);
+    while (busy) {
+        Py_BEGIN_ALLOW_THREADS
+        lockMutex(&frame_locks);
+        while (frameBusy(df, access)) {
+            waitCondition(&frame_unlocked, &frame_locks);
+        }
+        unlockMutex(&frame_locks);
+        Py_END_ALLOW_THREADS
+        // Another thread may have taken a lock before this one got the GIL back
+        lockMutex(&frame_locks);
+        busy = frameBusy(df, access);
+        unlockMutex(&frame_locks);
+    }
+}
+
+// Name a capsule takes once freeDataFrame() has freed its DataFrame, so
+// later calls fail instead of reading freed memory
+#define FREED_FRAME_NAME "DataFrame (freed)"
+
+// Function to get the DataFrame of a capsule for an access made while
+// holding the GIL
+static DataFrame* getDataFrame(PyObject* capsule, int access) {
+    if (PyCapsule_IsValid(capsule, FREED_FRAME_NAME)) {
+        PyErr_SetString(PyExc_ValueError, "DataFrame has been freed");
+        return NULL;
+    }
+    DataFrame* df = (DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame");
+    if (df) {
+        waitForFrame(df, access);
+    }
+    return df;
+}
+
+// Function to lock a DataFrame before releasing the GIL to work on it
+static void lockFrame(DataFrame* df, int access) {
+    waitForFrame(df, access);
+    lockMutex(&frame_locks);
+    if (access == FRAME_WRITE) {
+        df->writing = 1;
+    } else {
+        df->readers++;
+    }
+    unlockMutex(&frame_locks);
+}
+
+// Function to release a lock taken by lockFrame
+static void unlockFrame(DataFrame* df, int access) {
+    lockMutex(&frame_locks);
+    if (access == FRAME_WRITE) {
+        df->writing = 0;
+    } else {
+        df->readers--;
+    }
+    wakeAll(&frame_unlocked);
+    unlockMutex(&frame_locks);
+}
+
+#ifndef _WIN32
+// Function to reinitialise the frame locks in a forked child, in case the
+// fork came while another thread held them
+static void resetFrameLocksAfterFork(void) {
+    pthread_mutex_init(&frame_locks, NULL);
+    pthread_cond_init(&frame_unlocked, NULL);
+}
+#endif
+
+// Function to refuse changing a DataFrame while views share its storage.
+// Views keep validity bitmaps and null counts of their own, which would
+// no longer match values changed under them.
+static int checkNoViews(const DataFrame* df) {
+    if (df->views > 0) {
+        PyErr_SetString(PyExc_BufferError, "DataFrame has views sharing its storage; free them or copy() them first");
+        return -1;
+    }
+    return 0;
+}
+
+// Function to refuse an operation that would move or free column storage
+// while buffers exported by column() or validity(), or views, still point
+// into it
+static int checkNoExports(const DataFrame* df) {
+    if (df->exports > 0) {
+        PyErr_SetString(PyExc_BufferError, "DataFrame has exported column buffers; release them first");
+        return -1;
+    }
+    return checkNoViews(df);
+}
+
+// Function to free a DataFrame, or a view, once its capsule is gone
+static void releaseFrame(PyObject* capsule) {
+    freeDataFrame((DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame"));
+}
+
+// Function to hand a new DataFrame to Python, which frees it with the last
+// reference to its capsule
+static PyObject* newFrame(DataFrame* df) {
+    PyObject* capsule = PyCapsule_New((void*)df, "DataFrame", releaseFrame);
+    if (!capsule) {
+        freeDataFrame(df);
+    }
+    return capsule;
+}
+
+// Function to wrap rows [start, start + length) of a DataFrame object in a
+// view for Python. The view borrows from whichever DataFrame owns the
+// storage, holding a reference to its capsule until the view is freed or
+// changed.
+static PyObject* newView(PyObject* capsule, DataFrame* df, int start, int length) {
+    DataFrame* view = sliceRows(df, start, length);
+    if (!view) {
+        return PyErr_NoMemory();
+    }
+    view->base = df->base ? df->base : capsule;
+    Py_INCREF(view->base);
+    ((DataFrame*)PyCapsule_GetPointer(view->base, "DataFrame"))->views++;
+    return newFrame(view);
+}
+
+// Read-only PEP 3118 buffer over one column's values or validity bitmap.
+// It keeps the DataFrame's capsule alive and counts as an export, which
+// pins the storage until the object is deallocated.
+typedef struct {
+    PyObject_HEAD
+    PyObject* capsule;
+    DataFrame* df;
+    void* data;
+    Py_ssize_t shape;
+    Py_ssize_t itemsize;
+    const char* format;
+} ColumnBufferObject;
+
+// Function to release a ColumnBuffer and its hold on the DataFrame
+static void columnBufferDealloc(ColumnBufferObject* self) {
+    self->df->exports--;
+    Py_DECREF(self->capsule);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+// Function to fill a Py_buffer describing a ColumnBuffer's memory
+static int columnBufferGetBuffer(ColumnBufferObject* self, Py_buffer* view, int flags) {
+    if (flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "column buffers are read-only");
+        view->obj = NULL;
+        return -1;
+    }
+    view->buf = self->data;
+    view->obj = (PyObject*)self;
+    Py_INCREF(self);
+    view->len = self->shape * self->itemsize;
+    view->readonly = 1;
+    view->itemsize = self->itemsize;
+    view->format = (flags & PyBUF_FORMAT) ? (char*)self->format : NULL;
+    view->ndim = 1;
+    view->shape = (flags & PyBUF_ND) ? &self->shape : NULL;
+    view->strides = (flags & PyBUF_STRIDES) ? &self->itemsize : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static PyBufferProcs ColumnBufferAsBuffer = {
+    (getbufferproc)columnBufferGetBuffer,
+    NULL
+};
+
+static PyTypeObject ColumnBufferType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "dataframe.ColumnBuffer",
+    .tp_basicsize = sizeof(ColumnBufferObject),
+    .tp_dealloc = (destructor)columnBufferDealloc,
+    .tp_as_buffer = &ColumnBufferAsBuffer,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Read-only buffer over the storage of a DataFrame column.",
+};
+
+// Function to wrap n items of column storage in a ColumnBuffer
+static PyObject* newColumnBuffer(PyObject* capsule, DataFrame* df, void* data, Py_ssize_t n, Py_ssize_t itemsize,
+                                 const char* format) {
+    ColumnBufferObject* self = PyObject_New(ColumnBufferObject, &ColumnBufferType);
+    if (!self) {
+        return NULL;
+    }
+    Py_INCREF(capsule);
+    self->capsule = capsule;
+    self->df = df;
+    self->data = data;
+    self->shape = n;
+    self->itemsize = itemsize;
+    self->format = format;
+    df->exports++;
+    return (PyObject*)self;
+}
+
+// Batch DataFrames a CsvReader keeps for reuse once they are released
+#define CSV_READER_SPARE_BATCHES 2
+
+// Iterator over a CSV file in DataFrames of a fixed number of rows. While
+// one batch is in use the next is parsed on a background thread. A batch's
+// capsule holds a reference to the reader; when the capsule dies its
+// DataFrame goes back to the reader to be refilled, so steady iteration
+// cycles through three DataFrames whatever the size of the file.
+typedef struct {
+    PyObject_HEAD
+    CsvStream stream;
+    char* filename;
+    DataFrame* spare[CSV_READER_SPARE_BATCHES];
+    int num_spare;
+    int pending;        // a batch has been started and not yet returned
+    int threaded;       // the pending batch is being parsed by thread
+#ifdef _WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+} CsvReaderObject;
+
+#ifdef _WIN32
+static DWORD WINAPI csvReaderThreadMain(LPVOID arg) {
+    readCsvBatch((CsvStream*)arg);
+    return 0;
+}
+#else
+static void* csvReaderThreadMain(void* arg) {
+    readCsvBatch((CsvStream*)arg);
+    return NULL;
+}
+#endif
+
+// Function to start parsing the next batch of a reader on a background
+// thread, reusing a spare DataFrame if there is one. Parses on the calling
+// thread if no thread can be started.
+static void startCsvBatch(CsvReaderObject* self) {
+    CsvStream* stream = &self->stream;
+    stream->batch = self->num_spare > 0 ? self->spare[--self->num_spare] : newCsvBatch(stream);
+    self->pending = 1;
+    self->threaded = 0;
+    if (!stream->batch) {
+        stream->error = CSV_NO_MEMORY;
+        return;
+    }
+#ifdef _WIN32
+    self->thread = CreateThread(NULL, 0, csvReaderThreadMain, stream, 0, NULL);
+    self->threaded = self->thread != NULL;
+#else
+    self->threaded = pthread_create(&self->thread, NULL, csvReaderThreadMain, stream) == 0;
+#endif
+    if (!self->threaded) {
+        readCsvBatch(stream);
+    }
+}
+
+// Function to wait, without holding the GIL, for the pending batch of a
+// reader to be parsed
+static void waitForCsvBatch(CsvReaderObject* self) {
+    if (!self->threaded) {
+        return;
+    }
+    Py_BEGIN_ALLOW_THREADS
+#ifdef _WIN32
+    WaitForSingleObject(self->thread, INFINITE);
+    CloseHandle(self->thread);
+#else
+    pthread_join(self->thread, NULL);
+#endif
+    Py_END_ALLOW_THREADS
+    self->threaded = 0;
+}
+
+// Function to give a batch DataFrame back to its reader to be refilled
+static void recycleCsvBatch(CsvReaderObject* self, DataFrame* df) {
+    if (self->num_spare < CSV_READER_SPARE_BATCHES) {
+        // The batch is refilled in place, so its indexes would be stale
+        dropIndexes(df, -1, -1);
+        self->spare[self->num_spare++] = df;
+    } else {
+        freeDataFrame(df);
+    }
+}
+
+// Capsule destructor of the batches a CsvReader returns
+static void releaseCsvBatch(PyObject* capsule) {
+    CsvReaderObject* reader = (CsvReaderObject*)PyCapsule_GetContext(capsule);
+    recycleCsvBatch(reader, (DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame"));
+    Py_DECREF(reader);
+}
+
+// Function to return the next batch of a CsvReader and start parsing the one
+// after it
+static PyObject* csvReaderNext(CsvReaderObject* self) {
+    if (!self->pending) {
+        return NULL;
+    }
+    CsvStream* stream = &self->stream;
+    waitForCsvBatch(self);
+    self->pending = 0;
+    DataFrame* batch = stream->batch;
+    stream->batch = NULL;
+    if (stream->error) {
+        if (batch) {
+            recycleCsvBatch(self, batch);
+        }
+        if (stream->error == CSV_NO_MEMORY) {
+            return PyErr_NoMemory();
+        }
+        PyErr_Format(PyExc_ValueError, "%s, line %zu: %s", self->filename,
+                     lineNumberAt(stream->map.data, stream->error_offset),
+                     stream->error == CSV_TOO_MANY_FIELDS ? "too many fields" : "unterminated quoted field");
+        return NULL;
+    }
+    if (batch->num_rows == 0) {
+        recycleCsvBatch(self, batch);
+        return NULL;
+    }
+    advanceCsvStream(stream);
+    if (stream->pos < stream->map.size) {
+        startCsvBatch(self);
+    }
+    PyObject* capsule = PyCapsule_New((void*)batch, "DataFrame", releaseCsvBatch);
+    if (!capsule) {
+        recycleCsvBatch(self, batch);
+        return NULL;
+    }
+    Py_INCREF(self);
+    PyCapsule_SetContext(capsule, self);
+    return capsule;
+}
+
+// Function to release a CsvReader once no batch refers to it
+static void csvReaderDealloc(CsvReaderObject* self) {
+    waitForCsvBatch(self);
+    for (int k = 0; k < self->num_spare; k++) {
+        freeDataFrame(self->spare[k]);
+    }
+    closeCsvStream(&self->stream);
+    free(self->filename);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyTypeObject CsvReaderType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "dataframe.CsvReader",
+    .tp_basicsize = sizeof(CsvReaderObject),
+    .tp_dealloc = (destructor)csvReaderDealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Iterator over a CSV file in DataFrames of a fixed number of rows.",
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = (iternextfunc)csvReaderNext,
+};
+
+// Function to create a DataFrame object from Python
+static PyObject* py_createDataFrame(PyObject* self, PyObject* args) {
+    int num_rows, num_cols;
+    if (!PyArg_ParseTuple(args, "ii", &num_rows, &num_cols)) {
+        return NULL;
+    }
+    if (num_rows < 0 || num_cols < 0) {
+        PyErr_SetString(PyExc_ValueError, "number of rows and columns must be non-negative");
+        return NULL;
+    }
+    DataFrame* df = createDataFrame(num_rows, num_cols);
+    if (!df) {
+        return PyErr_NoMemory();
+    }
+    return newFrame(df);
+}
+
+// Function to free memory allocated to a DataFrame object
+static PyObject* py_freeDataFrame(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    if (!PyArg_ParseTuple(args, "O", &capsule)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_WRITE);
+    if (!df || checkNoExports(df) != 0) {
+        return NULL;
+    }
+    if (PyCapsule_GetDestructor(capsule) == releaseCsvBatch) {
+        PyErr_SetString(PyExc_ValueError, "batches of read_csv_chunked are reused once released and cannot be freed");
+        return NULL;
+    }
+    PyCapsule_SetDestructor(capsule, NULL);
+    PyCapsule_SetName(capsule, FREED_FRAME_NAME);
+    freeDataFrame(df);
+    Py_RETURN_NONE;
+}
+
+// Function to add a row of data to a DataFrame object from Python
+static PyObject* py_addRow(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    PyObject* values;
+    if (!PyArg_ParseTuple(args, "OO", &capsule, &values)) {
+        return NULL;
+    }
+
+    DataFrame* df = getDataFrame(capsule, FRAME_WRITE);
+    if (!df) {
+        return NULL;
+    }
+    if (!PyList_Check(values)) {
+        PyErr_SetString(PyExc_TypeError, "Values must be a list");
+        return NULL;
+    }
+    if (checkNoExports(df) != 0) {
+        return NULL;
+    }
+    if (detachView(df) != 0) {
+        return PyErr_NoMemory();
+    }
+
+    int num_cols = (int)PyList_Size(values);
+    if (num_cols != df->num_cols) {
+        PyErr_Format(PyExc_ValueError, "expected %d values, got %d", df->num_cols, num_cols);
+        return NULL;
+    }
+    char** c_values = (char**)malloc((num_cols > 0 ? num_cols : 1) * sizeof(char*));
+    for (int i = 0; i < num_cols; i++) {
+        PyObject* item = PyList_GetItem(values, i);
+        if (item == Py_None) {
+            c_values[i] = NULL;
+            continue;
+        }
+        if (!PyUnicode_Check(item)) {
+            PyErr_SetString(PyExc_TypeError, "List items must be strings or None");
+            free(c_values);
+            return NULL;
+        }
+        c_values[i] = (char*)PyUnicode_AsUTF8(item);
+    }
+
+    if (addRow(df, c_values) != 0) {
+        free(c_values);
+        PyErr_SetString(PyExc_ValueError, "values do not match the column dtypes");
+        return NULL;
+    }
+    free(c_values);
+    extendIndexes(df);
+    Py_RETURN_NONE;
+}
+
+static int datetimeFromPyObject(PyObject* value, int64_t* out);
+
+// One column of a batch given to append_rows: its values are read either
+// from a buffer, stride bytes apart, or from Python objects, stride items
+// apart
+typedef struct {
+    const char* data;         // buffer: the first value, or NULL for objects
+    char kind;                // buffer: 'q' for int64, 'd' for double, 'b' for one unsigned byte
+    PyObject** items;         // objects: borrowed references
+    Py_ssize_t stride;        // may be negative for a buffer
+} AppendSource;
+
+// Function to get the kind of values a buffer given to append_rows holds:
+// 'q' for 8-byte integers, 'd' for doubles and 'b' for bools and unsigned bytes
+static int appendBufferKind(const Py_buffer* view, char* kind) {
+    const char* format = view->format ? view->format : "B";
+    if (format[0] == '@' || format[0] == '=') {
+        format++;
+    }
+    if (strcmp(format, "d") == 0) {
+        *kind = 'd';
+    } else if ((strcmp(format, "q") == 0 || strcmp(format, "l") == 0) && view->itemsize == 8) {
+        *kind = 'q';
+    } else if (strcmp(format, "?") == 0 || strcmp(format, "B") == 0) {
+        *kind = 'b';
+    } else {
+        PyErr_Format(PyExc_TypeError, "cannot append a buffer of format '%s'; use 'q', 'd' or '?'", format);
+        return -1;
+    }
+    return 0;
+}
+
+// Function to check that a column can take the values of a buffer kind
+static int checkAppendBuffer(const Column* col, char kind) {
+    int ok = 0;
+    switch (col->dtype) {
+        case DTYPE_INT64:
+        case DTYPE_BOOL:
+            ok = kind != 'd';
+            break;
+        case DTYPE_FLOAT64:
+            ok = 1;
+            break;
+        case DTYPE_DATETIME:
+            ok = kind == 'q';
+            break;
+        case DTYPE_STRING:
+        case DTYPE_CATEGORY:
+            break;
+    }
+    if (!ok) {
+        PyErr_Format(PyExc_TypeError, "%s column '%s' cannot take a buffer of %s", dtypeName(col->dtype), col->name,
+                     kind == 'q' ? "integers" : kind == 'd' ? "doubles" : "bytes");
+        return -1;
+    }
+    return 0;
+}
+
+// Function to read an 8-byte integer of a buffer, which need not be aligned
+static inline int64_t bufferInt(const char* p) {
+    int64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Function to read a double of a buffer, which need not be aligned
+static inline double bufferDouble(const char* p) {
+    double value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// Function to copy n values of a buffer into rows [row, row + n) of a
+// column, which checkAppendBuffer accepted for it. Contiguous values are
+// copied whole, strided ones one at a time. NaN and NaT are missing.
+// Needs no GIL.
+static void appendBufferValues(Column* col, int row, const AppendSource* src, int n) {
+    Py_ssize_t stride = src->stride;
+    const char* p = src->data;
+    switch (col->dtype) {
+        case DTYPE_INT64:
+        case DTYPE_DATETIME: {
+            int64_t* out = (int64_t*)col->data + row;
+            if (src->kind == 'q' && stride == sizeof(int64_t)) {
+                memcpy(out, p, (size_t)n * sizeof(int64_t));
+            } else if (src->kind == 'q') {
+                for (int i = 0; i < n; i++, p += stride) out[i] = bufferInt(p);
+            } else {
+                for (int i = 0; i < n; i++, p += stride) out[i] = *(const uint8_t*)p;
+            }
+            if (col->dtype == DTYPE_DATETIME) {
+                for (int i = 0; i < n; i++) {
+                    if (out[i] == DATETIME_NAT) markNull(col, row + i);
+                }
+            }
+            break;
+        }
+        case DTYPE_FLOAT64: {
+            double* out = (double*)col->data + row;
+            if (src->kind == 'd' && stride == sizeof(double)) {
+                memcpy(out, p, (size_t)n * sizeof(double));
+            } else if (src->kind == 'd') {
+                for (int i = 0; i < n; i++, p += stride) out[i] = bufferDouble(p);
+            } else if (src->kind == 'q') {
+                for (int i = 0; i < n; i++, p += stride) out[i] = (double)bufferInt(p);
+            } else {
+                for (int i = 0; i < n; i++, p += stride) out[i] = *(const uint8_t*)p;
+            }
+            for (int i = 0; i < n; i++) {
+                if (isnan(out[i])) markNull(col, row + i);
+            }
+            break;
+        }
+        case DTYPE_BOOL: {
+            uint8_t* out = (uint8_t*)col->data + row;
+            if (src->kind == 'q') {
+                for (int i = 0; i < n; i++, p += stride) out[i] = bufferInt(p) != 0;
+            } else {
+                for (int i = 0; i < n; i++, p += stride) out[i] = *(const uint8_t*)p != 0;
+            }
+            break;
+        }
+        case DTYPE_STRING:
+        case DTYPE_CATEGORY:
+            break;
+    }
+}
+
+// Function to store a str into the next row of a column as addRow would,
+// or fail for any other object
+static int appendTextObject(Column* col, int row, PyObject* item) {
+    if (!PyUnicode_Check(item)) {
+        PyErr_Format(PyExc_TypeError, "%s column '%s' cannot hold a value of type %s", dtypeName(col->dtype),
+                     col->name, Py_TYPE(item)->tp_name);
+        return -1;
+    }
+    Py_ssize_t len;
+    const char* text = PyUnicode_AsUTF8AndSize(item, &len);
+    if (!text) {
+        return -1;
+    }
+    if (setCell(col, row, text, (size_t)len) != 0) {
+        if (isTextColumn(col)) {
+            PyErr_NoMemory();
+        } else {
+            PyErr_Format(PyExc_ValueError, "'%s' is not a valid %s for column '%s'", text, dtypeName(col->dtype),
+                         col->name);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+// Function to store n Python objects into rows [row, row + n) of a column,
+// one loop per dtype. None is missing, and a str is parsed as addRow
+// parses it; otherwise int64 columns take ints, float64 columns numbers,
+// bool columns bools and datetime columns datetimes, dates or nanoseconds.
+static int appendObjectValues(Column* col, int row, const AppendSource* src, int n) {
+    PyObject** items = src->items;
+    Py_ssize_t stride = src->stride;
+    switch (col->dtype) {
+        case DTYPE_INT64: {
+            int64_t* out = (int64_t*)col->data + row;
+            for (int i = 0; i < n; i++) {
+                PyObject* item = items[i * stride];
+                if (PyLong_Check(item)) {
+                    out[i] = PyLong_AsLongLong(item);
+                    if (out[i] == -1 && PyErr_Occurred()) return -1;
+                } else if (item == Py_None) {
+                    setNullCell(col, row + i);
+                } else if (appendTextObject(col, row + i, item) != 0) {
+                    return -1;
+                }
+            }
+            return 0;
+        }
+        case DTYPE_FLOAT64: {
+            double* out = (double*)col->data + row;
+            for (int i = 0; i < n; i++) {
+                PyObject* item = items[i * stride];
+                if (PyFloat_Check(item) || PyLong_Check(item)) {
+                    out[i] = PyFloat_AsDouble(item);
+                    if (out[i] == -1.0 && PyErr_Occurred()) return -1;
+                    if (isnan(out[i])) markNull(col, row + i);
+                } else if (item == Py_None) {
+                    setNullCell(col, row + i);
+                } else if (appendTextObject(col, row + i, item) != 0) {
+                    return -1;
+                }
+            }
+            return 0;
+        }
+        case DTYPE_BOOL: {
+            uint8_t* out = (uint8_t*)col->data + row;
+            for (int i = 0; i < n; i++) {
+                PyObject* item = items[i * stride];
+                if (PyBool_Check(item)) {
+                    out[i] = item == Py_True;
+                } else if (item == Py_None) {
+                    setNullCell(col, row + i);
+                } else if (appendTextObject(col, row + i, item) != 0) {
+                    return -1;
+                }
+            }
+            return 0;
+        }
+        case DTYPE_DATETIME: {
+            int64_t* out = (int64_t*)col->data + row;
+            for (int i = 0; i < n; i++) {
+                PyObject* item = items[i * stride];
+                if (item == Py_None) {
+                    setNullCell(col, row + i);
+                } else if (PyUnicode_Check(item)) {
+                    if (appendTextObject(col, row + i, item) != 0) return -1;
+                } else if (datetimeFromPyObject(item, &out[i]) != 0) {
+                    return -1;
+                } else if (out[i] == DATETIME_NAT) {
+                    markNull(col, row + i);
+                }
+            }
+            return 0;
+        }
+        case DTYPE_STRING:
+        case DTYPE_CATEGORY:
+            for (int i = 0; i < n; i++) {
+                PyObject* item = items[i * stride];
+                int status = item == Py_None ? setNullCell(col, row + i) : appendTextObject(col, row + i, item);
+                if (status != 0) {
+                    if (!PyErr_Occurred()) PyErr_NoMemory();
+                    return -1;
+                }
+            }
+            return 0;
+    }
+    return -1;
+}
+
+// A batch given to append_rows, split into one source per column
+typedef struct {
+    int num_rows;
+    AppendSource* sources;
+    Py_buffer* views;         // buffers to release
+    int num_views;
+    PyObject** rows;          // list of rows: each row as a fast sequence
+    PyObject** items;         // list of rows: every row's items, row after row
+    Py_ssize_t num_seqs;
+    PyObject* seq;            // list of rows: the list as a fast sequence
+    PyObject** columns;       // dict of columns: the fast sequence of each object column
+} AppendBatch;
+
+// Function to release what an AppendBatch holds
+static void freeAppendBatch(AppendBatch* batch, int num_cols) {
+    for (int v = 0; v < batch->num_views; v++) {
+        PyBuffer_Release(&batch->views[v]);
+    }
+    for (Py_ssize_t i = 0; batch->rows && i < batch->num_seqs; i++) {
+        Py_XDECREF(batch->rows[i]);
+    }
+    for (int j = 0; batch->columns && j < num_cols; j++) {
+        Py_XDECREF(batch->columns[j]);
+    }
+    Py_XDECREF(batch->seq);
+    free(batch->sources);
+    free(batch->views);
+    free(batch->rows);
+    free(batch->items);
+    free(batch->columns);
+    memset(batch, 0, sizeof(*batch));
+}
+
+// Function to set the number of rows of a batch from one of its columns
+static int setBatchRows(AppendBatch* batch, Py_ssize_t n, int first) {
+    if (n > INT_MAX) {
+        PyErr_SetString(PyExc_OverflowError, "too many rows in one batch");
+        return -1;
+    }
+    if (!first && n != batch->num_rows) {
+        PyErr_Format(PyExc_ValueError, "columns of a batch must have the same length, got %d and %zd",
+                     batch->num_rows, n);
+        return -1;
+    }
+    batch->num_rows = (int)n;
+    return 0;
+}
+
+// Function to read a column of a dict batch: a 1-D buffer, strided or
+// not, or a sequence
+static int readBatchColumn(AppendBatch* batch, const Column* col, PyObject* value, int j) {
+    AppendSource* src = &batch->sources[j];
+    if (PyObject_CheckBuffer(value)) {
+        Py_buffer* view = &batch->views[batch->num_views];
+        if (PyObject_GetBuffer(value, view, PyBUF_RECORDS_RO) != 0) {
+            return -1;
+        }
+        batch->num_views++;
+        if (view->ndim != 1) {
+            PyErr_Format(PyExc_ValueError, "column '%s' must be a 1-D buffer", col->name);
+            return -1;
+        }
+        if (appendBufferKind(view, &src->kind) != 0 || checkAppendBuffer(col, src->kind) != 0) {
+            return -1;
+        }
+        src->data = (const char*)view->buf;
+        src->stride = view->strides[0];
+        return setBatchRows(batch, view->shape[0], j == 0);
+    }
+    batch->columns[j] = PySequence_Fast(value, "columns of a batch must be buffers or sequences");
+    if (!batch->columns[j]) {
+        return -1;
+    }
+    src->items = PySequence_Fast_ITEMS(batch->columns[j]);
+    src->stride = 1;
+    return setBatchRows(batch, PySequence_Fast_GET_SIZE(batch->columns[j]), j == 0);
+}
+
+// Function to split a batch given to append_rows into one source per column
+// of df: a dict of columns by name, a 2-D buffer in any memory layout with
+// one column per column of df (1-D for a single column), or a sequence of
+// rows
+static int readAppendBatch(const DataFrame* df, PyObject* obj, AppendBatch* batch) {
+    int num_cols = df->num_cols;
+    memset(batch, 0, sizeof(*batch));
+    batch->sources = (AppendSource*)calloc(num_cols > 0 ? num_cols : 1, sizeof(AppendSource));
+    batch->views = (Py_buffer*)calloc(num_cols > 0 ? num_cols : 1, sizeof(Py_buffer));
+    batch->columns = (PyObject**)calloc(num_cols > 0 ? num_cols : 1, sizeof(PyObject*));
+    if (!batch->sources || !batch->views || !batch->columns) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    if (PyDict_Check(obj)) {
+        if (PyDict_Size(obj) != num_cols) {
+            PyErr_Format(PyExc_ValueError, "expected %d columns, got %zd", num_cols, PyDict_Size(obj));
+            return -1;
+        }
+        for (int j = 0; j < num_cols; j++) {
+            const Column* col = &df->columns[j];
+            PyObject* value = PyDict_GetItemString(obj, col->name);
+            if (!value) {
+                PyErr_Format(PyExc_KeyError, "batch has no column '%s'", col->name);
+                return -1;
+            }
+            if (readBatchColumn(batch, col, value, j) != 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+    if (PyObject_CheckBuffer(obj)) {
+        Py_buffer* view = &batch->views[0];
+        if (PyObject_GetBuffer(obj, view, PyBUF_RECORDS_RO) != 0) {
+            return -1;
+        }
+        batch->num_views = 1;
+        int width = view->ndim == 2 ? (int)view->shape[1] : 1;
+        if (view->ndim < 1 || view->ndim > 2 || width != num_cols) {
+            PyErr_Format(PyExc_ValueError, "a buffer batch must have shape (rows, %d)", num_cols);
+            return -1;
+        }
+        char kind;
+        if (appendBufferKind(view, &kind) != 0) {
+            return -1;
+        }
+        for (int j = 0; j < num_cols; j++) {
+            if (checkAppendBuffer(&df->columns[j], kind) != 0) {
+                return -1;
+            }
+            batch->sources[j].data = (const char*)view->buf + (view->ndim == 2 ? j * view->strides[1] : 0);
+            batch->sources[j].kind = kind;
+            batch->sources[j].stride = view->strides[0];
+        }
+        return setBatchRows(batch, view->shape[0], 1);
+    }
+    batch->seq = PySequence_Fast(obj, "batch must be a list of rows, a dict of columns or a buffer");
+    if (!batch->seq) {
+        return -1;
+    }
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(batch->seq);
+    if (setBatchRows(batch, n, 1) != 0) {
+        return -1;
+    }
+    batch->rows = (PyObject**)calloc(n > 0 ? n : 1, sizeof(PyObject*));
+    batch->items = (PyObject**)malloc(((size_t)n * num_cols + 1) * sizeof(PyObject*));
+    if (!batch->rows || !batch->items) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    // Lay the items out row after row, so each column is read stride apart
+    for (Py_ssize_t i = 0; i < n; i++) {
+        batch->rows[i] = PySequence_Fast(PySequence_Fast_GET_ITEM(batch->seq, i), "rows must be sequences");
+        batch->num_seqs = i + 1;
+        if (!batch->rows[i]) {
+            return -1;
+        }
+        if (PySequence_Fast_GET_SIZE(batch->rows[i]) != num_cols) {
+            PyErr_Format(PyExc_ValueError, "expected %d values in row %zd, got %zd", num_cols, i,
+                         PySequence_Fast_GET_SIZE(batch->rows[i]));
+            return -1;
+        }
+        memcpy(batch->items + i * num_cols, PySequence_Fast_ITEMS(batch->rows[i]), num_cols * sizeof(PyObject*));
+    }
+    for (int j = 0; j < num_cols; j++) {
+        batch->sources[j].items = batch->items + j;
+        batch->sources[j].stride = num_cols;
+    }
+    return 0;
+}
+
+// Function to append a batch of rows to a DataFrame object from Python.
+// Room for the whole batch is made first; Python objects are then
+// converted a column at a time, and buffers are copied without the GIL.
+// A batch that fails to convert leaves the DataFrame as it was.
+static PyObject* py_append_rows(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    PyObject* obj;
+    if (!PyArg_ParseTuple(args, "OO", &capsule, &obj)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_WRITE);
+    if (!df || checkNoExports(df) != 0) {
+        return NULL;
+    }
+    if (detachView(df) != 0) {
+        return PyErr_NoMemory();
+    }
+    AppendBatch batch;
+    if (readAppendBatch(df, obj, &batch) != 0) {
+        freeAppendBatch(&batch, df->num_cols);
+        return NULL;
+    }
+    int row = df->num_rows;
+    int n = batch.num_rows;
+    if (n > INT_MAX - row) {
+        freeAppendBatch(&batch, df->num_cols);
+        PyErr_SetString(PyExc_OverflowError, "too many rows for a DataFrame");
+        return NULL;
+    }
+    KernelSpan span;
+    beginKernel(&span, KERNEL_APPEND_ROWS);
+    int status = reserveRows(df, row + n);
+    if (status != 0) {
+        PyErr_NoMemory();
+    }
+    int has_buffers = 0;
+    for (int j = 0; status == 0 && j < df->num_cols; j++) {
+        if (batch.sources[j].data) {
+            has_buffers = 1;
+        } else {
+            status = appendObjectValues(&df->columns[j], row, &batch.sources[j], n);
+        }
+    }
+    if (status == 0 && has_buffers) {
+        lockFrame(df, FRAME_WRITE);
+        Py_BEGIN_ALLOW_THREADS
+        for (int j = 0; j < df->num_cols; j++) {
+            if (batch.sources[j].data) {
+                appendBufferValues(&df->columns[j], row, &batch.sources[j], n);
+            }
+        }
+        Py_END_ALLOW_THREADS
+        unlockFrame(df, FRAME_WRITE);
+    }
+    if (status == 0) {
+        df->num_rows += n;
+    } else if (df->capacity >= row + n) {
+        discardRows(df, row, row + n);
+    }
+    endKernel(&span, status == 0 ? n : 0);
+    freeAppendBatch(&batch, df->num_cols);
+    if (status != 0) {
+        return NULL;
+    }
+    extendIndexes(df);
+    Py_RETURN_NONE;
+}
+
+// Function to make room for a number of rows in a DataFrame object from Python
+static PyObject* py_reserve(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    int capacity;
+    if (!PyArg_ParseTuple(args, "Oi", &capsule, &capacity)) {
+        return NULL;
+    }
+    if (capacity < 0) {
+        PyErr_SetString(PyExc_ValueError, "n must be non-negative");
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_WRITE);
+    if (!df) {
+        return NULL;
+    }
+    if (capacity <= df->capacity) {
+        Py_RETURN_NONE;
+    }
+    if (checkNoExports(df) != 0) {
+        return NULL;
+    }
+    if (detachView(df) != 0 || reserveRows(df, capacity) != 0) {
+        return PyErr_NoMemory();
+    }
+    Py_RETURN_NONE;
+}
+
+// Function to print the contents of a DataFrame object from Python
+static PyObject* py_printDataFrame(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    if (!PyArg_ParseTuple(args, "O", &capsule)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    if (printDataFrame(df) != 0) {
+        return PyErr_NoMemory();
+    }
+    Py_RETURN_NONE;
+}
+
+// Function to fill the CSV options shared by loadCSV and read_csv_chunked
+// from their Python arguments; quotechar is NULL when not given
+static int parseCsvOptions(int delimiter, int has_header, PyObject* quotechar, CsvOptions* opts) {
+    opts->delimiter = (char)delimiter;
+    opts->quote = '"';
+    opts->has_header = has_header;
+    opts->categorical = CATEGORY_AUTO;
+    opts->columns = NULL;
+    opts->num_columns = 0;
+    opts->num_fields = 0;
+    if (quotechar == Py_None) {
+        opts->quote = '\0';
+    } else if (quotechar) {
+        if (!PyUnicode_Check(quotechar) || PyUnicode_GetLength(quotechar) != 1 ||
+            PyUnicode_ReadChar(quotechar, 0) > 127) {
+            PyErr_SetString(PyExc_TypeError, "quotechar must be a single ASCII character or None");
+            return -1;
+        }
+        opts->quote = (char)PyUnicode_ReadChar(quotechar, 0);
+    }
+    if (delimiter > 127 || delimiter == '\n' || delimiter == '\r' || delimiter == opts->quote) {
+        PyErr_SetString(PyExc_ValueError, "delimiter must be an ASCII character other than a newline or the quotechar");
+        return -1;
+    }
+    return 0;
+}
+
+// Function to read the categorical argument of loadCSV and scan_csv: 'auto',
+// or a flag; NULL when not given leaves the mode unchanged
+static int parseCategoryMode(PyObject* categorical, CategoryMode* mode) {
+    if (categorical && PyUnicode_Check(categorical)) {
+        if (PyUnicode_CompareWithASCIIString(categorical, "auto") != 0) {
+            PyErr_SetString(PyExc_ValueError, "categorical must be 'auto', True or False");
+            return -1;
+        }
+        *mode = CATEGORY_AUTO;
+    } else if (categorical) {
+        int flag = PyObject_IsTrue(categorical);
+        if (flag < 0) {
+            return -1;
+        }
+        *mode = flag ? CATEGORY_ALWAYS : CATEGORY_NEVER;
+    }
+    return 0;
+}
+
+// Function to load data from a CSV file into a DataFrame object from Python
+static PyObject* py_loadCSV(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"filename", "delimiter", "header", "quotechar", "categorical", NULL};
+    const char* filename;
+    int delimiter = ',';
+    int has_header = 1;
+    PyObject* quotechar = NULL;
+    PyObject* categorical = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|CpOO", kwlist, &filename, &delimiter, &has_header, &quotechar,
+                                     &categorical)) {
+        return NULL;
+    }
+    CsvOptions opts;
+    if (parseCsvOptions(delimiter, has_header, quotechar, &opts) != 0 ||
+        parseCategoryMode(categorical, &opts.categorical) != 0) {
+        return NULL;
+    }
+    DataFrame* df = loadCSV(filename, &opts);
+    if (!df) {
+        return NULL;
+    }
+    return newFrame(df);
+}
+
+// Function to open a CSV file for iteration in batches of chunksize rows
+// from Python. The first batch starts parsing right away.
+static PyObject* py_read_csv_chunked(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"path", "chunksize", "delimiter", "header", "quotechar", NULL};
+    const char* path;
+    int chunksize;
+    int delimiter = ',';
+    int has_header = 1;
+    PyObject* quotechar = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "si|CpO", kwlist, &path, &chunksize, &delimiter, &has_header,
+                                     &quotechar)) {
+        return NULL;
+    }
+    if (chunksize <= 0) {
+        PyErr_SetString(PyExc_ValueError, "chunksize must be positive");
+        return NULL;
+    }
+    CsvOptions opts;
+    if (parseCsvOptions(delimiter, has_header, quotechar, &opts) != 0) {
+        return NULL;
+    }
+    opts.categorical = CATEGORY_NEVER;
+    CsvReaderObject* reader = PyObject_New(CsvReaderObject, &CsvReaderType);
+    if (!reader) {
+        return NULL;
+    }
+    reader->num_spare = 0;
+    reader->pending = 0;
+    reader->threaded = 0;
+    reader->filename = copyString(path);
+    if (!reader->filename) {
+        PyObject_Free(reader);
+        return PyErr_NoMemory();
+    }
+    if (openCsvStream(path, &opts, chunksize, &reader->stream) != 0) {
+        free(reader->filename);
+        PyObject_Free(reader);
+        return NULL;
+    }
+    if (reader->stream.pos < reader->stream.map.size) {
+        startCsvBatch(reader);
+    }
+    return (PyObject*)reader;
+}
+
+// Function to cast a column of a DataFrame object to another dtype from Python
+static PyObject* py_astype(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    PyObject* column;
+    const char* dtype_name;
+    if (!PyArg_ParseTuple(args, "OOs", &capsule, &column, &dtype_name)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_WRITE);
+    if (!df) {
+        return NULL;
+    }
+    int col_index = resolveColumn(df, column);
+    if (col_index < 0) {
+        return NULL;
+    }
+    DType dtype;
+    if (parseDType(dtype_name, &dtype) != 0) {
+        PyErr_Format(PyExc_ValueError, "unknown dtype '%s'", dtype_name);
+        return NULL;
+    }
+    if (df->columns[col_index].dtype == dtype) {
+        Py_RETURN_NONE;
+    }
+    if (checkNoExports(df) != 0) {
+        return NULL;
+    }
+    if (detachView(df) != 0) {
+        return PyErr_NoMemory();
+    }
+    if (castColumn(df, col_index, dtype) != 0) {
+        return NULL;
+    }
+    dropIndexes(df, col_index, -1);
+    Py_RETURN_NONE;
+}
+
+// Function to get how many rows n picks from the start or end of num_rows
+// rows; a negative n leaves out -n rows instead
+static int countRows(int n, int num_rows) {
+    if (n < 0) {
+        return num_rows + n > 0 ? num_rows + n : 0;
+    }
+    return n < num_rows ? n : num_rows;
+}
+
+// Function to get a view of the first n rows of a DataFrame object from Python
+static PyObject* py_head(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    int n = 5; // Default to 5 rows if n is not provided
+    if (!PyArg_ParseTuple(args, "O|i", &capsule, &n)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    return newView(capsule, df, 0, countRows(n, df->num_rows));
+}
+
+// Function to get a view of the last n rows of a DataFrame object from Python
+static PyObject* py_tail(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    int n = 5; // Default to 5 rows if n is not provided
+    if (!PyArg_ParseTuple(args, "O|i", &capsule, &n)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    int length = countRows(n, df->num_rows);
+    return newView(capsule, df, df->num_rows - length, length);
+}
+
+// Function to copy the given rows of a DataFrame object into a new one for Python
+static PyObject* takeRowsToPython(DataFrame* df, const int* rows, int num_rows) {
+    DataFrame* result;
+    lockFrame(df, FRAME_READ);
+    Py_BEGIN_ALLOW_THREADS
+    result = takeRows(df, rows, num_rows);
+    Py_END_ALLOW_THREADS
+    unlockFrame(df, FRAME_READ);
+    if (!result) {
+        return PyErr_NoMemory();
+    }
+    return newFrame(result);
+}
+
+// Function to read the seed argument of sample: an int of any size, or None
+// for a seed that differs from call to call
+static int parseSeed(PyObject* seed, uint64_t* out) {
+    static uint64_t calls = 0;
+    if (!seed || seed == Py_None) {
+        calls++;
+        *out = mixHash((uint64_t)monotonicNanos() ^ ((uint64_t)time(NULL) << 32) ^
+                       (calls * UINT64_C(0x9e3779b97f4a7c15)) ^ (uint64_t)(uintptr_t)&calls);
+        return 0;
+    }
+    if (!PyLong_Check(seed)) {
+        PyErr_SetString(PyExc_TypeError, "seed must be an int or None");
+        return -1;
+    }
+    *out = (uint64_t)PyLong_AsUnsignedLongLongMask(seed);
+    return PyErr_Occurred() ? -1 : 0;
+}
+
+// Function to read the weights argument of sample into one weight per row:
+// a numeric column given by name or position, a buffer of doubles such as
+// array('d') or a sequence of numbers. Missing and NaN weights count as 0.
+// Returns a malloc'd array, or NULL with an error set.
+static double* readSampleWeights(DataFrame* df, PyObject* weights) {
+    int num_rows = df->num_rows;
+    double* out = (double*)malloc((num_rows > 0 ? num_rows : 1) * sizeof(double));
+    if (!out) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    Py_buffer view;
+    if (PyUnicode_Check(weights) || PyLong_Check(weights)) {
+        int col_index = resolveColumn(df, weights);
+        if (col_index < 0) {
+            free(out);
+            return NULL;
+        }
+        const Column* col = &df->columns[col_index];
+        if (col->dtype != DTYPE_INT64 && col->dtype != DTYPE_FLOAT64 && col->dtype != DTYPE_BOOL) {
+            PyErr_Format(PyExc_TypeError, "weights column '%s' must be int64, float64 or bool", col->name);
+            free(out);
+            return NULL;
+        }
+        for (int i = 0; i < num_rows; i++) {
+            if (isNullCell(col, i)) {
+                out[i] = 0.0;
+            } else if (col->dtype == DTYPE_FLOAT64) {
+                out[i] = ((const double*)col->data)[i];
+            } else {
+                out[i] = (double)integerAt(col, i);
+            }
+        }
+    } else if (PyObject_CheckBuffer(weights) &&
+               PyObject_GetBuffer(weights, &view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) == 0) {
+        int is_doubles = view.ndim == 1 && view.format && strcmp(view.format, "d") == 0;
+        if (is_doubles && view.shape[0] == num_rows) {
+            memcpy(out, view.buf, (size_t)num_rows * sizeof(double));
+        }
+        PyBuffer_Release(&view);
+        if (!is_doubles || view.shape[0] != num_rows) {
+            PyErr_Format(PyExc_ValueError, "weights must be a buffer of %d doubles", num_rows);
+            free(out);
+            return NULL;
+        }
+    } else {
+        PyErr_Clear();
+        PyObject* seq = PySequence_Fast(weights, "weights must be a column or a sequence of numbers");
+        if (!seq) {
+            free(out);
+            return NULL;
+        }
+        if (PySequence_Fast_GET_SIZE(seq) != num_rows) {
+            PyErr_Format(PyExc_ValueError, "expected %d weights, got %zd", num_rows, PySequence_Fast_GET_SIZE(seq));
+            Py_DECREF(seq);
+            free(out);
+            return NULL;
+        }
+        for (int i = 0; i < num_rows; i++) {
+            out[i] = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(seq, i));
+            if (out[i] == -1.0 && PyErr_Occurred()) {
+                Py_DECREF(seq);
+                free(out);
+                return NULL;
+            }
+        }
+        Py_DECREF(seq);
+    }
+    for (int i = 0; i < num_rows; i++) {
+        if (isnan(out[i])) {
+            out[i] = 0.0;
+        } else if (out[i] < 0.0 || isinf(out[i])) {
+            PyErr_SetString(PyExc_ValueError, "weights must be finite and non-negative");
+            free(out);
+            return NULL;
+        }
+    }
+    return out;
+}
+
+// Function to draw the number of items Algorithm L skips before the next
+// one enters a reservoir whose threshold is w
+static int64_t reservoirSkip(Random* rng, double w) {
+    double skip = floor(log(randomUnit(rng)) / log1p(-w));
+    return skip < (double)(INT64_MAX / 4) ? (int64_t)skip : INT64_MAX / 4;
+}
+
+// Function to sample count rows of a stream of DataFrames with the same
+// columns, such as the batches of read_csv_chunked, in one pass (reservoir
+// sampling, Li's Algorithm L). Only the rows that enter the reservoir are
+// copied, which after the first count rows become rarer and rarer; the
+// copies are compacted whenever they outgrow twice the reservoir. Column
+// dtypes that widen from batch to batch are widened in the sample too.
+static PyObject* sampleStream(PyObject* source, int count, uint64_t seed) {
+    PyObject* iterator = PyObject_GetIter(source);
+    if (!iterator) {
+        return NULL;
+    }
+    int* slots = (int*)malloc((count > 0 ? count : 1) * sizeof(int));
+    int* taken = NULL;
+    int* taken_slots = NULL;
+    int taken_capacity = 0;
+    DataFrame* pool = NULL;
+    int num_cols = -1, filled = 0, failed = !slots;
+    int64_t seen = 0, next = 0;
+    double w = 0.0;
+    Random rng;
+    seedRandom(&rng, seed);
+    if (failed) {
+        PyErr_NoMemory();
+    }
+    PyObject* item;
+    while (!failed && (item = PyIter_Next(iterator))) {
+        DataFrame* df = getDataFrame(item, FRAME_READ);
+        if (!df) {
+            failed = 1;
+        } else if (num_cols >= 0 && df->num_cols != num_cols) {
+            PyErr_Format(PyExc_ValueError, "DataFrames of the stream have %d and %d columns", num_cols, df->num_cols);
+            failed = 1;
+        } else if (df->num_rows > taken_capacity) {
+            int* grown = (int*)realloc(taken, (size_t)df->num_rows * sizeof(int));
+            taken = grown ? grown : taken;
+            grown = grown ? (int*)realloc(taken_slots, (size_t)df->num_rows * sizeof(int)) : NULL;
+            taken_slots = grown ? grown : taken_slots;
+            taken_capacity = grown ? df->num_rows : taken_capacity;
+            if (!grown) {
+                PyErr_NoMemory();
+                failed = 1;
+            }
+        }
+        if (failed) {
+            Py_DECREF(item);
+            break;
+        }
+        num_cols = df->num_cols;
+
+        // The first count rows fill the reservoir; after that each row that
+        // Algorithm L lands on replaces a random one
+        int m = df->num_rows, num_taken = 0;
+        for (int i = 0; filled < count && i < m; i++) {
+            taken[num_taken] = i;
+            taken_slots[num_taken++] = filled++;
+            if (filled == count) {
+                w = exp(log(randomUnit(&rng)) / count);
+                next = seen + i + 1 + reservoirSkip(&rng, w);
+            }
+        }
+        while (filled == count && count > 0 && next < seen + m) {
+            taken[num_taken] = (int)(next - seen);
+            taken_slots[num_taken++] = (int)randomBelow(&rng, (uint32_t)count);
+            w *= exp(log(randomUnit(&rng)) / count);
+            next += 1 + reservoirSkip(&rng, w);
+        }
+        if (num_taken > 0 || !pool) {
+            DataFrame* piece;
+            lockFrame(df, FRAME_READ);
+            Py_BEGIN_ALLOW_THREADS
+            piece = takeRows(df, taken, num_taken);
+            Py_END_ALLOW_THREADS
+            unlockFrame(df, FRAME_READ);
+            int base = pool ? pool->num_rows : 0;
+            if (!piece) {
+                PyErr_NoMemory();
+                failed = 1;
+            } else if (!pool) {
+                pool = piece;
+            } else {
+                if (matchColumnTypes(pool, piece) != 0) {
+                    failed = 1;
+                } else if (appendFrameRows(pool, piece) != 0) {
+                    PyErr_NoMemory();
+                    failed = 1;
+                }
+                freeDataFrame(piece);
+            }
+            for (int t = 0; !failed && t < num_taken; t++) {
+                slots[taken_slots[t]] = base + t;
+            }
+        }
+        if (!failed && pool->num_rows > 2 * filled + 4096) {
+            DataFrame* compacted = takeRows(pool, slots, filled);
+            if (!compacted) {
+                PyErr_NoMemory();
+                failed = 1;
+            } else {
+                freeDataFrame(pool);
+                pool = compacted;
+                for (int i = 0; i < filled; i++) {
+                    slots[i] = i;
+                }
+            }
+        }
+        seen += m;
+        Py_DECREF(item);
+    }
+    Py_DECREF(iterator);
+    failed |= PyErr_Occurred() != NULL;
+    if (!failed && !pool) {
+        PyErr_SetString(PyExc_ValueError, "cannot sample from an empty stream");
+        failed = 1;
+    } else if (!failed && filled < count) {
+        PyErr_Format(PyExc_ValueError, "cannot sample %d rows from a stream of %lld", count, (long long)seen);
+        failed = 1;
+    }
+    DataFrame* result = NULL;
+    if (!failed) {
+        shuffleRows(slots, filled, &rng);
+        Py_BEGIN_ALLOW_THREADS
+        result = takeRows(pool, slots, filled);
+        Py_END_ALLOW_THREADS
+        if (!result) {
+            PyErr_NoMemory();
+        }
+    }
+    if (pool) {
+        freeDataFrame(pool);
+    }
+    free(slots);
+    free(taken);
+    free(taken_slots);
+    return result ? newFrame(result) : NULL;
+}
+
+// Function to sample random rows from a DataFrame object, or a stream of
+// them, from Python into a new DataFrame
+static PyObject* py_sample(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"df", "n", "frac", "replace", "seed", "weights", "stratify_by", NULL};
+    PyObject* capsule;
+    PyObject* n_obj = Py_None;
+    PyObject* frac_obj = Py_None;
+    int replace = 0;
+    PyObject* seed_obj = Py_None;
+    PyObject* weights_obj = Py_None;
+    PyObject* strata_obj = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|OOpOOO", kwlist, &capsule, &n_obj, &frac_obj, &replace,
+                                     &seed_obj, &weights_obj, &strata_obj)) {
+        return NULL;
+    }
+    if (n_obj != Py_None && frac_obj != Py_None) {
+        PyErr_SetString(PyExc_ValueError, "give n or frac, not both");
+        return NULL;
+    }
+    long long n = 1;
+    if (n_obj != Py_None) {
+        n = PyLong_AsLongLong(n_obj);
+        if (n == -1 && PyErr_Occurred()) {
+            return NULL;
+        }
+        if (n < 0 || n > INT_MAX) {
+            PyErr_SetString(PyExc_ValueError, "n must be between 0 and 2**31 - 1");
+            return NULL;
+        }
+    }
+    uint64_t seed;
+    if (parseSeed(seed_obj, &seed) != 0) {
+        return NULL;
+    }
+    if (!PyCapsule_CheckExact(capsule)) {
+        if (frac_obj != Py_None || replace || weights_obj != Py_None || strata_obj != Py_None) {
+            PyErr_SetString(PyExc_ValueError, "a stream of DataFrames can only be sampled by n, without replacement");
+            return NULL;
+        }
+        return sampleStream(capsule, (int)n, seed);
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    if (frac_obj != Py_None) {
+        double frac = PyFloat_AsDouble(frac_obj);
+        if (frac == -1.0 && PyErr_Occurred()) {
+            return NULL;
+        }
+        if (!(frac >= 0.0) || frac > (double)INT_MAX || (frac > 1.0 && !replace)) {
+            PyErr_SetString(PyExc_ValueError, "frac must be between 0 and 1, or above 1 with replace=True");
+            return NULL;
+        }
+        n = (long long)floor(frac * df->num_rows + 0.5);
+        if (n > INT_MAX) {
+            PyErr_SetString(PyExc_ValueError, "sample has more than 2**31 - 1 rows");
+            return NULL;
+        }
+    }
+    if (!replace && n > df->num_rows) {
+        PyErr_Format(PyExc_ValueError, "cannot sample %lld rows from a DataFrame of %d without replacement", n,
+                     df->num_rows);
+        return NULL;
+    }
+    if (replace && n > 0 && df->num_rows == 0) {
+        PyErr_SetString(PyExc_ValueError, "cannot sample from an empty DataFrame");
+        return NULL;
+    }
+    SampleSpec spec;
+    spec.replace = replace;
+    spec.weights = NULL;
+    spec.strata = NULL;
+    spec.num_strata = 0;
+    spec.seed = seed;
+    if (strata_obj != Py_None) {
+        int is_list = PyList_Check(strata_obj) || PyTuple_Check(strata_obj);
+        spec.num_strata = is_list ? (int)PySequence_Size(strata_obj) : 1;
+        if (spec.num_strata <= 0) {
+            if (!PyErr_Occurred()) PyErr_SetString(PyExc_ValueError, "stratify_by must name at least one column");
+            return NULL;
+        }
+        spec.strata = (const Column**)malloc(spec.num_strata * sizeof(Column*));
+        if (!spec.strata) {
+            return PyErr_NoMemory();
+        }
+        for (int k = 0; k < spec.num_strata; k++) {
+            PyObject* column = is_list ? PySequence_GetItem(strata_obj, k) : (Py_INCREF(strata_obj), strata_obj);
+            int col_index = column ? resolveColumn(df, column) : -1;
+            Py_XDECREF(column);
+            if (col_index < 0) {
+                free(spec.strata);
+                return NULL;
+            }
+            spec.strata[k] = &df->columns[col_index];
+        }
+    }
+    double* weights = NULL;
+    if (weights_obj != Py_None) {
+        weights = readSampleWeights(df, weights_obj);
+        if (!weights) {
+            free(spec.strata);
+            return NULL;
+        }
+        spec.weights = weights;
+    }
+    int* rows = (int*)malloc((n > 0 ? (size_t)n : 1) * sizeof(int));
+    int status = -1;
+    if (rows) {
+        lockFrame(df, FRAME_READ);
+        Py_BEGIN_ALLOW_THREADS
+        status = sampleRows(df, &spec, (int)n, rows);
+        Py_END_ALLOW_THREADS
+        unlockFrame(df, FRAME_READ);
+    }
+    free(spec.strata);
+    free(weights);
+    if (status != 0) {
+        free(rows);
+        if (status == SAMPLE_TOO_FEW) {
+            PyErr_SetString(PyExc_ValueError, "too few rows have a positive weight to draw the sample from");
+            return NULL;
+        }
+        return PyErr_NoMemory();
+    }
+    PyObject* result = takeRowsToPython(df, rows, (int)n);
+    free(rows);
+    return result;
+}
+
+// Function to convert a Python row position to a row of num_rows rows,
+// counting negative positions from the end. Returns -1 with an error set
+// when it is out of range.
+static int rowPosition(PyObject* obj, int num_rows) {
+    Py_ssize_t pos = PyNumber_AsSsize_t(obj, PyExc_IndexError);
+    if (pos == -1 && PyErr_Occurred()) {
+        return -1;
+    }
+    if (pos < 0) {
+        pos += num_rows;
+    }
+    if (pos < 0 || pos >= num_rows) {
+        PyErr_SetString(PyExc_IndexError, "row position out of range");
+        return -1;
+    }
+    return (int)pos;
+}
+
+// Function to select rows of a DataFrame object by position from Python
+static PyObject* py_iloc(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    PyObject* selection;
+    if (!PyArg_ParseTuple(args, "OO", &capsule, &selection)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    if (PyIndex_Check(selection)) {
+        int row = rowPosition(selection, df->num_rows);
+        return row < 0 ? NULL : newView(capsule, df, row, 1);
+    }
+    int* rows;
+    Py_ssize_t count;
+    if (PySlice_Check(selection)) {
+        Py_ssize_t start, stop, step;
+        if (PySlice_Unpack(selection, &start, &stop, &step) != 0) {
+            return NULL;
+        }
+        count = PySlice_AdjustIndices(df->num_rows, &start, &stop, step);
+        if (step == 1) {
+            return newView(capsule, df, (int)start, (int)count);
+        }
+        rows = (int*)malloc((count > 0 ? count : 1) * sizeof(int));
+        if (!rows) {
+            return PyErr_NoMemory();
+        }
+        for (Py_ssize_t i = 0; i < count; i++) {
+            rows[i] = (int)(start + i * step);
+        }
+    } else {
+        PyObject* seq = PySequence_Fast(selection, "rows must be an int, a slice or a sequence of ints");
+        if (!seq) {
+            return NULL;
+        }
+        count = PySequence_Fast_GET_SIZE(seq);
+        rows = (int*)malloc((count > 0 ? count : 1) * sizeof(int));
+        if (!rows) {
+            Py_DECREF(seq);
+            return PyErr_NoMemory();
+        }
+        for (Py_ssize_t i = 0; i < count; i++) {
+            rows[i] = rowPosition(PySequence_Fast_GET_ITEM(seq, i), df->num_rows);
+            if (rows[i] < 0) {
+                free(rows);
+                Py_DECREF(seq);
+                return NULL;
+            }
+        }
+        Py_DECREF(seq);
+    }
+    PyObject* result = takeRowsToPython(df, rows, (int)count);
+    free(rows);
+    return result;
+}
+
+// Function to copy a DataFrame object, or the rows a view shows, from Python
+static PyObject* py_copy(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    if (!PyArg_ParseTuple(args, "O", &capsule)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    int* rows = (int*)malloc((df->num_rows > 0 ? df->num_rows : 1) * sizeof(int));
+    if (!rows) {
+        return PyErr_NoMemory();
+    }
+    for (int i = 0; i < df->num_rows; i++) {
+        rows[i] = i;
+    }
+    PyObject* result = takeRowsToPython(df, rows, df->num_rows);
+    free(rows);
+    return result;
+}
+
+// Function to render a DataFrame object as a table for display from Python
+static PyObject* py_to_string(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"df", "max_rows", "max_colwidth", NULL};
+    PyObject* capsule;
+    int max_rows = 20;
+    int max_colwidth = 50;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|ii", kwlist, &capsule, &max_rows, &max_colwidth)) {
+        return NULL;
+    }
+    if (max_rows < 0 || max_colwidth < 4) {
+        PyErr_SetString(PyExc_ValueError, "max_rows must be at least 0 and max_colwidth at least 4");
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    TextBuffer buf = {NULL, 0, 0};
+    if (formatTable(df, max_rows, max_colwidth, &buf) != 0) {
+        free(buf.data);
+        return PyErr_NoMemory();
+    }
+    PyObject* result = PyUnicode_DecodeUTF8(buf.data, (Py_ssize_t)buf.size, "replace");
+    free(buf.data);
+    return result;
+}
+
+// Function to provide information summary of a DataFrame object from Python
+static PyObject* py_info(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    if (!PyArg_ParseTuple(args, "O", &capsule)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+
+    int name_width = (int)strlen("Column");
+    for (int j = 0; j < df->num_cols; j++) {
+        int len = (int)strlen(df->columns[j].name);
+        if (len > name_width) name_width = len;
+    }
+
+    // Print one line per column with its dtype, non-null count and footprint,
+    // spare capacity and dictionary included
+    size_t memory = sizeof(DataFrame) + (size_t)df->num_cols * sizeof(Column);
+    size_t mapped = 0;
+    int64_t missing = 0;
+    printf("Total rows: %d\n", df->num_rows);
+    printf("Data columns (total %d columns):\n", df->num_cols);
+    printf(" %-4s %-*s  %-14s  %-14s  %s\n", "#", name_width, "Column", "Non-Null Count", "Dtype", "Memory (bytes)");
+    for (int j = 0; j < df->num_cols; j++) {
+        Column* col = &df->columns[j];
+        int64_t nulls = col->null_count;
+        size_t col_memory = 0;
+        size_t col_mapped = 0;
+        columnFootprint(col, df->capacity, &col_memory, &col_mapped);
+        printf(" %-4d %-*s  %-14lld  %-14s  %zu\n", j, name_width, col->name, (long long)(df->num_rows - nulls),
+               dtypeName(col->dtype), col_memory + col_mapped);
+        memory += col_memory;
+        mapped += col_mapped;
+        missing += nulls;
+    }
+    printf("Memory usage: %zu bytes\n", memory);
+    if (df->base) {
+        printf("Shared with the viewed DataFrame: %zu bytes\n", mapped);
+    } else if (df->mapping) {
+        printf("Mapped from file: %zu bytes\n", mapped);
+    }
+    printf("Missing values: %lld\n", (long long)missing);
+    if (df->indexes) {
+        int num_indexes = 0;
+        size_t index_memory = 0;
+        for (const ColumnIndex* index = df->indexes; index; index = index->next) {
+            num_indexes++;
+            index_memory += indexMemory(index);
+        }
+        printf("Indexes: %d (%zu bytes)\n", num_indexes, index_memory);
+    }
+
+    Py_RETURN_NONE;
+}
+
+// Function to get the bytes each column of a DataFrame takes up from Python
+static PyObject* py_memory_usage(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"df", "deep", NULL};
+    PyObject* capsule;
+    int deep = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|p", kwlist, &capsule, &deep)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    PyObject* result = PyDict_New();
+    for (int j = 0; result && j < df->num_cols; j++) {
+        const Column* col = &df->columns[j];
+        size_t bytes = 0;
+        if (deep) {
+            columnFootprint(col, df->capacity, &bytes, &bytes);
+        } else {
+            bytes = columnMemoryUsage(col, df->num_rows);
+        }
+        PyObject* value = PyLong_FromSize_t(bytes);
+        if (!value || PyDict_SetItemString(result, col->name, value) != 0) {
+            Py_CLEAR(result);
+        }
+        Py_XDECREF(value);
+    }
+    return result;
+}
+
+// Function to get data types of columns in a DataFrame object from Python
+static PyObject* py_dtypes(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    if (!PyArg_ParseTuple(args, "O", &capsule)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+
+    // Prepare a Python list to hold data types
+    PyObject* dtype_list = PyList_New(df->num_cols);
+    if (!dtype_list) {
+        return NULL;
+    }
+
+    for (int i = 0; i < df->num_cols; i++) {
+        PyList_SetItem(dtype_list, i, PyUnicode_FromString(dtypeName(df->columns[i].dtype)));
+    }
+
+    return dtype_list;
+}
+
+// Function to get shape (dimensions) of a DataFrame object from Python
+static PyObject* py_shape(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    if (!PyArg_ParseTuple(args, "O", &capsule)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+
+    // Create a tuple of (num_rows, num_cols)
+    PyObject* shape_tuple = PyTuple_New(2);
+    if (!shape_tuple) {
+        return NULL;
+    }
+    PyTuple_SetItem(shape_tuple, 0, PyLong_FromLong(df->num_rows));
+    PyTuple_SetItem(shape_tuple, 1, PyLong_FromLong(df->num_cols));
+
+    return shape_tuple;
+}
+
+// Function to get size (total number of elements) of a DataFrame object from Python
+static PyObject* py_size(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    if (!PyArg_ParseTuple(args, "O", &capsule)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+
+    // Return number of rows times number of columns
+    return PyLong_FromLongLong((long long)df->num_rows * df->num_cols);
+}
+
+// Function to get number of dimensions of a DataFrame object from Python
+static PyObject* py_ndim(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    if (!PyArg_ParseTuple(args, "O", &capsule)) {
+        return NULL;
+    }
+
+    // DataFrame is considered 2-dimensional
+    return PyLong_FromLong(2);
+}
+
+// Counts of the distinct values of a column over a stream of DataFrames,
+// keyed by Python value in order of first appearance. Missing values are
+// counted apart because a float column's NaN is not equal to itself.
+typedef struct {
+    PyObject* counts;       // dict from value to count
+    int64_t total;          // values counted, missing ones excluded
+    PyObject* null_key;     // how the first missing value read back, or NULL
+    int64_t null_count;
+    Py_ssize_t null_order;  // distinct values seen before the first missing one
+} StreamCounts;
+
+// Function to fold the values of one DataFrame's column into StreamCounts.
+// The column is counted in C and only its distinct values become Python
+// objects, so memory is bounded by the number of distinct values.
+static int addStreamCounts(StreamCounts* totals, const Column* col, int num_rows, int skip_nulls) {
+    ValueTable table;
+    if (countValues(col, num_rows, skip_nulls, &table) != 0) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    size_t count = 0;
+    ValueSlot* slots = sortedValueSlots(&table, compareSlotsByRow, &count);
+    freeValueTable(&table);
+    if (!slots) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    int status = 0;
+    for (size_t i = 0; status == 0 && i < count; i++) {
+        if (isNullCell(col, slots[i].row)) {
+            if (!totals->null_key) {
+                totals->null_key = cellToPyObject(col, slots[i].row);
+                totals->null_order = PyDict_Size(totals->counts);
+                status = totals->null_key ? 0 : -1;
+            }
+            totals->null_count += slots[i].count;
+            continue;
+        }
+        PyObject* key = cellToPyObject(col, slots[i].row);
+        PyObject* seen = key ? PyDict_GetItemWithError(totals->counts, key) : NULL;
+        PyObject* value = NULL;
+        if (key && (seen || !PyErr_Occurred())) {
+            value = PyLong_FromLongLong((seen ? PyLong_AsLongLong(seen) : 0) + slots[i].count);
+        }
+        if (!value || PyDict_SetItem(totals->counts, key, value) != 0) {
+            status = -1;
+        }
+        totals->total += slots[i].count;
+        Py_XDECREF(key);
+        Py_XDECREF(value);
+    }
+    free(slots);
+    return status;
+}
+
+// Function to release StreamCounts
+static void clearStreamCounts(StreamCounts* totals) {
+    Py_CLEAR(totals->counts);
+    Py_CLEAR(totals->null_key);
+}
+
+// One entry of StreamCounts while they are put in order
+typedef struct {
+    PyObject* key;
+    int64_t count;
+    Py_ssize_t order;
+} StreamCount;
+
+// Function to order stream counts by descending count, then by first
+// appearance, for qsort
+static int compareStreamCounts(const void* a, const void* b) {
+    const StreamCount* x = (const StreamCount*)a;
+    const StreamCount* y = (const StreamCount*)b;
+    if (x->count != y->count) {
+        return x->count > y->count ? -1 : 1;
+    }
+    return (x->order > y->order) - (x->order < y->order);
+}
+
+// Function to turn StreamCounts into the dict value_counts returns, most
+// frequent first with the earliest seen first on ties, keeping at most
+// limit values (all of them when limit is negative)
+static PyObject* streamCountsToDict(const StreamCounts* totals, Py_ssize_t limit) {
+    Py_ssize_t size = PyDict_Size(totals->counts);
+    StreamCount* entries = (StreamCount*)malloc((size + 1) * sizeof(StreamCount));
+    if (!entries) {
+        return PyErr_NoMemory();
+    }
+    // Orders are doubled so the missing values can slot in between
+    Py_ssize_t n = 0, pos = 0;
+    PyObject *key, *value;
+    while (PyDict_Next(totals->counts, &pos, &key, &value)) {
+        entries[n].key = key;
+        entries[n].count = PyLong_AsLongLong(value);
+        entries[n].order = 2 * n + 1;
+        n++;
+    }
+    if (totals->null_key) {
+        entries[n].key = totals->null_key;
+        entries[n].count = totals->null_count;
+        entries[n].order = 2 * totals->null_order;
+        n++;
+    }
+    qsort(entries, (size_t)n, sizeof(StreamCount), compareStreamCounts);
+    if (limit >= 0 && limit < n) {
+        n = limit;
+    }
+    PyObject* result = PyDict_New();
+    for (Py_ssize_t i = 0; result && i < n; i++) {
+        value = PyLong_FromLongLong(entries[i].count);
+        if (!value || PyDict_SetItem(result, entries[i].key, value) != 0) {
+            Py_CLEAR(result);
+        }
+        Py_XDECREF(value);
+    }
+    free(entries);
+    return result;
+}
+
+// Function to add one statistic to a describe result dict, taking ownership
+// of the value
+static int setStatistic(PyObject* stats, const char* name, PyObject* value) {
+    if (!value) {
+        return -1;
+    }
+    int status = PyDict_SetItemString(stats, name, value);
+    Py_DECREF(value);
+    return status;
+}
+
+// Function to turn a ColumnSummary into the dict describe returns for a
+// column of the given dtype; top is the most frequent value of a string or
+// bool column, or NULL when it has none
+static PyObject* summaryToDict(DType dtype, const ColumnSummary* summary, PyObject* top) {
+    static const char* quantile_names[NUM_DESCRIBE_QUANTILES] = {"25%", "50%", "75%"};
+    PyObject* stats = PyDict_New();
+    if (!stats) {
+        return NULL;
+    }
+    int status = setStatistic(stats, "count", PyLong_FromLongLong(summary->count));
+    switch (dtype) {
+        case DTYPE_INT64:
+        case DTYPE_FLOAT64:
+            status |= setStatistic(stats, "mean", PyFloat_FromDouble(summary->mean));
+            status |= setStatistic(stats, "std", PyFloat_FromDouble(summary->std));
+            status |= setStatistic(stats, "min", PyFloat_FromDouble(summary->min));
+            for (int q = 0; q < NUM_DESCRIBE_QUANTILES; q++) {
+                status |= setStatistic(stats, quantile_names[q], PyFloat_FromDouble(summary->quantiles[q]));
+            }
+            status |= setStatistic(stats, "max", PyFloat_FromDouble(summary->max));
+            break;
+        case DTYPE_DATETIME:
+            status |= setStatistic(stats, "mean", datetimeToPyObject(summary->datetime_mean));
+            status |= setStatistic(stats, "min", datetimeToPyObject(summary->datetime_min));
+            for (int q = 0; q < NUM_DESCRIBE_QUANTILES; q++) {
+                status |= setStatistic(stats, quantile_names[q], datetimeToPyObject(summary->datetime_quantiles[q]));
+            }
+            status |= setStatistic(stats, "max", datetimeToPyObject(summary->datetime_max));
+            break;
+        case DTYPE_BOOL:
+        case DTYPE_STRING:
+        case DTYPE_CATEGORY:
+            status |= setStatistic(stats, "unique", PyLong_FromLongLong(summary->unique));
+            top = top ? top : Py_None;
+            Py_INCREF(top);
+            status |= setStatistic(stats, "top", top);
+            status |= setStatistic(stats, "freq", PyLong_FromLongLong(summary->freq));
+            break;
+    }
+    if (status != 0) {
+        Py_DECREF(stats);
+        return NULL;
+    }
+    return stats;
+}
+
+// Running describe state of one column over a stream of DataFrames
+typedef struct {
+    DType dtype;                // of the latest DataFrame
+    NumericSummary numeric;     // int64 and float64 columns
+    DatetimeSummary datetime;   // datetime columns
+    StreamCounts values;        // string, category and bool columns
+} StreamSummary;
+
+// Shared state for folding one DataFrame of a stream into its summaries
+typedef struct {
+    const DataFrame* df;
+    StreamSummary* summaries;
+} StreamDescribeJob;
+
+// Function to tell which describe statistics a dtype gets: 0 numeric,
+// 1 datetime, 2 counts of distinct values
+static int describeKind(DType dtype) {
+    switch (dtype) {
+        case DTYPE_INT64:
+        case DTYPE_FLOAT64:
+            return 0;
+        case DTYPE_DATETIME:
+            return 1;
+        default:
+            return 2;
+    }
+}
+
+// Function to fold one numeric or datetime column of a StreamDescribeJob
+// into its running summary (runs on a worker thread)
+static void describeStreamColumn(void* ctx, int col_index) {
+    StreamDescribeJob* job = (StreamDescribeJob*)ctx;
+    const Column* col = &job->df->columns[col_index];
+    StreamSummary* summary = &job->summaries[col_index];
+    if (describeKind(col->dtype) == 0) {
+        addNumericValues(&summary->numeric, col, job->df->num_rows);
+    } else if (describeKind(col->dtype) == 1) {
+        addDatetimeValues(&summary->datetime, col, job->df->num_rows);
+    }
+}
+
+// Function to describe a stream of DataFrames with the same columns, such as
+// the batches of read_csv_chunked, holding only running totals: moments,
+// extremes and quantile sketches for numeric and datetime columns and
+// counts of distinct values for the others. A column's dtype may widen
+// from batch to batch but must keep the same kind of statistics.
+static PyObject* describeStream(PyObject* source) {
+    PyObject* iterator = PyObject_GetIter(source);
+    if (!iterator) {
+        return NULL;
+    }
+    PyObject* names = NULL;
+    StreamSummary* summaries = NULL;
+    int num_cols = 0, failed = 0;
+    PyObject* item;
+    while (!failed && (item = PyIter_Next(iterator))) {
+        DataFrame* df = getDataFrame(item, FRAME_READ);
+        if (!df) {
+            failed = 1;
+        } else if (!names) {
+            num_cols = df->num_cols;
+            summaries = (StreamSummary*)calloc(num_cols > 0 ? num_cols : 1, sizeof(StreamSummary));
+            names = summaries ? PyList_New(num_cols) : PyErr_NoMemory();
+            failed = !names;
+            for (int j = 0; !failed && j < num_cols; j++) {
+                StreamSummary* summary = &summaries[j];
+                summary->dtype = df->columns[j].dtype;
+                if (describeKind(summary->dtype) == 0) {
+                    initNumericSummary(&summary->numeric, 1);
+                } else if (describeKind(summary->dtype) == 1) {
+                    initDatetimeSummary(&summary->datetime, 1);
+                } else {
+                    summary->values.counts = PyDict_New();
+                    failed = !summary->values.counts;
+                }
+                PyObject* name = PyUnicode_FromString(df->columns[j].name);
+                failed |= !name;
+                PyList_SET_ITEM(names, j, name);
+            }
+        } else if (df->num_cols != num_cols) {
+            PyErr_Format(PyExc_ValueError, "DataFrames of the stream have %d and %d columns", num_cols, df->num_cols);
+            failed = 1;
+        }
+        for (int j = 0; !failed && j < num_cols; j++) {
+            DType dtype = df->columns[j].dtype;
+            if (describeKind(dtype) != describeKind(summaries[j].dtype)) {
+                PyErr_Format(PyExc_TypeError, "column '%s' changed from %s to %s within the stream",
+                             df->columns[j].name, dtypeName(summaries[j].dtype), dtypeName(dtype));
+                failed = 1;
+            } else {
+                summaries[j].dtype = dtype;
+            }
+        }
+        if (!failed) {
+            StreamDescribeJob job;
+            job.df = df;
+            job.summaries = summaries;
+            lockFrame(df, FRAME_READ);
+            Py_BEGIN_ALLOW_THREADS
+            KernelSpan span;
+            beginKernel(&span, KERNEL_DESCRIBE);
+            parallelFor(num_cols, getNumThreads(), describeStreamColumn, &job);
+            endKernel(&span, df->num_rows);
+            Py_END_ALLOW_THREADS
+            unlockFrame(df, FRAME_READ);
+        }
+        for (int j = 0; !failed && j < num_cols; j++) {
+            if (describeKind(summaries[j].dtype) == 2) {
+                failed = addStreamCounts(&summaries[j].values, &df->columns[j], df->num_rows, 1) != 0;
+            }
+        }
+        Py_DECREF(item);
+    }
+    Py_DECREF(iterator);
+    failed |= PyErr_Occurred() != NULL;
+
+    PyObject* result = failed ? NULL : PyDict_New();
+    for (int j = 0; j < num_cols && summaries; j++) {
+        StreamSummary* summary = &summaries[j];
+        ColumnSummary out;
+        PyObject* top = NULL;
+        int status = 0;
+        memset(&out, 0, sizeof(out));
+        if (describeKind(summary->dtype) == 0) {
+            status = finishNumericSummary(&summary->numeric, &out);
+        } else if (describeKind(summary->dtype) == 1) {
+            status = finishDatetimeSummary(&summary->datetime, &out);
+        } else if (summary->values.counts) {
+            // The first value with the highest count was seen earliest
+            Py_ssize_t pos = 0;
+            PyObject *key, *value;
+            out.count = summary->values.total;
+            out.unique = PyDict_Size(summary->values.counts);
+            while (PyDict_Next(summary->values.counts, &pos, &key, &value)) {
+                int64_t freq = PyLong_AsLongLong(value);
+                if (freq > out.freq) {
+                    out.freq = freq;
+                    top = key;
+                }
+            }
+        }
+        if (status != 0 && result) {
+            PyErr_NoMemory();
+            Py_CLEAR(result);
+        }
+        PyObject* stats = result ? summaryToDict(summary->dtype, &out, top) : NULL;
+        if (result && (!stats || PyDict_SetItem(result, PyList_GET_ITEM(names, j), stats) != 0)) {
+            Py_CLEAR(result);
+        }
+        Py_XDECREF(stats);
+        clearStreamCounts(&summary->values);
+    }
+    free(summaries);
+    Py_XDECREF(names);
+    return result;
+}
+
+// Function to describe statistics of a DataFrame object from Python. Returns
+// a dict from column name to a dict of statistics: count, mean, std, min,
+// quartiles and max for numeric columns; count, mean, min, quartiles and
+// max for datetime columns; count, unique, top and freq for string and bool
+// columns. Quartiles are approximate unless exact is set. Columns are
+// summarized in parallel. Anything other than a DataFrame is taken to be an
+// iterable of DataFrames and described as one.
+static PyObject* py_describe(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"df", "exact", NULL};
+    PyObject* capsule;
+    int exact = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|p", kwlist, &capsule, &exact)) {
+        return NULL;
+    }
+    if (!PyCapsule_CheckExact(capsule)) {
+        if (exact) {
+            PyErr_SetString(PyExc_ValueError, "exact quantiles need a DataFrame, not a stream of them");
+            return NULL;
+        }
+        return describeStream(capsule);
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    DescribeJob job;
+    job.df = df;
+    job.exact = exact;
+    job.summaries = (ColumnSummary*)calloc(df->num_cols > 0 ? df->num_cols : 1, sizeof(ColumnSummary));
+    if (!job.summaries) {
+        return PyErr_NoMemory();
+    }
+    lockFrame(df, FRAME_READ);
+    Py_BEGIN_ALLOW_THREADS
+    KernelSpan span;
+    beginKernel(&span, KERNEL_DESCRIBE);
+    parallelFor(df->num_cols, getNumThreads(), describeColumn, &job);
+    endKernel(&span, df->num_rows);
+    Py_END_ALLOW_THREADS
+    unlockFrame(df, FRAME_READ);
+
+    PyObject* result = PyDict_New();
+    for (int j = 0; result && j < df->num_cols; j++) {
+        if (job.summaries[j].status != 0) {
+            PyErr_NoMemory();
+            Py_CLEAR(result);
+            break;
+        }
+        const Column* col = &df->columns[j];
+        const ColumnSummary* summary = &job.summaries[j];
+        PyObject* top = NULL;
+        if ((isTextColumn(col) || col->dtype == DTYPE_BOOL) && summary->top_row >= 0) {
+            top = cellToPyObject(col, summary->top_row);
+            if (!top) {
+                Py_CLEAR(result);
+                break;
+            }
+        }
+        PyObject* stats = summaryToDict(col->dtype, summary, top);
+        if (!stats || PyDict_SetItemString(result, col->name, stats) != 0) {
+            Py_CLEAR(result);
+        }
+        Py_XDECREF(top);
+        Py_XDECREF(stats);
+    }
+    free(job.summaries);
+    return result;
+}
+
+// Function to get the distinct values of a column, in order of first
+// appearance, from Python
+static PyObject* py_unique(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    PyObject* column;
+    if (!PyArg_ParseTuple(args, "OO", &capsule, &column)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    int col_index = resolveColumn(df, column);
+    if (col_index < 0) {
+        return NULL;
+    }
+    Column* col = &df->columns[col_index];
+    size_t count = 0;
+    ValueSlot* slots = NULL;
+    lockFrame(df, FRAME_READ);
+    Py_BEGIN_ALLOW_THREADS
+    ValueTable table;
+    if (countValues(col, df->num_rows, 0, &table) == 0) {
+        slots = sortedValueSlots(&table, compareSlotsByRow, &count);
+        freeValueTable(&table);
+    }
+    Py_END_ALLOW_THREADS
+    unlockFrame(df, FRAME_READ);
+    if (!slots) {
+        return PyErr_NoMemory();
+    }
+    PyObject* result = PyList_New((Py_ssize_t)count);
+    for (size_t i = 0; result && i < count; i++) {
+        PyObject* value = cellToPyObject(col, slots[i].row);
+        if (!value) {
+            Py_CLEAR(result);
+            break;
+        }
+        PyList_SET_ITEM(result, (Py_ssize_t)i, value);
+    }
+    free(slots);
+    return result;
+}
+
+// Function to check for missing values. Returns a dict mapping each column
+// name to a bytes mask with one 0/1 byte per row, expanded from the
+// validity bitmap a word at a time.
+static PyObject* py_isnull(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    if (!PyArg_ParseTuple(args, "O", &capsule)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    PyObject* result = PyDict_New();
+    for (int j = 0; result && j < df->num_cols; j++) {
+        const Column* col = &df->columns[j];
+        PyObject* mask = PyBytes_FromStringAndSize(NULL, df->num_rows);
+        if (!mask) {
+            Py_CLEAR(result);
+            break;
+        }
+        char* out = PyBytes_AS_STRING(mask);
+        memset(out, 0, (size_t)df->num_rows);
+        for (size_t w = 0; col->null_count > 0 && w < VALIDITY_WORDS(df->num_rows); w++) {
+            uint64_t missing = ~col->validity[w];
+            while (missing) {
+                size_t row = w * 64 + (size_t)countTrailingZeros64(missing);
+                if (row < (size_t)df->num_rows) out[row] = 1;
+                missing &= missing - 1;
+            }
+        }
+        if (PyDict_SetItemString(result, col->name, mask) != 0) {
+            Py_CLEAR(result);
+        }
+        Py_DECREF(mask);
+    }
+    return result;
+}
+
+// Function alias for isnull()
+static PyObject* py_isna(PyObject* self, PyObject* args) {
+    return py_isnull(self, args);
+}
+
+// Callback deciding the new value of one string cell during a rewrite;
+// returns NULL to keep the current value, which may be missing
+typedef const char* (*StringRewrite)(const char* text, size_t len, int missing, size_t* out_len, void* ctx);
+
+// Function to rebuild a category column with a fresh dictionary. rewrite
+// runs once per dictionary value and once for missing rows; the rows are
+// then remapped code by code.
+static int rewriteCategoryColumn(Column* col, int num_rows, int capacity, StringRewrite rewrite, void* ctx) {
+    const CategoryDict* dict = col->dict;
+    int* remap = (int*)malloc(((size_t)dict->size + 1) * sizeof(int));
+    Column rebuilt = *col;
+    if (!remap || initColumnStorage(&rebuilt, capacity) != 0) {
+        free(remap);
+        return -1;
+    }
+    int status = 0;
+    int max_code = 0;
+    for (int code = 0; status == 0 && code <= dict->size; code++) {
+        // remap[dict->size] is the code of missing rows, -1 when they stay missing
+        size_t len = 0, new_len;
+        const char* text = code < dict->size ? stringAt(&dict->values, code, &len) : "";
+        const char* replacement = rewrite(text, len, code == dict->size, &new_len, ctx);
+        remap[code] = -1;
+        if (replacement || code < dict->size) {
+            remap[code] = replacement ? internCategory(rebuilt.dict, replacement, new_len)
+                                      : internCategory(rebuilt.dict, text, len);
+            status = remap[code] < 0 ? -1 : 0;
+            max_code = remap[code] > max_code ? remap[code] : max_code;
+        }
+    }
+    int width = max_code <= UINT8_MAX ? 1 : (max_code <= UINT16_MAX ? 2 : 4);
+    if (status != 0 || (width > 1 && widenCodes(&rebuilt, width) != 0)) {
+        free(remap);
+        freeColumnStorage(&rebuilt);
+        return -1;
+    }
+    for (int i = 0; i < num_rows; i++) {
+        int code = remap[isNullCell(col, i) ? dict->size : (int)codeAt(col, i)];
+        setCode(&rebuilt, i, code < 0 ? 0 : (uint32_t)code);
+        if (code < 0) markNull(&rebuilt, i);
+    }
+    free(remap);
+    freeColumnStorage(col);
+    *col = rebuilt;
+    return 0;
+}
+
+// Function to rebuild a string column into a fresh heap, letting rewrite
+// replace individual values. Replacements of any length are safe because
+// the heap is sized for the new contents before anything is copied.
+// Category columns only rewrite their dictionary.
+static int rewriteStringColumn(Column* col, int num_rows, int capacity, StringRewrite rewrite, void* ctx) {
+    if (col->dtype == DTYPE_CATEGORY) {
+        return rewriteCategoryColumn(col, num_rows, capacity, rewrite, ctx);
+    }
+    size_t total = 0;
+    int changed = 0;
+    for (int i = 0; i < num_rows; i++) {
+        size_t len, new_len;
+        const char* text = stringAt(col, i, &len);
+        if (rewrite(text, len, isNullCell(col, i), &new_len, ctx)) {
+            total += new_len;
+            changed = 1;
+        } else {
+            total += len;
+        }
+    }
+    if (!changed) {
+        return 0;
+    }
+    Column rebuilt = *col;
+    if (initColumnStorage(&rebuilt, capacity) != 0 || reserveHeap(&rebuilt, total) != 0) {
+        freeColumnStorage(&rebuilt);
+        return -1;
+    }
+    for (int i = 0; i < num_rows; i++) {
+        size_t len, new_len;
+        const char* text = stringAt(col, i, &len);
+        int missing = isNullCell(col, i);
+        const char* replacement = rewrite(text, len, missing, &new_len, ctx);
+        if (replacement) {
+            appendString(&rebuilt, i, replacement, new_len);
+        } else {
+            appendString(&rebuilt, i, text, len);
+            if (missing) markNull(&rebuilt, i);
+        }
+    }
+    freeColumnStorage(col);
+    *col = rebuilt;
+    return 0;
+}
+
+// Bounds of a clip on string columns; fillna keeps its value in lower
+typedef struct {
+    const char* lower;
+    size_t lower_len;
+    const char* upper;
+    size_t upper_len;
+} StringBounds;
+
+// Kinds of element-wise op
+typedef enum {
+    ELEMENTWISE_FILLNA,
+    ELEMENTWISE_CLIP
+} ElementwiseKind;
+
+// A fillna or clip with its argument parsed once for every dtype. fillna
+// keeps its value in the _lo fields. Several ops can be run over a column
+// in a single pass.
+typedef struct {
+    ElementwiseKind kind;
+    int ints_ok;                // the argument parses as int64
+    int floats_ok;
+    int bools_ok;
+    int times_ok;
+    int64_t int_lo, int_hi;
+    double float_lo, float_hi;
+    uint8_t bool_value;
+    int64_t time_lo, time_hi;
+    StringBounds text;
+    const uint8_t* columns;     // per column, whether the op applies; NULL for all
+} ElementwiseOp;
+
+// Function to parse the value of a fillna. A column is only filled when the
+// value parses as its dtype.
+static void parseFillValue(const char* value, ElementwiseOp* op) {
+    memset(op, 0, sizeof(ElementwiseOp));
+    op->kind = ELEMENTWISE_FILLNA;
+    size_t len = strlen(value);
+    op->ints_ok = parseInt64(value, len, &op->int_lo) == 0;
+    op->floats_ok = len != 0 && parseFloat64(value, len, &op->float_lo) == 0 && !isnan(op->float_lo);
+    op->bools_ok = parseBool(value, len, &op->bool_value) == 0;
+    op->time_lo = DATETIME_NAT;
+    op->times_ok = parseDatetime(value, len, &op->time_lo) == 0 && op->time_lo != DATETIME_NAT;
+    op->text.lower = value;
+    op->text.lower_len = len;
+}
+
+// Function to parse the bounds of a clip; a NULL bound leaves that side open
+static void parseClipBounds(const char* lower, const char* upper, ElementwiseOp* op) {
+    memset(op, 0, sizeof(ElementwiseOp));
+    op->kind = ELEMENTWISE_CLIP;
+    StringBounds bounds = {lower, lower ? strlen(lower) : 0, upper, upper ? strlen(upper) : 0};
+    op->text = bounds;
+    op->int_lo = op->time_lo = INT64_MIN;
+    op->int_hi = op->time_hi = INT64_MAX;
+    op->float_lo = -INFINITY;
+    op->float_hi = INFINITY;
+    op->ints_ok = (!lower || parseInt64(lower, bounds.lower_len, &op->int_lo) == 0) &&
+                  (!upper || parseInt64(upper, bounds.upper_len, &op->int_hi) == 0);
+    op->floats_ok = (!lower || parseFloat64(lower, bounds.lower_len, &op->float_lo) == 0) &&
+                    (!upper || parseFloat64(upper, bounds.upper_len, &op->float_hi) == 0);
+    op->times_ok = (!lower || (parseDatetime(lower, bounds.lower_len, &op->time_lo) == 0 &&
+                               op->time_lo != DATETIME_NAT)) &&
+                   (!upper || (parseDatetime(upper, bounds.upper_len, &op->time_hi) == 0 &&
+                               op->time_hi != DATETIME_NAT));
+}
+
+// Function to check that an op can run on a column, raising ValueError for
+// clip bounds that are not numbers of the column's dtype
+static int checkElementwiseOp(const ElementwiseOp* op, const Column* col) {
+    if (op->kind == ELEMENTWISE_CLIP &&
+        ((col->dtype == DTYPE_INT64 && !op->ints_ok) || (col->dtype == DTYPE_FLOAT64 && !op->floats_ok) ||
+         (col->dtype == DTYPE_DATETIME && !op->times_ok))) {
+        PyErr_Format(PyExc_ValueError, "clip bounds are not valid %s values for column '%s'", dtypeName(col->dtype),
+                     col->name);
+        return -1;
+    }
+    return 0;
+}
+
+// Function to tell whether an op rebuilds a column's storage rather than
+// writing it in place: filling or clipping strings does
+static int elementwiseRebuilds(const ElementwiseOp* op, const Column* col) {
+    return isTextColumn(col) && (op->kind == ELEMENTWISE_CLIP || col->null_count > 0);
+}
+
+// Rows per task of an element-wise pass over a fixed-width column, a
+// multiple of 64 so that no two tasks share a validity word
+#define ELEMENTWISE_CHUNK_ROWS (1 << 16)
+
+// Rows each op of a fused pass runs over before the next op takes them,
+// few enough to stay in cache between ops
+#define ELEMENTWISE_BLOCK_ROWS 4096
+
+// Function to store value into the missing rows of a fixed-width column
+// in [begin, end), begin a multiple of 64, and mark them valid. Only
+// validity words with a missing row are visited. Returns the rows filled;
+// the caller adjusts the null count.
+static int64_t fillMissingRows(Column* col, int begin, int end, const void* value, size_t width) {
+    char* data = (char*)col->data;
+    int64_t filled = 0;
+    for (int w = begin >> 6; w < (end + 63) >> 6; w++) {
+        uint64_t missing = ~col->validity[w];
+        if (!missing) {
+            continue;
+        }
+        if (w * 64 + 64 > end) {
+            missing &= (UINT64_C(1) << (end & 63)) - 1;
+        }
+        col->validity[w] |= missing;
+        filled += popcount64(missing);
+        while (missing) {
+            memcpy(data + (size_t)(w * 64 + countTrailingZeros64(missing)) * width, value, width);
+            missing &= missing - 1;
+        }
+    }
+    return filled;
+}
+
+// Function to clip n int64 values to [lo, hi], lo winning when lo > hi;
+// the two selects compile to vector compares and blends
+static void clipInt64Values(int64_t* values, int n, int64_t lo, int64_t hi) {
+    for (int i = 0; i < n; i++) {
+        int64_t value = values[i];
+        int64_t clipped = value > hi ? hi : value;
+        values[i] = value < lo ? lo : clipped;
+    }
+}
+
+// Function to clip n datetime values to [lo, hi], leaving NaT alone
+static void clipDatetimeValues(int64_t* values, int n, int64_t lo, int64_t hi) {
+    for (int i = 0; i < n; i++) {
+        int64_t value = values[i];
+        int64_t clipped = value > hi ? hi : value;
+        clipped = value < lo ? lo : clipped;
+        values[i] = value == DATETIME_NAT ? value : clipped;
+    }
+}
+
+// Function to clip n float64 values to [lo, hi]; NaN compares false both
+// ways and so stays NaN
+static void clipFloat64Values(double* values, int n, double lo, double hi) {
+    for (int i = 0; i < n; i++) {
+        double value = values[i];
+        double clipped = value > hi ? hi : value;
+        values[i] = value < lo ? lo : clipped;
+    }
+}
+
+// Function to run ops over rows [begin, end) of an int64, datetime,
+// float64 or bool column, block by block so every op runs as a tight loop
+// while the block is in cache. Returns the rows filled.
+static int64_t applyFixedWidthOps(Column* col, int begin, int end, const ElementwiseOp** ops, int num_ops) {
+    int64_t filled = 0;
+    for (int block = begin; block < end; block += ELEMENTWISE_BLOCK_ROWS) {
+        int block_end = end - block > ELEMENTWISE_BLOCK_ROWS ? block + ELEMENTWISE_BLOCK_ROWS : end;
+        for (int k = 0; k < num_ops; k++) {
+            const ElementwiseOp* op = ops[k];
+            if (op->kind == ELEMENTWISE_FILLNA) {
+                if (col->null_count == 0) {
+                    continue;
+                }
+                if (col->dtype == DTYPE_INT64 && op->ints_ok) {
+                    filled += fillMissingRows(col, block, block_end, &op->int_lo, sizeof(int64_t));
+                } else if (col->dtype == DTYPE_DATETIME && op->times_ok) {
+                    filled += fillMissingRows(col, block, block_end, &op->time_lo, sizeof(int64_t));
+                } else if (col->dtype == DTYPE_FLOAT64 && op->floats_ok) {
+                    filled += fillMissingRows(col, block, block_end, &op->float_lo, sizeof(double));
+                } else if (col->dtype == DTYPE_BOOL && op->bools_ok) {
+                    filled += fillMissingRows(col, block, block_end, &op->bool_value, 1);
+                }
+            } else if (col->dtype == DTYPE_INT64) {
+                clipInt64Values((int64_t*)col->data + block, block_end - block, op->int_lo, op->int_hi);
+            } else if (col->dtype == DTYPE_DATETIME) {
+                clipDatetimeValues((int64_t*)col->data + block, block_end - block, op->time_lo, op->time_hi);
+            } else if (col->dtype == DTYPE_FLOAT64) {
+                clipFloat64Values((double*)col->data + block, block_end - block, op->float_lo, op->float_hi);
+            }
+        }
+    }
+    return filled;
+}
+
+// The ops applied to one string column, for rewriteElementwise
+typedef struct {
+    const ElementwiseOp** ops;
+    int num_ops;
+} ElementwiseRewrite;
+
+// Function to run ops over one string value, for rewriteStringColumn.
+// Replacements are the ops' own arguments, so nothing is allocated.
+static const char* rewriteElementwise(const char* text, size_t len, int missing, size_t* out_len, void* ctx) {
+    const ElementwiseRewrite* rewrite = (const ElementwiseRewrite*)ctx;
+    const char* result = NULL;
+    for (int k = 0; k < rewrite->num_ops; k++) {
+        const StringBounds* bounds = &rewrite->ops[k]->text;
+        if (rewrite->ops[k]->kind == ELEMENTWISE_FILLNA) {
+            if (missing) {
+                result = text = bounds->lower;
+                len = bounds->lower_len;
+                missing = 0;
+            }
+        } else if (missing) {
+            continue;
+        } else if (bounds->lower && compareBytes(text, len, bounds->lower, bounds->lower_len) < 0) {
+            result = text = bounds->lower;
+            len = bounds->lower_len;
+        } else if (bounds->upper && compareBytes(text, len, bounds->upper, bounds->upper_len) > 0) {
+            result = text = bounds->upper;
+            len = bounds->upper_len;
+        }
+    }
+    *out_len = len;
+    return result;
+}
+
+// Shared state for running element-wise ops over the columns of a DataFrame.
+// Tasks cover one chunk of rows of one column; string and category columns
+// are rebuilt whole by their first chunk's task.
+typedef struct {
+    DataFrame* df;
+    const ElementwiseOp* ops;
+    int num_ops;
+    int num_chunks;
+    int* status;          // per task
+    int64_t* filled;      // per task, rows that were missing and were filled
+} ElementwiseJob;
+
+// Function to run the ops that apply to one column over one chunk of its
+// rows in a single pass (runs on a worker thread)
+static void elementwiseChunk(void* ctx, int task) {
+    ElementwiseJob* job = (ElementwiseJob*)ctx;
+    int col_index = task / job->num_chunks;
+    int chunk = task % job->num_chunks;
+    Column* col = &job->df->columns[col_index];
+    job->status[task] = 0;
+    job->filled[task] = 0;
+    if (chunk > 0 && isTextColumn(col)) {
+        return;
+    }
+    const ElementwiseOp** ops = (const ElementwiseOp**)malloc((job->num_ops > 0 ? job->num_ops : 1) *
+                                                            sizeof(ElementwiseOp*));
+    if (!ops) {
+        job->status[task] = -1;
+        return;
+    }
+    int num_ops = 0, clips = 0;
+    for (int k = 0; k < job->num_ops; k++) {
+        if (!job->ops[k].columns || job->ops[k].columns[col_index]) {
+            ops[num_ops++] = &job->ops[k];
+            clips |= job->ops[k].kind == ELEMENTWISE_CLIP;
+        }
+    }
+    // Filling alone has nothing to do on a column without missing values
+    if (num_ops > 0 && (clips || col->null_count > 0)) {
+        int num_rows = job->df->num_rows;
+        if (isTextColumn(col)) {
+            ElementwiseRewrite rewrite = {ops, num_ops};
+            job->status[task] = rewriteStringColumn(col, num_rows, job->df->capacity, rewriteElementwise, &rewrite);
+        } else {
+            int begin = chunk * ELEMENTWISE_CHUNK_ROWS;
+            int end = num_rows - begin > ELEMENTWISE_CHUNK_ROWS ? begin + ELEMENTWISE_CHUNK_ROWS : num_rows;
+            job->filled[task] = applyFixedWidthOps(col, begin, end, ops, num_ops);
+        }
+    }
+    free(ops);
+}
+
+// Function to run element-wise ops over every column of a DataFrame, each
+// column in a single pass whatever the number of ops. Fixed-width columns
+// are split into chunks of rows so that even one large column keeps every
+// core busy. The ops must have been checked against the columns. Returns
+// -1 when out of memory.
+static int applyElementwise(DataFrame* df, const ElementwiseOp* ops, int num_ops) {
+    ElementwiseJob job;
+    job.df = df;
+    job.ops = ops;
+    job.num_ops = num_ops;
+    job.num_chunks = df->num_rows > 0 ? (df->num_rows - 1) / ELEMENTWISE_CHUNK_ROWS + 1 : 1;
+    int num_tasks = df->num_cols * job.num_chunks;
+    job.status = (int*)malloc((num_tasks > 0 ? num_tasks : 1) * sizeof(int));
+    job.filled = (int64_t*)malloc((num_tasks > 0 ? num_tasks : 1) * sizeof(int64_t));
+    if (!job.status || !job.filled) {
+        free(job.status);
+        free(job.filled);
+        return -1;
+    }
+    KernelSpan span;
+    beginKernel(&span, KERNEL_ELEMENTWISE);
+    parallelFor(num_tasks, getNumThreads(), elementwiseChunk, &job);
+    endKernel(&span, df->num_rows);
+    int status = 0;
+    for (int t = 0; t < num_tasks; t++) {
+        status |= job.status[t];
+        df->columns[t / job.num_chunks].null_count -= job.filled[t];
+    }
+    free(job.status);
+    free(job.filled);
+    return status;
+}
+
+// Ways fillna can fill a missing value from the values around it
+typedef enum {
+    FILL_FORWARD,       // the last value before it
+    FILL_BACKWARD,      // the next value after it
+    FILL_INTERPOLATE    // a straight line between the two
+} FillMethod;
+
+// Shared state for filling the missing values of the selected columns from
+// their neighbours. Tasks cover one chunk of rows of one column: the first
+// pass finds the first and last valid row of every chunk, which tell every
+// chunk the valid rows around it, and the second fills the chunks.
+typedef struct {
+    DataFrame* df;
+    FillMethod method;
+    int limit;              // most rows filled from one valid value, -1 for no limit
+    const uint8_t* columns; // per column, whether to fill it
+    int num_chunks;
+    int* first_valid;       // per task, -1 for none
+    int* last_valid;
+    int* before;            // per task, the last valid row before the chunk
+    int* after;             // per task, the first valid row after the chunk
+    int* status;
+    int64_t* filled;
+} FillJob;
+
+// Function to tell whether a FillJob fills a column. Interpolation only
+// applies to numbers and datetimes.
+static int fillsColumn(const FillJob* job, const Column* col, int col_index) {
+    if (col->null_count == 0 || (job->columns && !job->columns[col_index])) {
+        return 0;
+    }
+    return job->method != FILL_INTERPOLATE || col->dtype == DTYPE_INT64 || col->dtype == DTYPE_FLOAT64 ||
+           col->dtype == DTYPE_DATETIME;
+}
+
+// Function to get the rows [begin, end) of a FillJob task
+static void fillChunkRows(const FillJob* job, int task, int* begin, int* end) {
+    int num_rows = job->df->num_rows;
+    *begin = (task % job->num_chunks) * ELEMENTWISE_CHUNK_ROWS;
+    *end = num_rows - *begin > ELEMENTWISE_CHUNK_ROWS ? *begin + ELEMENTWISE_CHUNK_ROWS : num_rows;
+}
+
+// Function to find the first and last valid row of a chunk, a validity
+// word at a time (runs on a worker thread)
+static void findValidBounds(void* ctx, int task) {
+    FillJob* job = (FillJob*)ctx;
+    const Column* col = &job->df->columns[task / job->num_chunks];
+    int begin, end;
+    fillChunkRows(job, task, &begin, &end);
+    job->first_valid[task] = job->last_valid[task] = -1;
+    if (!fillsColumn(job, col, task / job->num_chunks)) {
+        return;
+    }
+    int first_word = begin >> 6, last_word = (end - 1) >> 6;
+    for (int w = first_word; w <= last_word; w++) {
+        uint64_t valid = col->validity[w];
+        if (w == last_word && (end & 63)) {
+            valid &= (UINT64_C(1) << (end & 63)) - 1;
+        }
+        if (valid) {
+            job->first_valid[task] = w * 64 + countTrailingZeros64(valid);
+            break;
+        }
+    }
+    for (int w = last_word; job->first_valid[task] >= 0 && w >= first_word; w--) {
+        uint64_t valid = col->validity[w];
+        if (w == last_word && (end & 63)) {
+            valid &= (UINT64_C(1) << (end & 63)) - 1;
+        }
+        if (valid) {
+            job->last_valid[task] = w * 64 + 63 - countLeadingZeros64(valid);
+            break;
+        }
+    }
+}
+
+// Function to compute the value of row from the valid rows around it by
+// method; returns 0 when it stays missing
+static int fillValueOf(const FillJob* job, const Column* col, int row, int prev, int next, int64_t* out) {
+    int limit = job->limit;
+    if (job->method == FILL_FORWARD || job->method == FILL_INTERPOLATE) {
+        if (prev < 0 || (limit >= 0 && row - prev > limit)) {
+            return 0;
+        }
+    }
+    if (job->method == FILL_BACKWARD || job->method == FILL_INTERPOLATE) {
+        if (next < 0 || (job->method == FILL_BACKWARD && limit >= 0 && next - row > limit)) {
+            return 0;
+        }
+    }
+    int source = job->method == FILL_BACKWARD ? next : prev;
+    if (job->method != FILL_INTERPOLATE) {
+        *out = source;
+        return 1;
+    }
+    double t = (double)(row - prev) / (double)(next - prev);
+    if (col->dtype == DTYPE_FLOAT64) {
+        const double* values = (const double*)col->data;
+        double value = values[prev] + (values[next] - values[prev]) * t;
+        memcpy(out, &value, sizeof(value));
+    } else {
+        const int64_t* values = (const int64_t*)col->data;
+        *out = values[prev] + (int64_t)llround((double)(values[next] - values[prev]) * t);
+    }
+    return 1;
+}
+
+// Function to fill the missing rows of one chunk of a fixed-width column in
+// place (runs on a worker thread). Valid rows are never written, so reading
+// them across chunk boundaries is safe.
+static void fillChunk(void* ctx, int task) {
+    FillJob* job = (FillJob*)ctx;
+    int col_index = task / job->num_chunks;
+    Column* col = &job->df->columns[col_index];
+    job->filled[task] = 0;
+    job->status[task] = 0;
+    if (!fillsColumn(job, col, col_index) || col->dtype == DTYPE_STRING) {
+        return;
+    }
+    int begin, end;
+    fillChunkRows(job, task, &begin, &end);
+    size_t width = col->dtype == DTYPE_CATEGORY ? 0 : dtypeWidth(col->dtype);
+    char* data = (char*)col->data;
+    int prev = job->before[task];
+    int64_t filled = 0;
+    for (int i = begin; i < end; i++) {
+        if (!isNullCell(col, i)) {
+            prev = i;
+            continue;
+        }
+        // Find the end of the run of missing rows, within the chunk or past it
+        int run_end = i + 1;
+        while (run_end < end && isNullCell(col, run_end)) {
+            run_end++;
+        }
+        int next = run_end < end ? run_end : job->after[task];
+        for (int row = i; row < run_end; row++) {
+            int64_t value;
+            if (!fillValueOf(job, col, row, prev, next, &value)) {
+                continue;
+            }
+            if (job->method == FILL_INTERPOLATE) {
+                memcpy(data + (size_t)row * 8, &value, 8);
+            } else if (width == 0) {
+                setCode(col, row, codeAt(col, (int)value));
+            } else {
+                memcpy(data + (size_t)row * width, data + (size_t)value * width, width);
+            }
+            col->validity[row >> 6] |= UINT64_C(1) << (row & 63);
+            filled++;
+        }
+        i = run_end - 1;
+    }
+    job->filled[task] = filled;
+}
+
+// Function to fill the missing rows of a string column into a new heap,
+// one column per task (runs on a worker thread)
+static void fillStringColumn(void* ctx, int col_index) {
+    FillJob* job = (FillJob*)ctx;
+    Column* col = &job->df->columns[col_index];
+    int num_rows = job->df->num_rows;
+    int task = col_index * job->num_chunks;
+    if (col->dtype != DTYPE_STRING || !fillsColumn(job, col, col_index)) {
+        return;
+    }
+    int* source = (int*)malloc((num_rows > 0 ? num_rows : 1) * sizeof(int));
+    Column rebuilt = *col;
+    if (!source || initColumnStorage(&rebuilt, job->df->capacity) != 0) {
+        free(source);
+        job->status[task] = -1;
+        return;
+    }
+    // Every row takes the string of its source row; rows left missing keep
+    // their own empty one
+    size_t total = 0;
+    int prev = -1, next = -1;
+    for (int i = num_rows - 1; i >= 0; i--) {
+        source[i] = next;
+        if (!isNullCell(col, i)) next = i;
+    }
+    for (int i = 0; i < num_rows; i++) {
+        int64_t value;
+        if (!isNullCell(col, i)) {
+            source[i] = prev = i;
+        } else {
+            source[i] = fillValueOf(job, col, i, prev, source[i], &value) ? (int)value : -1;
+        }
+        if (source[i] >= 0) {
+            total += (size_t)(STRING_OFFSETS(col)[source[i] + 1] - STRING_OFFSETS(col)[source[i]]);
+        }
+    }
+    if (reserveHeap(&rebuilt, total) != 0) {
+        free(source);
+        freeColumnStorage(&rebuilt);
+        job->status[task] = -1;
+        return;
+    }
+    for (int i = 0; i < num_rows; i++) {
+        size_t len = 0;
+        const char* text = source[i] >= 0 ? stringAt(col, source[i], &len) : "";
+        appendString(&rebuilt, i, text, len);
+        if (source[i] < 0) {
+            markNull(&rebuilt, i);
+        }
+    }
+    free(source);
+    freeColumnStorage(col);
+    *col = rebuilt;
+}
+
+// Function to fill the missing values of the selected columns (NULL for
+// all) of a DataFrame from the valid values around them. With a limit of
+// at least 0, at most limit rows after (before, for FILL_BACKWARD) a valid
+// value are filled from it. Interpolation runs between two valid values
+// only and leaves other dtypes alone. Returns -1 when out of memory.
+static int fillByMethod(DataFrame* df, FillMethod method, int limit, const uint8_t* columns) {
+    FillJob job;
+    job.df = df;
+    job.method = method;
+    job.limit = limit;
+    job.columns = columns;
+    job.num_chunks = df->num_rows > 0 ? (df->num_rows - 1) / ELEMENTWISE_CHUNK_ROWS + 1 : 1;
+    int num_tasks = df->num_cols * job.num_chunks;
+    size_t n = num_tasks > 0 ? (size_t)num_tasks : 1;
+    job.first_valid = (int*)malloc(n * sizeof(int));
+    job.last_valid = (int*)malloc(n * sizeof(int));
+    job.before = (int*)malloc(n * sizeof(int));
+    job.after = (int*)malloc(n * sizeof(int));
+    job.status = (int*)calloc(n, sizeof(int));
+    job.filled = (int64_t*)calloc(n, sizeof(int64_t));
+    int status = -1;
+    if (job.first_valid && job.last_valid && job.before && job.after && job.status && job.filled) {
+        KernelSpan span;
+        beginKernel(&span, KERNEL_ELEMENTWISE);
+        parallelFor(num_tasks, getNumThreads(), findValidBounds, &job);
+        for (int j = 0; j < df->num_cols; j++) {
+            int base = j * job.num_chunks;
+            int last = -1;
+            for (int c = 0; c < job.num_chunks; c++) {
+                job.before[base + c] = last;
+                last = job.last_valid[base + c] >= 0 ? job.last_valid[base + c] : last;
+            }
+            int first = -1;
+            for (int c = job.num_chunks - 1; c >= 0; c--) {
+                job.after[base + c] = first;
+                first = job.first_valid[base + c] >= 0 ? job.first_valid[base + c] : first;
+            }
+        }
+        parallelFor(num_tasks, getNumThreads(), fillChunk, &job);
+        parallelFor(df->num_cols, getNumThreads(), fillStringColumn, &job);
+        endKernel(&span, df->num_rows);
+        status = 0;
+        for (int t = 0; t < num_tasks; t++) {
+            status |= job.status[t];
+            df->columns[t / job.num_chunks].null_count -= job.filled[t];
+        }
+    }
+    free(job.first_valid);
+    free(job.last_valid);
+    free(job.before);
+    free(job.after);
+    free(job.status);
+    free(job.filled);
+    return status;
+}
+
+// Function to get the text of a fillna or clip argument: a str as is, any
+// other object as str() gives it. *holder keeps the text alive and must be
+// released by the caller.
+static const char* argumentText(PyObject* value, PyObject** holder) {
+    *holder = PyUnicode_Check(value) ? (Py_INCREF(value), value) : PyObject_Str(value);
+    return *holder ? PyUnicode_AsUTF8(*holder) : NULL;
+}
+
+// Function to read the columns argument of fillna and clip: a column or a
+// list of them. *mask receives a malloc'd flag per column of df, or NULL
+// for None (every column).
+static int parseColumnMask(DataFrame* df, PyObject* columns, uint8_t** mask) {
+    *mask = NULL;
+    if (!columns || columns == Py_None) {
+        return 0;
+    }
+    *mask = (uint8_t*)calloc(df->num_cols > 0 ? df->num_cols : 1, 1);
+    if (!*mask) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    int is_list = PyList_Check(columns) || PyTuple_Check(columns);
+    Py_ssize_t count = is_list ? PySequence_Size(columns) : 1;
+    for (Py_ssize_t k = 0; k < count; k++) {
+        PyObject* column = is_list ? PySequence_GetItem(columns, k) : (Py_INCREF(columns), columns);
+        int col_index = column ? resolveColumn(df, column) : -1;
+        Py_XDECREF(column);
+        if (col_index < 0) {
+            free(*mask);
+            *mask = NULL;
+            return -1;
+        }
+        (*mask)[col_index] = 1;
+    }
+    return 0;
+}
+
+// Function to run element-wise ops over a DataFrame object from Python.
+// String columns are rebuilt, so they must not be exported.
+static PyObject* runElementwise(PyObject* capsule, const ElementwiseOp* ops, int num_ops) {
+    DataFrame* df = getDataFrame(capsule, FRAME_WRITE);
+    if (!df || checkNoViews(df) != 0) {
+        return NULL;
+    }
+    for (int k = 0; k < num_ops; k++) {
+        for (int j = 0; j < df->num_cols; j++) {
+            const Column* col = &df->columns[j];
+            if (ops[k].columns && !ops[k].columns[j]) {
+                continue;
+            }
+            if (checkElementwiseOp(&ops[k], col) != 0 ||
+                (elementwiseRebuilds(&ops[k], col) && checkNoExports(df) != 0)) {
+                return NULL;
+            }
+        }
+    }
+    if (detachView(df) != 0) {
+        return PyErr_NoMemory();
+    }
+    for (int k = 0; k < num_ops; k++) {
+        for (int j = 0; j < df->num_cols; j++) {
+            if (!ops[k].columns || ops[k].columns[j]) {
+                dropIndexes(df, j, -1);
+            }
+        }
+    }
+    int status;
+    lockFrame(df, FRAME_WRITE);
+    Py_BEGIN_ALLOW_THREADS
+    status = applyElementwise(df, ops, num_ops);
+    Py_END_ALLOW_THREADS
+    unlockFrame(df, FRAME_WRITE);
+    if (status != 0) {
+        return PyErr_NoMemory();
+    }
+    Py_RETURN_NONE;
+}
+
+// Function to fill missing values of a DataFrame object by method from Python
+static PyObject* runFillMethod(PyObject* capsule, const char* method_name, int limit, PyObject* columns) {
+    FillMethod method;
+    if (strcmp(method_name, "ffill") == 0 || strcmp(method_name, "pad") == 0) {
+        method = FILL_FORWARD;
+    } else if (strcmp(method_name, "bfill") == 0 || strcmp(method_name, "backfill") == 0) {
+        method = FILL_BACKWARD;
+    } else if (strcmp(method_name, "interpolate") == 0) {
+        method = FILL_INTERPOLATE;
+    } else {
+        PyErr_SetString(PyExc_ValueError, "method must be 'ffill', 'bfill' or 'interpolate'");
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_WRITE);
+    uint8_t* mask = NULL;
+    if (!df || checkNoViews(df) != 0 || parseColumnMask(df, columns, &mask) != 0) {
+        return NULL;
+    }
+    // Filling strings rebuilds their heap
+    for (int j = 0; method != FILL_INTERPOLATE && j < df->num_cols; j++) {
+        const Column* col = &df->columns[j];
+        if ((!mask || mask[j]) && col->dtype == DTYPE_STRING && col->null_count > 0 && checkNoExports(df) != 0) {
+            free(mask);
+            return NULL;
+        }
+    }
+    if (detachView(df) != 0) {
+        free(mask);
+        return PyErr_NoMemory();
+    }
+    for (int j = 0; j < df->num_cols; j++) {
+        if (!mask || mask[j]) {
+            dropIndexes(df, j, -1);
+        }
+    }
+    int status;
+    lockFrame(df, FRAME_WRITE);
+    Py_BEGIN_ALLOW_THREADS
+    status = fillByMethod(df, method, limit, mask);
+    Py_END_ALLOW_THREADS
+    unlockFrame(df, FRAME_WRITE);
+    free(mask);
+    if (status != 0) {
+        return PyErr_NoMemory();
+    }
+    Py_RETURN_NONE;
+}
+
+// Function to fill null values with a value, per-column values or a method.
+// Each column is only filled with a value that parses as its dtype.
+static PyObject* py_fillna(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"df", "value", "method", "limit", "columns", NULL};
+    PyObject* capsule;
+    PyObject* value = Py_None;
+    const char* method = NULL;
+    PyObject* limit_obj = Py_None;
+    PyObject* columns = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|OzOO", kwlist, &capsule, &value, &method, &limit_obj,
+                                     &columns)) {
+        return NULL;
+    }
+    if ((value == Py_None) == (method == NULL)) {
+        PyErr_SetString(PyExc_ValueError, "give either a value or a method");
+        return NULL;
+    }
+    if (method) {
+        long limit = -1;
+        if (limit_obj != Py_None) {
+            limit = PyLong_AsLong(limit_obj);
+            if (limit == -1 && PyErr_Occurred()) {
+                return NULL;
+            }
+            if (limit <= 0 || limit > INT_MAX) {
+                PyErr_SetString(PyExc_ValueError, "limit must be a positive int");
+                return NULL;
+            }
+        }
+        return runFillMethod(capsule, method, (int)limit, columns);
+    }
+    if (limit_obj != Py_None) {
+        PyErr_SetString(PyExc_ValueError, "limit only applies to a method");
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    if (PyDict_Check(value) && columns != Py_None) {
+        PyErr_SetString(PyExc_ValueError, "give columns or a dict of values, not both");
+        return NULL;
+    }
+
+    // A dict becomes one op per column, each applying to its column only
+    int num_ops = PyDict_Check(value) ? (int)PyDict_Size(value) : 1;
+    ElementwiseOp* ops = (ElementwiseOp*)calloc(num_ops > 0 ? num_ops : 1, sizeof(ElementwiseOp));
+    PyObject** holders = (PyObject**)calloc(num_ops > 0 ? num_ops : 1, sizeof(PyObject*));
+    uint8_t* masks = (uint8_t*)calloc((size_t)(num_ops > 0 ? num_ops : 1) * (df->num_cols > 0 ? df->num_cols : 1), 1);
+    uint8_t* mask = NULL;
+    PyObject* result = NULL;
+    int count = 0;
+    if (!ops || !holders || !masks) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    if (PyDict_Check(value)) {
+        Py_ssize_t pos = 0;
+        PyObject* key;
+        PyObject* item;
+        while (PyDict_Next(value, &pos, &key, &item)) {
+            int col_index = resolveColumn(df, key);
+            if (col_index < 0) {
+                goto done;
+            }
+            if (item == Py_None) {
+                continue;
+            }
+            const char* text = argumentText(item, &holders[count]);
+            if (!text) {
+                goto done;
+            }
+            parseFillValue(text, &ops[count]);
+            ops[count].columns = masks + (size_t)count * df->num_cols;
+            masks[(size_t)count * df->num_cols + col_index] = 1;
+            count++;
+        }
+    } else {
+        const char* text = argumentText(value, &holders[0]);
+        if (!text || parseColumnMask(df, columns, &mask) != 0) {
+            goto done;
+        }
+        parseFillValue(text, &ops[0]);
+        ops[0].columns = mask;
+        count = 1;
+    }
+    result = runElementwise(capsule, ops, count);
+done:
+    for (int k = 0; holders && k < num_ops; k++) {
+        Py_XDECREF(holders[k]);
+    }
+    free(ops);
+    free(holders);
+    free(masks);
+    free(mask);
+    return result;
+}
+
+// Function to save a DataFrame object to a column file from Python
+static PyObject* py_save(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"df", "path", "stats", NULL};
+    PyObject* capsule;
+    const char* path;
+    int with_stats = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "Os|p", kwlist, &capsule, &path, &with_stats)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    int status;
+    lockFrame(df, FRAME_READ);
+    Py_BEGIN_ALLOW_THREADS
+    status = writeColumnFile(df, path, with_stats);
+    Py_END_ALLOW_THREADS
+    unlockFrame(df, FRAME_READ);
+    if (status != 0) {
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+    }
+    Py_RETURN_NONE;
+}
+
+// Function to open a column file as a DataFrame object from Python
+static PyObject* py_open(PyObject* self, PyObject* args) {
+    const char* path;
+    if (!PyArg_ParseTuple(args, "s", &path)) {
+        return NULL;
+    }
+    DataFrame* df = openColumnFile(path);
+    if (!df) {
+        return NULL;
+    }
+    return newFrame(df);
+}
+
+// Function to convert a min/max statistic of a column file to Python
+static PyObject* statisticToPyObject(DType dtype, uint64_t bits) {
+    switch (dtype) {
+        case DTYPE_FLOAT64: {
+            double value;
+            memcpy(&value, &bits, sizeof(value));
+            return PyFloat_FromDouble(value);
+        }
+        case DTYPE_BOOL:
+            return PyBool_FromLong(bits != 0);
+        case DTYPE_DATETIME:
+            return datetimeToPyObject((int64_t)bits);
+        default:
+            return PyLong_FromLongLong((long long)(int64_t)bits);
+    }
+}
+
+// Function to read the schema and statistics of a column file from Python
+// without touching its column data
+static PyObject* py_schema(PyObject* self, PyObject* args) {
+    const char* path;
+    if (!PyArg_ParseTuple(args, "s", &path)) {
+        return NULL;
+    }
+    MappedFile map;
+    if (mapFile(path, 0, &map) != 0) {
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+    }
+    const ColumnFileEntry* entries = readColumnFileHeader(&map, path);
+    if (!entries) {
+        unmapFile(&map);
+        return NULL;
+    }
+    const ColumnFileHeader* header = (const ColumnFileHeader*)map.data;
+    PyObject* columns = PyList_New(0);
+    int status = columns ? 0 : -1;
+    for (uint64_t j = 0; status == 0 && j < header->num_cols; j++) {
+        const ColumnFileEntry* entry = &entries[j];
+        if (entry->dtype > DTYPE_CATEGORY || !fileRangeValid(&map, entry->name_offset, entry->name_len)) {
+            PyErr_Format(PyExc_ValueError, "%s is truncated or corrupt", path);
+            status = -1;
+            break;
+        }
+        DType dtype = (DType)entry->dtype;
+        PyObject* stats = PyDict_New();
+        status = stats ? 0 : -1;
+        status |= setStatistic(stats, "name", PyUnicode_FromStringAndSize(map.data + entry->name_offset,
+                                                                          (Py_ssize_t)entry->name_len));
+        status |= setStatistic(stats, "dtype", PyUnicode_FromString(dtypeName(dtype)));
+        status |= setStatistic(stats, "null_count", PyLong_FromUnsignedLongLong(entry->null_count));
+        if (entry->has_stats) {
+            status |= setStatistic(stats, "min", statisticToPyObject(dtype, entry->min));
+            status |= setStatistic(stats, "max", statisticToPyObject(dtype, entry->max));
+        }
+        if (status == 0 && PyList_Append(columns, stats) != 0) {
+            status = -1;
+        }
+        Py_XDECREF(stats);
+    }
+    PyObject* result = status == 0 ? Py_BuildValue("{s:K,s:O}", "num_rows", (unsigned long long)header->num_rows,
+                                                   "columns", columns)
+                                   : NULL;
+    Py_XDECREF(columns);
+    unmapFile(&map);
+    return result;
+}
+
+// Function to get column names
+static PyObject* py_columns(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    if (!PyArg_ParseTuple(args, "O", &capsule)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    PyObject* column_list = PyList_New(df->num_cols);
+    for (int i = 0; i < df->num_cols; i++) {
+        PyList_SetItem(column_list, i, PyUnicode_FromString(df->columns[i].name));
+    }
+    return column_list;
+}
+
+// Function to export a column's values to Python without copying. int64
+// and datetime columns export int64 ('q'), float64 columns double ('d'),
+// bool columns '?' and category columns their codes ('B', 'H' or 'I' by
+// code width), so numpy.asarray() wraps the storage in place.
+static PyObject* py_column(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    PyObject* column;
+    if (!PyArg_ParseTuple(args, "OO", &capsule, &column)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    int col_index = resolveColumn(df, column);
+    if (col_index < 0) {
+        return NULL;
+    }
+    Column* col = &df->columns[col_index];
+    const char* format = NULL;
+    switch (col->dtype) {
+        case DTYPE_INT64:
+        case DTYPE_DATETIME:
+            format = "q";
+            break;
+        case DTYPE_FLOAT64:
+            format = "d";
+            break;
+        case DTYPE_BOOL:
+            format = "?";
+            break;
+        case DTYPE_STRING:
+            PyErr_Format(PyExc_TypeError, "string column '%s' has no fixed-width buffer", col->name);
+            return NULL;
+        case DTYPE_CATEGORY:
+            format = col->code_width == 1 ? "B" : (col->code_width == 2 ? "H" : "I");
+            break;
+    }
+    return newColumnBuffer(capsule, df, col->data, df->num_rows, (Py_ssize_t)columnWidth(col), format);
+}
+
+// Function to get the dictionary of a category column: the list of its
+// values, indexed by code
+static PyObject* py_categories(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    PyObject* column;
+    if (!PyArg_ParseTuple(args, "OO", &capsule, &column)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    int col_index = resolveColumn(df, column);
+    if (col_index < 0) {
+        return NULL;
+    }
+    Column* col = &df->columns[col_index];
+    if (col->dtype != DTYPE_CATEGORY) {
+        PyErr_Format(PyExc_TypeError, "column '%s' is not a category column", col->name);
+        return NULL;
+    }
+    PyObject* values = PyList_New(col->dict->size);
+    for (int code = 0; values && code < col->dict->size; code++) {
+        PyObject* value = cellToPyObject(&col->dict->values, code);
+        if (!value) {
+            Py_DECREF(values);
+            return NULL;
+        }
+        PyList_SET_ITEM(values, code, value);
+    }
+    return values;
+}
+
+// Function to export a column's validity bitmap to Python without copying:
+// (num_rows + 7) / 8 bytes, bit i of byte i / 8 set when row i holds a
+// value. On little-endian machines this is the Arrow layout.
+static PyObject* py_validity(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    PyObject* column;
+    if (!PyArg_ParseTuple(args, "OO", &capsule, &column)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    int col_index = resolveColumn(df, column);
+    if (col_index < 0) {
+        return NULL;
+    }
+    return newColumnBuffer(capsule, df, df->columns[col_index].validity, ((Py_ssize_t)df->num_rows + 7) / 8, 1, "B");
+}
+
+// Function to count the distinct values of a column over a stream of
+// DataFrames, such as the batches of read_csv_chunked, into a dict like
+// value_counts returns for a single DataFrame
+static PyObject* valueCountsOfStream(PyObject* source, PyObject* column, Py_ssize_t limit, int dropna) {
+    PyObject* iterator = PyObject_GetIter(source);
+    if (!iterator) {
+        return NULL;
+    }
+    StreamCounts totals;
+    memset(&totals, 0, sizeof(totals));
+    totals.counts = PyDict_New();
+    int failed = !totals.counts;
+    PyObject* item;
+    while (!failed && (item = PyIter_Next(iterator))) {
+        DataFrame* df = getDataFrame(item, FRAME_READ);
+        int col_index = df ? resolveColumn(df, column) : -1;
+        failed = col_index < 0 || addStreamCounts(&totals, &df->columns[col_index], df->num_rows, dropna) != 0;
+        Py_DECREF(item);
+    }
+    Py_DECREF(iterator);
+    PyObject* result = failed || PyErr_Occurred() ? NULL : streamCountsToDict(&totals, limit);
+    clearStreamCounts(&totals);
+    return result;
+}
+
+// Function to count the distinct values of a column from Python. Returns a
+// dict from value to count, most frequent first, limited to the top n
+// values when n is given; missing values are counted unless dropna is set.
+// Anything other than a DataFrame is taken to be an iterable of DataFrames
+// and counted as one.
+static PyObject* py_value_counts(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"df", "column", "n", "dropna", NULL};
+    PyObject* capsule;
+    PyObject* column;
+    PyObject* limit = Py_None;
+    int dropna = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|Op", kwlist, &capsule, &column, &limit, &dropna)) {
+        return NULL;
+    }
+    Py_ssize_t n = -1;
+    if (limit != Py_None) {
+        n = PyLong_AsSsize_t(limit);
+        if (n == -1 && PyErr_Occurred()) {
+            return NULL;
+        }
+        if (n < 0) {
+            PyErr_SetString(PyExc_ValueError, "n must be non-negative");
+            return NULL;
+        }
+    }
+    if (!PyCapsule_CheckExact(capsule)) {
+        return valueCountsOfStream(capsule, column, n, dropna);
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    int col_index = resolveColumn(df, column);
+    if (col_index < 0) {
+        return NULL;
+    }
+    Column* col = &df->columns[col_index];
+    size_t count = 0;
+    ValueSlot* slots = NULL;
+    lockFrame(df, FRAME_READ);
+    Py_BEGIN_ALLOW_THREADS
+    ValueTable table;
+    if (countValues(col, df->num_rows, dropna, &table) == 0) {
+        slots = sortedValueSlots(&table, compareSlotsByCount, &count);
+        freeValueTable(&table);
+    }
+    Py_END_ALLOW_THREADS
+    unlockFrame(df, FRAME_READ);
+    if (!slots) {
+        return PyErr_NoMemory();
+    }
+    if (n >= 0 && (size_t)n < count) {
+        count = (size_t)n;
+    }
+
+    // Only the distinct values that are returned become Python objects
+    PyObject* counts_dict = PyDict_New();
+    for (size_t i = 0; counts_dict && i < count; i++) {
+        PyObject* key = cellToPyObject(col, slots[i].row);
+        PyObject* value = PyLong_FromLongLong(slots[i].count);
+        if (!key || !value || PyDict_SetItem(counts_dict, key, value) != 0) {
+            Py_CLEAR(counts_dict);
+        }
+        Py_XDECREF(key);
+        Py_XDECREF(value);
+    }
+    free(slots);
+    return counts_dict;
+}
+
+
+// Function to trim values at specified thresholds; numeric columns are
+// compared as numbers, string columns lexicographically
+static PyObject* py_clip(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"df", "lower", "upper", "columns", NULL};
+    PyObject* capsule;
+    PyObject* lower = Py_None;
+    PyObject* upper = Py_None;
+    PyObject* columns = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|OOO", kwlist, &capsule, &lower, &upper, &columns)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    PyObject* lower_text = NULL;
+    PyObject* upper_text = NULL;
+    const char* lo = lower != Py_None ? argumentText(lower, &lower_text) : NULL;
+    const char* hi = upper != Py_None ? argumentText(upper, &upper_text) : NULL;
+    PyObject* result = NULL;
+    uint8_t* mask = NULL;
+    if ((lower == Py_None || lo) && (upper == Py_None || hi) && parseColumnMask(df, columns, &mask) == 0) {
+        ElementwiseOp op;
+        parseClipBounds(lo, hi, &op);
+        op.columns = mask;
+        result = runElementwise(capsule, &op, 1);
+    }
+    free(mask);
+    Py_XDECREF(lower_text);
+    Py_XDECREF(upper_text);
+    return result;
+}
+
+// Function to build sort keys from the by, ascending and na_position
+// arguments shared by sort_values and argsort. by is one column or a list
+// of them; ascending is one flag or a list with one flag per column.
+// Returns a malloc'd array and stores its length, or NULL on error.
+static SortKey* parseSortKeys(DataFrame* df, PyObject* by, PyObject* ascending, const char* na_position,
+                              int* num_keys) {
+    int nulls_first;
+    if (strcmp(na_position, "last") == 0) {
+        nulls_first = 0;
+    } else if (strcmp(na_position, "first") == 0) {
+        nulls_first = 1;
+    } else {
+        PyErr_SetString(PyExc_ValueError, "na_position must be 'first' or 'last'");
+        return NULL;
+    }
+    int by_is_list = PyList_Check(by) || PyTuple_Check(by);
+    int count = by_is_list ? (int)PySequence_Size(by) : 1;
+    if (count == 0) {
+        PyErr_SetString(PyExc_ValueError, "by must name at least one column");
+        return NULL;
+    }
+    int ascending_is_list = ascending && (PyList_Check(ascending) || PyTuple_Check(ascending));
+    if (ascending_is_list && PySequence_Size(ascending) != count) {
+        PyErr_SetString(PyExc_ValueError, "ascending must have one entry per sort column");
+        return NULL;
+    }
+    SortKey* keys = (SortKey*)malloc(count * sizeof(SortKey));
+    if (!keys) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    for (int k = 0; k < count; k++) {
+        PyObject* column = by_is_list ? PySequence_GetItem(by, k) : (Py_INCREF(by), by);
+        if (!column) {
+            free(keys);
+            return NULL;
+        }
+        int col_index = resolveColumn(df, column);
+        Py_DECREF(column);
+        int is_ascending = 1;
+        if (col_index >= 0 && ascending) {
+            PyObject* flag = ascending_is_list ? PySequence_GetItem(ascending, k) : (Py_INCREF(ascending), ascending);
+            is_ascending = flag ? PyObject_IsTrue(flag) : -1;
+            Py_XDECREF(flag);
+        }
+        if (col_index < 0 || is_ascending < 0) {
+            free(keys);
+            return NULL;
+        }
+        Column* col = &df->columns[col_index];
+        if (col->dtype == DTYPE_CATEGORY && categoryRanks(col->dict) != 0) {
+            free(keys);
+            PyErr_NoMemory();
+            return NULL;
+        }
+        keys[k].col = col;
+        keys[k].descending = !is_ascending;
+        keys[k].nulls_first = nulls_first;
+    }
+    *num_keys = count;
+    return keys;
+}
+
+// Function to convert row numbers to a Python array('q')
+static PyObject* rowsToArray(const int* rows, int n) {
+    PyObject* bytes = PyBytes_FromStringAndSize(NULL, (Py_ssize_t)n * (Py_ssize_t)sizeof(int64_t));
+    if (!bytes) {
+        return NULL;
+    }
+    int64_t* out = (int64_t*)PyBytes_AS_STRING(bytes);
+    for (int i = 0; i < n; i++) {
+        out[i] = rows[i];
+    }
+    PyObject* array_module = PyImport_ImportModule("array");
+    PyObject* result = NULL;
+    if (array_module) {
+        result = PyObject_CallMethod(array_module, "array", "sO", "q", bytes);
+        Py_DECREF(array_module);
+    }
+    Py_DECREF(bytes);
+    return result;
+}
+
+// Function to sort the rows of a DataFrame object in place from Python
+static PyObject* py_sort_values(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"df", "by", "ascending", "na_position", NULL};
+    PyObject* capsule;
+    PyObject* by;
+    PyObject* ascending = NULL;
+    const char* na_position = "last";
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|Os", kwlist, &capsule, &by, &ascending, &na_position)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_WRITE);
+    if (!df || checkNoExports(df) != 0) {
+        return NULL;
+    }
+    int num_keys;
+    SortKey* keys = parseSortKeys(df, by, ascending, na_position, &num_keys);
+    if (!keys) {
+        return NULL;
+    }
+    if (detachView(df) != 0) {
+        free(keys);
+        return PyErr_NoMemory();
+    }
+    // Rows move, so every index is stale
+    dropIndexes(df, -1, -1);
+    int status;
+    lockFrame(df, FRAME_WRITE);
+    Py_BEGIN_ALLOW_THREADS
+    int* perm = argsortRows(df, keys, num_keys);
+    status = perm ? applyPermutation(df, perm) : -1;
+    free(perm);
+    Py_END_ALLOW_THREADS
+    unlockFrame(df, FRAME_WRITE);
+    free(keys);
+    if (status != 0) {
+        return PyErr_NoMemory();
+    }
+    Py_RETURN_NONE;
+}
+
+// Function to return the sorting permutation of a DataFrame object to Python
+// as an array('q') of row indices, leaving the DataFrame untouched
+static PyObject* py_argsort(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"df", "by", "ascending", "na_position", NULL};
+    PyObject* capsule;
+    PyObject* by;
+    PyObject* ascending = NULL;
+    const char* na_position = "last";
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|Os", kwlist, &capsule, &by, &ascending, &na_position)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    int num_keys;
+    SortKey* keys = parseSortKeys(df, by, ascending, na_position, &num_keys);
+    if (!keys) {
+        return NULL;
+    }
+    int* perm;
+    lockFrame(df, FRAME_READ);
+    Py_BEGIN_ALLOW_THREADS
+    perm = argsortRows(df, keys, num_keys);
+    Py_END_ALLOW_THREADS
+    unlockFrame(df, FRAME_READ);
+    free(keys);
+    if (!perm) {
+        return PyErr_NoMemory();
+    }
+    PyObject* result = rowsToArray(perm, df->num_rows);
+    free(perm);
+    return result;
+}
+
+// Function to return the first n rows of a DataFrame in the order of the
+// given columns, as a list of (row_index, value, ...) tuples. Later columns
+// break ties on earlier ones; rows missing the first column are left out.
+static PyObject* topKFromPython(PyObject* args, PyObject* kwargs, int descending) {
+    static char* kwlist[] = {"df", "columns", "n", NULL};
+    PyObject* capsule;
+    PyObject* columns;
+    int n;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOi", kwlist, &capsule, &columns, &n)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    int num_keys;
+    SortKey* keys = parseSortKeys(df, columns, descending ? Py_False : Py_True, "last", &num_keys);
+    if (!keys) {
+        return NULL;
+    }
+    int count;
+    int* rows = NULL;
+    lockFrame(df, FRAME_READ);
+    Py_BEGIN_ALLOW_THREADS
+    if (topKByIndex(df, keys, num_keys, n, &rows, &count) == 0) {
+        rows = topKRows(df, keys, num_keys, n, &count);
+    }
+    Py_END_ALLOW_THREADS
+    unlockFrame(df, FRAME_READ);
+    free(keys);
+    if (!rows) {
+        return PyErr_NoMemory();
+    }
+    PyObject* result = PyList_New(count);
+    for (int i = 0; result && i < count; i++) {
+        PyObject* row = PyTuple_New(df->num_cols + 1);
+        if (!row) {
+            Py_CLEAR(result);
+            break;
+        }
+        PyList_SET_ITEM(result, i, row);
+        PyObject* index = PyLong_FromLong(rows[i]);
+        if (!index) {
+            Py_CLEAR(result);
+            break;
+        }
+        PyTuple_SET_ITEM(row, 0, index);
+        for (int j = 0; j < df->num_cols; j++) {
+            PyObject* value = cellToPyObject(&df->columns[j], rows[i]);
+            if (!value) {
+                Py_CLEAR(result);
+                break;
+            }
+            PyTuple_SET_ITEM(row, j + 1, value);
+        }
+    }
+    free(rows);
+    return result;
+}
+
+// Function to get the n rows with the largest values in the given columns
+static PyObject* py_nlargest(PyObject* self, PyObject* args, PyObject* kwargs) {
+    return topKFromPython(args, kwargs, 1);
+}
+
+// Function to get the n rows with the smallest values in the given columns
+static PyObject* py_nsmallest(PyObject* self, PyObject* args, PyObject* kwargs) {
+    return topKFromPython(args, kwargs, 0);
+}
+
+// Largest magnitude an int64 reaches, as a double
+#define INT64_LIMIT 9223372036854775808.0
+
+// Function to set pred to the inclusive range of int64 values x with
+// "x op value" for an exact integer value
+static void setIntRange(Predicate* pred, const char* op, int64_t value) {
+    pred->kind = PREDICATE_INT_RANGE;
+    pred->int_lo = INT64_MIN;
+    pred->int_hi = INT64_MAX;
+    if (strcmp(op, "==") == 0) {
+        pred->int_lo = pred->int_hi = value;
+    } else if (strcmp(op, "<") == 0) {
+        pred->empty = value == INT64_MIN;
+        pred->int_hi = value - !pred->empty;
+    } else if (strcmp(op, "<=") == 0) {
+        pred->int_hi = value;
+    } else if (strcmp(op, ">") == 0) {
+        pred->empty = value == INT64_MAX;
+        pred->int_lo = value + !pred->empty;
+    } else {
+        pred->int_lo = value;
+    }
+}
+
+// Function to set pred to the inclusive range of int64 values x with
+// "x op value" for any real value, rounding the bound inward
+static void setIntRangeFromDouble(Predicate* pred, const char* op, double value) {
+    pred->kind = PREDICATE_INT_RANGE;
+    pred->int_lo = INT64_MIN;
+    pred->int_hi = INT64_MAX;
+    if (isnan(value)) {
+        pred->empty = 1;
+    } else if (strcmp(op, "==") == 0) {
+        pred->empty = value != floor(value) || value < -INT64_LIMIT || value >= INT64_LIMIT;
+        if (!pred->empty) pred->int_lo = pred->int_hi = (int64_t)value;
+    } else if (strcmp(op, "<") == 0 || strcmp(op, "<=") == 0) {
+        // x < v is x <= ceil(v) - 1 and x <= v is x <= floor(v)
+        double bound = op[1] ? floor(value) : ceil(value) - 1.0;
+        pred->empty = bound < -INT64_LIMIT;
+        if (!pred->empty && bound < INT64_LIMIT) pred->int_hi = (int64_t)bound;
+    } else {
+        // x > v is x >= floor(v) + 1 and x >= v is x >= ceil(v)
+        double bound = op[1] ? ceil(value) : floor(value) + 1.0;
+        pred->empty = bound >= INT64_LIMIT;
+        if (!pred->empty && bound > -INT64_LIMIT) pred->int_lo = (int64_t)bound;
+    }
+}
+
+// Function to set pred to the range of doubles x with "x op value"
+static void setFloatRange(Predicate* pred, const char* op, double value) {
+    pred->kind = PREDICATE_FLOAT_RANGE;
+    pred->float_lo = -INFINITY;
+    pred->float_hi = INFINITY;
+    if (strcmp(op, "==") == 0) {
+        pred->float_lo = pred->float_hi = value;
+    } else if (strcmp(op, "<") == 0) {
+        pred->float_hi = nextafter(value, -INFINITY);
+    } else if (strcmp(op, "<=") == 0) {
+        pred->float_hi = value;
+    } else if (strcmp(op, ">") == 0) {
+        pred->float_lo = nextafter(value, INFINITY);
+    } else {
+        pred->float_lo = value;
+    }
+    pred->empty = isnan(value);
+}
+
+// Function to convert a Python datetime, date, ISO 8601 string or integer
+// count of nanoseconds to a timestamp
+static int datetimeFromPyObject(PyObject* value, int64_t* out) {
+    if (PyDateTime_Check(value)) {
+        int64_t days = daysFromCivil(PyDateTime_GET_YEAR(value), PyDateTime_GET_MONTH(value),
+                                     PyDateTime_GET_DAY(value));
+        int64_t seconds = (int64_t)PyDateTime_DATE_GET_HOUR(value) * 3600 + PyDateTime_DATE_GET_MINUTE(value) * 60 +
+                          PyDateTime_DATE_GET_SECOND(value);
+        *out = days * NS_PER_DAY + seconds * NS_PER_SECOND + (int64_t)PyDateTime_DATE_GET_MICROSECOND(value) * 1000;
+        return 0;
+    }
+    if (PyDate_Check(value)) {
+        *out = daysFromCivil(PyDateTime_GET_YEAR(value), PyDateTime_GET_MONTH(value), PyDateTime_GET_DAY(value)) *
+               NS_PER_DAY;
+        return 0;
+    }
+    if (PyUnicode_Check(value)) {
+        Py_ssize_t len;
+        const char* text = PyUnicode_AsUTF8AndSize(value, &len);
+        if (!text) {
+            return -1;
+        }
+        if (parseDatetime(text, (size_t)len, out) != 0) {
+            PyErr_Format(PyExc_ValueError, "'%s' is not a valid datetime", text);
+            return -1;
+        }
+        return 0;
+    }
+    if (PyLong_Check(value)) {
+        *out = PyLong_AsLongLong(value);
+        return *out == -1 && PyErr_Occurred() ? -1 : 0;
+    }
+    PyErr_SetString(PyExc_TypeError, "datetime columns are compared with datetimes, ISO strings or nanoseconds");
+    return -1;
+}
+
+// Function to build the range leaf "column op value" for a column that is
+// not a string column
+static int parseRangeLeaf(const Column* col, const char* op, PyObject* value, Predicate* pred) {
+    pred->col = col;
+    if (col->dtype == DTYPE_DATETIME) {
+        int64_t timestamp;
+        if (datetimeFromPyObject(value, &timestamp) != 0) {
+            return -1;
+        }
+        setIntRange(pred, op, timestamp);
+        return 0;
+    }
+    if (!PyLong_Check(value) && !PyFloat_Check(value)) {
+        PyErr_Format(PyExc_TypeError, "column '%s' is compared with numbers", col->name);
+        return -1;
+    }
+    if (col->dtype == DTYPE_FLOAT64) {
+        double number = PyFloat_AsDouble(value);
+        if (number == -1.0 && PyErr_Occurred()) {
+            return -1;
+        }
+        setFloatRange(pred, op, number);
+        return 0;
+    }
+    int overflow = 0;
+    long long exact = PyLong_Check(value) ? PyLong_AsLongLongAndOverflow(value, &overflow) : 0;
+    if (exact == -1 && PyErr_Occurred()) {
+        return -1;
+    }
+    if (PyLong_Check(value) && !overflow) {
+        setIntRange(pred, op, (int64_t)exact);
+    } else {
+        setIntRangeFromDouble(pred, op, PyLong_Check(value) ? overflow * INFINITY : PyFloat_AS_DOUBLE(value));
+    }
+    if (col->dtype == DTYPE_BOOL) {
+        // Bools are the integers 0 and 1
+        if (pred->int_lo < 0) pred->int_lo = 0;
+        if (pred->int_hi > 1) pred->int_hi = 1;
+        pred->empty |= pred->int_lo > pred->int_hi;
+    }
+    return 0;
+}
+
+// Function to build the leaf "column op text" for a string column
+static int parseStringLeaf(const Column* col, const char* op, PyObject* value, Predicate* pred) {
+    if (!PyUnicode_Check(value)) {
+        PyErr_Format(PyExc_TypeError, "string column '%s' is compared with str", col->name);
+        return -1;
+    }
+    Py_ssize_t len;
+    pred->col = col;
+    pred->text.text = PyUnicode_AsUTF8AndSize(value, &len);
+    pred->text.len = (size_t)len;
+    if (!pred->text.text) {
+        return -1;
+    }
+    if (strcmp(op, "==") == 0) {
+        pred->kind = PREDICATE_STRING_EQUAL;
+    } else if (strcmp(op, "startswith") == 0) {
+        pred->kind = PREDICATE_STARTS_WITH;
+    } else if (strcmp(op, "contains") == 0) {
+        pred->kind = PREDICATE_CONTAINS;
+    } else {
+        pred->kind = PREDICATE_STRING_COMPARE;
+        pred->string_sign = op[0] == '<' ? -1 : 1;
+        pred->string_inclusive = op[1] == '=';
+    }
+    return 0;
+}
+
+// Function to compare int64 values for qsort
+static int compareInt64Values(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Function to compare doubles for qsort
+static int compareDoubleValues(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Function to build the leaf "column in values". Values that cannot equal
+// any value of the column, and None, are dropped from the list.
+static int parseInLeaf(const Column* col, PyObject* values, Predicate* pred) {
+    PyObject* seq = PySequence_Fast(values, "'in' takes an iterable of values");
+    if (!seq) {
+        return -1;
+    }
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(seq);
+    PyObject** items = PySequence_Fast_ITEMS(seq);
+    size_t n = 0;
+    int status = 0;
+    pred->col = col;
+    if (isTextColumn(col)) {
+        pred->kind = PREDICATE_STRING_IN;
+        pred->strings = (FilterString*)malloc((count > 0 ? count : 1) * sizeof(FilterString));
+        status = pred->strings ? 0 : -1;
+    } else if (col->dtype == DTYPE_FLOAT64) {
+        pred->kind = PREDICATE_FLOAT_IN;
+        pred->floats = (double*)malloc((count > 0 ? count : 1) * sizeof(double));
+        status = pred->floats ? 0 : -1;
+    } else {
+        pred->kind = PREDICATE_INT_IN;
+        pred->ints = (int64_t*)malloc((count > 0 ? count : 1) * sizeof(int64_t));
+        status = pred->ints ? 0 : -1;
+    }
+    if (status != 0) {
+        PyErr_NoMemory();
+    }
+    for (Py_ssize_t i = 0; status == 0 && i < count; i++) {
+        if (items[i] == Py_None) {
+            continue;
+        }
+        if (isTextColumn(col)) {
+            status = parseStringLeaf(col, "==", items[i], pred);
+            pred->kind = PREDICATE_STRING_IN;
+            if (status == 0) pred->strings[n++] = pred->text;
+            continue;
+        }
+        Predicate equal;
+        memset(&equal, 0, sizeof(equal));
+        status = parseRangeLeaf(col, "==", items[i], &equal);
+        if (status != 0 || equal.empty) {
+            continue;
+        }
+        if (col->dtype == DTYPE_FLOAT64) {
+            pred->floats[n++] = equal.float_lo;
+        } else {
+            pred->ints[n++] = equal.int_lo;
+        }
+    }
+    Py_DECREF(seq);
+    if (status != 0) {
+        return -1;
+    }
+    pred->list_len = n;
+    pred->empty = n == 0;
+    if (isTextColumn(col)) {
+        qsort(pred->strings, n, sizeof(FilterString), compareFilterStrings);
+    } else if (col->dtype == DTYPE_FLOAT64) {
+        qsort(pred->floats, n, sizeof(double), compareDoubleValues);
+    } else {
+        qsort(pred->ints, n, sizeof(int64_t), compareInt64Values);
+    }
+    if (col->dtype == DTYPE_BOOL) {
+        // Bool columns are uint8, so the set {0, 1} becomes a range
+        int has_false = 0, has_true = 0;
+        for (size_t i = 0; i < n; i++) {
+            has_false |= pred->ints[i] == 0;
+            has_true |= pred->ints[i] == 1;
+        }
+        free(pred->ints);
+        pred->ints = NULL;
+        pred->kind = PREDICATE_INT_RANGE;
+        pred->int_lo = has_false ? 0 : 1;
+        pred->int_hi = has_true ? 1 : 0;
+        pred->empty = !has_false && !has_true;
+    }
+    return 0;
+}
+
+// Function to turn the string leaves of a predicate on a category column
+// into code lookups: each test runs once per dictionary value, and rows then
+// match by indexing a table with their codes
+static int encodeCategoryLeaves(Predicate* pred) {
+    for (int c = 0; c < pred->num_children; c++) {
+        if (encodeCategoryLeaves(&pred->children[c]) != 0) {
+            return -1;
+        }
+    }
+    if (!pred->col || pred->col->dtype != DTYPE_CATEGORY || pred->kind < PREDICATE_STRING_EQUAL ||
+        pred->kind > PREDICATE_CONTAINS) {
+        return 0;
+    }
+    const CategoryDict* dict = pred->col->dict;
+    pred->code_matches = (uint8_t*)calloc(dict->size > 0 ? dict->size : 1, 1);
+    if (!pred->code_matches) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    Predicate test = *pred;
+    test.col = &dict->values;
+    for (int begin = 0; !pred->empty && begin < dict->size; begin += FILTER_BLOCK_ROWS) {
+        int end = dict->size - begin < FILTER_BLOCK_ROWS ? dict->size : begin + FILTER_BLOCK_ROWS;
+        uint64_t words[FILTER_BLOCK_WORDS];
+        evaluateLeaf(&test, begin, end, NULL, words);
+        for (int code = begin; code < end; code++) {
+            pred->code_matches[code] = (uint8_t)((words[(code - begin) >> 6] >> ((code - begin) & 63)) & 1);
+        }
+    }
+    pred->kind = PREDICATE_CODE_IN;
+    return 0;
+}
+
+// Function to convert a predicate from Python into a Predicate tree.
+// Leaves are tuples (column, op[, value[, value]]) with op one of
+//   ==  !=  <  <=  >  >=            compare with a value
+//   between                         lo <= x <= hi
+//   in  not in                      membership in an iterable
+//   startswith  contains            string columns only
+//   isnull  notnull (isna, notna)   no value
+// and ('and', p, ...), ('or', p, ...) and ('not', p) combine predicates.
+// Comparisons never match a missing value.
+static int parsePredicate(DataFrame* df, PyObject* obj, Predicate* pred) {
+    memset(pred, 0, sizeof(Predicate));
+    if (!PyTuple_Check(obj) && !PyList_Check(obj)) {
+        PyErr_SetString(PyExc_TypeError, "a predicate is a tuple such as (column, op, value)");
+        return -1;
+    }
+    PyObject* seq = PySequence_Fast(obj, "");
+    if (!seq) {
+        return -1;
+    }
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    PyObject** items = PySequence_Fast_ITEMS(seq);
+    const char* head = n >= 2 && PyUnicode_Check(items[0]) ? PyUnicode_AsUTF8(items[0]) : NULL;
+    int status = -1;
+    if (head && (PyTuple_Check(items[1]) || PyList_Check(items[1])) &&
+        (strcmp(head, "and") == 0 || strcmp(head, "or") == 0 || strcmp(head, "not") == 0)) {
+        pred->kind = head[0] == 'a' ? PREDICATE_AND : head[0] == 'o' ? PREDICATE_OR : PREDICATE_NOT;
+        if (pred->kind == PREDICATE_NOT && n != 2) {
+            PyErr_SetString(PyExc_ValueError, "'not' takes exactly one predicate");
+            goto done;
+        }
+        pred->children = (Predicate*)calloc((size_t)(n - 1), sizeof(Predicate));
+        if (!pred->children) {
+            PyErr_NoMemory();
+            goto done;
+        }
+        for (Py_ssize_t c = 1; c < n; c++) {
+            pred->num_children = (int)c;
+            if (parsePredicate(df, items[c], &pred->children[c - 1]) != 0) {
+                goto done;
+            }
+        }
+        status = 0;
+        goto done;
+    }
+
+    const char* op = n >= 2 && PyUnicode_Check(items[1]) ? PyUnicode_AsUTF8(items[1]) : NULL;
+    if (!op) {
+        PyErr_SetString(PyExc_TypeError, "a predicate is a tuple such as (column, op, value)");
+        goto done;
+    }
+    int col_index = resolveColumn(df, items[0]);
+    if (col_index < 0) {
+        goto done;
+    }
+    const Column* col = &df->columns[col_index];
+    int is_string = isTextColumn(col);
+    pred->col = col;
+    if (strcmp(op, "isnull") == 0 || strcmp(op, "isna") == 0 || strcmp(op, "notnull") == 0 ||
+        strcmp(op, "notna") == 0) {
+        pred->kind = op[0] == 'i' ? PREDICATE_IS_NULL : PREDICATE_NOT_NULL;
+        status = n == 2 ? 0 : -1;
+    } else if (strcmp(op, "between") == 0) {
+        if (n != 4) {
+            PyErr_SetString(PyExc_ValueError, "'between' takes a lower and an upper bound");
+            goto done;
+        }
+        if (is_string) {
+            pred->kind = PREDICATE_AND;
+            pred->children = (Predicate*)calloc(2, sizeof(Predicate));
+            if (!pred->children) {
+                PyErr_NoMemory();
+                goto done;
+            }
+            pred->num_children = 2;
+            status = parseStringLeaf(col, ">=", items[2], &pred->children[0]) != 0 ||
+                             parseStringLeaf(col, "<=", items[3], &pred->children[1]) != 0
+                         ? -1 : 0;
+        } else {
+            Predicate upper;
+            memset(&upper, 0, sizeof(upper));
+            if (parseRangeLeaf(col, ">=", items[2], pred) != 0 || parseRangeLeaf(col, "<=", items[3], &upper) != 0) {
+                goto done;
+            }
+            // Intersect the two half-open ranges into one
+            pred->int_hi = upper.int_hi;
+            pred->float_hi = upper.float_hi;
+            pred->empty |= upper.empty || (pred->kind == PREDICATE_INT_RANGE ? pred->int_lo > pred->int_hi
+                                                                             : !(pred->float_lo <= pred->float_hi));
+            status = 0;
+        }
+    } else if (strcmp(op, "in") == 0 || strcmp(op, "not in") == 0) {
+        if (n != 3) {
+            PyErr_Format(PyExc_ValueError, "'%s' takes one iterable of values", op);
+            goto done;
+        }
+        status = parseInLeaf(col, items[2], pred);
+        pred->negate = op[0] == 'n';
+    } else if (strcmp(op, "==") == 0 || strcmp(op, "!=") == 0 || strcmp(op, "<") == 0 || strcmp(op, "<=") == 0 ||
+               strcmp(op, ">") == 0 || strcmp(op, ">=") == 0 || strcmp(op, "startswith") == 0 ||
+               strcmp(op, "contains") == 0) {
+        if (n != 3) {
+            PyErr_Format(PyExc_ValueError, "'%s' takes one value", op);
+            goto done;
+        }
+        int negate = op[0] == '!';
+        const char* test = negate ? "==" : op;
+        if (is_string) {
+            status = parseStringLeaf(col, test, items[2], pred);
+        } else if (test[0] == 's' || test[0] == 'c') {
+            PyErr_Format(PyExc_TypeError, "'%s' needs a string column", op);
+        } else {
+            status = parseRangeLeaf(col, test, items[2], pred);
+        }
+        pred->negate = negate;
+    } else {
+        PyErr_Format(PyExc_ValueError, "unknown predicate operator '%s'", op);
+    }
+    if (status != 0 && !PyErr_Occurred()) {
+        PyErr_Format(PyExc_ValueError, "wrong number of values for '%s'", op);
+    }
+    if (status == 0 && col->dtype == DTYPE_CATEGORY) {
+        status = encodeCategoryLeaves(pred);
+    }
+
+done:
+    Py_DECREF(seq);
+    if (status != 0) {
+        freePredicate(pred);
+    }
+    return status;
+}
+
+// Function to filter the rows of a DataFrame object from Python into a new DataFrame
+static PyObject* py_filter(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    PyObject* predicate;
+    if (!PyArg_ParseTuple(args, "OO", &capsule, &predicate)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    Predicate pred;
+    if (parsePredicate(df, predicate, &pred) != 0) {
+        return NULL;
+    }
+    DataFrame* result = NULL;
+    lockFrame(df, FRAME_READ);
+    Py_BEGIN_ALLOW_THREADS
+    int count = 0;
+    int* rows = filterRows(df, &pred, &count);
+    if (rows) {
+        result = takeRows(df, rows, count);
+    }
+    free(rows);
+    Py_END_ALLOW_THREADS
+    unlockFrame(df, FRAME_READ);
+    freePredicate(&pred);
+    if (!result) {
+        return PyErr_NoMemory();
+    }
+    return newFrame(result);
+}
+
+// Function to return the rows of a DataFrame object matching a predicate to
+// Python as an array('q') selection vector, leaving the DataFrame untouched
+static PyObject* py_argfilter(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    PyObject* predicate;
+    if (!PyArg_ParseTuple(args, "OO", &capsule, &predicate)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    Predicate pred;
+    if (parsePredicate(df, predicate, &pred) != 0) {
+        return NULL;
+    }
+    int count = 0;
+    int* rows;
+    lockFrame(df, FRAME_READ);
+    Py_BEGIN_ALLOW_THREADS
+    rows = filterRows(df, &pred, &count);
+    Py_END_ALLOW_THREADS
+    unlockFrame(df, FRAME_READ);
+    freePredicate(&pred);
+    if (!rows) {
+        return PyErr_NoMemory();
+    }
+    PyObject* result = rowsToArray(rows, count);
+    free(rows);
+    return result;
+}
+
+// Function to parse the name of an index kind given from Python
+static int parseIndexKind(const char* name) {
+    for (int kind = 0; kind < NUM_INDEX_KINDS; kind++) {
+        if (strcmp(index_kind_names[kind], name) == 0) {
+            return kind;
+        }
+    }
+    PyErr_SetString(PyExc_ValueError, "kind must be 'sorted' or 'hash'");
+    return -1;
+}
+
+// Function to index a column of a DataFrame object from Python
+static PyObject* py_create_index(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"df", "column", "kind", NULL};
+    PyObject* capsule;
+    PyObject* column;
+    const char* kind_name = "sorted";
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|s", kwlist, &capsule, &column, &kind_name)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_WRITE);
+    if (!df) {
+        return NULL;
+    }
+    int col_index = resolveColumn(df, column);
+    int kind = parseIndexKind(kind_name);
+    if (col_index < 0 || kind < 0) {
+        return NULL;
+    }
+    if (findIndex(df, col_index, (IndexKind)kind)) {
+        Py_RETURN_NONE;
+    }
+    ColumnIndex* index;
+    lockFrame(df, FRAME_WRITE);
+    Py_BEGIN_ALLOW_THREADS
+    index = buildIndex(df, col_index, (IndexKind)kind);
+    Py_END_ALLOW_THREADS
+    if (index) {
+        ColumnIndex** link = &df->indexes;
+        while (*link) {
+            link = &(*link)->next;
+        }
+        *link = index;
+    }
+    unlockFrame(df, FRAME_WRITE);
+    if (!index) {
+        return PyErr_NoMemory();
+    }
+    Py_RETURN_NONE;
+}
+
+// Function to drop indexes over a column of a DataFrame object from Python
+static PyObject* py_drop_index(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"df", "column", "kind", NULL};
+    PyObject* capsule;
+    PyObject* column;
+    const char* kind_name = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|z", kwlist, &capsule, &column, &kind_name)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_WRITE);
+    if (!df) {
+        return NULL;
+    }
+    int col_index = resolveColumn(df, column);
+    int kind = kind_name ? parseIndexKind(kind_name) : -1;
+    if (col_index < 0 || (kind_name && kind < 0)) {
+        return NULL;
+    }
+    if (dropIndexes(df, col_index, kind) == 0) {
+        PyErr_Format(PyExc_ValueError, "column '%s' has no %s%sindex", df->columns[col_index].name,
+                     kind_name ? kind_name : "", kind_name ? " " : "");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+// Function to list the indexes of a DataFrame object to Python
+static PyObject* py_indexes(PyObject* self, PyObject* args) {
+    PyObject* capsule;
+    if (!PyArg_ParseTuple(args, "O", &capsule)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    PyObject* result = PyList_New(0);
+    for (const ColumnIndex* index = df->indexes; result && index; index = index->next) {
+        PyObject* item = Py_BuildValue("(ss)", df->columns[index->column].name, index_kind_names[index->kind]);
+        if (!item || PyList_Append(result, item) != 0) {
+            Py_CLEAR(result);
+        }
+        Py_XDECREF(item);
+    }
+    return result;
+}
+
+// Function to return the rows of a DataFrame object holding a value, or
+// any of a list of values, to Python as an array('q'), looked up in an index
+static PyObject* py_lookup(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"df", "column", "value", NULL};
+    PyObject* capsule;
+    PyObject* column;
+    PyObject* value;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOO", kwlist, &capsule, &column, &value)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    int col_index = resolveColumn(df, column);
+    if (col_index < 0) {
+        return NULL;
+    }
+    if (!findIndex(df, col_index, INDEX_HASH) && !findIndex(df, col_index, INDEX_SORTED)) {
+        PyErr_Format(PyExc_ValueError, "column '%s' has no index", df->columns[col_index].name);
+        return NULL;
+    }
+    // The lookup is the leaf a filter on the value would have
+    int is_list = PyList_Check(value) || PyTuple_Check(value);
+    PyObject* leaf = Py_BuildValue("(isO)", col_index, is_list ? "in" : "==", value);
+    Predicate pred;
+    if (!leaf || parsePredicate(df, leaf, &pred) != 0) {
+        Py_XDECREF(leaf);
+        return NULL;
+    }
+    Py_DECREF(leaf);
+    int* rows = NULL;
+    int count = 0;
+    int status;
+    lockFrame(df, FRAME_READ);
+    Py_BEGIN_ALLOW_THREADS
+    KernelSpan span;
+    beginKernel(&span, KERNEL_INDEX_LOOKUP);
+    status = leafIndexRows(df, &pred, df->num_rows, &rows, &count);
+    if (status > 0) {
+        qsort(rows, count, sizeof(int), compareRowIndices);
+    }
+    endKernel(&span, status > 0 ? count : 0);
+    Py_END_ALLOW_THREADS
+    unlockFrame(df, FRAME_READ);
+    freePredicate(&pred);
+    if (status < 0) {
+        return PyErr_NoMemory();
+    }
+    if (status == 0) {
+        PyErr_SetString(PyExc_ValueError, "the index cannot look up this value");
+        return NULL;
+    }
+    PyObject* result = rowsToArray(rows, count);
+    free(rows);
+    return result;
+}
+
+// Function to return the rows of a DataFrame object whose values lie in a
+// range to Python as an array('q') in value order, read from a sorted index
+static PyObject* py_range(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"df", "column", "lo", "hi", NULL};
+    PyObject* capsule;
+    PyObject* column;
+    PyObject* bounds[2] = {Py_None, Py_None};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO|OO", kwlist, &capsule, &column, &bounds[0], &bounds[1])) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    int col_index = resolveColumn(df, column);
+    if (col_index < 0) {
+        return NULL;
+    }
+    const Column* col = &df->columns[col_index];
+    const ColumnIndex* index = findIndex(df, col_index, INDEX_SORTED);
+    if (!index) {
+        PyErr_Format(PyExc_ValueError, "column '%s' has no sorted index", col->name);
+        return NULL;
+    }
+    // Each bound is the leaf "column >= lo" or "column <= hi" of a filter;
+    // the range runs from the lower end of one to the upper end of the other
+    static const char* const ops[2] = {">=", "<="};
+    IndexRange range;
+    memset(&range, 0, sizeof(range));
+    int empty = 0;
+    for (int b = 0; b < 2; b++) {
+        if (bounds[b] == Py_None) {
+            continue;
+        }
+        Predicate leaf;
+        memset(&leaf, 0, sizeof(leaf));
+        int status = isTextColumn(col) ? parseStringLeaf(col, ops[b], bounds[b], &leaf)
+                                       : parseRangeLeaf(col, ops[b], bounds[b], &leaf);
+        if (status != 0) {
+            freePredicate(&leaf);
+            return NULL;
+        }
+        IndexRange part;
+        empty |= leaf.empty;
+        if (!leaf.empty) {
+            leafRange(&leaf, 0, &part);
+            if (b == 0 || bounds[0] == Py_None) {
+                range = part;
+            } else {
+                range.hi = part.hi;
+                range.has_hi = part.has_hi;
+                range.hi_inclusive = part.hi_inclusive;
+            }
+        }
+        freePredicate(&leaf);
+    }
+    int* rows = NULL;
+    int64_t count = 0;
+    lockFrame(df, FRAME_READ);
+    Py_BEGIN_ALLOW_THREADS
+    KernelSpan span;
+    beginKernel(&span, KERNEL_INDEX_LOOKUP);
+    if (!empty) {
+        count = sortedRangeRows(index, col, &range, NULL, INT64_MAX);
+    }
+    rows = (int*)malloc((size_t)(count > 0 ? count : 1) * sizeof(int));
+    if (rows) {
+        sortedRangeRows(index, col, &range, rows, count);
+    }
+    endKernel(&span, rows ? count : 0);
+    Py_END_ALLOW_THREADS
+    unlockFrame(df, FRAME_READ);
+    if (!rows) {
+        return PyErr_NoMemory();
+    }
+    PyObject* result = rowsToArray(rows, (int)count);
+    free(rows);
+    return result;
+}
+
+// Function to append one (column, aggregation name) pair given from Python
+// to a growing list of aggregations
+static int addAggregation(DataFrame* df, PyObject* column, PyObject* name, Aggregation* aggs, int* num_aggs) {
+    int col_index = resolveColumn(df, column);
+    if (col_index < 0) {
+        return -1;
+    }
+    const char* text = PyUnicode_Check(name) ? PyUnicode_AsUTF8(name) : NULL;
+    if (!text) {
+        if (!PyErr_Occurred()) PyErr_SetString(PyExc_TypeError, "aggregations are given by name, e.g. 'sum'");
+        return -1;
+    }
+    int kind = 0;
+    while (kind < NUM_AGG_KINDS && strcmp(agg_names[kind], text) != 0) {
+        kind++;
+    }
+    if (kind == NUM_AGG_KINDS) {
+        PyErr_Format(PyExc_ValueError, "unknown aggregation '%s'", text);
+        return -1;
+    }
+    const Column* col = &df->columns[col_index];
+    if ((kind == AGG_SUM || kind == AGG_MEAN) && (isTextColumn(col) || col->dtype == DTYPE_DATETIME)) {
+        PyErr_Format(PyExc_TypeError, "cannot take the %s of %s column '%s'", text, dtypeName(col->dtype), col->name);
+        return -1;
+    }
+    aggs[*num_aggs].col = col;
+    aggs[*num_aggs].kind = (AggKind)kind;
+    (*num_aggs)++;
+    return 0;
+}
+
+// Function to parse the aggregations of groupby: a dict mapping columns to
+// one aggregation name or a list of them, or a list of (column, name) pairs.
+// Returns a malloc'd array and stores its length, or NULL on error.
+static Aggregation* parseAggregations(DataFrame* df, PyObject* spec, int* num_aggs) {
+    PyObject* pairs = PyDict_Check(spec) ? PyDict_Items(spec) : (Py_INCREF(spec), spec);
+    if (!pairs) {
+        return NULL;
+    }
+    PyObject* seq = PySequence_Fast(pairs, "aggs must be a dict or a list of (column, aggregation) pairs");
+    Py_DECREF(pairs);
+    if (!seq) {
+        return NULL;
+    }
+    // Count the aggregations first so the array is allocated once
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    Py_ssize_t total = 0;
+    for (Py_ssize_t i = 0; i < n; i++) {
+        PyObject* pair = PySequence_Fast_GET_ITEM(seq, i);
+        if (!PyTuple_Check(pair) || PyTuple_GET_SIZE(pair) != 2) {
+            PyErr_SetString(PyExc_TypeError, "aggs must be a dict or a list of (column, aggregation) pairs");
+            Py_DECREF(seq);
+            return NULL;
+        }
+        PyObject* names = PyTuple_GET_ITEM(pair, 1);
+        total += PyList_Check(names) || PyTuple_Check(names) ? PySequence_Size(names) : 1;
+    }
+    Aggregation* aggs = (Aggregation*)malloc((total > 0 ? (size_t)total : 1) * sizeof(Aggregation));
+    if (!aggs) {
+        Py_DECREF(seq);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    *num_aggs = 0;
+    int status = 0;
+    for (Py_ssize_t i = 0; status == 0 && i < n; i++) {
+        PyObject* pair = PySequence_Fast_GET_ITEM(seq, i);
+        PyObject* column = PyTuple_GET_ITEM(pair, 0);
+        PyObject* names = PyTuple_GET_ITEM(pair, 1);
+        if (PyList_Check(names) || PyTuple_Check(names)) {
+            for (Py_ssize_t k = 0; status == 0 && k < PySequence_Size(names); k++) {
+                PyObject* name = PySequence_GetItem(names, k);
+                status = name ? addAggregation(df, column, name, aggs, num_aggs) : -1;
+                Py_XDECREF(name);
+            }
+        } else {
+            status = addAggregation(df, column, names, aggs, num_aggs);
+        }
+    }
+    Py_DECREF(seq);
+    if (status != 0) {
+        free(aggs);
+        return NULL;
+    }
+    return aggs;
+}
+
+// Function to group the rows of a DataFrame object from Python and return
+// the aggregated groups as a new DataFrame
+static PyObject* py_groupby(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"df", "by", "aggs", "dropna", NULL};
+    PyObject* capsule;
+    PyObject* by;
+    PyObject* spec;
+    int dropna = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOO|p", kwlist, &capsule, &by, &spec, &dropna)) {
+        return NULL;
+    }
+    DataFrame* df = getDataFrame(capsule, FRAME_READ);
+    if (!df) {
+        return NULL;
+    }
+    int by_is_list = PyList_Check(by) || PyTuple_Check(by);
+    int num_keys = by_is_list ? (int)PySequence_Size(by) : 1;
+    if (num_keys <= 0) {
+        if (!PyErr_Occurred()) PyErr_SetString(PyExc_ValueError, "by must name at least one column");
+        return NULL;
+    }
+    const Column** key_cols = (const Column**)malloc(num_keys * sizeof(Column*));
+    if (!key_cols) {
+        return PyErr_NoMemory();
+    }
+    for (int k = 0; k < num_keys; k++) {
+        PyObject* column = by_is_list ? PySequence_GetItem(by, k) : (Py_INCREF(by), by);
+        int col_index = column ? resolveColumn(df, column) : -1;
+        Py_XDECREF(column);
+        if (col_index < 0) {
+            free(key_cols);
+            return NULL;
+        }
+        key_cols[k] = &df->columns[col_index];
+    }
+    int num_aggs = 0;
+    Aggregation* aggs = parseAggregations(df, spec, &num_aggs);
+    if (!aggs) {
+        free(key_cols);
+        return NULL;
+    }
+    DataFrame* result;
+    lockFrame(df, FRAME_READ);
+    Py_BEGIN_ALLOW_THREADS
+    result = groupRows(df, key_cols, num_keys, dropna, aggs, num_aggs);
+    Py_END_ALLOW_THREADS
+    unlockFrame(df, FRAME_READ);
+    free(key_cols);
+    free(aggs);
+    if (!result) {
+        return PyErr_NoMemory();
+    }
+    return newFrame(result);
+}
+
+// Function to join two DataFrame objects from Python into a new DataFrame
+static PyObject* py_join(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"left", "right", "on", "how", "rsuffix", NULL};
+    PyObject* left_capsule;
+    PyObject* right_capsule;
+    PyObject* on;
+    const char* how = "inner";
+    const char* rsuffix = "_right";
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOO|ss", kwlist, &left_capsule, &right_capsule, &on, &how,
+                                     &rsuffix)) {
+        return NULL;
+    }
+    DataFrame* left = getDataFrame(left_capsule, FRAME_READ);
+    DataFrame* right = left ? getDataFrame(right_capsule, FRAME_READ) : NULL;
+    if (!right) {
+        return NULL;
+    }
+    JoinKind kind;
+    if (strcmp(how, "inner") == 0) {
+        kind = JOIN_INNER;
+    } else if (strcmp(how, "left") == 0) {
+        kind = JOIN_LEFT;
+    } else if (strcmp(how, "semi") == 0) {
+        kind = JOIN_SEMI;
+    } else if (strcmp(how, "anti") == 0) {
+        kind = JOIN_ANTI;
+    } else {
+        PyErr_SetString(PyExc_ValueError, "how must be 'inner', 'left', 'semi' or 'anti'");
+        return NULL;
+    }
+    int on_is_list = PyList_Check(on) || PyTuple_Check(on);
+    int num_keys = on_is_list ? (int)PySequence_Size(on) : 1;
+    if (num_keys <= 0) {
+        if (!PyErr_Occurred()) PyErr_SetString(PyExc_ValueError, "on must name at least one column");
+        return NULL;
+    }
+    const Column** keys = (const Column**)malloc(2 * num_keys * sizeof(Column*));
+    if (!keys) {
+        return PyErr_NoMemory();
+    }
+    for (int k = 0; k < num_keys; k++) {
+        PyObject* column = on_is_list ? PySequence_GetItem(on, k) : (Py_INCREF(on), on);
+        int left_index = column ? resolveColumn(left, column) : -1;
+        int right_index = left_index >= 0 ? resolveColumn(right, column) : -1;
+        Py_XDECREF(column);
+        if (right_index < 0) {
+            free(keys);
+            return NULL;
+        }
+        keys[k] = &left->columns[left_index];
+        keys[num_keys + k] = &right->columns[right_index];
+        if (keys[k]->dtype != keys[num_keys + k]->dtype &&
+            !(isTextColumn(keys[k]) && isTextColumn(keys[num_keys + k]))) {
+            PyErr_Format(PyExc_TypeError, "cannot join %s column '%s' with %s column '%s'", dtypeName(keys[k]->dtype),
+                         keys[k]->name, dtypeName(keys[num_keys + k]->dtype), keys[num_keys + k]->name);
+            free(keys);
+            return NULL;
+        }
+    }
+    DataFrame* result;
+    lockFrame(left, FRAME_READ);
+    lockFrame(right, FRAME_READ);
+    Py_BEGIN_ALLOW_THREADS
+    result = joinFrames(kind, left, keys, right, keys + num_keys, num_keys, rsuffix);
+    Py_END_ALLOW_THREADS
+    unlockFrame(right, FRAME_READ);
+    unlockFrame(left, FRAME_READ);
+    free(keys);
+    if (!result) {
+        return PyErr_NoMemory();
+    }
+    return newFrame(result);
+}
+
+// Steps a LazyFrame can record
+typedef enum {
+    PLAN_FRAME,     // source: a DataFrame
+    PLAN_CSV,       // source: a CSV file
+    PLAN_SELECT,
+    PLAN_FILTER,
+    PLAN_SORT,
+    PLAN_HEAD,
+    PLAN_FILLNA,
+    PLAN_CLIP
+} PlanKind;
+
+// A query recorded instead of run: one step and the LazyFrame it applies
+// to. LazyFrames never change, so queries built from a common start share
+// its steps. Columns are only resolved when the plan is built.
+typedef struct LazyFrameObject {
+    PyObject_HEAD
+    struct LazyFrameObject* input;  // NULL for a source
+    PlanKind kind;
+    PyObject* args;                 // the step's arguments, as given
+    int n;                          // PLAN_HEAD: rows kept
+    CsvOptions opts;                // PLAN_CSV
+} LazyFrameObject;
+
+// Steps of an optimized plan, run in order over the columns the plan reads
+typedef enum {
+    STEP_FILTER,
+    STEP_SORT,
+    STEP_TOP_K,     // a sort followed by a head
+    STEP_HEAD,
+    STEP_MAP        // consecutive fillna and clip steps, run in one pass per column
+} StepKind;
+
+typedef struct {
+    StepKind kind;
+    PyObject* predicate;        // STEP_FILTER: a predicate naming columns by source position
+    int* keys;                  // STEP_SORT, STEP_TOP_K: source positions of the sort columns
+    int num_keys;
+    LazyFrameObject* sort;      // STEP_SORT, STEP_TOP_K: the recorded sort, for its directions
+    int n;                      // STEP_TOP_K, STEP_HEAD: rows kept
+    LazyFrameObject** ops;      // STEP_MAP: the recorded fillna and clip steps, in order
+    uint8_t* masks;             // STEP_MAP: per op, which source columns it applies to
+    int num_ops;
+} PlanStep;
+
+// An optimized plan. Column references are resolved to positions in the
+// source, so steps can be reordered freely past the selects that renamed
+// their positions.
+typedef struct {
+    LazyFrameObject* source;
+    DataFrame* schema;          // the source DataFrame, or a CSV header with no rows
+    int num_source_cols;
+    PlanStep* steps;
+    int num_steps;
+    int* output;                // source positions of the result's columns, in order
+    int num_output;
+    uint8_t* needed;            // per source column, whether any step or the result reads it
+} Plan;
+
+// Function to make a DataFrame sharing the given columns of df, in order,
+// without copying them; release it with freeView
+static DataFrame* viewColumns(const DataFrame* df, const int* columns, int num_columns) {
+    DataFrame* view = (DataFrame*)malloc(sizeof(DataFrame));
+    if (!view) {
+        return NULL;
+    }
+    view->columns = (Column*)malloc((num_columns > 0 ? num_columns : 1) * sizeof(Column));
+    if (!view->columns) {
+        free(view);
+        return NULL;
+    }
+    for (int j = 0; j < num_columns; j++) {
+        view->columns[j] = df->columns[columns[j]];
+    }
+    view->num_rows = df->num_rows;
+    view->num_cols = num_columns;
+    view->capacity = df->capacity;
+    view->exports = 0;
+    view->mapping = NULL;
+    view->views = 0;
+    view->base = NULL;
+    view->readers = 0;
+    view->writing = 0;
+    view->indexes = NULL;
+    return view;
+}
+
+// Function to release a view made by viewColumns, leaving its columns alone
+static void freeView(DataFrame* view) {
+    free(view->columns);
+    free(view);
+}
+
+// Function to copy a predicate, replacing the column of every leaf, as
+// resolved against view, by keys[column]. Returns a new reference.
+static PyObject* mapPredicateColumns(PyObject* obj, DataFrame* view, PyObject** keys) {
+    if (!PyTuple_Check(obj) && !PyList_Check(obj)) {
+        PyErr_SetString(PyExc_TypeError, "a predicate is a tuple such as (column, op, value)");
+        return NULL;
+    }
+    PyObject* seq = PySequence_Fast(obj, "");
+    if (!seq) {
+        return NULL;
+    }
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    PyObject** items = PySequence_Fast_ITEMS(seq);
+    const char* head = n >= 2 && PyUnicode_Check(items[0]) ? PyUnicode_AsUTF8(items[0]) : NULL;
+    int combines = head && (PyTuple_Check(items[1]) || PyList_Check(items[1])) &&
+                   (strcmp(head, "and") == 0 || strcmp(head, "or") == 0 || strcmp(head, "not") == 0);
+    PyObject* result = n > 0 ? PyTuple_New(n) : NULL;
+    if (n == 0) {
+        PyErr_SetString(PyExc_TypeError, "a predicate is a tuple such as (column, op, value)");
+    }
+    for (Py_ssize_t i = 0; result && i < n; i++) {
+        PyObject* item;
+        if (combines && i > 0) {
+            item = mapPredicateColumns(items[i], view, keys);
+        } else if (!combines && i == 0) {
+            int col_index = resolveColumn(view, items[0]);
+            item = col_index >= 0 ? keys[col_index] : NULL;
+            Py_XINCREF(item);
+        } else {
+            item = items[i];
+            Py_INCREF(item);
+        }
+        if (!item) {
+            Py_CLEAR(result);
+            break;
+        }
+        PyTuple_SET_ITEM(result, i, item);
+    }
+    Py_DECREF(seq);
+    return result;
+}
+
+// Function to mark the source columns read by a predicate of a plan
+static void markPredicateColumns(PyObject* pred, uint8_t* mask) {
+    PyObject* first = PyTuple_GET_ITEM(pred, 0);
+    if (PyLong_Check(first)) {
+        mask[PyLong_AsLong(first)] = 1;
+        return;
+    }
+    for (Py_ssize_t i = 1; i < PyTuple_GET_SIZE(pred); i++) {
+        markPredicateColumns(PyTuple_GET_ITEM(pred, i), mask);
+    }
+}
+
+// Function to release the contents of a plan step
+static void freePlanStep(PlanStep* step) {
+    Py_XDECREF(step->predicate);
+    free(step->keys);
+    free(step->ops);
+    free(step->masks);
+}
+
+// Function to release a plan built by buildPlan
+static void freePlan(Plan* plan) {
+    for (int i = 0; i < plan->num_steps; i++) {
+        freePlanStep(&plan->steps[i]);
+    }
+    free(plan->steps);
+    free(plan->output);
+    free(plan->needed);
+    if (plan->schema && plan->source->kind == PLAN_CSV) {
+        freeDataFrame(plan->schema);
+    }
+}
+
+// Function to drop step i of a plan
+static void removePlanStep(Plan* plan, int i) {
+    freePlanStep(&plan->steps[i]);
+    memmove(&plan->steps[i], &plan->steps[i + 1], (size_t)(plan->num_steps - i - 1) * sizeof(PlanStep));
+    plan->num_steps--;
+}
+
+// Function to swap steps i - 1 and i of a plan
+static void swapPlanSteps(Plan* plan, int i) {
+    PlanStep step = plan->steps[i - 1];
+    plan->steps[i - 1] = plan->steps[i];
+    plan->steps[i] = step;
+}
+
+// Function to resolve one column reference, or a list of them, against the
+// current columns of a plan; stores source positions in a malloc'd array
+static int* resolvePlanColumns(Plan* plan, const int* current, int num_current, PyObject* columns, int* count) {
+    DataFrame* view = viewColumns(plan->schema, current, num_current);
+    int is_list = PyList_Check(columns) || PyTuple_Check(columns);
+    int n = is_list ? (int)PySequence_Size(columns) : 1;
+    int* positions = view && n >= 0 ? (int*)malloc((n > 0 ? n : 1) * sizeof(int)) : NULL;
+    if (!positions && !PyErr_Occurred()) {
+        PyErr_NoMemory();
+    }
+    for (int k = 0; positions && k < n; k++) {
+        PyObject* column = is_list ? PySequence_GetItem(columns, k) : (Py_INCREF(columns), columns);
+        int col_index = column ? resolveColumn(view, column) : -1;
+        Py_XDECREF(column);
+        if (col_index < 0) {
+            free(positions);
+            positions = NULL;
+            break;
+        }
+        positions[k] = current[col_index];
+    }
+    if (view) {
+        freeView(view);
+    }
+    *count = n;
+    return positions;
+}
+
+// Function to read the schema of a plan's source: the DataFrame itself, or
+// the header of a CSV file
+static int readPlanSchema(Plan* plan) {
+    LazyFrameObject* source = plan->source;
+    if (source->kind == PLAN_FRAME) {
+        plan->schema = getDataFrame(PyTuple_GET_ITEM(source->args, 0), FRAME_READ);
+    } else {
+        const char* path = PyUnicode_AsUTF8(PyTuple_GET_ITEM(source->args, 0));
+        MappedFile map;
+        size_t pos;
+        if (path && openCsvFile(path, &source->opts, &map, &plan->schema, &pos) == 0) {
+            unmapFile(&map);
+        }
+    }
+    if (!plan->schema) {
+        return -1;
+    }
+    plan->num_source_cols = plan->schema->num_cols;
+    return 0;
+}
+
+// Function to turn the recorded steps of a LazyFrame into plan steps with
+// every column resolved to its source position
+static int resolvePlan(LazyFrameObject* lazy, Plan* plan) {
+    int depth = 0;
+    for (LazyFrameObject* node = lazy; node->input; node = node->input) {
+        depth++;
+    }
+    LazyFrameObject** nodes = (LazyFrameObject**)malloc((depth > 0 ? depth : 1) * sizeof(LazyFrameObject*));
+    plan->steps = (PlanStep*)calloc(depth > 0 ? depth : 1, sizeof(PlanStep));
+    if (!nodes || !plan->steps) {
+        free(nodes);
+        PyErr_NoMemory();
+        return -1;
+    }
+    LazyFrameObject* node = lazy;
+    for (int i = depth - 1; i >= 0; i--, node = node->input) {
+        nodes[i] = node;
+    }
+    plan->source = node;
+    if (readPlanSchema(plan) != 0) {
+        free(nodes);
+        return -1;
+    }
+    int num_src = plan->num_source_cols;
+    int num_current = num_src;
+    int* current = (int*)malloc((num_src > 0 ? num_src : 1) * sizeof(int));
+    PyObject** keys = (PyObject**)calloc(num_src > 0 ? num_src : 1, sizeof(PyObject*));
+    int status = current && keys ? 0 : -1;
+    if (status != 0) {
+        PyErr_NoMemory();
+    }
+    for (int j = 0; status == 0 && j < num_src; j++) {
+        current[j] = j;
+    }
+    for (int i = 0; status == 0 && i < depth; i++) {
+        LazyFrameObject* step_node = nodes[i];
+        PyObject* arg = PyTuple_GET_SIZE(step_node->args) > 0 ? PyTuple_GET_ITEM(step_node->args, 0) : NULL;
+        PlanStep* step = &plan->steps[plan->num_steps];
+        memset(step, 0, sizeof(PlanStep));
+        if (step_node->kind == PLAN_SELECT) {
+            int count;
+            int* selected = resolvePlanColumns(plan, current, num_current, arg, &count);
+            uint8_t* seen = selected ? (uint8_t*)calloc(num_src > 0 ? num_src : 1, 1) : NULL;
+            status = seen ? 0 : -1;
+            if (selected && !seen) {
+                PyErr_NoMemory();
+            }
+            for (int k = 0; status == 0 && k < count; k++) {
+                if (seen[selected[k]]) {
+                    PyErr_Format(PyExc_ValueError, "column '%s' is selected twice",
+                                 plan->schema->columns[selected[k]].name);
+                    status = -1;
+                }
+                seen[selected[k]] = 1;
+            }
+            free(seen);
+            if (status == 0) {
+                memcpy(current, selected, (size_t)count * sizeof(int));
+                num_current = count;
+            }
+            free(selected);
+            continue;
+        }
+        plan->num_steps++;
+        if (step_node->kind == PLAN_FILTER) {
+            step->kind = STEP_FILTER;
+            DataFrame* view = viewColumns(plan->schema, current, num_current);
+            for (int j = 0; view && status == 0 && j < num_current; j++) {
+                Py_XSETREF(keys[j], PyLong_FromLong(current[j]));
+                status = keys[j] ? 0 : -1;
+            }
+            step->predicate = view && status == 0 ? mapPredicateColumns(arg, view, keys) : NULL;
+            status = step->predicate ? 0 : -1;
+            if (!view) {
+                PyErr_NoMemory();
+            } else {
+                freeView(view);
+            }
+        } else if (step_node->kind == PLAN_SORT) {
+            step->kind = STEP_SORT;
+            step->sort = step_node;
+            step->keys = resolvePlanColumns(plan, current, num_current, arg, &step->num_keys);
+            status = step->keys ? 0 : -1;
+        } else if (step_node->kind == PLAN_HEAD) {
+            step->kind = STEP_HEAD;
+            step->n = step_node->n;
+        } else {
+            step->kind = STEP_MAP;
+            step->num_ops = 1;
+            step->ops = (LazyFrameObject**)malloc(sizeof(LazyFrameObject*));
+            step->masks = (uint8_t*)calloc(num_src > 0 ? num_src : 1, 1);
+            status = step->ops && step->masks ? 0 : -1;
+            if (status != 0) {
+                PyErr_NoMemory();
+            } else {
+                step->ops[0] = step_node;
+                for (int j = 0; j < num_current; j++) {
+                    step->masks[current[j]] = 1;
+                }
+            }
+        }
+    }
+    for (int j = 0; keys && j < num_src; j++) {
+        Py_XDECREF(keys[j]);
+    }
+    free(keys);
+    free(nodes);
+    plan->output = current;
+    plan->num_output = num_current;
+    return status;
+}
 
-// Function alias for isnull()
-static PyObject* py_isna(PyObject* self, PyObject* args) {
-    return py_isnull(self, args);
+// Function to tell whether a filter reads none of the columns a map writes,
+// so that the two can be swapped
+static int filterSkipsMap(const Plan* plan, const PlanStep* filter, const PlanStep* map) {
+    int num_src = plan->num_source_cols;
+    uint8_t* read = (uint8_t*)calloc(num_src > 0 ? num_src : 1, 1);
+    if (!read) {
+        return 0;
+    }
+    markPredicateColumns(filter->predicate, read);
+    int disjoint = 1;
+    for (int k = 0; disjoint && k < map->num_ops; k++) {
+        for (int j = 0; disjoint && j < num_src; j++) {
+            disjoint = !(read[j] && map->masks[(size_t)k * num_src + j]);
+        }
+    }
+    free(read);
+    return disjoint;
 }
 
-// Function to fill null values with a specified value
-static PyObject* py_fillna(PyObject* self, PyObject* args) {
-    PyObject* capsule;
-    const char* fill_value;
-    if (!PyArg_ParseTuple(args, "Os", &capsule, &fill_value)) {
-        return NULL;
+// Function to make one rewrite of a plan, returning 1 if something changed
+// and -1 when out of memory. Rewrites, in order of preference:
+//   a filter moves below a sort, and below a fillna or clip of other columns
+//   consecutive filters become one 'and'
+//   a head moves below a fillna or clip, and merges into a head or top-k below it
+//   a sort followed by a head becomes a top-k
+//   consecutive fillna and clip steps fuse into one map
+static int rewritePlan(Plan* plan) {
+    PlanStep* steps = plan->steps;
+    for (int i = 1; i < plan->num_steps; i++) {
+        PlanStep* below = &steps[i - 1];
+        if (steps[i].kind != STEP_FILTER) {
+            continue;
+        }
+        if (below->kind == STEP_FILTER) {
+            PyObject* both = Py_BuildValue("(sOO)", "and", below->predicate, steps[i].predicate);
+            if (!both) {
+                return -1;
+            }
+            Py_SETREF(below->predicate, both);
+            removePlanStep(plan, i);
+            return 1;
+        }
+        if (below->kind == STEP_SORT || (below->kind == STEP_MAP && filterSkipsMap(plan, &steps[i], below))) {
+            swapPlanSteps(plan, i);
+            return 1;
+        }
     }
-    DataFrame* df = (DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame");
-    for (int i = 0; i < df->num_rows; i++) {
-        for (int j = 0; j < df->num_cols; j++) {
-            if (df->rows[i].data[j][0] == '\0') {
-                strcpy(df->rows[i].data[j], fill_value);
+    for (int i = 1; i < plan->num_steps; i++) {
+        PlanStep* below = &steps[i - 1];
+        if (steps[i].kind != STEP_HEAD) {
+            continue;
+        }
+        if (below->kind == STEP_MAP) {
+            swapPlanSteps(plan, i);
+            return 1;
+        }
+        if (below->kind == STEP_HEAD || below->kind == STEP_TOP_K) {
+            below->n = below->n < steps[i].n ? below->n : steps[i].n;
+            removePlanStep(plan, i);
+            return 1;
+        }
+        if (below->kind == STEP_SORT) {
+            below->kind = STEP_TOP_K;
+            below->n = steps[i].n;
+            removePlanStep(plan, i);
+            return 1;
+        }
+    }
+    for (int i = 1; i < plan->num_steps; i++) {
+        PlanStep* below = &steps[i - 1];
+        if (steps[i].kind != STEP_MAP || below->kind != STEP_MAP) {
+            continue;
+        }
+        int num_src = plan->num_source_cols > 0 ? plan->num_source_cols : 1;
+        int num_ops = below->num_ops + steps[i].num_ops;
+        LazyFrameObject** ops = (LazyFrameObject**)realloc(below->ops, num_ops * sizeof(LazyFrameObject*));
+        if (ops) {
+            below->ops = ops;
+        }
+        uint8_t* masks = ops ? (uint8_t*)realloc(below->masks, (size_t)num_ops * num_src) : NULL;
+        if (!masks) {
+            return -1;
+        }
+        below->masks = masks;
+        memcpy(ops + below->num_ops, steps[i].ops, steps[i].num_ops * sizeof(LazyFrameObject*));
+        memcpy(masks + (size_t)below->num_ops * num_src, steps[i].masks, (size_t)steps[i].num_ops * num_src);
+        below->num_ops = num_ops;
+        removePlanStep(plan, i);
+        return 1;
+    }
+    return 0;
+}
+
+// Function to find the source columns the plan reads, walking back from
+// the result. fillna and clip are narrowed to the columns still read after
+// them, so columns a later select drops are never filled or clipped.
+static int findNeededColumns(Plan* plan) {
+    int num_src = plan->num_source_cols;
+    plan->needed = (uint8_t*)calloc(num_src > 0 ? num_src : 1, 1);
+    if (!plan->needed) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    for (int j = 0; j < plan->num_output; j++) {
+        plan->needed[plan->output[j]] = 1;
+    }
+    for (int i = plan->num_steps - 1; i >= 0; i--) {
+        PlanStep* step = &plan->steps[i];
+        if (step->kind == STEP_FILTER) {
+            markPredicateColumns(step->predicate, plan->needed);
+        } else if (step->kind == STEP_SORT || step->kind == STEP_TOP_K) {
+            for (int k = 0; k < step->num_keys; k++) {
+                plan->needed[step->keys[k]] = 1;
+            }
+        } else if (step->kind == STEP_MAP) {
+            for (size_t m = 0; m < (size_t)step->num_ops * num_src; m++) {
+                step->masks[m] &= plan->needed[m % num_src];
             }
         }
     }
-    Py_RETURN_NONE;
+    return 0;
 }
 
-// Function to get column names
-static PyObject* py_columns(PyObject* self, PyObject* args) {
-    PyObject* capsule;
-    if (!PyArg_ParseTuple(args, "O", &capsule)) {
-        return NULL;
+// Function to resolve and optimize the plan of a LazyFrame. On failure the
+// plan is released and an exception is set.
+static int buildPlan(LazyFrameObject* lazy, Plan* plan) {
+    memset(plan, 0, sizeof(Plan));
+    int status = resolvePlan(lazy, plan);
+    while (status == 0) {
+        int changed = rewritePlan(plan);
+        if (changed < 0) {
+            PyErr_NoMemory();
+            status = -1;
+        }
+        if (changed <= 0) {
+            break;
+        }
     }
-    DataFrame* df = (DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame");
-    PyObject* column_list = PyList_New(df->num_cols);
-    for (int i = 0; i < df->num_cols; i++) {
-        PyList_SetItem(column_list, i, PyUnicode_FromString(df->headers[i]));
+    if (status == 0) {
+        status = findNeededColumns(plan);
     }
-    return column_list;
+    if (status != 0) {
+        freePlan(plan);
+    }
+    return status;
 }
 
-// Function to count unique values in a specified column
-static PyObject* py_value_counts(PyObject* self, PyObject* args) {
-    PyObject* capsule;
-    int col_index;
-    if (!PyArg_ParseTuple(args, "Oi", &capsule, &col_index)) {
-        return NULL;
+// Rows flowing between the steps of a running plan
+typedef struct {
+    DataFrame* frame;   // the columns read by the plan
+    int owned;          // 0 while frame is a view of the source DataFrame
+    int* rows;          // rows of frame in their current order, or NULL for all of them
+    int num_rows;
+} PlanRows;
+
+// Function to copy the current rows into a DataFrame of the plan's own
+static int materializeRows(PlanRows* state) {
+    if (state->owned && !state->rows) {
+        return 0;
     }
-    DataFrame* df = (DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame");
-    PyObject* counts_dict = PyDict_New();
-    for (int i = 0; i < df->num_rows; i++) {
-        const char* value = df->rows[i].data[col_index];
-        PyObject* key = PyUnicode_FromString(value);
-        PyObject* count = PyDict_GetItem(counts_dict, key);
-        if (count) {
-            PyDict_SetItem(counts_dict, key, PyLong_FromLong(PyLong_AsLong(count) + 1));
-        } else {
-            PyDict_SetItem(counts_dict, key, PyLong_FromLong(1));
+    int* rows = state->rows;
+    if (!rows) {
+        state->num_rows = state->frame->num_rows;
+        rows = (int*)malloc((state->num_rows > 0 ? state->num_rows : 1) * sizeof(int));
+        for (int i = 0; rows && i < state->num_rows; i++) {
+            rows[i] = i;
         }
     }
-    return counts_dict;
+    DataFrame* taken = NULL;
+    if (rows) {
+        Py_BEGIN_ALLOW_THREADS
+        taken = takeRows(state->frame, rows, state->num_rows);
+        Py_END_ALLOW_THREADS
+    }
+    free(rows);
+    state->rows = NULL;
+    if (!taken) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    if (state->owned) {
+        freeDataFrame(state->frame);
+    } else {
+        freeView(state->frame);
+    }
+    state->frame = taken;
+    state->owned = 1;
+    return 0;
 }
 
+// Function to run a filter step over the current rows
+static int runFilterStep(PlanRows* state, const PlanStep* step, DataFrame* schema, PyObject** working) {
+    if (state->rows && materializeRows(state) != 0) {
+        return -1;
+    }
+    PyObject* predicate = mapPredicateColumns(step->predicate, schema, working);
+    Predicate pred;
+    int status = predicate ? parsePredicate(state->frame, predicate, &pred) : -1;
+    Py_XDECREF(predicate);
+    if (status != 0) {
+        return -1;
+    }
+    int count = 0;
+    Py_BEGIN_ALLOW_THREADS
+    state->rows = filterRows(state->frame, &pred, &count);
+    Py_END_ALLOW_THREADS
+    freePredicate(&pred);
+    state->num_rows = count;
+    if (!state->rows) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    return 0;
+}
 
-// Function to trim values at specified thresholds
-static PyObject* py_clip(PyObject* self, PyObject* args) {
-    PyObject* capsule;
-    const char* lower;
-    const char* upper;
-    if (!PyArg_ParseTuple(args, "Oss", &capsule, &lower, &upper)) {
-        return NULL;
+// Function to run a sort or top-k step over the current rows. The top-k
+// heap leaves out rows missing the first key, so it is only used when the
+// rows it finds are the whole answer.
+static int runSortStep(PlanRows* state, const PlanStep* step, PyObject** working) {
+    if (state->rows && materializeRows(state) != 0) {
+        return -1;
     }
-    DataFrame* df = (DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame");
-    for (int i = 0; i < df->num_rows; i++) {
-        for (int j = 0; j < df->num_cols; j++) {
-            if (strcmp(df->rows[i].data[j], lower) < 0) {
-                free(df->rows[i].data[j]);
-                df->rows[i].data[j] = (char*)malloc((strlen(lower) + 1) * sizeof(char));
-                strcpy(df->rows[i].data[j], lower);
-            } else if (strcmp(df->rows[i].data[j], upper) > 0) {
-                free(df->rows[i].data[j]);
-                df->rows[i].data[j] = (char*)malloc((strlen(upper) + 1) * sizeof(char));
-                strcpy(df->rows[i].data[j], upper);
+    PyObject* by = PyList_New(step->num_keys);
+    for (int k = 0; by && k < step->num_keys; k++) {
+        Py_INCREF(working[step->keys[k]]);
+        PyList_SET_ITEM(by, k, working[step->keys[k]]);
+    }
+    PyObject* na_position = by ? PyTuple_GET_ITEM(step->sort->args, 2) : NULL;
+    const char* nulls = na_position ? PyUnicode_AsUTF8(na_position) : NULL;
+    int num_keys;
+    SortKey* keys = nulls ? parseSortKeys(state->frame, by, PyTuple_GET_ITEM(step->sort->args, 1), nulls, &num_keys)
+                          : NULL;
+    Py_XDECREF(by);
+    if (!keys) {
+        return -1;
+    }
+    int num_rows = state->frame->num_rows;
+    int count = num_rows;
+    int* rows;
+    Py_BEGIN_ALLOW_THREADS
+    const Column* primary = keys[0].col;
+    int by_heap = step->kind == STEP_TOP_K && (!keys[0].nulls_first || primary->null_count == 0);
+    rows = by_heap ? topKRows(state->frame, keys, num_keys, step->n, &count) : NULL;
+    if (!by_heap || (rows && count < step->n && primary->null_count > 0)) {
+        free(rows);
+        rows = argsortRows(state->frame, keys, num_keys);
+        count = step->kind == STEP_TOP_K && step->n < num_rows ? step->n : num_rows;
+    }
+    Py_END_ALLOW_THREADS
+    free(keys);
+    state->rows = rows;
+    state->num_rows = count;
+    if (!rows) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    return 0;
+}
+
+// Function to run a head step over the current rows, without copying them
+static int runHeadStep(PlanRows* state, const PlanStep* step) {
+    if (!state->rows) {
+        state->num_rows = state->frame->num_rows;
+        state->rows = (int*)malloc((state->num_rows > 0 ? state->num_rows : 1) * sizeof(int));
+        if (!state->rows) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        for (int i = 0; i < state->num_rows; i++) {
+            state->rows[i] = i;
+        }
+    }
+    if (step->n < state->num_rows) {
+        state->num_rows = step->n;
+    }
+    return 0;
+}
+
+// Function to run a map step: every fillna and clip of the step over each
+// column in a single pass
+static int runMapStep(PlanRows* state, const PlanStep* step, int num_src, const int* position) {
+    if (materializeRows(state) != 0) {
+        return -1;
+    }
+    DataFrame* df = state->frame;
+    ElementwiseOp* ops = (ElementwiseOp*)calloc(step->num_ops, sizeof(ElementwiseOp));
+    uint8_t* masks = (uint8_t*)calloc((size_t)step->num_ops * (df->num_cols > 0 ? df->num_cols : 1), 1);
+    int status = ops && masks ? 0 : -1;
+    if (status != 0) {
+        PyErr_NoMemory();
+    }
+    for (int k = 0; status == 0 && k < step->num_ops; k++) {
+        PyObject* args = step->ops[k]->args;
+        const char* first = PyUnicode_AsUTF8(PyTuple_GET_ITEM(args, 0));
+        const char* second = step->ops[k]->kind == PLAN_CLIP ? PyUnicode_AsUTF8(PyTuple_GET_ITEM(args, 1)) : "";
+        if (!first || !second) {
+            status = -1;
+            break;
+        }
+        if (step->ops[k]->kind == PLAN_CLIP) {
+            parseClipBounds(first, second, &ops[k]);
+        } else {
+            parseFillValue(first, &ops[k]);
+        }
+        ops[k].columns = masks + (size_t)k * df->num_cols;
+        for (int j = 0; status == 0 && j < num_src; j++) {
+            if (step->masks[(size_t)k * num_src + j]) {
+                masks[(size_t)k * df->num_cols + position[j]] = 1;
+                status = checkElementwiseOp(&ops[k], &df->columns[position[j]]);
             }
         }
     }
-    Py_RETURN_NONE;
+    if (status == 0) {
+        Py_BEGIN_ALLOW_THREADS
+        status = applyElementwise(df, ops, step->num_ops);
+        Py_END_ALLOW_THREADS
+        if (status != 0) {
+            PyErr_NoMemory();
+        }
+    }
+    free(ops);
+    free(masks);
+    return status;
 }
 
-// Function to sort DataFrame by a specified column
-static PyObject* py_sort_values(PyObject* self, PyObject* args) {
-    PyObject* capsule;
-    int col_index;
-    if (!PyArg_ParseTuple(args, "Oi", &capsule, &col_index)) {
-        return NULL;
+// Function to run a plan into a new DataFrame. Only the columns the plan
+// reads are loaded; rows are carried as a selection of row numbers through
+// sorts, heads and filters and copied once, when a step needs to write
+// them or at the end.
+static DataFrame* runPlan(Plan* plan) {
+    int num_src = plan->num_source_cols;
+    int* loaded = (int*)malloc((num_src > 0 ? num_src : 1) * sizeof(int));
+    int* position = (int*)malloc((num_src > 0 ? num_src : 1) * sizeof(int));
+    PyObject** working = (PyObject**)calloc(num_src > 0 ? num_src : 1, sizeof(PyObject*));
+    int num_loaded = 0;
+    int status = loaded && position && working ? 0 : -1;
+    if (status != 0) {
+        PyErr_NoMemory();
     }
-    DataFrame* df = (DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame");
+    for (int j = 0; status == 0 && j < num_src; j++) {
+        position[j] = -1;
+        if (plan->needed[j]) {
+            position[j] = num_loaded;
+            loaded[num_loaded++] = j;
+        }
+        working[j] = position[j] >= 0 ? PyLong_FromLong(position[j]) : (Py_INCREF(Py_None), Py_None);
+        status = working[j] ? 0 : -1;
+    }
+
+    PlanRows state = {NULL, 0, NULL, 0};
+    DataFrame* source = plan->source->kind == PLAN_FRAME ? plan->schema : NULL;
+    if (status == 0 && source) {
+        state.frame = viewColumns(source, loaded, num_loaded);
+        if (!state.frame) {
+            PyErr_NoMemory();
+            status = -1;
+        }
+    } else if (status == 0) {
+        CsvOptions opts = plan->source->opts;
+        opts.columns = loaded;
+        opts.num_columns = num_loaded;
+        state.frame = loadCSV(PyUnicode_AsUTF8(PyTuple_GET_ITEM(plan->source->args, 0)), &opts);
+        state.owned = 1;
+        status = state.frame ? 0 : -1;
+    }
+    if (source && status == 0) {
+        lockFrame(source, FRAME_READ);
+    }
+    for (int i = 0; status == 0 && i < plan->num_steps; i++) {
+        PlanStep* step = &plan->steps[i];
+        switch (step->kind) {
+            case STEP_FILTER:
+                status = runFilterStep(&state, step, plan->schema, working);
+                break;
+            case STEP_SORT:
+            case STEP_TOP_K:
+                status = runSortStep(&state, step, working);
+                break;
+            case STEP_HEAD:
+                status = runHeadStep(&state, step);
+                break;
+            case STEP_MAP:
+                status = runMapStep(&state, step, num_src, position);
+                break;
+        }
+    }
+    if (status == 0) {
+        status = materializeRows(&state);
+    }
+    if (source && state.frame) {
+        unlockFrame(source, FRAME_READ);
+    }
+    if (status == 0) {
+        for (int j = 0; j < plan->num_output; j++) {
+            loaded[j] = position[plan->output[j]];
+        }
+        if (selectColumns(state.frame, loaded, plan->num_output) != 0) {
+            PyErr_NoMemory();
+            status = -1;
+        }
+    }
+    for (int j = 0; working && j < num_src; j++) {
+        Py_XDECREF(working[j]);
+    }
+    free(working);
+    free(loaded);
+    free(position);
+    free(state.rows);
+    if (status != 0 && state.frame) {
+        if (state.owned) {
+            freeDataFrame(state.frame);
+        } else {
+            freeView(state.frame);
+        }
+    }
+    return status == 0 ? state.frame : NULL;
+}
+
+// Function to format source columns of a plan as "[a, b]"
+static PyObject* formatPlanColumns(const Plan* plan, const int* columns, int num_columns) {
+    PyObject* names = PyList_New(num_columns);
+    for (int k = 0; names && k < num_columns; k++) {
+        PyObject* name = PyUnicode_FromString(plan->schema->columns[columns[k]].name);
+        if (!name) {
+            Py_CLEAR(names);
+            break;
+        }
+        PyList_SET_ITEM(names, k, name);
+    }
+    PyObject* separator = names ? PyUnicode_FromString(", ") : NULL;
+    PyObject* joined = separator ? PyUnicode_Join(separator, names) : NULL;
+    PyObject* result = joined ? PyUnicode_FromFormat("[%U]", joined) : NULL;
+    Py_XDECREF(names);
+    Py_XDECREF(separator);
+    Py_XDECREF(joined);
+    return result;
+}
+
+// Function to format the source columns set in a mask as "[a, b]"
+static PyObject* formatPlanMask(const Plan* plan, const uint8_t* mask) {
+    int* columns = (int*)malloc((plan->num_source_cols > 0 ? plan->num_source_cols : 1) * sizeof(int));
+    if (!columns) {
+        return PyErr_NoMemory();
+    }
+    int count = 0;
+    for (int j = 0; j < plan->num_source_cols; j++) {
+        if (mask[j]) {
+            columns[count++] = j;
+        }
+    }
+    PyObject* result = formatPlanColumns(plan, columns, count);
+    free(columns);
+    return result;
+}
+
+// Function to format the sort keys of a sort or top-k step as
+// "[a ASC, b DESC] NULLS LAST"
+static PyObject* formatPlanSortKeys(const Plan* plan, const PlanStep* step) {
+    PyObject* ascending = PyTuple_GET_ITEM(step->sort->args, 1);
+    int ascending_is_list = PyList_Check(ascending) || PyTuple_Check(ascending);
+    PyObject* keys = PyList_New(step->num_keys);
+    for (int k = 0; keys && k < step->num_keys; k++) {
+        PyObject* flag = ascending_is_list ? PySequence_GetItem(ascending, k) : (Py_INCREF(ascending), ascending);
+        int is_ascending = flag ? PyObject_IsTrue(flag) : -1;
+        Py_XDECREF(flag);
+        PyObject* key = is_ascending < 0 ? NULL
+                                         : PyUnicode_FromFormat("%s %s", plan->schema->columns[step->keys[k]].name,
+                                                                is_ascending ? "ASC" : "DESC");
+        if (!key) {
+            Py_CLEAR(keys);
+            break;
+        }
+        PyList_SET_ITEM(keys, k, key);
+    }
+    PyObject* separator = keys ? PyUnicode_FromString(", ") : NULL;
+    PyObject* joined = separator ? PyUnicode_Join(separator, keys) : NULL;
+    const char* nulls = joined ? PyUnicode_AsUTF8(PyTuple_GET_ITEM(step->sort->args, 2)) : NULL;
+    PyObject* result = nulls ? PyUnicode_FromFormat("[%U] NULLS %s", joined, strcmp(nulls, "first") == 0 ? "FIRST"
+                                                                                                        : "LAST")
+                             : NULL;
+    Py_XDECREF(keys);
+    Py_XDECREF(separator);
+    Py_XDECREF(joined);
+    return result;
+}
 
-    // Simple bubble sort for demonstration purposes
-    for (int i = 0; i < df->num_rows - 1; i++) {
-        for (int j = 0; j < df->num_rows - i - 1; j++) {
-            if (strcmp(df->rows[j].data[col_index], df->rows[j + 1].data[col_index]) > 0) {
-                Row temp = df->rows[j];
-                df->rows[j] = df->rows[j + 1];
-                df->rows[j + 1] = temp;
+// Function to format one step of a plan as a line of explain()
+static PyObject* formatPlanStep(const Plan* plan, const PlanStep* step, PyObject** names) {
+    switch (step->kind) {
+        case STEP_FILTER: {
+            PyObject* predicate = mapPredicateColumns(step->predicate, plan->schema, names);
+            PyObject* line = predicate ? PyUnicode_FromFormat("FILTER %R", predicate) : NULL;
+            Py_XDECREF(predicate);
+            return line;
+        }
+        case STEP_SORT:
+        case STEP_TOP_K: {
+            PyObject* keys = formatPlanSortKeys(plan, step);
+            PyObject* line = !keys ? NULL
+                             : step->kind == STEP_SORT ? PyUnicode_FromFormat("SORT BY %U", keys)
+                                                       : PyUnicode_FromFormat("TOP_K %d BY %U", step->n, keys);
+            Py_XDECREF(keys);
+            return line;
+        }
+        case STEP_HEAD:
+            return PyUnicode_FromFormat("HEAD %d", step->n);
+        case STEP_MAP: {
+            PyObject* ops = PyList_New(step->num_ops);
+            for (int k = 0; ops && k < step->num_ops; k++) {
+                LazyFrameObject* op = step->ops[k];
+                PyObject* columns = formatPlanMask(plan, step->masks + (size_t)k * plan->num_source_cols);
+                PyObject* text = !columns ? NULL
+                                 : op->kind == PLAN_FILLNA
+                                     ? PyUnicode_FromFormat("fillna(%R) ON %U", PyTuple_GET_ITEM(op->args, 0), columns)
+                                     : PyUnicode_FromFormat("clip(%R, %R) ON %U", PyTuple_GET_ITEM(op->args, 0),
+                                                            PyTuple_GET_ITEM(op->args, 1), columns);
+                Py_XDECREF(columns);
+                if (!text) {
+                    Py_CLEAR(ops);
+                    break;
+                }
+                PyList_SET_ITEM(ops, k, text);
             }
+            PyObject* separator = ops ? PyUnicode_FromString(", ") : NULL;
+            PyObject* joined = separator ? PyUnicode_Join(separator, ops) : NULL;
+            PyObject* line = joined ? PyUnicode_FromFormat("MAP %U", joined) : NULL;
+            Py_XDECREF(ops);
+            Py_XDECREF(separator);
+            Py_XDECREF(joined);
+            return line;
         }
     }
-    Py_RETURN_NONE;
+    return NULL;
 }
 
-// Function to get n largest values in a column
-static PyObject* py_nlargest(PyObject* self, PyObject* args) {
-    PyObject* capsule;
-    int col_index, n;
-    if (!PyArg_ParseTuple(args, "Oii", &capsule, &col_index, &n)) {
+// Function to describe an optimized plan, one step per line from the
+// result down to the source, each indented under the step it feeds
+static PyObject* explainPlan(const Plan* plan) {
+    int num_src = plan->num_source_cols;
+    PyObject** names = (PyObject**)calloc(num_src > 0 ? num_src : 1, sizeof(PyObject*));
+    int* loaded = (int*)malloc((num_src > 0 ? num_src : 1) * sizeof(int));
+    PyObject* lines = names && loaded ? PyList_New(0) : PyErr_NoMemory();
+    int num_loaded = 0;
+    for (int j = 0; lines && j < num_src; j++) {
+        names[j] = PyUnicode_FromString(plan->schema->columns[j].name);
+        if (!names[j]) {
+            Py_CLEAR(lines);
+        }
+        if (plan->needed[j]) {
+            loaded[num_loaded++] = j;
+        }
+    }
+    // The result's column order is only worth a line when it is not the
+    // order the columns are loaded in
+    int reordered = plan->num_output != num_loaded;
+    for (int j = 0; !reordered && j < num_loaded; j++) {
+        reordered = plan->output[j] != loaded[j];
+    }
+    PyObject* line = NULL;
+    if (lines && reordered) {
+        PyObject* columns = formatPlanColumns(plan, plan->output, plan->num_output);
+        line = columns ? PyUnicode_FromFormat("SELECT %U", columns) : NULL;
+        Py_XDECREF(columns);
+        if (!line || PyList_Append(lines, line) != 0) {
+            Py_CLEAR(lines);
+        }
+        Py_XDECREF(line);
+    }
+    for (int i = plan->num_steps - 1; lines && i >= 0; i--) {
+        line = formatPlanStep(plan, &plan->steps[i], names);
+        if (!line || PyList_Append(lines, line) != 0) {
+            Py_CLEAR(lines);
+        }
+        Py_XDECREF(line);
+    }
+    if (lines) {
+        PyObject* columns = formatPlanColumns(plan, loaded, num_loaded);
+        if (!columns) {
+            line = NULL;
+        } else if (plan->source->kind == PLAN_CSV) {
+            line = PyUnicode_FromFormat("SCAN CSV %R %U (%d of %d columns)", PyTuple_GET_ITEM(plan->source->args, 0),
+                                        columns, num_loaded, num_src);
+        } else {
+            line = PyUnicode_FromFormat("SCAN DataFrame %U (%d of %d columns)", columns, num_loaded, num_src);
+        }
+        Py_XDECREF(columns);
+        if (!line || PyList_Append(lines, line) != 0) {
+            Py_CLEAR(lines);
+        }
+        Py_XDECREF(line);
+    }
+    PyObject* space = lines ? PyUnicode_FromString("  ") : NULL;
+    if (!space) {
+        Py_CLEAR(lines);
+    }
+    for (Py_ssize_t i = 1; lines && i < PyList_GET_SIZE(lines); i++) {
+        PyObject* indent = PySequence_Repeat(space, i);
+        PyObject* indented = indent ? PyUnicode_Concat(indent, PyList_GET_ITEM(lines, i)) : NULL;
+        Py_XDECREF(indent);
+        if (!indented) {
+            Py_CLEAR(lines);
+            break;
+        }
+        PyList_SetItem(lines, i, indented);
+    }
+    PyObject* separator = lines ? PyUnicode_FromString("\n") : NULL;
+    PyObject* result = separator ? PyUnicode_Join(separator, lines) : NULL;
+    Py_XDECREF(separator);
+    Py_XDECREF(space);
+    Py_XDECREF(lines);
+    for (int j = 0; names && j < num_src; j++) {
+        Py_XDECREF(names[j]);
+    }
+    free(names);
+    free(loaded);
+    return result;
+}
+
+static PyTypeObject LazyFrameType;
+
+// Function to record a step on top of a LazyFrame; steals args
+static PyObject* newLazyFrame(LazyFrameObject* input, PlanKind kind, PyObject* args) {
+    if (!args) {
         return NULL;
     }
-    DataFrame* df = (DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame");
+    LazyFrameObject* self = PyObject_New(LazyFrameObject, &LazyFrameType);
+    if (!self) {
+        Py_DECREF(args);
+        return NULL;
+    }
+    Py_XINCREF(input);
+    self->input = input;
+    self->kind = kind;
+    self->args = args;
+    self->n = 0;
+    if (input) {
+        self->opts = input->opts;
+    } else {
+        memset(&self->opts, 0, sizeof(CsvOptions));
+    }
+    return (PyObject*)self;
+}
 
-    // Create an array of pointers to the rows
-    char** rows = (char**)malloc(df->num_rows * sizeof(char*));
-    for (int i = 0; i < df->num_rows; i++) {
-        rows[i] = df->rows[i].data[col_index];
+// Function to release a LazyFrame
+static void lazyFrameDealloc(LazyFrameObject* self) {
+    Py_XDECREF(self->input);
+    Py_XDECREF(self->args);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+// Function to record a select
+static PyObject* lazySelect(LazyFrameObject* self, PyObject* args) {
+    PyObject* columns;
+    if (!PyArg_ParseTuple(args, "O", &columns)) {
+        return NULL;
     }
+    return newLazyFrame(self, PLAN_SELECT, Py_BuildValue("(O)", columns));
+}
 
-    // Sort the array in descending order
-    qsort(rows, df->num_rows, sizeof(char*), (int(*)(const void*, const void*))strcmp);
+// Function to record a filter
+static PyObject* lazyFilter(LazyFrameObject* self, PyObject* args) {
+    PyObject* predicate;
+    if (!PyArg_ParseTuple(args, "O", &predicate)) {
+        return NULL;
+    }
+    return newLazyFrame(self, PLAN_FILTER, Py_BuildValue("(O)", predicate));
+}
 
-    // Create a Python list to hold the n largest values
-    PyObject* largest_list = PyList_New(n);
-    for (int i = 0; i < n && i < df->num_rows; i++) {
-        PyList_SetItem(largest_list, i, PyUnicode_FromString(rows[i]));
+// Function to record a sort
+static PyObject* lazySortValues(LazyFrameObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"by", "ascending", "na_position", NULL};
+    PyObject* by;
+    PyObject* ascending = Py_True;
+    const char* na_position = "last";
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|Os", kwlist, &by, &ascending, &na_position)) {
+        return NULL;
+    }
+    if (strcmp(na_position, "last") != 0 && strcmp(na_position, "first") != 0) {
+        PyErr_SetString(PyExc_ValueError, "na_position must be 'first' or 'last'");
+        return NULL;
     }
+    return newLazyFrame(self, PLAN_SORT, Py_BuildValue("(OOs)", by, ascending, na_position));
+}
 
-    free(rows);
-    return largest_list;
+// Function to record a head
+static PyObject* lazyHead(LazyFrameObject* self, PyObject* args) {
+    int n = 5;
+    if (!PyArg_ParseTuple(args, "|i", &n)) {
+        return NULL;
+    }
+    if (n < 0) {
+        PyErr_SetString(PyExc_ValueError, "n must be non-negative");
+        return NULL;
+    }
+    LazyFrameObject* head = (LazyFrameObject*)newLazyFrame(self, PLAN_HEAD, PyTuple_New(0));
+    if (head) {
+        head->n = n;
+    }
+    return (PyObject*)head;
+}
+
+// Function to record a fillna
+static PyObject* lazyFillna(LazyFrameObject* self, PyObject* args) {
+    PyObject* value;
+    if (!PyArg_ParseTuple(args, "U", &value)) {
+        return NULL;
+    }
+    return newLazyFrame(self, PLAN_FILLNA, Py_BuildValue("(O)", value));
+}
+
+// Function to record a clip
+static PyObject* lazyClip(LazyFrameObject* self, PyObject* args) {
+    PyObject* lower;
+    PyObject* upper;
+    if (!PyArg_ParseTuple(args, "UU", &lower, &upper)) {
+        return NULL;
+    }
+    return newLazyFrame(self, PLAN_CLIP, Py_BuildValue("(OO)", lower, upper));
+}
+
+// Function to optimize and run the plan of a LazyFrame
+static PyObject* lazyCollect(LazyFrameObject* self, PyObject* unused) {
+    Plan plan;
+    if (buildPlan(self, &plan) != 0) {
+        return NULL;
+    }
+    DataFrame* df = runPlan(&plan);
+    freePlan(&plan);
+    if (!df) {
+        return NULL;
+    }
+    return newFrame(df);
+}
+
+// Function to describe the optimized plan of a LazyFrame
+static PyObject* lazyExplain(LazyFrameObject* self, PyObject* unused) {
+    Plan plan;
+    if (buildPlan(self, &plan) != 0) {
+        return NULL;
+    }
+    PyObject* result = explainPlan(&plan);
+    freePlan(&plan);
+    return result;
 }
 
-// Function to get n smallest values in a column
-static PyObject* py_nsmallest(PyObject* self, PyObject* args) {
+static PyMethodDef LazyFrameMethods[] = {
+    {"select", (PyCFunction)lazySelect, METH_VARARGS,
+     "select(columns)\n"
+     "Keep only the given columns, in the given order."},
+    {"filter", (PyCFunction)lazyFilter, METH_VARARGS,
+     "filter(predicate)\n"
+     "Keep the rows matching predicate, written as for dataframe.filter()."},
+    {"sort_values", (PyCFunction)(void(*)(void))lazySortValues, METH_VARARGS | METH_KEYWORDS,
+     "sort_values(by, ascending=True, na_position='last')\n"
+     "Stable sort of the rows by one or more columns."},
+    {"head", (PyCFunction)lazyHead, METH_VARARGS,
+     "head(n=5)\n"
+     "Keep the first n rows."},
+    {"fillna", (PyCFunction)lazyFillna, METH_VARARGS,
+     "fillna(value)\n"
+     "Fill missing values of the columns value parses as."},
+    {"clip", (PyCFunction)lazyClip, METH_VARARGS,
+     "clip(lower, upper)\n"
+     "Trim values at the given bounds."},
+    {"collect", (PyCFunction)lazyCollect, METH_NOARGS,
+     "collect()\n"
+     "Optimize the plan and run it into a new DataFrame."},
+    {"explain", (PyCFunction)lazyExplain, METH_NOARGS,
+     "explain()\n"
+     "Return the optimized plan as text, from the result down to the source."},
+    {NULL, NULL, 0, NULL}  // Sentinel
+};
+
+static PyTypeObject LazyFrameType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "dataframe.LazyFrame",
+    .tp_basicsize = sizeof(LazyFrameObject),
+    .tp_dealloc = (destructor)lazyFrameDealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "A query over a DataFrame or a CSV file, recorded and optimized as a whole by collect().",
+    .tp_methods = LazyFrameMethods,
+};
+
+// Function to start a lazy query over a DataFrame object from Python
+static PyObject* py_lazy(PyObject* self, PyObject* args) {
     PyObject* capsule;
-    int col_index, n;
-    if (!PyArg_ParseTuple(args, "Oii", &capsule, &col_index, &n)) {
+    if (!PyArg_ParseTuple(args, "O", &capsule)) {
         return NULL;
     }
-    DataFrame* df = (DataFrame*)PyCapsule_GetPointer(capsule, "DataFrame");
+    if (!getDataFrame(capsule, FRAME_READ)) {
+        return NULL;
+    }
+    return newLazyFrame(NULL, PLAN_FRAME, Py_BuildValue("(O)", capsule));
+}
 
-    // Create an array of pointers to the rows
-    char** rows = (char**)malloc(df->num_rows * sizeof(char*));
-    for (int i = 0; i < df->num_rows; i++) {
-        rows[i] = df->rows[i].data[col_index];
+// Function to start a lazy query over a CSV file from Python. Nothing is
+// read until the query is collected or explained.
+static PyObject* py_scan_csv(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* kwlist[] = {"path", "delimiter", "header", "quotechar", "categorical", NULL};
+    PyObject* path;
+    int delimiter = ',';
+    int has_header = 1;
+    PyObject* quotechar = NULL;
+    PyObject* categorical = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "U|CpOO", kwlist, &path, &delimiter, &has_header, &quotechar,
+                                     &categorical)) {
+        return NULL;
+    }
+    CsvOptions opts;
+    if (parseCsvOptions(delimiter, has_header, quotechar, &opts) != 0 ||
+        parseCategoryMode(categorical, &opts.categorical) != 0) {
+        return NULL;
+    }
+    LazyFrameObject* scan = (LazyFrameObject*)newLazyFrame(NULL, PLAN_CSV, Py_BuildValue("(O)", path));
+    if (scan) {
+        scan->opts = opts;
+    }
+    return (PyObject*)scan;
+}
+
+// Function to set the number of threads parallel work may use from Python.
+// Jobs already running keep the threads they started with.
+static PyObject* py_set_num_threads(PyObject* self, PyObject* args) {
+    int num_threads;
+    if (!PyArg_ParseTuple(args, "i", &num_threads)) {
+        return NULL;
+    }
+    if (num_threads < 1) {
+        PyErr_SetString(PyExc_ValueError, "the number of threads must be at least 1");
+        return NULL;
+    }
+    lockMutex(&pool.mutex);
+    pool.num_threads = num_threads;
+    unlockMutex(&pool.mutex);
+    Py_RETURN_NONE;
+}
+
+// Function to get the number of threads parallel work may use from Python
+static PyObject* py_get_num_threads(PyObject* self, PyObject* args) {
+    return PyLong_FromLong(getNumThreads());
+}
+
+// Function to turn the per-operation counters on or off from Python
+static PyObject* py_enable_stats(PyObject* self, PyObject* args) {
+    int on = 1;
+    if (!PyArg_ParseTuple(args, "|p", &on)) {
+        return NULL;
+    }
+    lockMutex(&profiling.mutex);
+    profiling.mode = on ? profiling.mode | PROFILE_STATS : profiling.mode & ~PROFILE_STATS;
+    unlockMutex(&profiling.mutex);
+    Py_RETURN_NONE;
+}
+
+// Function to get the per-operation counters from Python
+static PyObject* py_stats(PyObject* self, PyObject* args) {
+    KernelStats kernels[NUM_KERNELS];
+    lockMutex(&profiling.mutex);
+    memcpy(kernels, profiling.kernels, sizeof(kernels));
+    unlockMutex(&profiling.mutex);
+    PyObject* result = PyDict_New();
+    for (int k = 0; result && k < NUM_KERNELS; k++) {
+        const KernelStats* stats = &kernels[k];
+        if (stats->calls == 0) {
+            continue;
+        }
+        PyObject* entry = Py_BuildValue("{s:L,s:L,s:d,s:L,s:i}", "calls", (long long)stats->calls, "rows",
+                                        (long long)stats->rows, "seconds", stats->nanoseconds / 1e9,
+                                        "bytes_allocated", (long long)stats->allocated, "max_threads",
+                                        stats->max_threads);
+        if (!entry || PyDict_SetItemString(result, kernel_names[k], entry) != 0) {
+            Py_CLEAR(result);
+        }
+        Py_XDECREF(entry);
     }
+    return result;
+}
+
+// Function to zero the per-operation counters from Python
+static PyObject* py_reset_stats(PyObject* self, PyObject* args) {
+    lockMutex(&profiling.mutex);
+    memset(profiling.kernels, 0, sizeof(profiling.kernels));
+    unlockMutex(&profiling.mutex);
+    Py_RETURN_NONE;
+}
 
-    // Sort the array in ascending order
-    qsort(rows, df->num_rows, sizeof(char*), (int(*)(const void*, const void*))strcmp);
+// Function to start recording kernel spans from Python, dropping any
+// recorded by an earlier trace that was not stopped
+static PyObject* py_start_trace(PyObject* self, PyObject* args) {
+    lockMutex(&profiling.mutex);
+    profiling.num_events = 0;
+    profiling.dropped_events = 0;
+    profiling.trace_start = monotonicNanos();
+    profiling.mode |= PROFILE_TRACE;
+    unlockMutex(&profiling.mutex);
+    Py_RETURN_NONE;
+}
 
-    // Create a Python list to hold the n smallest values
-    PyObject* smallest_list = PyList_New(n);
-    for (int i = 0; i < n && i < df->num_rows; i++) {
-        PyList_SetItem(smallest_list, i, PyUnicode_FromString(rows[i]));
+// Function to stop recording kernel spans and write them to a file as
+// Chrome trace events from Python. Timestamps are microseconds since
+// start_trace(); each thread that ran a kernel gets its own track.
+static PyObject* py_stop_trace(PyObject* self, PyObject* args) {
+    const char* path;
+    if (!PyArg_ParseTuple(args, "s", &path)) {
+        return NULL;
     }
+    lockMutex(&profiling.mutex);
+    profiling.mode &= ~PROFILE_TRACE;
+    TraceEvent* events = profiling.events;
+    size_t num_events = profiling.num_events;
+    int64_t dropped = profiling.dropped_events;
+    profiling.events = NULL;
+    profiling.num_events = 0;
+    profiling.event_capacity = 0;
+    profiling.dropped_events = 0;
+    unlockMutex(&profiling.mutex);
 
-    free(rows);
-    return smallest_list;
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        free(events);
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+    }
+    fprintf(file, "{\"traceEvents\": [\n");
+    for (size_t i = 0; i < num_events; i++) {
+        const TraceEvent* event = &events[i];
+        fprintf(file,
+                "  {\"name\": \"%s\", \"cat\": \"kernel\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                "\"pid\": 1, \"tid\": %d, \"args\": {\"rows\": %lld, \"threads\": %d, \"bytes_allocated\": %lld}}%s\n",
+                kernel_names[event->kernel], event->start / 1e3, event->duration / 1e3, event->thread,
+                (long long)event->rows, event->threads, (long long)event->allocated, i + 1 < num_events ? "," : "");
+    }
+    fprintf(file, "], \"displayTimeUnit\": \"ms\", \"otherData\": {\"dropped_events\": %lld}}\n", (long long)dropped);
+    int failed = ferror(file);
+    failed |= fclose(file) != 0;
+    free(events);
+    if (failed) {
+        return PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+    }
+    return PyLong_FromSize_t(num_events);
 }
 
 // Module definition
@@ -663,5 +15104,32 @@ static struct PyModuleDef dataframe_module = {
 
 // Module initialization function
 PyMODINIT_FUNC PyInit_dataframe(void) {
+    PyDateTime_IMPORT;
+    if (!PyDateTimeAPI) {
+        return NULL;
+    }
+#ifdef _WIN32
+    c_numeric_locale = _create_locale(LC_NUMERIC, "C");
+#else
+    c_numeric_locale = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+#endif
+    if (!c_numeric_locale) {
+        return PyErr_NoMemory();
+    }
+    pool.num_threads = getNumCPUs();
+#ifndef _WIN32
+    pthread_atfork(NULL, NULL, resetPoolAfterFork);
+    pthread_atfork(NULL, NULL, resetFrameLocksAfterFork);
+    pthread_atfork(NULL, NULL, resetProfilingAfterFork);
+#endif
+    if (PyType_Ready(&ColumnBufferType) < 0) {
+        return NULL;
+    }
+    if (PyType_Ready(&CsvReaderType) < 0) {
+        return NULL;
+    }
+    if (PyType_Ready(&LazyFrameType) < 0) {
+        return NULL;
+    }
     return PyModule_Create(&dataframe_module);
-}
\ No newline at end of file
+}
@@ -1,7 +1,7 @@
 from setuptools import setup, Extension
 
 # Define the extension module
-dataframes_module = Extension('dataframes',
+dataframes_module = Extension('dataframe',
                               sources=['dataframes.c'])
 
 setup(
@@ -16,15 +16,15 @@ def main():
 
     # Get and print the head of the DataFrame
     print("\nHead of DataFrame:")
-    dataframe.head(df, 2)
+    print(dataframe.to_string(dataframe.head(df, 2)))
 
     # Get and print the tail of the DataFrame
     print("\nTail of DataFrame:")
-    dataframe.tail(df, 1)
+    print(dataframe.to_string(dataframe.tail(df, 1)))
 
     # Sample a random row from the DataFrame
     print("\nSample from DataFrame:")
-    dataframe.sample(df)
+    print(dataframe.to_string(dataframe.sample(df)))
 
     # Print information summary of the DataFrame
     print("\nDataFrame information:")
@@ -48,11 +48,11 @@ def main():
 
     # Describe statistics of the DataFrame
     print("\nDescribe DataFrame:")
-    dataframe.describe(df)
+    print(dataframe.describe(df))
 
     # Get unique values of a column
     print("\nUnique values of column 0:")
-    dataframe.unique(df, 0)
+    print(dataframe.unique(df, 0))
 
     # Free DataFrame memory
     dataframe.freeDataFrame(df)